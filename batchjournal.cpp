@@ -0,0 +1,187 @@
+#include "batchjournal.h"
+#include "outputwriter.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QList>
+#include <QMutexLocker>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Records collect this long before a group is written, unless there are
+// this many bytes of them first
+const int GroupMsecs = 200;
+const int MaxGroupBytes = 64 * 1024;
+
+const QByteArray Header = "docpdf-journal 1 ";
+
+} // namespace
+
+BatchJournal::BatchJournal(OutputWriter *outputs)
+    : m_outputs(outputs)
+    , m_thread(nullptr)
+    , m_pendingCommits(0)
+    , m_stopping(false)
+{
+}
+
+BatchJournal::~BatchJournal()
+{
+    close();
+}
+
+bool BatchJournal::open(const QString &directory, const QByteArray &key)
+{
+    QDir().mkpath(directory);
+    QByteArray name = QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex();
+    m_file.setFileName(directory + "/" + QString::fromLatin1(name) + ".journal");
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Cannot open batch journal" << m_file.fileName();
+        return false;
+    }
+
+    // "ok|failed size mtime path"; a later line for a file replaces the
+    // earlier one
+    QByteArray header = Header + key.toPercentEncoding() + '\n';
+    qint64 length = 0;
+    if (m_file.readLine() == header) {
+        length = header.size();
+        while (true) {
+            QByteArray line = m_file.readLine();
+            // A torn last line is from a crash in the middle of a write
+            if (!line.endsWith('\n')) {
+                break;
+            }
+            length += line.size();
+
+            QList<QByteArray> fields = line.trimmed().split(' ');
+            if (fields.size() != 4) {
+                continue;
+            }
+            QString inputPath = QString::fromUtf8(QByteArray::fromPercentEncoding(fields[3]));
+            if (fields[0] == "ok") {
+                m_done.insert(inputPath, qMakePair(fields[1].toLongLong(), fields[2].toLongLong()));
+            } else {
+                m_done.remove(inputPath);
+            }
+        }
+    }
+
+    // Appends go after the last complete record; a new journal, or one
+    // left by another batch under the same name, starts over
+    if (length == 0) {
+        m_file.resize(0);
+        m_file.seek(0);
+        m_file.write(header);
+    } else {
+        m_file.resize(length);
+        m_file.seek(length);
+    }
+
+    m_thread = QThread::create([this]() { writeLoop(); });
+    m_thread->start();
+    return true;
+}
+
+bool BatchJournal::isOpen() const
+{
+    return m_thread != nullptr;
+}
+
+int BatchJournal::doneCount() const
+{
+    return m_done.size();
+}
+
+bool BatchJournal::isDone(const QString &inputPath) const
+{
+    auto it = m_done.constFind(inputPath);
+    if (it == m_done.constEnd()) {
+        return false;
+    }
+    QFileInfo inputInfo(inputPath);
+    return it->first == inputInfo.size() && it->second == inputInfo.lastModified().toMSecsSinceEpoch();
+}
+
+void BatchJournal::record(const QString &inputPath, bool ok)
+{
+    if (!m_thread) {
+        return;
+    }
+
+    // Stat before taking the lock; the converter is the only caller
+    QFileInfo inputInfo(inputPath);
+    QByteArray line = (ok ? "ok " : "failed ") + QByteArray::number(inputInfo.size()) + ' '
+                      + QByteArray::number(inputInfo.lastModified().toMSecsSinceEpoch()) + ' '
+                      + inputPath.toUtf8().toPercentEncoding("/") + '\n';
+    qint64 commits = m_outputs->commitCount();
+
+    QMutexLocker locker(&m_mutex);
+    bool first = m_pending.isEmpty();
+    m_pending += line;
+    m_pendingCommits = commits;
+    if (first || m_pending.size() >= MaxGroupBytes) {
+        m_recordAvailable.wakeOne();
+    }
+}
+
+void BatchJournal::close()
+{
+    if (!m_thread) {
+        return;
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_recordAvailable.wakeOne();
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+    m_file.close();
+}
+
+void BatchJournal::remove()
+{
+    close();
+    m_file.remove();
+}
+
+void BatchJournal::writeLoop()
+{
+    QMutexLocker locker(&m_mutex);
+    while (true) {
+        while (m_pending.isEmpty() && !m_stopping) {
+            m_recordAvailable.wait(&m_mutex);
+        }
+        if (m_pending.isEmpty()) {
+            break;
+        }
+        // The first record of a group waits for company
+        if (!m_stopping && m_pending.size() < MaxGroupBytes) {
+            m_recordAvailable.wait(&m_mutex, GroupMsecs);
+        }
+
+        QByteArray group = m_pending;
+        qint64 commits = m_pendingCommits;
+        m_pending.clear();
+        locker.unlock();
+
+        m_outputs->waitForSync(commits);
+        bool ok = m_file.write(group) == group.size() && m_file.flush();
+#ifdef Q_OS_UNIX
+        ok = ok && ::fsync(m_file.handle()) == 0;
+#endif
+        if (!ok) {
+            qWarning() << "Cannot write batch journal" << m_file.fileName();
+        }
+
+        locker.relock();
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef BATCHJOURNAL_H
+#define BATCHJOURNAL_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+class OutputWriter;
+
+// Append-only record of the files a directory batch has finished, so a
+// batch stopped by a crash, a kill or a cancel resumes where it stopped
+// instead of starting again from the first file.
+//
+// Each batch (direction, settings, input and output directories) has its
+// own journal. A finished file appends a line with its result and the
+// input's size and mtime; a background thread writes the lines and syncs
+// the journal in groups a few times a second, so recording costs the
+// converter a memory append. A group is written only once the outputs it
+// records are synced, so after a crash the journal never lists a file
+// whose output was lost. The journal is deleted when its batch completes.
+class BatchJournal
+{
+public:
+    explicit BatchJournal(OutputWriter *outputs);
+    ~BatchJournal();
+
+    // Opens the journal of the batch identified by key in directory and
+    // loads what earlier runs recorded
+    bool open(const QString &directory, const QByteArray &key);
+    bool isOpen() const;
+
+    // Files earlier runs converted
+    int doneCount() const;
+
+    // Converted by an earlier run and unchanged since; failed files are
+    // tried again. Safe to call from any thread.
+    bool isDone(const QString &inputPath) const;
+
+    // Appends a finished file; it is written with the next group
+    void record(const QString &inputPath, bool ok);
+
+    // Writes and syncs everything recorded, then closes the journal
+    void close();
+
+    // Closes and deletes the journal once its batch has completed
+    void remove();
+
+private:
+    void writeLoop();
+
+    OutputWriter *m_outputs;
+    QFile m_file;
+    QHash<QString, QPair<qint64, qint64>> m_done;  // input path -> size, mtime
+
+    QThread *m_thread;
+    QMutex m_mutex;
+    QWaitCondition m_recordAvailable;
+    QByteArray m_pending;
+    qint64 m_pendingCommits;    // outputs that must be synced first
+    bool m_stopping;
+};
+
+#endif // BATCHJOURNAL_H
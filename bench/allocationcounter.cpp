@@ -0,0 +1,68 @@
+#include "allocationcounter.h"
+#include <atomic>
+#include <cstdlib>
+
+#ifdef __GLIBC__
+#define ALLOCATIONCOUNTER_GLIBC
+#endif
+
+namespace {
+
+// Constant-initialized, so they work before any constructor has run
+std::atomic<qint64> allocationCount{0};
+std::atomic<qint64> allocatedBytes{0};
+
+#ifdef ALLOCATIONCOUNTER_GLIBC
+void count(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(qint64(size), std::memory_order_relaxed);
+}
+#endif
+
+} // namespace
+
+#ifdef ALLOCATIONCOUNTER_GLIBC
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t elements, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) noexcept
+{
+    count(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t elements, size_t size) noexcept
+{
+    count(elements * size);
+    return __libc_calloc(elements, size);
+}
+
+void *realloc(void *pointer, size_t size) noexcept
+{
+    count(size);
+    return __libc_realloc(pointer, size);
+}
+
+}
+#endif
+
+bool AllocationCounter::isAvailable()
+{
+#ifdef ALLOCATIONCOUNTER_GLIBC
+    return true;
+#else
+    return false;
+#endif
+}
+
+AllocationCounter::Snapshot AllocationCounter::snapshot()
+{
+    Snapshot snapshot;
+    snapshot.allocations = allocationCount.load(std::memory_order_relaxed);
+    snapshot.bytes = allocatedBytes.load(std::memory_order_relaxed);
+    return snapshot;
+}
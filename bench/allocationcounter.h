@@ -0,0 +1,25 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// Counts the heap allocations of the whole process, so benchmarks can
+// report what a conversion allocates besides how long it takes.
+//
+// On glibc malloc, calloc and realloc are interposed and forwarded to
+// glibc's own implementation; that covers operator new as well as Qt's
+// containers, which allocate through malloc directly. Elsewhere nothing
+// is counted and isAvailable() is false.
+class AllocationCounter
+{
+public:
+    struct Snapshot {
+        qint64 allocations = 0;     // calls, reallocations included
+        qint64 bytes = 0;           // requested; frees are not subtracted
+    };
+
+    static bool isAvailable();
+    static Snapshot snapshot();
+};
+
+#endif // ALLOCATIONCOUNTER_H
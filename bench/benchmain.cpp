@@ -0,0 +1,285 @@
+// docpdf-bench: micro and end-to-end benchmarks over a generated corpus.
+//
+// Results are written as one JSON document (to stdout or --output) so they
+// can be stored and compared between builds:
+//   {"benchmarks":[{"name":"pdf-extract","medianSeconds":...,"mbPerSecond":...}, ...]}
+// Where heap allocations can be counted, each result also has the
+// allocations and bytes requested per timed run.
+#include "allocationcounter.h"
+#include "corpusgenerator.h"
+#include "docpdf.h"
+#include "docxwriter.h"
+#include "filescanner.h"
+#include "pdfdocument.h"
+#include "pdftextextractor.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+
+namespace {
+
+struct Workload {
+    qint64 bytes = 0;
+    int files = 0;
+};
+
+class Runner
+{
+public:
+    Runner(int iterations, const QString &filter)
+        : m_iterations(iterations)
+        , m_filter(filter)
+    {
+    }
+
+    bool wants(const QString &name) const
+    {
+        return m_filter.isEmpty() || name.contains(m_filter);
+    }
+
+    // Runs body once to warm caches, then m_iterations timed times
+    void run(const QString &name, const Workload &workload, const std::function<bool()> &body)
+    {
+        if (!wants(name)) {
+            return;
+        }
+        fprintf(stderr, "%s...\n", qPrintable(name));
+
+        QJsonObject result{{"name", name}, {"bytes", workload.bytes}, {"files", workload.files}};
+        if (!body()) {
+            result["error"] = "benchmark body failed";
+            m_results.append(result);
+            return;
+        }
+
+        QList<double> seconds;
+        QElapsedTimer timer;
+        AllocationCounter::Snapshot before = AllocationCounter::snapshot();
+        for (int i = 0; i < m_iterations; ++i) {
+            timer.start();
+            body();
+            seconds << timer.nsecsElapsed() / 1e9;
+        }
+        AllocationCounter::Snapshot after = AllocationCounter::snapshot();
+        std::sort(seconds.begin(), seconds.end());
+        double median = seconds.at(seconds.size() / 2);
+
+        result["iterations"] = m_iterations;
+        result["minSeconds"] = seconds.first();
+        result["medianSeconds"] = median;
+        result["maxSeconds"] = seconds.last();
+        if (median > 0) {
+            result["mbPerSecond"] = workload.bytes / median / (1024.0 * 1024.0);
+            result["filesPerSecond"] = workload.files / median;
+        }
+        if (AllocationCounter::isAvailable()) {
+            result["allocationsPerIteration"] = double(after.allocations - before.allocations) / m_iterations;
+            result["allocatedBytesPerIteration"] = double(after.bytes - before.bytes) / m_iterations;
+        }
+        m_results.append(result);
+    }
+
+    void skip(const QString &name, const QString &reason)
+    {
+        if (wants(name)) {
+            m_results.append(QJsonObject{{"name", name}, {"skipped", reason}});
+        }
+    }
+
+    QJsonArray results() const { return m_results; }
+
+private:
+    int m_iterations;
+    QString m_filter;
+    QJsonArray m_results;
+};
+
+Workload filesIn(const QString &directory, const QStringList &nameFilters)
+{
+    Workload workload;
+    for (const QFileInfo &info : QDir(directory).entryInfoList(nameFilters, QDir::Files)) {
+        workload.bytes += info.size();
+        workload.files++;
+    }
+    return workload;
+}
+
+// Runs a whole batch through DocPdf with the cache off, like the CLI does;
+// without nativeDocx every document goes to soffice, as --no-native-docx
+bool convertBatch(DocPdf::Direction direction, const QString &input, const QString &output,
+                  bool nativeDocx = true)
+{
+    DocPdf converter;
+    converter.setCacheEnabled(false);
+    converter.setNativeDocxEnabled(nativeDocx);
+    converter.setOutputDirectory(output);
+    converter.setMetricsDirectory(QString());
+
+    bool success = false;
+    QObject::connect(&converter, &DocPdf::finished, [&success](int converted, int total) {
+        success = total > 0 && converted == total;
+    });
+
+    if (direction == DocPdf::DocToPdf) {
+        converter.convertDocToPdf(input);
+    } else {
+        converter.convertPdfToDocx(input);
+    }
+    return success;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("docpdf-bench");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks the docpdf conversion paths and prints the results as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption corpusOption("corpus", "Directory for the generated corpus (default: a temporary directory).", "dir");
+    QCommandLineOption iterationsOption("iterations", "Timed runs per benchmark (default: 5).", "n", "5");
+    QCommandLineOption filterOption("filter", "Only run benchmarks whose name contains this text.", "text");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "Write the JSON results to this file.", "file");
+    QCommandLineOption generateOnlyOption("generate-only", "Write the corpus and exit.");
+    parser.addOption(corpusOption);
+    parser.addOption(iterationsOption);
+    parser.addOption(filterOption);
+    parser.addOption(outputOption);
+    parser.addOption(generateOnlyOption);
+    parser.process(app);
+
+    int iterations = parser.value(iterationsOption).toInt();
+    if (iterations < 1) {
+        fprintf(stderr, "docpdf-bench: --iterations needs a positive number\n");
+        return 64;
+    }
+
+    QTemporaryDir temporaryCorpus;
+    QString corpus = parser.isSet(corpusOption) ? parser.value(corpusOption) : temporaryCorpus.path();
+    CorpusGenerator generator;
+    if (!generator.generate(corpus)) {
+        fprintf(stderr, "docpdf-bench: %s\n", qPrintable(generator.errorString()));
+        return 1;
+    }
+    if (parser.isSet(generateOnlyOption)) {
+        return 0;
+    }
+
+    QTemporaryDir scratch;
+    if (!scratch.isValid()) {
+        fprintf(stderr, "docpdf-bench: cannot create a scratch directory\n");
+        return 1;
+    }
+
+    QDir corpusDir(corpus);
+    QString pdfDir = corpusDir.filePath("pdf");
+    QString docxDir = corpusDir.filePath("docx");
+    QString treeDir = corpusDir.filePath("tree");
+    Runner runner(iterations, parser.value(filterOption));
+
+    // Native text extraction, the first step of PDF -> DOCX
+    Workload pdfs = filesIn(pdfDir, QStringList() << "*.pdf");
+    runner.run("pdf-extract", pdfs, [&]() {
+        for (const QString &name : QDir(pdfDir).entryList(QStringList() << "*.pdf", QDir::Files)) {
+            PdfDocument document;
+            if (!document.load(QDir(pdfDir).filePath(name))) {
+                return false;
+            }
+            PdfTextExtractor extractor(document);
+            if (extractor.text().isEmpty()) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    // XML escaping and package writing, the second step of PDF -> DOCX.
+    // The text is fed in page-sized chunks as the streaming path does.
+    QByteArray text = CorpusGenerator(2).text(100000);
+    Workload textWorkload;
+    textWorkload.bytes = text.size();
+    textWorkload.files = 1;
+    QString docxOutput = QDir(scratch.path()).filePath("bench.docx");
+    for (int level : { 0, 6 }) {
+        runner.run(QString("docx-write-level%1").arg(level), textWorkload, [&, level]() {
+            DocxWriter docx(docxOutput);
+            docx.setCompressionLevel(level);
+            const int ChunkSize = 64 * 1024;
+            for (qint64 offset = 0; offset < text.size(); offset += ChunkSize) {
+                if (!docx.addText(text.constData() + offset, qMin<qint64>(ChunkSize, text.size() - offset))) {
+                    return false;
+                }
+            }
+            return docx.close();
+        });
+    }
+
+    // Directory discovery, on one thread and on the default eight
+    Workload tree;
+    tree.files = FileScanner().scan(treeDir).size();
+    for (int threads : { 1, 8 }) {
+        runner.run(QString("discovery-threads%1").arg(threads), tree, [&, threads]() {
+            FileScanner scanner(threads);
+            return scanner.scan(treeDir).size() == tree.files;
+        });
+    }
+
+    // End to end, including pool scheduling and output writing
+    runner.run("end-to-end-pdf-docx", pdfs, [&]() {
+        return convertBatch(DocPdf::PdfToDocx, pdfDir, QDir(scratch.path()).filePath("pdf-docx"));
+    });
+    // The corpus documents are text-only, so the native converter takes
+    // them all; the soffice variant measures what the others cost
+    Workload docx = filesIn(docxDir, QStringList() << "*.docx");
+    runner.run("end-to-end-doc-pdf-native", docx, [&]() {
+        return convertBatch(DocPdf::DocToPdf, docxDir, QDir(scratch.path()).filePath("doc-pdf-native"));
+    });
+    if (QStandardPaths::findExecutable("soffice").isEmpty()) {
+        runner.skip("end-to-end-doc-pdf-soffice", "soffice not found");
+    } else {
+        runner.run("end-to-end-doc-pdf-soffice", docx, [&]() {
+            return convertBatch(DocPdf::DocToPdf, docxDir, QDir(scratch.path()).filePath("doc-pdf-soffice"), false);
+        });
+    }
+
+    QJsonObject report{
+        {"version", app.applicationVersion()},
+        {"cpu", QSysInfo::currentCpuArchitecture()},
+        {"threads", QThread::idealThreadCount()},
+        {"iterations", iterations},
+        {"benchmarks", runner.results()}
+    };
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            fprintf(stderr, "docpdf-bench: cannot write %s\n", qPrintable(file.fileName()));
+            return 1;
+        }
+    } else {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+
+    for (const QJsonValue &result : runner.results()) {
+        if (result.toObject().contains("error")) {
+            return 1;
+        }
+    }
+    return 0;
+}
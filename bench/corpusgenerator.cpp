@@ -0,0 +1,232 @@
+#include "corpusgenerator.h"
+#include "docxwriter.h"
+#include <QDir>
+#include <QFile>
+#include <QList>
+
+namespace {
+
+const char *const Words[] = {
+    "the", "quarterly", "report", "shows", "revenue", "growth", "of", "and",
+    "margin", "in", "all", "regions", "R&D", "spending", "rose", "while",
+    "<draft>", "costs", "fell", "\"final\"", "figures", "it's", "a", "for",
+    "customer", "contract", "delivery", "schedule", "Q3", "2024", "per", "cent",
+    "management", "expects", "further", "improvement", "next", "year", "to", "be"
+};
+const int WordCount = sizeof(Words) / sizeof(Words[0]);
+
+struct PdfSpec {
+    const char *name;
+    int pages;
+    int linesPerPage;
+    bool compressed;
+};
+
+const PdfSpec PdfCorpus[] = {
+    { "small-plain.pdf", 1, 40, false },
+    { "small-flate.pdf", 1, 40, true },
+    { "medium-plain.pdf", 20, 50, false },
+    { "medium-flate.pdf", 20, 50, true },
+    { "dense-flate.pdf", 10, 400, true },
+    { "large-flate.pdf", 200, 50, true }
+};
+
+struct DocxSpec {
+    const char *name;
+    int paragraphs;
+};
+
+const DocxSpec DocxCorpus[] = {
+    { "small.docx", 50 },
+    { "medium.docx", 500 },
+    { "large.docx", 5000 }
+};
+
+void appendPdfString(QByteArray *out, const QByteArray &text)
+{
+    out->append('(');
+    for (char c : text) {
+        if (c == '(' || c == ')' || c == '\\') {
+            out->append('\\');
+        }
+        out->append(c);
+    }
+    out->append(')');
+}
+
+} // namespace
+
+CorpusGenerator::CorpusGenerator(quint64 seed)
+    : m_seed(seed)
+    , m_state(seed)
+{
+}
+
+bool CorpusGenerator::generate(const QString &directory)
+{
+    m_state = m_seed;
+    m_errorString.clear();
+
+    QDir root(directory);
+    if (!root.mkpath("pdf") || !root.mkpath("docx")) {
+        m_errorString = QString("Cannot create %1").arg(directory);
+        return false;
+    }
+
+    for (const PdfSpec &spec : PdfCorpus) {
+        if (!writeFile(root.filePath(QString("pdf/") + spec.name),
+                       pdf(spec.pages, spec.linesPerPage, spec.compressed))) {
+            return false;
+        }
+    }
+    for (const DocxSpec &spec : DocxCorpus) {
+        if (!writeDocx(root.filePath(QString("docx/") + spec.name), spec.paragraphs)) {
+            return false;
+        }
+    }
+
+    // A previous run leaves the same tree, so only build it once
+    QString tree = root.filePath("tree");
+    if (!QDir(tree).exists()) {
+        return writeTree(tree, 3, 6, 40);
+    }
+    return true;
+}
+
+QByteArray CorpusGenerator::text(int lineCount)
+{
+    QByteArray result;
+    for (int i = 0; i < lineCount; ++i) {
+        result += line();
+        result += '\n';
+    }
+    return result;
+}
+
+QByteArray CorpusGenerator::pdf(int pageCount, int linesPerPage, bool compressed)
+{
+    // Objects: 1 catalog, 2 page tree, 3 font, then a page and its content
+    // stream for every page
+    QByteArray out = "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n";
+    QList<qint64> offsets;
+    int objectCount = 3 + 2 * pageCount;
+
+    auto beginObject = [&](int number) {
+        offsets << out.size();
+        out += QByteArray::number(number) + " 0 obj\n";
+    };
+
+    beginObject(1);
+    out += "<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+
+    beginObject(2);
+    out += "<< /Type /Pages /Count " + QByteArray::number(pageCount) + " /Kids [";
+    for (int i = 0; i < pageCount; ++i) {
+        out += ' ' + QByteArray::number(4 + 2 * i) + " 0 R";
+    }
+    out += " ] >>\nendobj\n";
+
+    beginObject(3);
+    out += "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica /Encoding /WinAnsiEncoding >>\nendobj\n";
+
+    for (int i = 0; i < pageCount; ++i) {
+        int pageObject = 4 + 2 * i;
+
+        QByteArray content = "BT\n/F1 10 Tf\n12 TL\n50 800 Td\n";
+        for (int j = 0; j < linesPerPage; ++j) {
+            appendPdfString(&content, line());
+            content += " Tj T*\n";
+        }
+        content += "ET\n";
+
+        QByteArray filter;
+        if (compressed) {
+            // qCompress prefixes the zlib stream with its 4-byte length
+            content = qCompress(content, 6).mid(4);
+            filter = " /Filter /FlateDecode";
+        }
+
+        beginObject(pageObject);
+        out += "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 595 842]"
+               " /Resources << /Font << /F1 3 0 R >> >> /Contents "
+               + QByteArray::number(pageObject + 1) + " 0 R >>\nendobj\n";
+
+        beginObject(pageObject + 1);
+        out += "<< /Length " + QByteArray::number(content.size()) + filter + " >>\nstream\n";
+        out += content;
+        out += "\nendstream\nendobj\n";
+    }
+
+    qint64 xrefOffset = out.size();
+    out += "xref\n0 " + QByteArray::number(objectCount + 1) + "\n0000000000 65535 f \n";
+    for (qint64 offset : offsets) {
+        out += QByteArray::number(offset).rightJustified(10, '0') + " 00000 n \n";
+    }
+    out += "trailer\n<< /Size " + QByteArray::number(objectCount + 1) + " /Root 1 0 R >>\n";
+    out += "startxref\n" + QByteArray::number(xrefOffset) + "\n%%EOF\n";
+    return out;
+}
+
+bool CorpusGenerator::writeDocx(const QString &fileName, int paragraphCount)
+{
+    DocxWriter docx(fileName);
+    if (!docx.isOpen() || !docx.addText(text(paragraphCount)) || !docx.close()) {
+        m_errorString = QString("Cannot write %1: %2").arg(fileName, docx.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool CorpusGenerator::writeTree(const QString &directory, int depth, int directoriesPerLevel, int filesPerDirectory)
+{
+    static const char *const Suffixes[] = { ".pdf", ".docx", ".txt", ".doc" };
+
+    if (!QDir().mkpath(directory)) {
+        m_errorString = QString("Cannot create %1").arg(directory);
+        return false;
+    }
+    for (int i = 0; i < filesPerDirectory; ++i) {
+        if (!writeFile(QString("%1/file%2%3").arg(directory).arg(i).arg(Suffixes[i % 4]), QByteArray())) {
+            return false;
+        }
+    }
+    if (depth == 0) {
+        return true;
+    }
+    for (int i = 0; i < directoriesPerLevel; ++i) {
+        if (!writeTree(QString("%1/dir%2").arg(directory).arg(i), depth - 1, directoriesPerLevel, filesPerDirectory)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+quint32 CorpusGenerator::next()
+{
+    // 64-bit LCG (Knuth's MMIX constants); the high bits are the output
+    m_state = m_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return quint32(m_state >> 33);
+}
+
+QByteArray CorpusGenerator::line()
+{
+    QByteArray result;
+    int wordCount = 6 + int(next() % 10);
+    for (int i = 0; i < wordCount; ++i) {
+        if (i > 0) {
+            result += ' ';
+        }
+        result += Words[next() % WordCount];
+    }
+    return result;
+}
+
+bool CorpusGenerator::writeFile(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+        m_errorString = QString("Cannot write %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef CORPUSGENERATOR_H
+#define CORPUSGENERATOR_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+// Builds a deterministic benchmark corpus: the same seed always produces
+// the same documents (PDFs are byte-identical; DOCX packages differ only in
+// their ZIP timestamps), so timings from different builds are comparable.
+//
+// Layout below the target directory:
+//   pdf/   PDFs of 1 to 200 pages, with plain and Flate content streams
+//   docx/  DOCX files of 50 to 5000 paragraphs
+//   tree/  a nested directory tree of empty .pdf/.docx/.txt files for
+//          discovery benchmarks
+class CorpusGenerator
+{
+public:
+    explicit CorpusGenerator(quint64 seed = 1);
+
+    bool generate(const QString &directory);
+    QString errorString() const { return m_errorString; }
+
+    // Text of lineCount lines of pseudo-random words, including characters
+    // that need XML escaping
+    QByteArray text(int lineCount);
+
+    // A single-font PDF with linesPerPage lines of text on each page
+    QByteArray pdf(int pageCount, int linesPerPage, bool compressed);
+
+    bool writeDocx(const QString &fileName, int paragraphCount);
+    bool writeTree(const QString &directory, int depth, int directoriesPerLevel, int filesPerDirectory);
+
+private:
+    quint32 next();
+    QByteArray line();
+    bool writeFile(const QString &fileName, const QByteArray &data);
+
+    quint64 m_seed;
+    quint64 m_state;
+    QString m_errorString;
+};
+
+#endif // CORPUSGENERATOR_H
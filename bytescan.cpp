@@ -0,0 +1,216 @@
+#include "bytescan.h"
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BYTESCAN_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+bool isTokenEnd(char c)
+{
+    switch (c) {
+    case ' ': case '\n': case '\r': case '\t': case '\f': case '\0':
+    case '(': case ')': case '<': case '>': case '[': case ']':
+    case '{': case '}': case '/': case '%':
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isStringSpecial(char c)
+{
+    return c == '(' || c == ')' || c == '\\';
+}
+
+bool isXmlSpecial(char c)
+{
+    return uchar(c) < 0x20 || c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+}
+
+bool isSpace(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+#ifdef BYTESCAN_SSE2
+__m128i load(const char *data)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+}
+
+__m128i equal(__m128i block, char c)
+{
+    return _mm_cmpeq_epi8(block, _mm_set1_epi8(c));
+}
+#endif
+
+} // namespace
+
+namespace ByteScan
+{
+
+qint64 find(const char *data, qint64 size, qint64 from, const char *needle, qint64 needleLength)
+{
+    from = qMax<qint64>(from, 0);
+    if (needleLength <= 0) {
+        return from <= size ? from : -1;
+    }
+
+    const qint64 last = size - needleLength;
+    qint64 i = from;
+
+#ifdef BYTESCAN_SSE2
+    // Compare the first and last needle bytes 16 positions at a time and
+    // only memcmp the candidates where both match
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i lastByte = _mm_set1_epi8(needle[needleLength - 1]);
+    for (; i + 15 <= last; i += 16) {
+        __m128i head = _mm_cmpeq_epi8(load(data + i), first);
+        __m128i tail = _mm_cmpeq_epi8(load(data + i + needleLength - 1), lastByte);
+        uint mask = uint(_mm_movemask_epi8(_mm_and_si128(head, tail)));
+        while (mask) {
+            qint64 candidate = i + qCountTrailingZeroBits(mask);
+            if (needleLength <= 2 || memcmp(data + candidate + 1, needle + 1, size_t(needleLength - 2)) == 0) {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i <= last; ++i) {
+        if (data[i] == needle[0] && memcmp(data + i, needle, size_t(needleLength)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+qint64 findTokenEnd(const char *data, qint64 size, qint64 from)
+{
+    qint64 i = qMax<qint64>(from, 0);
+
+#ifdef BYTESCAN_SSE2
+    const __m128i space = _mm_set1_epi8(' ');
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = load(data + i);
+        // Bytes <= 0x20 cover all whitespace; other control bytes are
+        // filtered out below
+        __m128i hits = _mm_cmpeq_epi8(_mm_min_epu8(block, space), block);
+        hits = _mm_or_si128(hits, _mm_or_si128(equal(block, '('), equal(block, ')')));
+        hits = _mm_or_si128(hits, _mm_or_si128(equal(block, '<'), equal(block, '>')));
+        hits = _mm_or_si128(hits, _mm_or_si128(equal(block, '['), equal(block, ']')));
+        hits = _mm_or_si128(hits, _mm_or_si128(equal(block, '{'), equal(block, '}')));
+        hits = _mm_or_si128(hits, _mm_or_si128(equal(block, '/'), equal(block, '%')));
+        uint mask = uint(_mm_movemask_epi8(hits));
+        while (mask) {
+            qint64 candidate = i + qCountTrailingZeroBits(mask);
+            if (isTokenEnd(data[candidate])) {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    while (i < size && !isTokenEnd(data[i])) {
+        i++;
+    }
+    return i;
+}
+
+qint64 findStringSpecial(const char *data, qint64 size, qint64 from)
+{
+    qint64 i = qMax<qint64>(from, 0);
+
+#ifdef BYTESCAN_SSE2
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = load(data + i);
+        __m128i hits = _mm_or_si128(_mm_or_si128(equal(block, '('), equal(block, ')')), equal(block, '\\'));
+        uint mask = uint(_mm_movemask_epi8(hits));
+        if (mask) {
+            return i + qCountTrailingZeroBits(mask);
+        }
+    }
+#endif
+
+    while (i < size && !isStringSpecial(data[i])) {
+        i++;
+    }
+    return i;
+}
+
+qint64 findXmlSpecial(const char *data, qint64 size, qint64 from)
+{
+    qint64 i = qMax<qint64>(from, 0);
+
+#ifdef BYTESCAN_SSE2
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = load(data + i);
+        __m128i hits = _mm_cmpeq_epi8(_mm_min_epu8(block, control), block);
+        hits = _mm_or_si128(hits, _mm_or_si128(equal(block, '&'), equal(block, '<')));
+        hits = _mm_or_si128(hits, _mm_or_si128(equal(block, '>'), equal(block, '"')));
+        hits = _mm_or_si128(hits, equal(block, '\''));
+        uint mask = uint(_mm_movemask_epi8(hits));
+        if (mask) {
+            return i + qCountTrailingZeroBits(mask);
+        }
+    }
+#endif
+
+    while (i < size && !isXmlSpecial(data[i])) {
+        i++;
+    }
+    return i;
+}
+
+qint64 findNonAscii(const char *data, qint64 size, qint64 from)
+{
+    qint64 i = qMax<qint64>(from, 0);
+
+#ifdef BYTESCAN_SSE2
+    for (; i + 16 <= size; i += 16) {
+        uint mask = uint(_mm_movemask_epi8(load(data + i)));
+        if (mask) {
+            return i + qCountTrailingZeroBits(mask);
+        }
+    }
+#endif
+
+    while (i < size && uchar(data[i]) < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+qint64 findNonSpace(const char *data, qint64 size, qint64 from)
+{
+    qint64 i = qMax<qint64>(from, 0);
+
+#ifdef BYTESCAN_SSE2
+    // '\t' to '\r' are contiguous: subtracting '\t' leaves them at 0-4
+    const __m128i controls = _mm_set1_epi8(4);
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = load(data + i);
+        __m128i shifted = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+        __m128i spaces = _mm_cmpeq_epi8(_mm_min_epu8(shifted, controls), shifted);
+        spaces = _mm_or_si128(spaces, equal(block, ' '));
+        uint mask = ~uint(_mm_movemask_epi8(spaces)) & 0xffff;
+        if (mask) {
+            return i + qCountTrailingZeroBits(mask);
+        }
+    }
+#endif
+
+    while (i < size && isSpace(data[i])) {
+        i++;
+    }
+    return i;
+}
+
+}
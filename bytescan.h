@@ -0,0 +1,37 @@
+#ifndef BYTESCAN_H
+#define BYTESCAN_H
+
+#include <QtGlobal>
+
+// Vectorized byte searches used by the PDF parser on large mapped files,
+// by the DOCX writer and on extracted text. SSE2 is used when the compiler targets it;
+// otherwise plain loops.
+namespace ByteScan
+{
+
+// Offset of the first occurrence of needle in data[from, size), or -1
+qint64 find(const char *data, qint64 size, qint64 from, const char *needle, qint64 needleLength);
+
+// Offset of the first PDF whitespace or delimiter byte at or after from,
+// or size if there is none (the end of a keyword or name token)
+qint64 findTokenEnd(const char *data, qint64 size, qint64 from);
+
+// Offset of the first '(', ')' or '\\' at or after from, or size
+qint64 findStringSpecial(const char *data, qint64 size, qint64 from);
+
+// Offset of the first byte that cannot be copied into XML text as is (a
+// markup character or any control byte, '\n' included) at or after from,
+// or size
+qint64 findXmlSpecial(const char *data, qint64 size, qint64 from);
+
+// Offset of the first byte with the high bit set at or after from, or
+// size; where UTF-8 text leaves ASCII
+qint64 findNonAscii(const char *data, qint64 size, qint64 from);
+
+// Offset of the first byte at or after from that QByteArray::trimmed()
+// would keep, or size; tells blank text apart without copying it
+qint64 findNonSpace(const char *data, qint64 size, qint64 from);
+
+}
+
+#endif // BYTESCAN_H
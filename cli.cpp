@@ -0,0 +1,379 @@
+#include "cli.h"
+#include "docpdf.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDir>
+#include <QThread>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+namespace {
+
+enum ExitCode {
+    Success = 0,
+    SomeFailed = 1,
+    NoInput = 2,
+    Canceled = 3,
+    UsageError = 64
+};
+
+// Running conversions get this long to finish on SIGINT or SIGTERM
+const int CancelDrainMsecs = 5000;
+
+#ifdef Q_OS_WIN
+// docpdf is built as a GUI program, which Windows starts without a console.
+// Output the caller redirected to a file or pipe arrives anyway; otherwise
+// stdout and stderr go to the console of the shell that started us.
+void attachParentConsole()
+{
+    bool outputRedirected = GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) != FILE_TYPE_UNKNOWN;
+    bool errorRedirected = GetFileType(GetStdHandle(STD_ERROR_HANDLE)) != FILE_TYPE_UNKNOWN;
+    if (!AttachConsole(ATTACH_PARENT_PROCESS)) {
+        return;
+    }
+    if (!outputRedirected) {
+        freopen("CONOUT$", "w", stdout);
+    }
+    if (!errorRedirected) {
+        freopen("CONOUT$", "w", stderr);
+    }
+}
+#endif
+
+void printJson(const QJsonObject &object)
+{
+    QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    line += '\n';
+    fwrite(line.constData(), 1, size_t(line.size()), stdout);
+    fflush(stdout);
+}
+
+int usageError(const QString &message)
+{
+    fprintf(stderr, "docpdf: %s\n", qPrintable(message));
+    return UsageError;
+}
+
+#ifdef Q_OS_UNIX
+// Batch control from outside: SIGUSR1 pauses, SIGUSR2 resumes, SIGINT and
+// SIGTERM let running conversions finish briefly and cancel the rest. The
+// handler only writes the signal number to a pipe; a thread reads it and
+// calls the converter.
+int signalPipe[2] = {-1, -1};
+
+void forwardSignal(int signalNumber)
+{
+    char byte = char(signalNumber);
+    ssize_t written = ::write(signalPipe[1], &byte, 1);
+    Q_UNUSED(written);
+}
+
+class SignalForwarder
+{
+public:
+    explicit SignalForwarder(DocPdf *converter)
+        : m_thread(nullptr)
+        , m_canceled(false)
+    {
+        if (::pipe(signalPipe) != 0) {
+            return;
+        }
+        for (int fd : signalPipe) {
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+
+        m_thread = QThread::create([this, converter]() {
+            char byte = 0;
+            while (::read(signalPipe[0], &byte, 1) == 1 && byte != 0) {
+                if (byte == SIGUSR1) {
+                    converter->pause();
+                } else if (byte == SIGUSR2) {
+                    converter->resume();
+                } else {
+                    converter->pause();
+                    converter->waitForDrained(CancelDrainMsecs);
+                    converter->cancel();
+                    m_canceled = true;
+                    // Watch and spool mode run until the event loop quits
+                    QMetaObject::invokeMethod(QCoreApplication::instance(), "quit", Qt::QueuedConnection);
+                }
+            }
+        });
+        m_thread->start();
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = forwardSignal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        for (int signalNumber : {SIGUSR1, SIGUSR2, SIGINT, SIGTERM}) {
+            ::sigaction(signalNumber, &action, nullptr);
+        }
+    }
+
+    ~SignalForwarder()
+    {
+        if (!m_thread) {
+            return;
+        }
+        for (int signalNumber : {SIGUSR1, SIGUSR2, SIGINT, SIGTERM}) {
+            ::signal(signalNumber, SIG_DFL);
+        }
+        // A zero byte stops the thread
+        char byte = 0;
+        ssize_t written = ::write(signalPipe[1], &byte, 1);
+        Q_UNUSED(written);
+        m_thread->wait();
+        delete m_thread;
+        ::close(signalPipe[0]);
+        ::close(signalPipe[1]);
+    }
+
+    // Whether SIGINT or SIGTERM canceled the conversions
+    bool hasCanceled() const { return m_canceled; }
+
+private:
+    QThread *m_thread;
+    std::atomic<bool> m_canceled;
+};
+#endif
+
+} // namespace
+
+bool Cli::isRequested(int argc, char *argv[])
+{
+    static const char *const cliArguments[] = {
+        "--cli", "-i", "--input", "-h", "--help", "--help-all", "-v", "--version"
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        for (const char *argument : cliArguments) {
+            size_t length = strlen(argument);
+            if (strncmp(argv[i], argument, length) == 0 && (argv[i][length] == '\0' || argv[i][length] == '=')) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int Cli::run(int argc, char *argv[])
+{
+#ifdef Q_OS_WIN
+    attachParentConsole();
+#endif
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("docpdf");
+    app.setApplicationVersion("1.0.0");
+    app.setOrganizationName("DocPDF");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Converts DOC/DOCX files to PDF and PDF files to DOCX.\n"
+                                     "Progress is printed as JSON lines on stdout.");
+    QCommandLineOption helpOption = parser.addHelpOption();
+    QCommandLineOption versionOption = parser.addVersionOption();
+
+    QCommandLineOption cliOption("cli", "Run without the GUI (implied by --input).");
+    QCommandLineOption inputOption(QStringList() << "i" << "input",
+                                   "Directory with the files to convert.", "dir");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Directory for the converted files (default: next to each input).", "dir");
+    QCommandLineOption directionOption(QStringList() << "d" << "direction",
+                                       "doc-pdf or pdf-docx (default: doc-pdf).", "direction", "doc-pdf");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+                                  "Files converted in parallel (default: CPUs allowed by the cgroup).", "n");
+    QCommandLineOption batchSizeOption("batch-size",
+                                       "Most documents per soffice run for doc-pdf (default: 50, 1 disables batching).",
+                                       "n");
+    QCommandLineOption officeServerOption("office-server",
+                                          "Keep one warm LibreOffice instance per job and convert through unoconv "
+                                          "instead of batched soffice runs.");
+    QCommandLineOption noNativeDocxOption("no-native-docx",
+                                          "Send every DOC and DOCX file to LibreOffice, even text-only ones.");
+    QCommandLineOption recursiveOption(QStringList() << "r" << "recursive", "Include subdirectories.");
+    QCommandLineOption includeOption("include",
+                                     "Only convert files whose name or relative path matches the glob (repeatable).",
+                                     "glob");
+    QCommandLineOption excludeOption("exclude",
+                                     "Skip files and directories whose name or relative path matches the glob (repeatable).",
+                                     "glob");
+    QCommandLineOption metricsOption("metrics",
+                                     "Directory for metrics.json and metrics.prom (default: the cache directory).",
+                                     "dir");
+    QCommandLineOption noCacheOption("no-cache", "Convert every file, even if its output is up to date.");
+    QCommandLineOption noResumeOption("no-resume",
+                                      "Start the batch over instead of resuming where an interrupted run stopped.");
+    QCommandLineOption watchOption("watch", "Keep running and convert files as they are written.");
+    QCommandLineOption spoolOption("spool",
+                                   "Share --input with other docpdf processes, on any host, claiming files "
+                                   "through leases; keeps running.");
+
+    parser.addOption(cliOption);
+    parser.addOption(inputOption);
+    parser.addOption(outputOption);
+    parser.addOption(directionOption);
+    parser.addOption(jobsOption);
+    parser.addOption(batchSizeOption);
+    parser.addOption(officeServerOption);
+    parser.addOption(noNativeDocxOption);
+    parser.addOption(recursiveOption);
+    parser.addOption(includeOption);
+    parser.addOption(excludeOption);
+    parser.addOption(metricsOption);
+    parser.addOption(noCacheOption);
+    parser.addOption(noResumeOption);
+    parser.addOption(watchOption);
+    parser.addOption(spoolOption);
+
+    if (!parser.parse(app.arguments())) {
+        return usageError(parser.errorText());
+    }
+    if (parser.isSet(helpOption)) {
+        parser.showHelp(Success);
+    }
+    if (parser.isSet(versionOption)) {
+        parser.showVersion();
+    }
+
+    if (!parser.isSet(inputOption)) {
+        return usageError("--input is required");
+    }
+
+    if (parser.isSet(watchOption) && parser.isSet(spoolOption)) {
+        return usageError("--watch and --spool cannot be combined");
+    }
+
+    QString direction = parser.value(directionOption);
+    if (direction != "doc-pdf" && direction != "pdf-docx") {
+        return usageError(QString("unknown direction '%1'").arg(direction));
+    }
+
+    DocPdf converter;
+
+    if (parser.isSet(jobsOption)) {
+        bool ok = false;
+        int jobs = parser.value(jobsOption).toInt(&ok);
+        if (!ok || jobs < 1) {
+            return usageError("--jobs needs a positive number");
+        }
+        converter.setJobCount(jobs);
+    }
+
+    if (parser.isSet(batchSizeOption)) {
+        bool ok = false;
+        int batchSize = parser.value(batchSizeOption).toInt(&ok);
+        if (!ok || batchSize < 1) {
+            return usageError("--batch-size needs a positive number");
+        }
+        converter.setOfficeBatchSize(batchSize);
+    }
+
+    QString input = parser.value(inputOption);
+    if (!QDir(input).exists()) {
+        printJson(QJsonObject{{"event", "error"}, {"message", QString("Input directory not found: %1").arg(input)}});
+        return NoInput;
+    }
+
+    converter.setOfficeServerMode(parser.isSet(officeServerOption));
+    converter.setNativeDocxEnabled(!parser.isSet(noNativeDocxOption));
+    converter.setRecursive(parser.isSet(recursiveOption));
+    converter.setIncludePatterns(parser.values(includeOption));
+    converter.setExcludePatterns(parser.values(excludeOption));
+    converter.setCacheEnabled(!parser.isSet(noCacheOption));
+    converter.setResumeEnabled(!parser.isSet(noResumeOption));
+    if (parser.isSet(metricsOption)) {
+        converter.setMetricsDirectory(parser.value(metricsOption));
+    }
+    if (parser.isSet(outputOption)) {
+        QString output = parser.value(outputOption);
+        if (!QDir().mkpath(output)) {
+            printJson(QJsonObject{{"event", "error"}, {"message", QString("Cannot create output directory: %1").arg(output)}});
+            return NoInput;
+        }
+        converter.setOutputDirectory(output);
+    }
+
+    int exitCode = NoInput;
+
+    QObject::connect(&converter, &DocPdf::progress, [](int current, int total, const QString &filename) {
+        printJson(QJsonObject{{"event", "progress"}, {"current", current}, {"total", total}, {"file", filename}});
+    });
+    QObject::connect(&converter, &DocPdf::finished,
+                     [&exitCode](int converted, int total, const QString &type, int cached) {
+        printJson(QJsonObject{{"event", "finished"}, {"type", type}, {"converted", converted},
+                              {"failed", total - converted}, {"total", total}, {"cached", cached}});
+        exitCode = converted == total ? Success : SomeFailed;
+    });
+    QObject::connect(&converter, &DocPdf::error, [](const QString &errorMessage) {
+        printJson(QJsonObject{{"event", "error"}, {"message", errorMessage}});
+    });
+    QObject::connect(&converter, &DocPdf::canceled, [&exitCode](int converted, int total) {
+        printJson(QJsonObject{{"event", "canceled"}, {"converted", converted}, {"total", total}});
+        exitCode = Canceled;
+    });
+    QObject::connect(&converter, &DocPdf::paused, []() {
+        printJson(QJsonObject{{"event", "paused"}});
+    });
+    QObject::connect(&converter, &DocPdf::resumed, []() {
+        printJson(QJsonObject{{"event", "resumed"}});
+    });
+
+#ifdef Q_OS_UNIX
+    SignalForwarder signalForwarder(&converter);
+#endif
+    // A signal ends watch and spool mode by quitting the event loop, whose
+    // exit code alone would report success
+    auto runUntilQuit = [&]() {
+        int status = app.exec();
+#ifdef Q_OS_UNIX
+        if (signalForwarder.hasCanceled()) {
+            return int(Canceled);
+        }
+#endif
+        return status;
+    };
+
+    // The converter runs on this thread, so the batch completes before
+    // these calls return
+    DocPdf::Direction mode = direction == "doc-pdf" ? DocPdf::DocToPdf : DocPdf::PdfToDocx;
+    if (parser.isSet(spoolOption)) {
+        converter.startSpool(input, mode);
+        printJson(QJsonObject{{"event", "spooling"}, {"directory", QDir(input).absolutePath()}});
+        return runUntilQuit();
+    }
+    if (mode == DocPdf::DocToPdf) {
+        converter.convertDocToPdf(input);
+    } else {
+        converter.convertPdfToDocx(input);
+    }
+
+    if (parser.isSet(watchOption)) {
+        converter.startWatching(input, mode);
+        if (!converter.isWatching()) {
+            return NoInput;
+        }
+        printJson(QJsonObject{{"event", "watching"}, {"directory", QDir(input).absolutePath()}});
+        // Nothing is left to watch once the directory is removed
+        QObject::connect(&converter, &DocPdf::error, &app, [&converter]() {
+            if (!converter.isWatching()) {
+                QCoreApplication::exit(NoInput);
+            }
+        });
+        return runUntilQuit();
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,21 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Headless batch mode. Runs on a QCoreApplication (no widgets, no display
+// needed), prints one JSON object per line on stdout and exits with:
+//   0  every file converted
+//   1  some files failed
+//   2  no input files, or the input directory could not be used
+//   3  canceled by SIGINT or SIGTERM; running it again resumes the batch
+//   64 invalid command line
+namespace Cli
+{
+
+// True when the arguments ask for the command-line mode
+bool isRequested(int argc, char *argv[]);
+
+int run(int argc, char *argv[]);
+
+}
+
+#endif // CLI_H
@@ -0,0 +1,301 @@
+#include "compoundfilereader.h"
+#include <QtEndian>
+
+namespace {
+
+const char Signature[] = "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1";
+
+const qint64 HeaderSize = 512;
+const qint64 DirectoryEntrySize = 128;
+const int HeaderFatSectors = 109;
+
+// Sector numbers above this are markers: end of chain, free, FAT, DIFAT
+const quint32 MaximumSector = 0xFFFFFFFA;
+const quint32 NoStream = 0xFFFFFFFF;
+
+const quint8 StorageEntry = 1;
+const quint8 StreamEntry = 2;
+const quint8 RootEntry = 5;
+
+// A stream is read into one buffer, and the size in its directory entry is
+// not checked against the file until its sector chain is followed; a lying
+// entry must not make us allocate more than this. Real WordDocument and
+// table streams stay far below it.
+const quint64 MaximumStreamSize = 512 * 1024 * 1024;
+
+quint16 le16(const uchar *data)
+{
+    return qFromLittleEndian<quint16>(data);
+}
+
+quint32 le32(const uchar *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+} // namespace
+
+CompoundFileReader::CompoundFileReader(const QString &fileName)
+    : m_file(fileName)
+    , m_data(nullptr)
+    , m_size(0)
+    , m_sectorSize(0)
+    , m_miniSectorSize(0)
+    , m_miniStreamCutoff(0)
+    , m_open(false)
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        fail(m_file.errorString());
+        return;
+    }
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        fail("Cannot map " + fileName);
+        return;
+    }
+    m_open = readHeader() && readDirectory();
+}
+
+CompoundFileReader::CompoundFileReader(const QByteArray &data)
+    : m_buffer(data)
+    , m_data(reinterpret_cast<const uchar *>(m_buffer.constData()))
+    , m_size(m_buffer.size())
+    , m_sectorSize(0)
+    , m_miniSectorSize(0)
+    , m_miniStreamCutoff(0)
+    , m_open(false)
+{
+    m_open = readHeader() && readDirectory();
+}
+
+CompoundFileReader::~CompoundFileReader()
+{
+    if (m_data && m_file.isOpen()) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+}
+
+bool CompoundFileReader::isCompoundFile(const QByteArray &data)
+{
+    return data.startsWith(QByteArray::fromRawData(Signature, 8));
+}
+
+bool CompoundFileReader::isOpen() const
+{
+    return m_open;
+}
+
+QString CompoundFileReader::errorString() const
+{
+    return m_errorString;
+}
+
+bool CompoundFileReader::contains(const QString &name) const
+{
+    return m_entries.contains(name);
+}
+
+QByteArray CompoundFileReader::read(const QString &name, bool *ok) const
+{
+    if (ok) {
+        *ok = false;
+    }
+
+    auto it = m_entries.constFind(name);
+    if (!m_open || it == m_entries.constEnd() || it->type != StreamEntry) {
+        m_errorString = "No compound file stream " + name;
+        return QByteArray();
+    }
+    const Entry &entry = it.value();
+    if (entry.size > MaximumStreamSize) {
+        m_errorString = "Compound file stream too large";
+        return QByteArray();
+    }
+
+    // Small streams live in the mini stream, in sectors of their own
+    QByteArray data;
+    if (entry.size > 0 && !readChain(entry.start, entry.size < m_miniStreamCutoff, &data)) {
+        return QByteArray();
+    }
+    if (quint64(data.size()) < entry.size) {
+        m_errorString = "Truncated compound file stream " + name;
+        return QByteArray();
+    }
+    data.truncate(qsizetype(entry.size));
+
+    if (ok) {
+        *ok = true;
+    }
+    return data;
+}
+
+bool CompoundFileReader::readHeader()
+{
+    if (m_size < HeaderSize || !isCompoundFile(QByteArray::fromRawData(reinterpret_cast<const char *>(m_data), 8))) {
+        return fail("Not a compound file");
+    }
+    quint16 sectorShift = le16(m_data + 30);
+    quint16 miniSectorShift = le16(m_data + 32);
+    if (le16(m_data + 28) != 0xFFFE || (sectorShift != 9 && sectorShift != 12) || miniSectorShift != 6) {
+        return fail("Damaged compound file header");
+    }
+    m_sectorSize = qint64(1) << sectorShift;
+    m_miniSectorSize = qint64(1) << miniSectorShift;
+    m_miniStreamCutoff = le32(m_data + 56);
+
+    // The FAT sectors are listed in the header, then in a chain of DIFAT
+    // sectors whose last entry links to the next
+    QList<quint32> fatSectors;
+    for (int i = 0; i < HeaderFatSectors; ++i) {
+        quint32 index = le32(m_data + 76 + 4 * i);
+        if (index < MaximumSector) {
+            fatSectors << index;
+        }
+    }
+    // A file has no more FAT or DIFAT sectors than sectors; a chain that
+    // runs past that count is circular or damaged
+    qint64 sectorCount = m_size / m_sectorSize;
+    quint32 difat = le32(m_data + 68);
+    qint64 perDifatSector = m_sectorSize / 4 - 1;
+    for (quint32 i = 0; i < le32(m_data + 72) && difat < MaximumSector; ++i) {
+        qint64 offset = (qint64(difat) + 1) * m_sectorSize;
+        if (offset + m_sectorSize > m_size || i >= sectorCount || fatSectors.size() > sectorCount) {
+            return fail("Damaged compound file DIFAT");
+        }
+        for (qint64 k = 0; k < perDifatSector; ++k) {
+            quint32 index = le32(m_data + offset + 4 * k);
+            if (index < MaximumSector) {
+                fatSectors << index;
+            }
+        }
+        difat = le32(m_data + offset + 4 * perDifatSector);
+    }
+    if (quint32(fatSectors.size()) != le32(m_data + 44) || fatSectors.size() > sectorCount) {
+        return fail("Damaged compound file DIFAT");
+    }
+
+    qint64 perFatSector = m_sectorSize / 4;
+    m_fat.reserve(fatSectors.size() * perFatSector);
+    for (quint32 index : fatSectors) {
+        qint64 offset = (qint64(index) + 1) * m_sectorSize;
+        if (offset + m_sectorSize > m_size) {
+            return fail("Damaged compound file FAT");
+        }
+        for (qint64 k = 0; k < perFatSector; ++k) {
+            m_fat << le32(m_data + offset + 4 * k);
+        }
+    }
+    return true;
+}
+
+bool CompoundFileReader::readDirectory()
+{
+    QByteArray directory;
+    if (!readChain(le32(m_data + 48), false, &directory)) {
+        return false;
+    }
+    int count = int(directory.size() / DirectoryEntrySize);
+    const uchar *entries = reinterpret_cast<const uchar *>(directory.constData());
+    if (count == 0 || entries[66] != RootEntry) {
+        return fail("Damaged compound file directory");
+    }
+    // Version 3 files leave the high half of stream sizes undefined
+    bool version3 = le16(m_data + 26) == 3;
+    auto streamSize = [&](const uchar *entry) {
+        quint64 size = qFromLittleEndian<quint64>(entry + 120);
+        return version3 ? size & 0xFFFFFFFF : size;
+    };
+
+    // The mini stream is the root entry's data; its sectors are chained
+    // through the mini FAT
+    quint64 miniStreamSize = streamSize(entries);
+    if (miniStreamSize > MaximumStreamSize) {
+        return fail("Compound file mini stream too large");
+    }
+    if (miniStreamSize > 0) {
+        QByteArray miniFat;
+        if (!readChain(le32(m_data + 60), false, &miniFat) || !readChain(le32(entries + 116), false, &m_miniStream)) {
+            return false;
+        }
+        m_miniStream.truncate(qsizetype(miniStreamSize));
+        const uchar *table = reinterpret_cast<const uchar *>(miniFat.constData());
+        m_miniFat.reserve(miniFat.size() / 4);
+        for (qsizetype i = 0; i + 4 <= miniFat.size(); i += 4) {
+            m_miniFat << le32(table + i);
+        }
+    }
+
+    // Children of a storage form a tree through their sibling links; the
+    // visited flags stop damaged files that link in circles
+    QList<bool> visited(count, false);
+    QList<quint32> pending;
+    pending << le32(entries + 76);
+    while (!pending.isEmpty()) {
+        quint32 index = pending.takeLast();
+        if (index == NoStream) {
+            continue;
+        }
+        if (index >= quint32(count) || visited.at(index)) {
+            return fail("Damaged compound file directory");
+        }
+        visited[index] = true;
+
+        const uchar *entry = entries + index * DirectoryEntrySize;
+        pending << le32(entry + 68) << le32(entry + 72);
+        quint16 nameSize = le16(entry + 64);
+        if (nameSize < 2 || nameSize > 64 || nameSize % 2 != 0) {
+            return fail("Damaged compound file directory");
+        }
+
+        Entry child;
+        child.type = entry[66];
+        if (child.type != StreamEntry && child.type != StorageEntry) {
+            continue;
+        }
+        child.start = le32(entry + 116);
+        child.size = child.type == StreamEntry ? streamSize(entry) : 0;
+        QString name = QString::fromUtf16(reinterpret_cast<const char16_t *>(entry), nameSize / 2 - 1);
+        m_entries.insert(name, child);
+    }
+    return true;
+}
+
+bool CompoundFileReader::readChain(quint32 start, bool mini, QByteArray *data) const
+{
+    const QList<quint32> &table = mini ? m_miniFat : m_fat;
+    qint64 sectorSize = mini ? m_miniSectorSize : m_sectorSize;
+
+    // A chain never has more links than its table has entries
+    quint32 index = start;
+    for (qsizetype steps = 0; index < MaximumSector; ++steps) {
+        if (index >= quint32(table.size()) || steps >= table.size()) {
+            m_errorString = "Damaged compound file sector chain";
+            return false;
+        }
+        if (mini) {
+            qint64 offset = qint64(index) * sectorSize;
+            if (offset >= m_miniStream.size()) {
+                m_errorString = "Damaged compound file mini stream";
+                return false;
+            }
+            data->append(m_miniStream.constData() + offset, qMin(sectorSize, m_miniStream.size() - offset));
+        } else {
+            // The last sector of a file is sometimes cut short
+            qint64 offset = (qint64(index) + 1) * sectorSize;
+            if (offset >= m_size) {
+                m_errorString = "Truncated compound file";
+                return false;
+            }
+            data->append(reinterpret_cast<const char *>(m_data + offset), qMin(sectorSize, m_size - offset));
+        }
+        index = table.at(index);
+    }
+    return true;
+}
+
+bool CompoundFileReader::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
@@ -0,0 +1,66 @@
+#ifndef COMPOUNDFILEREADER_H
+#define COMPOUNDFILEREADER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+// Minimal reader for Compound File Binary containers, the OLE storage
+// format of Word 97-2003 documents.
+//
+// The file is memory-mapped, the sector chains of the FAT, the mini FAT
+// and the directory are resolved on open, and streams are read whole.
+// Only entries directly below the root storage are indexed; that is where
+// Word keeps the streams a text reader needs.
+class CompoundFileReader
+{
+public:
+    explicit CompoundFileReader(const QString &fileName);
+    // Reads a container already in memory, without copying it
+    explicit CompoundFileReader(const QByteArray &data);
+    ~CompoundFileReader();
+
+    // True if data starts with the compound file signature
+    static bool isCompoundFile(const QByteArray &data);
+
+    bool isOpen() const;
+    QString errorString() const;
+
+    // Streams and storages below the root storage
+    bool contains(const QString &name) const;
+
+    // Returns the stream; sets *ok to false (and returns an empty array)
+    // if it is missing, a storage or its sector chain is damaged
+    QByteArray read(const QString &name, bool *ok = nullptr) const;
+
+private:
+    struct Entry {
+        quint8 type = 0;
+        quint32 start = 0;
+        quint64 size = 0;
+    };
+
+    bool readHeader();
+    bool readDirectory();
+    // Follows a chain of the FAT, or of the mini FAT inside the mini stream
+    bool readChain(quint32 start, bool mini, QByteArray *data) const;
+    bool fail(const QString &message);
+
+    QFile m_file;
+    QByteArray m_buffer;        // keeps in-memory data alive
+    const uchar *m_data;
+    qint64 m_size;
+    qint64 m_sectorSize;
+    qint64 m_miniSectorSize;
+    quint32 m_miniStreamCutoff;
+    QList<quint32> m_fat;
+    QList<quint32> m_miniFat;
+    QByteArray m_miniStream;
+    QHash<QString, Entry> m_entries;
+    bool m_open;
+    mutable QString m_errorString;
+};
+
+#endif // COMPOUNDFILEREADER_H
@@ -0,0 +1,490 @@
+#include "conversioncache.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace {
+
+const quint32 IndexMagic = 0x44504349; // "DPCI"
+const quint32 IndexVersion = 1;
+
+// XXH64, streaming
+class XxHash64
+{
+public:
+    XxHash64()
+        : m_length(0)
+        , m_bufferSize(0)
+    {
+        m_accumulators[0] = Prime1 + Prime2;
+        m_accumulators[1] = Prime2;
+        m_accumulators[2] = 0;
+        m_accumulators[3] = 0 - Prime1;
+    }
+
+    void update(const char *data, qint64 size)
+    {
+        const uchar *bytes = reinterpret_cast<const uchar *>(data);
+        m_length += quint64(size);
+
+        if (m_bufferSize > 0) {
+            qint64 take = qMin<qint64>(size, 32 - m_bufferSize);
+            memcpy(m_buffer + m_bufferSize, bytes, size_t(take));
+            m_bufferSize += int(take);
+            bytes += take;
+            size -= take;
+            if (m_bufferSize < 32) {
+                return;
+            }
+            consumeStripe(m_buffer);
+            m_bufferSize = 0;
+        }
+
+        while (size >= 32) {
+            consumeStripe(bytes);
+            bytes += 32;
+            size -= 32;
+        }
+
+        memcpy(m_buffer, bytes, size_t(size));
+        m_bufferSize = int(size);
+    }
+
+    quint64 digest() const
+    {
+        quint64 hash;
+        if (m_length >= 32) {
+            hash = rotate(m_accumulators[0], 1) + rotate(m_accumulators[1], 7)
+                   + rotate(m_accumulators[2], 12) + rotate(m_accumulators[3], 18);
+            for (quint64 accumulator : m_accumulators) {
+                hash ^= round(0, accumulator);
+                hash = hash * Prime1 + Prime4;
+            }
+        } else {
+            hash = Prime5;
+        }
+        hash += m_length;
+
+        const uchar *p = m_buffer;
+        int remaining = m_bufferSize;
+        for (; remaining >= 8; p += 8, remaining -= 8) {
+            hash ^= round(0, qFromLittleEndian<quint64>(p));
+            hash = rotate(hash, 27) * Prime1 + Prime4;
+        }
+        if (remaining >= 4) {
+            hash ^= quint64(qFromLittleEndian<quint32>(p)) * Prime1;
+            hash = rotate(hash, 23) * Prime2 + Prime3;
+            p += 4;
+            remaining -= 4;
+        }
+        for (; remaining > 0; ++p, --remaining) {
+            hash ^= *p * Prime5;
+            hash = rotate(hash, 11) * Prime1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= Prime2;
+        hash ^= hash >> 29;
+        hash *= Prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+private:
+    static const quint64 Prime1 = 0x9E3779B185EBCA87ull;
+    static const quint64 Prime2 = 0xC2B2AE3D27D4EB4Full;
+    static const quint64 Prime3 = 0x165667B19E3779F9ull;
+    static const quint64 Prime4 = 0x85EBCA77C2B2AE63ull;
+    static const quint64 Prime5 = 0x27D4EB2F165667C5ull;
+
+    static quint64 rotate(quint64 value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    static quint64 round(quint64 accumulator, quint64 input)
+    {
+        accumulator += input * Prime2;
+        return rotate(accumulator, 31) * Prime1;
+    }
+
+    void consumeStripe(const uchar *stripe)
+    {
+        for (int i = 0; i < 4; ++i) {
+            m_accumulators[i] = round(m_accumulators[i], qFromLittleEndian<quint64>(stripe + 8 * i));
+        }
+    }
+
+    quint64 m_accumulators[4];
+    quint64 m_length;
+    uchar m_buffer[32];
+    int m_bufferSize;
+};
+
+qint64 modificationTime(const QFileInfo &info)
+{
+    return info.lastModified().toMSecsSinceEpoch();
+}
+
+QByteArray contentKey(quint64 hash, const QByteArray &settings)
+{
+    char bytes[8];
+    qToLittleEndian(hash, bytes);
+    return QByteArray(bytes, 8) + settings;
+}
+
+// A cloned output may be hard-linked to another one; writing into it in
+// place would change both, so unlink it before converting
+void detachOutput(const QString &outputPath)
+{
+#ifdef Q_OS_UNIX
+    struct stat info;
+    if (::stat(QFile::encodeName(outputPath).constData(), &info) == 0 && info.st_nlink > 1) {
+        QFile::remove(outputPath);
+    }
+#else
+    Q_UNUSED(outputPath);
+#endif
+}
+
+} // namespace
+
+ConversionCache::ConversionCache()
+    : m_indexFile(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/conversions.idx")
+    , m_loaded(false)
+    , m_dirty(false)
+    , m_hits(0)
+    , m_lookups(0)
+{
+}
+
+void ConversionCache::setIndexFile(const QString &fileName)
+{
+    QMutexLocker locker(&m_mutex);
+    if (fileName != m_indexFile) {
+        m_indexFile = fileName;
+        m_loaded = false;
+    }
+}
+
+QString ConversionCache::indexFile() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_indexFile;
+}
+
+bool ConversionCache::load()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_loaded) {
+        return true;
+    }
+    m_loaded = true;
+    m_dirty = false;
+    m_entries.clear();
+    m_byContent.clear();
+
+    QFile file(m_indexFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        // No index yet
+        return !file.exists();
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    stream >> magic >> version >> count;
+    if (magic != IndexMagic || version != IndexVersion) {
+        return false;
+    }
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString inputPath;
+        Entry entry;
+        stream >> inputPath >> entry.inputSize >> entry.inputMtime >> entry.hash >> entry.settings
+               >> entry.outputPath >> entry.outputSize >> entry.outputMtime;
+        if (stream.status() == QDataStream::Ok) {
+            m_byContent.insert(contentKey(entry.hash, entry.settings), inputPath);
+            m_entries.insert(inputPath, entry);
+        }
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        // A truncated index is only a cold cache
+        m_entries.clear();
+        m_byContent.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ConversionCache::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_dirty) {
+        return true;
+    }
+
+    QDir().mkpath(QFileInfo(m_indexFile).absolutePath());
+    QSaveFile file(m_indexFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    // Entries whose output is gone can never hit again
+    QList<QString> inputs;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        if (QFile::exists(it.value().outputPath)) {
+            inputs << it.key();
+        }
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << IndexMagic << IndexVersion << quint32(inputs.size());
+    for (const QString &inputPath : inputs) {
+        const Entry &entry = m_entries[inputPath];
+        stream << inputPath << entry.inputSize << entry.inputMtime << entry.hash << entry.settings
+               << entry.outputPath << entry.outputSize << entry.outputMtime;
+    }
+
+    if (stream.status() != QDataStream::Ok || !file.commit()) {
+        return false;
+    }
+    m_dirty = false;
+    return true;
+}
+
+bool ConversionCache::lookup(const QString &inputPath, const QString &outputPath,
+                             const QByteArray &settings, Ticket *ticket)
+{
+    *ticket = Ticket();
+
+    QFileInfo input(inputPath);
+    if (!input.exists()) {
+        return false;
+    }
+
+    Entry entry;
+    entry.inputSize = input.size();
+    entry.inputMtime = modificationTime(input);
+    entry.settings = settings;
+    entry.outputPath = outputPath;
+    ticket->inputSize = entry.inputSize;
+    ticket->inputMtime = entry.inputMtime;
+
+    // Fast path: unchanged size and mtime, output untouched since we wrote it
+    {
+        QMutexLocker locker(&m_mutex);
+        m_lookups++;
+
+        auto it = m_entries.constFind(inputPath);
+        if (it != m_entries.constEnd() && it.value().settings == settings
+            && it.value().outputPath == outputPath && it.value().inputSize == entry.inputSize
+            && it.value().inputMtime == entry.inputMtime && outputIsCurrent(it.value())) {
+            m_hits++;
+            return true;
+        }
+    }
+
+    entry.hash = hashFile(inputPath, &ticket->hashed);
+    ticket->hash = entry.hash;
+
+    if (ticket->hashed) {
+        QString donorOutput;
+        {
+            QMutexLocker locker(&m_mutex);
+
+            // Touched but identical
+            auto it = m_entries.find(inputPath);
+            if (it != m_entries.end() && it.value().settings == settings
+                && it.value().outputPath == outputPath && it.value().hash == entry.hash
+                && outputIsCurrent(it.value())) {
+                it.value().inputSize = entry.inputSize;
+                it.value().inputMtime = entry.inputMtime;
+                m_dirty = true;
+                m_hits++;
+                return true;
+            }
+
+            // Same bytes converted somewhere else
+            QString donor = m_byContent.value(contentKey(entry.hash, settings));
+            auto donorEntry = m_entries.constFind(donor);
+            if (donorEntry != m_entries.constEnd() && donorEntry.value().hash == entry.hash
+                && donorEntry.value().settings == settings && donorEntry.value().outputPath != outputPath
+                && outputIsCurrent(donorEntry.value())) {
+                donorOutput = donorEntry.value().outputPath;
+            }
+        }
+
+        if (!donorOutput.isEmpty() && cloneFile(donorOutput, outputPath) && recordOutput(inputPath, entry)) {
+            QMutexLocker locker(&m_mutex);
+            m_hits++;
+            return true;
+        }
+    }
+
+    detachOutput(outputPath);
+    return false;
+}
+
+void ConversionCache::store(const QString &inputPath, const QString &outputPath,
+                            const QByteArray &settings, const Ticket &ticket)
+{
+    if (!ticket.hashed) {
+        return;
+    }
+
+    Entry entry;
+    entry.inputSize = ticket.inputSize;
+    entry.inputMtime = ticket.inputMtime;
+    entry.hash = ticket.hash;
+    entry.settings = settings;
+    entry.outputPath = outputPath;
+    recordOutput(inputPath, entry);
+}
+
+void ConversionCache::resetStatistics()
+{
+    QMutexLocker locker(&m_mutex);
+    m_hits = 0;
+    m_lookups = 0;
+}
+
+int ConversionCache::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+int ConversionCache::lookups() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lookups;
+}
+
+quint64 ConversionCache::hashFile(const QString &fileName, bool *ok)
+{
+    if (ok) {
+        *ok = false;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    XxHash64 hash;
+    qint64 size = file.size();
+    uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+    if (mapped) {
+        hash.update(reinterpret_cast<const char *>(mapped), size);
+        file.unmap(mapped);
+    } else {
+        QByteArray block(1024 * 1024, Qt::Uninitialized);
+        qint64 read;
+        while ((read = file.read(block.data(), block.size())) > 0) {
+            hash.update(block.constData(), read);
+        }
+        if (read < 0) {
+            return 0;
+        }
+    }
+
+    if (ok) {
+        *ok = true;
+    }
+    return hash.digest();
+}
+
+bool ConversionCache::outputIsCurrent(const Entry &entry) const
+{
+    QFileInfo output(entry.outputPath);
+    return output.exists() && output.size() == entry.outputSize
+           && modificationTime(output) == entry.outputMtime;
+}
+
+bool ConversionCache::recordOutput(const QString &inputPath, Entry entry)
+{
+    QFileInfo output(entry.outputPath);
+    if (!output.exists()) {
+        return false;
+    }
+    entry.outputSize = output.size();
+    entry.outputMtime = modificationTime(output);
+
+    QMutexLocker locker(&m_mutex);
+    m_byContent.insert(contentKey(entry.hash, entry.settings), inputPath);
+    m_entries.insert(inputPath, entry);
+    m_dirty = true;
+    return true;
+}
+
+bool ConversionCache::cloneFile(const QString &source, const QString &target)
+{
+    // Clone next to the target and rename it into place
+    QString temporary = target + ".docpdf-clone";
+    QFile::remove(temporary);
+    bool cloned = false;
+
+#ifdef Q_OS_LINUX
+    // Reflink: shares extents copy-on-write on Btrfs, XFS and friends
+    int in = ::open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+    if (in >= 0) {
+        int out = ::open(QFile::encodeName(temporary).constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (out >= 0) {
+            cloned = ::ioctl(out, FICLONE, in) == 0;
+            ::close(out);
+            if (!cloned) {
+                QFile::remove(temporary);
+            }
+        }
+        ::close(in);
+    }
+#endif
+#ifdef Q_OS_UNIX
+    if (!cloned) {
+        cloned = ::link(QFile::encodeName(source).constData(), QFile::encodeName(temporary).constData()) == 0;
+    }
+#endif
+    if (!cloned) {
+        cloned = QFile::copy(source, temporary);
+    }
+    if (!cloned) {
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    if (::rename(QFile::encodeName(temporary).constData(), QFile::encodeName(target).constData()) == 0) {
+        return true;
+    }
+#else
+    QFile::remove(target);
+    if (QFile::rename(temporary, target)) {
+        return true;
+    }
+#endif
+    QFile::remove(temporary);
+    return false;
+}
@@ -0,0 +1,79 @@
+#ifndef CONVERSIONCACHE_H
+#define CONVERSIONCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// Persistent index of finished conversions.
+//
+// Each entry records the input's size, mtime and XXH64 content hash, the
+// converter settings and the output's size and mtime. A conversion is
+// skipped when the output is still the one we wrote and the input is
+// unchanged: size and mtime match (no hashing needed), or the content hash
+// matches after a touch. A byte-identical input converted elsewhere with
+// the same settings is satisfied by cloning that output (reflink, then
+// hard link, then copy). All methods are thread-safe.
+class ConversionCache
+{
+public:
+    ConversionCache();
+
+    // Index file; defaults to conversions.idx in the user cache directory
+    void setIndexFile(const QString &fileName);
+    QString indexFile() const;
+
+    bool load();
+    bool save();
+
+    // Input state captured by lookup() and consumed by store()
+    struct Ticket {
+        qint64 inputSize = 0;
+        qint64 inputMtime = 0;
+        quint64 hash = 0;
+        bool hashed = false;
+    };
+
+    // lookup() returns true when outputPath is up to date (or was cloned)
+    // and otherwise prepares it to be rewritten; store() records an output
+    // converted after a failed lookup. Callers skip store() for outputs
+    // that should be converted again next time.
+    bool lookup(const QString &inputPath, const QString &outputPath,
+                const QByteArray &settings, Ticket *ticket);
+    void store(const QString &inputPath, const QString &outputPath,
+               const QByteArray &settings, const Ticket &ticket);
+
+    // Lookup statistics since the last reset
+    void resetStatistics();
+    int hits() const;
+    int lookups() const;
+
+    static quint64 hashFile(const QString &fileName, bool *ok = nullptr);
+
+private:
+    struct Entry {
+        qint64 inputSize = 0;
+        qint64 inputMtime = 0;
+        quint64 hash = 0;
+        QByteArray settings;
+        QString outputPath;
+        qint64 outputSize = 0;
+        qint64 outputMtime = 0;
+    };
+
+    bool outputIsCurrent(const Entry &entry) const;
+    bool recordOutput(const QString &inputPath, Entry entry);
+    static bool cloneFile(const QString &source, const QString &target);
+
+    mutable QMutex m_mutex;
+    QString m_indexFile;
+    bool m_loaded;
+    bool m_dirty;
+    QHash<QString, Entry> m_entries;            // by input path
+    QHash<QByteArray, QString> m_byContent;     // hash + settings -> input path
+    int m_hits;
+    int m_lookups;
+};
+
+#endif // CONVERSIONCACHE_H
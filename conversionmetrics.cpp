@@ -0,0 +1,347 @@
+#include "conversionmetrics.h"
+#include <QDir>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+namespace {
+
+// Innermost file scope on this thread; StageTimers attach to it
+thread_local ConversionMetrics::FileScope *currentScope = nullptr;
+
+const char *const StageNames[ConversionMetrics::StageCount] = {
+    "discovery",
+    "cache",
+    "process",
+    "text_extraction",
+    "xml_generation",
+    "compression",
+    "disk_write",
+    "other"
+};
+
+QByteArray formatNumber(double value)
+{
+    return QByteArray::number(value, 'g', 9);
+}
+
+void appendHistogram(QByteArray *out, const char *name, const QByteArray &labels,
+                     const ConversionMetrics::Histogram &histogram)
+{
+    // Prometheus buckets are cumulative
+    QByteArray prefix = QByteArray(name) + "_bucket{" + labels + (labels.isEmpty() ? "" : ",");
+    quint64 cumulative = 0;
+    for (int i = 0; i < ConversionMetrics::Histogram::BucketCount; ++i) {
+        cumulative += histogram.bucket(i);
+        *out += prefix + "le=\"" + formatNumber(ConversionMetrics::Histogram::upperBound(i)) + "\"} "
+                + QByteArray::number(cumulative) + '\n';
+    }
+    *out += prefix + "le=\"+Inf\"} " + QByteArray::number(histogram.count()) + '\n';
+
+    QByteArray suffix = labels.isEmpty() ? QByteArray(" ") : "{" + labels + "} ";
+    *out += QByteArray(name) + "_sum" + suffix + formatNumber(histogram.sumSeconds()) + '\n';
+    *out += QByteArray(name) + "_count" + suffix + QByteArray::number(histogram.count()) + '\n';
+}
+
+bool writeFile(const QString &fileName, const QByteArray &data)
+{
+    QSaveFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit();
+}
+
+} // namespace
+
+ConversionMetrics::Histogram::Histogram()
+{
+    clear();
+}
+
+void ConversionMetrics::Histogram::add(qint64 nanos)
+{
+    int index = 0;
+    qint64 bound = 100000;
+    while (index < BucketCount && nanos > bound) {
+        bound *= 2;
+        index++;
+    }
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumNanos.fetch_add(quint64(qMax<qint64>(0, nanos)), std::memory_order_relaxed);
+    m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConversionMetrics::Histogram::clear()
+{
+    m_count.store(0, std::memory_order_relaxed);
+    m_sumNanos.store(0, std::memory_order_relaxed);
+    for (std::atomic<quint64> &bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+double ConversionMetrics::Histogram::upperBound(int i)
+{
+    return 0.0001 * double(1 << i);
+}
+
+QJsonObject ConversionMetrics::Histogram::toJson() const
+{
+    QJsonArray buckets;
+    for (int i = 0; i <= BucketCount; ++i) {
+        buckets.append(QJsonObject{
+            {"le", i < BucketCount ? QJsonValue(upperBound(i)) : QJsonValue("+Inf")},
+            {"count", double(bucket(i))}
+        });
+    }
+    return QJsonObject{
+        {"count", double(count())},
+        {"sumSeconds", sumSeconds()},
+        {"buckets", buckets}
+    };
+}
+
+ConversionMetrics::FileScope::FileScope(ConversionMetrics *metrics, const QString &path)
+    : m_metrics(metrics)
+    , m_previous(currentScope)
+    , m_timer(nullptr)
+{
+    m_record.path = path;
+    m_elapsed.start();
+    currentScope = this;
+}
+
+ConversionMetrics::FileScope::~FileScope()
+{
+    currentScope = m_previous;
+
+    m_record.totalNanos = m_elapsed.nsecsElapsed();
+    qint64 attributed = 0;
+    for (qint64 nanos : m_record.stageNanos) {
+        attributed += nanos;
+    }
+    qint64 remainder = m_record.totalNanos - attributed;
+    if (remainder > 0) {
+        m_record.stageNanos[Other] += remainder;
+        m_metrics->record(Other, remainder);
+    }
+    m_metrics->addFile(m_record);
+}
+
+ConversionMetrics::StageTimer::StageTimer(Stage stage)
+    : m_scope(currentScope)
+    , m_parent(nullptr)
+    , m_stage(stage)
+    , m_childNanos(0)
+{
+    if (m_scope) {
+        m_parent = m_scope->m_timer;
+        m_scope->m_timer = this;
+        m_elapsed.start();
+    }
+}
+
+ConversionMetrics::StageTimer::~StageTimer()
+{
+    if (!m_scope) {
+        return;
+    }
+
+    qint64 elapsed = m_elapsed.nsecsElapsed();
+    qint64 exclusive = elapsed - m_childNanos;
+    m_scope->m_record.stageNanos[m_stage] += exclusive;
+    m_scope->m_metrics->record(m_stage, exclusive);
+
+    m_scope->m_timer = m_parent;
+    if (m_parent) {
+        m_parent->m_childNanos += elapsed;
+    }
+}
+
+ConversionMetrics::ConversionMetrics()
+    : m_wallNanos(0)
+    , m_deferred(0)
+{
+}
+
+void ConversionMetrics::reset(const QString &label)
+{
+    for (Histogram &histogram : m_stages) {
+        histogram.clear();
+    }
+    m_files.clear();
+
+    QMutexLocker locker(&m_mutex);
+    m_label = label;
+    m_records.clear();
+    m_timeouts.clear();
+    m_wallNanos = 0;
+    m_deferred = 0;
+    m_wallClock.start();
+}
+
+void ConversionMetrics::finish()
+{
+    QMutexLocker locker(&m_mutex);
+    m_wallNanos = m_wallClock.nsecsElapsed();
+}
+
+void ConversionMetrics::record(Stage stage, qint64 nanos)
+{
+    m_stages[stage].add(nanos);
+}
+
+void ConversionMetrics::addFile(const FileRecord &record)
+{
+    m_files.add(record.totalNanos);
+
+    QMutexLocker locker(&m_mutex);
+    m_records << record;
+}
+
+void ConversionMetrics::reportTimeout(const QString &program, int timeoutMs)
+{
+    FileScope *scope = currentScope;
+    if (!scope) {
+        return;
+    }
+    scope->m_record.timeouts << program;
+    scope->m_metrics->addTimeout(program, scope->m_record.path, timeoutMs);
+}
+
+void ConversionMetrics::addTimeout(const QString &program, const QString &path, int timeoutMs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_timeouts << Timeout{program, path, timeoutMs};
+}
+
+int ConversionMetrics::timeoutCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_timeouts.size();
+}
+
+void ConversionMetrics::setDeferredCount(int files)
+{
+    QMutexLocker locker(&m_mutex);
+    m_deferred = files;
+}
+
+QJsonObject ConversionMetrics::toJson() const
+{
+    QJsonObject stages;
+    for (int i = 0; i < StageCount; ++i) {
+        stages[stageName(Stage(i))] = m_stages[i].toJson();
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    int converted = 0;
+    QJsonArray files;
+    for (const FileRecord &record : m_records) {
+        QJsonObject fileStages;
+        for (int i = 0; i < StageCount; ++i) {
+            if (record.stageNanos[i] > 0) {
+                fileStages[stageName(Stage(i))] = record.stageNanos[i] / 1e9;
+            }
+        }
+        QJsonObject file{
+            {"file", record.path},
+            {"ok", record.ok},
+            {"seconds", record.totalNanos / 1e9},
+            {"stages", fileStages}
+        };
+        if (!record.timeouts.isEmpty()) {
+            file["timeouts"] = QJsonArray::fromStringList(record.timeouts);
+        }
+        files.append(file);
+        if (record.ok) {
+            converted++;
+        }
+    }
+
+    QJsonArray timeouts;
+    for (const Timeout &timeout : m_timeouts) {
+        timeouts.append(QJsonObject{
+            {"program", timeout.program},
+            {"file", timeout.path},
+            {"timeoutMs", timeout.timeoutMs}
+        });
+    }
+
+    return QJsonObject{
+        {"batch", m_label},
+        {"wallSeconds", m_wallNanos / 1e9},
+        {"converted", converted},
+        {"failed", int(m_records.size()) - converted},
+        {"fileLatency", m_files.toJson()},
+        {"stages", stages},
+        {"timeouts", timeouts},
+        {"deferred", m_deferred},
+        {"files", files}
+    };
+}
+
+QByteArray ConversionMetrics::toPrometheus() const
+{
+    QByteArray out;
+
+    out += "# HELP docpdf_stage_seconds Time spent in each conversion stage of the last batch.\n"
+           "# TYPE docpdf_stage_seconds histogram\n";
+    for (int i = 0; i < StageCount; ++i) {
+        appendHistogram(&out, "docpdf_stage_seconds",
+                        QByteArray("stage=\"") + stageName(Stage(i)) + "\"", m_stages[i]);
+    }
+
+    out += "# HELP docpdf_file_seconds Conversion latency per file in the last batch.\n"
+           "# TYPE docpdf_file_seconds histogram\n";
+    appendHistogram(&out, "docpdf_file_seconds", QByteArray(), m_files);
+
+    QMutexLocker locker(&m_mutex);
+
+    int converted = 0;
+    for (const FileRecord &record : m_records) {
+        if (record.ok) {
+            converted++;
+        }
+    }
+    out += "# HELP docpdf_batch_files Files in the last batch by result.\n"
+           "# TYPE docpdf_batch_files gauge\n";
+    out += "docpdf_batch_files{result=\"converted\"} " + QByteArray::number(converted) + '\n';
+    out += "docpdf_batch_files{result=\"failed\"} " + QByteArray::number(m_records.size() - converted) + '\n';
+
+    out += "# HELP docpdf_batch_seconds Wall-clock duration of the last batch.\n"
+           "# TYPE docpdf_batch_seconds gauge\n";
+    out += "docpdf_batch_seconds " + formatNumber(m_wallNanos / 1e9) + '\n';
+
+    out += "# HELP docpdf_batch_deferred_files Files held back by memory admission in the last batch.\n"
+           "# TYPE docpdf_batch_deferred_files gauge\n";
+    out += "docpdf_batch_deferred_files " + QByteArray::number(m_deferred) + '\n';
+
+    QHash<QString, int> timeoutsByProgram;
+    for (const Timeout &timeout : m_timeouts) {
+        timeoutsByProgram[timeout.program]++;
+    }
+    out += "# HELP docpdf_subprocess_timeouts Subprocesses that hit their deadline in the last batch.\n"
+           "# TYPE docpdf_subprocess_timeouts gauge\n";
+    for (auto it = timeoutsByProgram.constBegin(); it != timeoutsByProgram.constEnd(); ++it) {
+        out += "docpdf_subprocess_timeouts{program=\"" + it.key().toUtf8() + "\"} "
+               + QByteArray::number(it.value()) + '\n';
+    }
+    return out;
+}
+
+bool ConversionMetrics::writeReports(const QString &directory) const
+{
+    QDir dir(directory);
+    if (!dir.mkpath(".")) {
+        return false;
+    }
+    return writeFile(dir.filePath("metrics.json"), QJsonDocument(toJson()).toJson(QJsonDocument::Indented))
+           && writeFile(dir.filePath("metrics.prom"), toPrometheus());
+}
+
+const char *ConversionMetrics::stageName(Stage stage)
+{
+    return StageNames[stage];
+}
@@ -0,0 +1,155 @@
+#ifndef CONVERSIONMETRICS_H
+#define CONVERSIONMETRICS_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+
+// Per-stage timing of a conversion batch.
+//
+// A FileScope on the worker thread attributes everything below it to one
+// file; StageTimers placed in the converters then add their time to that
+// file and to the aggregate histograms. Timers nest and record exclusive
+// time, so a DocxWriter flush that deflates and writes is split between
+// XML generation, compression and disk writes. Without an active scope a
+// StageTimer does nothing, which keeps the cost to a thread-local read.
+//
+// Aggregates are lock-free atomics; the per-file list takes a mutex once
+// per file.
+class ConversionMetrics
+{
+public:
+    enum Stage {
+        Discovery,
+        Cache,              // index lookups, hashing and cloning
+        Process,            // external converters (soffice, unoconv, pdftotext)
+        TextExtraction,     // PDF and DOCX parsing, content stream interpretation
+        XmlGeneration,
+        Compression,
+        DiskWrite,
+        Other,              // conversion time not covered by a finer stage
+        StageCount
+    };
+
+    // Latency histogram with power-of-two buckets from 100 us to ~13 s
+    class Histogram
+    {
+    public:
+        static const int BucketCount = 18;
+
+        Histogram();
+        void add(qint64 nanos);
+        void clear();
+
+        quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+        double sumSeconds() const { return m_sumNanos.load(std::memory_order_relaxed) / 1e9; }
+        // Observations in bucket i (i == BucketCount is the overflow bucket)
+        quint64 bucket(int i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+        static double upperBound(int i);
+
+        QJsonObject toJson() const;
+
+    private:
+        std::atomic<quint64> m_count;
+        std::atomic<quint64> m_sumNanos;
+        std::atomic<quint64> m_buckets[BucketCount + 1];
+    };
+
+    struct FileRecord {
+        QString path;
+        bool ok = false;
+        qint64 totalNanos = 0;
+        qint64 stageNanos[StageCount] = {};
+        QStringList timeouts;       // programs that ran out of time
+    };
+
+    class StageTimer;
+
+    // Attributes work on the current thread to one file until destroyed
+    class FileScope
+    {
+    public:
+        FileScope(ConversionMetrics *metrics, const QString &path);
+        ~FileScope();
+
+        void setOk(bool ok) { m_record.ok = ok; }
+
+    private:
+        friend class ConversionMetrics;
+        friend class StageTimer;
+
+        ConversionMetrics *m_metrics;
+        FileScope *m_previous;
+        StageTimer *m_timer;
+        QElapsedTimer m_elapsed;
+        FileRecord m_record;
+    };
+
+    class StageTimer
+    {
+    public:
+        explicit StageTimer(Stage stage);
+        ~StageTimer();
+
+    private:
+        FileScope *m_scope;
+        StageTimer *m_parent;
+        Stage m_stage;
+        QElapsedTimer m_elapsed;
+        qint64 m_childNanos;
+    };
+
+    ConversionMetrics();
+
+    // Starts a new batch; label names it in the reports
+    void reset(const QString &label);
+    void finish();
+
+    void record(Stage stage, qint64 nanos);
+    void addFile(const FileRecord &record);
+
+    // Called by converters whose subprocess hit its deadline; attributed
+    // to the file scope active on this thread
+    static void reportTimeout(const QString &program, int timeoutMs);
+    void addTimeout(const QString &program, const QString &path, int timeoutMs);
+
+    int timeoutCount() const;
+
+    // Files whose start was put off because their memory did not fit
+    void setDeferredCount(int files);
+    const Histogram &stage(Stage stage) const { return m_stages[stage]; }
+    const Histogram &fileLatency() const { return m_files; }
+
+    QJsonObject toJson() const;
+    QByteArray toPrometheus() const;
+
+    // Writes metrics.json and metrics.prom into directory
+    bool writeReports(const QString &directory) const;
+
+    static const char *stageName(Stage stage);
+
+private:
+    struct Timeout {
+        QString program;
+        QString path;
+        int timeoutMs;
+    };
+
+    Histogram m_stages[StageCount];
+    Histogram m_files;
+
+    mutable QMutex m_mutex;
+    QString m_label;
+    QElapsedTimer m_wallClock;
+    qint64 m_wallNanos;
+    int m_deferred;
+    QList<FileRecord> m_records;
+    QList<Timeout> m_timeouts;
+};
+
+#endif // CONVERSIONMETRICS_H
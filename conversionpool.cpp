@@ -0,0 +1,204 @@
+#include "conversionpool.h"
+#include <QMutexLocker>
+
+ConversionPool::ConversionPool(int workerCount)
+    : m_pendingJobs(0)
+    , m_submitted(0)
+    , m_taken(0)
+    , m_runningJobs(0)
+    , m_memoryBudget(0)
+    , m_reservedMemory(0)
+    , m_deferred(0)
+    , m_closed(false)
+    , m_paused(false)
+    , m_stopping(false)
+{
+    if (workerCount < 1) {
+        workerCount = 1;
+    }
+
+    for (int i = 0; i < workerCount; ++i) {
+        m_workers << new Worker;
+    }
+
+    for (int i = 0; i < workerCount; ++i) {
+        m_workers[i]->thread = QThread::create([this, i]() { workerLoop(i); });
+        m_workers[i]->thread->start();
+    }
+}
+
+ConversionPool::~ConversionPool()
+{
+    {
+        QMutexLocker locker(&m_stateMutex);
+        m_stopping = true;
+        m_closed = true;
+        m_jobAvailable.wakeAll();
+        m_resultAvailable.wakeAll();
+    }
+
+    for (Worker *worker : m_workers) {
+        worker->thread->wait();
+        delete worker->thread;
+        delete worker;
+    }
+}
+
+void ConversionPool::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_stateMutex);
+    m_memoryBudget = qMax<qint64>(0, bytes);
+    m_jobAvailable.wakeAll();
+}
+
+int ConversionPool::deferredCount() const
+{
+    QMutexLocker locker(&m_stateMutex);
+    return m_deferred;
+}
+
+int ConversionPool::idleWorkerCount() const
+{
+    QMutexLocker locker(&m_stateMutex);
+    return qMax(0, int(m_workers.size()) - m_runningJobs);
+}
+
+int ConversionPool::submit(Task task, const Cost &cost)
+{
+    QMutexLocker locker(&m_stateMutex);
+    if (m_closed) {
+        return -1;
+    }
+
+    int sequence = m_submitted++;
+
+    // Spread jobs round-robin; idle workers steal from busy ones
+    Worker *worker = m_workers[sequence % m_workers.size()];
+    worker->queue.emplace(qMakePair(-cost.msecs, sequence), Job{sequence, std::move(task), cost});
+
+    m_pendingJobs++;
+    m_jobAvailable.wakeOne();
+    return sequence;
+}
+
+void ConversionPool::close()
+{
+    QMutexLocker locker(&m_stateMutex);
+    m_closed = true;
+    m_resultAvailable.wakeAll();
+}
+
+void ConversionPool::pause()
+{
+    QMutexLocker locker(&m_stateMutex);
+    m_paused = true;
+}
+
+void ConversionPool::resume()
+{
+    QMutexLocker locker(&m_stateMutex);
+    m_paused = false;
+    m_jobAvailable.wakeAll();
+}
+
+bool ConversionPool::nextResult(int *sequence, bool *ok)
+{
+    QMutexLocker locker(&m_stateMutex);
+
+    while (true) {
+        // Sequences are handed out in order, so the next one is m_taken
+        auto result = m_results.find(m_taken);
+        if (result != m_results.end()) {
+            if (sequence) {
+                *sequence = m_taken;
+            }
+            if (ok) {
+                *ok = result.value();
+            }
+            m_results.erase(result);
+            m_taken++;
+            return true;
+        }
+
+        if ((m_closed && m_taken >= m_submitted) || m_stopping) {
+            return false;
+        }
+
+        m_resultAvailable.wait(&m_stateMutex);
+    }
+}
+
+void ConversionPool::workerLoop(int workerIndex)
+{
+    while (true) {
+        Job job;
+        {
+            QMutexLocker locker(&m_stateMutex);
+            // Queued jobs that do not fit wait for a running one to finish
+            while (!m_stopping && !(!m_paused && m_pendingJobs > 0 && takeJob(workerIndex, &job))) {
+                m_jobAvailable.wait(&m_stateMutex);
+            }
+            if (m_stopping) {
+                return;
+            }
+            m_pendingJobs--;
+            m_runningJobs++;
+            m_reservedMemory += job.cost.memoryBytes;
+        }
+
+        bool ok = job.task(workerIndex);
+
+        QMutexLocker locker(&m_stateMutex);
+        m_runningJobs--;
+        m_reservedMemory -= job.cost.memoryBytes;
+        m_results.insert(job.sequence, ok);
+        m_resultAvailable.wakeAll();
+        // The memory just released may admit a deferred job
+        if (m_memoryBudget > 0 && m_pendingJobs > 0) {
+            m_jobAvailable.wakeAll();
+        }
+    }
+}
+
+bool ConversionPool::takeJob(int workerIndex, Job *job)
+{
+    // Deferred jobs were once at the front of a queue; if the smallest
+    // does not fit, none of them does
+    if (!m_deferredJobs.empty() && admits(m_deferredJobs.begin()->second)) {
+        *job = std::move(m_deferredJobs.begin()->second);
+        m_deferredJobs.erase(m_deferredJobs.begin());
+        return true;
+    }
+
+    // Otherwise the costliest queue head that fits, own queue first on
+    // ties, so stealing also keeps the batch longest-first. Heads that do
+    // not fit are set aside, so each job is looked at here only once.
+    Queue *best = nullptr;
+    const int count = m_workers.size();
+    for (int offset = 0; offset < count; ++offset) {
+        Queue &queue = m_workers[(workerIndex + offset) % count]->queue;
+        while (!queue.empty() && !admits(queue.begin()->second)) {
+            Job &deferred = queue.begin()->second;
+            m_deferredJobs.emplace(qMakePair(deferred.cost.memoryBytes, deferred.sequence), std::move(deferred));
+            queue.erase(queue.begin());
+            m_deferred++;
+        }
+        if (!queue.empty() && (!best || queue.begin()->first.first < best->begin()->first.first)) {
+            best = &queue;
+        }
+    }
+
+    if (!best) {
+        return false;
+    }
+    *job = std::move(best->begin()->second);
+    best->erase(best->begin());
+    return true;
+}
+
+bool ConversionPool::admits(const Job &job) const
+{
+    // A job larger than the whole budget runs once nothing else does
+    return m_memoryBudget <= 0 || m_runningJobs == 0
+           || m_reservedMemory + job.cost.memoryBytes <= m_memoryBudget;
+}
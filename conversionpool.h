@@ -0,0 +1,105 @@
+#ifndef CONVERSIONPOOL_H
+#define CONVERSIONPOOL_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QThread>
+#include <functional>
+#include <map>
+
+// Fixed-size pool of worker threads with per-worker job queues and work
+// stealing. Jobs may be submitted while the pool is running; results are
+// handed back to the submitting thread in submission order, so a finished
+// job's result waits for those of the jobs submitted before it.
+//
+// Queued jobs start longest first by their estimated cost, so a huge file
+// found late in the walk does not run alone at the end of the batch. Each
+// job also reserves its estimated memory against the pool's budget: a job
+// that does not fit next to the running ones is deferred, and smaller ones
+// start in its place; one larger than the whole budget runs on its own.
+class ConversionPool
+{
+public:
+    using Task = std::function<bool(int workerIndex)>;
+
+    struct Cost {
+        qint64 msecs = 0;
+        qint64 memoryBytes = 0;
+    };
+
+    explicit ConversionPool(int workerCount = QThread::idealThreadCount());
+    ~ConversionPool();
+
+    int workerCount() const { return m_workers.size(); }
+
+    // Memory the running jobs may reserve together; 0 (the default) admits
+    // everything
+    void setMemoryBudget(qint64 bytes);
+
+    // Jobs that had to wait for memory while a worker was idle
+    int deferredCount() const;
+
+    // Workers not running a job right now
+    int idleWorkerCount() const;
+
+    // Queues a task and returns its sequence number (0-based, in submit order)
+    int submit(Task task, const Cost &cost);
+    int submit(Task task) { return submit(std::move(task), Cost()); }
+
+    // Signals that no more tasks will be submitted
+    void close();
+
+    // Queued jobs wait until resume(); running ones carry on
+    void pause();
+    void resume();
+
+    // Blocks until the next job in submission order has finished and
+    // returns its result. Returns false once the pool is closed and every
+    // result has been taken.
+    bool nextResult(int *sequence, bool *ok);
+
+private:
+    struct Job {
+        int sequence;
+        Task task;
+        Cost cost;
+    };
+
+    // Costliest first, then in submission order
+    using Queue = std::map<QPair<qint64, int>, Job>;
+    // Smallest memory cost first, then in submission order
+    using DeferredQueue = std::map<QPair<qint64, int>, Job>;
+
+    // Queues are guarded by the state mutex
+    struct Worker {
+        Queue queue;
+        QThread *thread = nullptr;
+    };
+
+    void workerLoop(int workerIndex);
+    bool takeJob(int workerIndex, Job *job);
+    bool admits(const Job &job) const;
+
+    QList<Worker *> m_workers;
+    DeferredQueue m_deferredJobs;
+
+    mutable QMutex m_stateMutex;
+    QWaitCondition m_jobAvailable;
+    QWaitCondition m_resultAvailable;
+    int m_pendingJobs;
+    int m_submitted;
+    int m_taken;
+    int m_runningJobs;
+    qint64 m_memoryBudget;
+    qint64 m_reservedMemory;
+    int m_deferred;
+    bool m_closed;
+    bool m_paused;
+    bool m_stopping;
+    QMap<int, bool> m_results;      // finished, not yet taken, by sequence
+};
+
+#endif // CONVERSIONPOOL_H
@@ -0,0 +1,414 @@
+#include "directorywatcher.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef Q_OS_LINUX
+// Close-write and moved-to mean a writer is done; modify only pushes back
+// a file that is already pending. Create is for new subdirectories.
+const uint32_t WatchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_DELETE | IN_MOVED_FROM | IN_CREATE
+                           | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+#endif
+
+} // namespace
+
+DirectoryWatcher::DirectoryWatcher(QObject *parent)
+    : QObject(parent)
+    , m_recursive(false)
+    , m_debounceInterval(250)
+    , m_inotifyFd(-1)
+    , m_rootWatch(-1)
+    , m_notifier(nullptr)
+    , m_fallback(nullptr)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &DirectoryWatcher::flushSettled);
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    stop();
+}
+
+bool DirectoryWatcher::start(const QString &directory, const PathFilter &filter, bool recursive)
+{
+    stop();
+
+    m_directory = QDir(directory).absolutePath();
+    m_filter = filter;
+    m_recursive = recursive;
+    m_clock.start();
+
+    if (!startInotify()) {
+        // Portable fallback: rescan whenever a watched directory or file changes
+        m_fallback = new QFileSystemWatcher(this);
+        connect(m_fallback, &QFileSystemWatcher::directoryChanged, this, &DirectoryWatcher::rescan);
+        connect(m_fallback, &QFileSystemWatcher::fileChanged, this, &DirectoryWatcher::rescan);
+    }
+
+    if (!watchDirectory(QString())) {
+        stop();
+        return false;
+    }
+    // Also watches the subdirectories
+    scanDirectory(false);
+    return true;
+}
+
+void DirectoryWatcher::stop()
+{
+    m_timer.stop();
+    m_pending.clear();
+    m_snapshot.clear();
+
+    delete m_notifier;
+    m_notifier = nullptr;
+#ifdef Q_OS_LINUX
+    if (m_inotifyFd >= 0) {
+        ::close(m_inotifyFd);
+        m_inotifyFd = -1;
+    }
+#endif
+    m_rootWatch = -1;
+    m_watches.clear();
+
+    delete m_fallback;
+    m_fallback = nullptr;
+    m_watchedDirectories.clear();
+}
+
+bool DirectoryWatcher::isWatching() const
+{
+    return m_notifier || m_fallback;
+}
+
+bool DirectoryWatcher::usesInotify() const
+{
+    return m_notifier != nullptr;
+}
+
+void DirectoryWatcher::setDebounceInterval(int msec)
+{
+    m_debounceInterval = qMax(0, msec);
+}
+
+bool DirectoryWatcher::startInotify()
+{
+#ifdef Q_OS_LINUX
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        return false;
+    }
+
+    m_notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &DirectoryWatcher::readInotifyEvents);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void DirectoryWatcher::readInotifyEvents()
+{
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    bool directoryGone = false;
+
+    while (true) {
+        ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were dropped; fall back to comparing the listing
+                scanDirectory(true);
+                continue;
+            }
+            if (event->wd == m_rootWatch && (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))) {
+                directoryGone = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                // A subdirectory was removed, along with its watch
+                m_watches.remove(event->wd);
+                continue;
+            }
+
+            auto watch = m_watches.constFind(event->wd);
+            if (event->len == 0 || watch == m_watches.constEnd()) {
+                continue;
+            }
+
+            QString fileName = QFile::decodeName(event->name);
+            QString relativePath = watch.value().isEmpty() ? fileName : watch.value() + "/" + fileName;
+
+            if (event->mask & IN_ISDIR) {
+                if (!m_recursive || fileName.startsWith('.')) {
+                    continue;
+                }
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    if (m_filter.acceptsDirectory(fileName, relativePath)) {
+                        addSubdirectory(relativePath);
+                    }
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    removeSubdirectory(relativePath);
+                }
+                continue;
+            }
+
+            if (!matches(fileName, relativePath)) {
+                continue;
+            }
+
+            QString path = m_directory + "/" + relativePath;
+            if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                schedule(path);
+            } else if (event->mask & IN_MODIFY) {
+                if (m_pending.contains(path)) {
+                    schedule(path);
+                }
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                m_pending.remove(path);
+            }
+        }
+    }
+
+    if (directoryGone) {
+        m_notifier->setEnabled(false);
+        reportGone();
+    }
+#endif
+}
+
+void DirectoryWatcher::rescan()
+{
+    if (!QFileInfo(m_directory).isDir()) {
+        m_fallback->blockSignals(true);
+        reportGone();
+        return;
+    }
+    scanDirectory(true);
+}
+
+void DirectoryWatcher::reportGone()
+{
+    // Not from inside the notifier's or the fallback watcher's own signal
+    QMetaObject::invokeMethod(this, [this]() {
+        stop();
+        emit directoryGone();
+    }, Qt::QueuedConnection);
+}
+
+void DirectoryWatcher::scanDirectory(bool reportChanges)
+{
+    // QFileSystemWatcher drops removed directories by itself
+    for (auto it = m_watchedDirectories.begin(); it != m_watchedDirectories.end();) {
+        if (QFileInfo(*it).isDir()) {
+            ++it;
+        } else {
+            m_fallback->removePath(*it);
+            it = m_watchedDirectories.erase(it);
+        }
+    }
+
+    QHash<QString, QPair<qint64, qint64>> snapshot;
+    walk(QString(), [&](const QFileInfo &entry) {
+        QString path = entry.absoluteFilePath();
+        QPair<qint64, qint64> state(entry.size(), entry.lastModified().toMSecsSinceEpoch());
+        snapshot.insert(path, state);
+
+        if (reportChanges && m_snapshot.value(path, QPair<qint64, qint64>(-1, -1)) != state) {
+            schedule(path);
+        }
+    });
+
+    // QFileSystemWatcher only reports in-place rewrites for watched files
+    if (m_fallback) {
+        QStringList added;
+        for (auto it = snapshot.constBegin(); it != snapshot.constEnd(); ++it) {
+            if (!m_snapshot.contains(it.key())) {
+                added << it.key();
+            }
+        }
+        if (!added.isEmpty()) {
+            m_fallback->addPaths(added);
+        }
+    }
+
+    m_snapshot = snapshot;
+}
+
+void DirectoryWatcher::walk(const QString &relativeDirectory, const std::function<void(const QFileInfo &)> &onFile)
+{
+    QStringList directories(relativeDirectory);
+    while (!directories.isEmpty()) {
+        QString directory = directories.takeLast();
+        // Past the inotify watch limit a subtree is left out
+        if (!watchDirectory(directory)) {
+            continue;
+        }
+
+        QString path = directory.isEmpty() ? m_directory : m_directory + "/" + directory;
+        const QFileInfoList entries = QDir(path).entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+        for (const QFileInfo &entry : entries) {
+            QString relativePath = directory.isEmpty() ? entry.fileName() : directory + "/" + entry.fileName();
+            if (entry.isDir()) {
+                if (m_recursive && !entry.isSymLink() && m_filter.acceptsDirectory(entry.fileName(), relativePath)) {
+                    directories << relativePath;
+                }
+            } else if (matches(entry.fileName(), relativePath)) {
+                onFile(entry);
+            }
+        }
+    }
+}
+
+bool DirectoryWatcher::watchDirectory(const QString &relativeDirectory)
+{
+    QString path = relativeDirectory.isEmpty() ? m_directory : m_directory + "/" + relativeDirectory;
+
+#ifdef Q_OS_LINUX
+    if (m_inotifyFd >= 0) {
+        // Watching a directory again returns its existing descriptor
+        int watch = inotify_add_watch(m_inotifyFd, QFile::encodeName(path).constData(), WatchMask);
+        if (watch < 0) {
+            return false;
+        }
+        if (relativeDirectory.isEmpty()) {
+            m_rootWatch = watch;
+        }
+        m_watches.insert(watch, relativeDirectory);
+        return true;
+    }
+#endif
+
+    if (m_watchedDirectories.contains(path)) {
+        return true;
+    }
+    if (!m_fallback->addPath(path)) {
+        return false;
+    }
+    m_watchedDirectories.insert(path);
+    return true;
+}
+
+void DirectoryWatcher::addSubdirectory(const QString &relativeDirectory)
+{
+    // Files may have been written into it before its watch was added
+    walk(relativeDirectory, [this](const QFileInfo &entry) {
+        schedule(entry.absoluteFilePath());
+    });
+}
+
+void DirectoryWatcher::removeSubdirectory(const QString &relativeDirectory)
+{
+    QString prefix = relativeDirectory + "/";
+
+#ifdef Q_OS_LINUX
+    // A directory moved away keeps its watches; a deleted one lost them already
+    for (auto it = m_watches.begin(); it != m_watches.end();) {
+        if (it.value() == relativeDirectory || it.value().startsWith(prefix)) {
+            inotify_rm_watch(m_inotifyFd, it.key());
+            it = m_watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#endif
+
+    QString pendingPrefix = m_directory + "/" + prefix;
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (it.key().startsWith(pendingPrefix)) {
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    armTimer();
+}
+
+bool DirectoryWatcher::matches(const QString &fileName, const QString &relativePath) const
+{
+    return !fileName.startsWith('.') && !fileName.startsWith("~$") && m_filter.acceptsFile(fileName, relativePath);
+}
+
+void DirectoryWatcher::schedule(const QString &path)
+{
+    QFileInfo info(path);
+
+    Pending pending;
+    pending.deadline = m_clock.elapsed() + m_debounceInterval;
+    pending.size = info.size();
+    pending.mtime = info.lastModified().toMSecsSinceEpoch();
+    m_pending.insert(path, pending);
+
+    armTimer();
+}
+
+void DirectoryWatcher::armTimer()
+{
+    if (m_pending.isEmpty()) {
+        m_timer.stop();
+        return;
+    }
+
+    qint64 earliest = m_pending.constBegin().value().deadline;
+    for (auto it = m_pending.constBegin(); it != m_pending.constEnd(); ++it) {
+        earliest = qMin(earliest, it.value().deadline);
+    }
+    m_timer.start(int(qMax<qint64>(0, earliest - m_clock.elapsed())));
+}
+
+void DirectoryWatcher::flushSettled()
+{
+    qint64 now = m_clock.elapsed();
+    QStringList ready;
+
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (it.value().deadline > now) {
+            ++it;
+            continue;
+        }
+
+        QFileInfo info(it.key());
+        if (!info.exists()) {
+            it = m_pending.erase(it);
+            continue;
+        }
+
+        // Still being written: wait for another quiet period
+        qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+        if (info.size() != it.value().size || mtime != it.value().mtime) {
+            it.value().size = info.size();
+            it.value().mtime = mtime;
+            it.value().deadline = now + m_debounceInterval;
+            ++it;
+            continue;
+        }
+
+        ready << it.key();
+        it = m_pending.erase(it);
+    }
+
+    armTimer();
+
+    if (!ready.isEmpty()) {
+        ready.sort();
+        emit filesReady(ready);
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef DIRECTORYWATCHER_H
+#define DIRECTORYWATCHER_H
+
+#include "filescanner.h"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <functional>
+
+class QFileInfo;
+class QSocketNotifier;
+class QFileSystemWatcher;
+
+// Reports files in a directory that were written or moved in, once they
+// have settled.
+//
+// On Linux this uses inotify close-write and moved-to events, so a file is
+// picked up as soon as its writer closes it. Elsewhere (or if inotify is
+// unavailable) QFileSystemWatcher triggers a rescan and files are reported
+// once their size and mtime stop changing. Either way a file must stay
+// unchanged for the debounce interval before it is reported. Office lock
+// files ("~$...") and hidden entries are ignored.
+//
+// Files are selected with the same PathFilter a FileScanner uses. When
+// recursive, subdirectories the filter accepts are watched too, including
+// ones created or moved in while watching.
+class DirectoryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DirectoryWatcher(QObject *parent = nullptr);
+    ~DirectoryWatcher();
+
+    bool start(const QString &directory, const PathFilter &filter, bool recursive);
+    void stop();
+
+    bool isWatching() const;
+    bool usesInotify() const;
+
+    // Quiet period before a written file is reported (default 250 ms)
+    void setDebounceInterval(int msec);
+
+signals:
+    void filesReady(const QStringList &files);
+    // The directory was removed or moved away; watching has stopped
+    void directoryGone();
+
+private slots:
+    void readInotifyEvents();
+    void rescan();
+    void flushSettled();
+
+private:
+    struct Pending {
+        qint64 deadline = 0;
+        qint64 size = -1;
+        qint64 mtime = -1;
+    };
+
+    bool startInotify();
+    void reportGone();
+    void scanDirectory(bool reportChanges);
+    void walk(const QString &relativeDirectory, const std::function<void(const QFileInfo &)> &onFile);
+    bool watchDirectory(const QString &relativeDirectory);
+    void addSubdirectory(const QString &relativeDirectory);
+    void removeSubdirectory(const QString &relativeDirectory);
+    bool matches(const QString &fileName, const QString &relativePath) const;
+    void schedule(const QString &path);
+    void armTimer();
+
+    QString m_directory;
+    PathFilter m_filter;
+    bool m_recursive;
+    int m_debounceInterval;
+
+    int m_inotifyFd;
+    int m_rootWatch;
+    QHash<int, QString> m_watches; // inotify: watch descriptor, relative directory
+    QSet<QString> m_watchedDirectories; // fallback
+    QSocketNotifier *m_notifier;
+    QFileSystemWatcher *m_fallback;
+    QHash<QString, QPair<qint64, qint64>> m_snapshot; // fallback: size, mtime
+
+    QHash<QString, Pending> m_pending;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+};
+
+#endif // DIRECTORYWATCHER_H
@@ -0,0 +1,747 @@
+#include "docdocument.h"
+#include "compoundfilereader.h"
+#include "pdfwriter.h"
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+
+const quint16 WordIdentifier = 0xA5EC;
+// Word 97; Word 6 and 95 files have a different layout
+const quint16 Word97Version = 0xC1;
+
+const quint16 EncryptedFlag = 0x0100;
+const quint16 Table1Flag = 0x0200;
+const quint16 ObfuscatedFlag = 0x8000;
+
+// Indexes into FibRgLw97, counts of characters per story
+const int MainText = 3;
+const int FootnoteText = 4;
+const int HeaderText = 5;
+const int CommentText = 7;
+const int EndnoteText = 8;
+const int TextboxText = 9;
+const int HeaderTextboxText = 10;
+
+// Indexes into FibRgFcLcb97, offset and size pairs in the table stream
+const int StyleSheet = 1;
+const int SectionTable = 6;
+const int CharacterBinTable = 12;
+const int ParagraphBinTable = 13;
+const int PieceTable = 33;
+const int FloatingShapes = 40;
+
+const qint64 FkpSize = 512;
+const quint32 CompressedFlag = 0x40000000;
+
+// Word's built-in defaults in twips: Letter with 1.25" and 1" margins
+const double DefaultPageWidth = 12240;
+const double DefaultPageHeight = 15840;
+const double DefaultMarginLeftRight = 1800;
+const double DefaultMarginTopBottom = 1440;
+
+// Default Paragraph Font, the character style nobody names explicitly
+const quint16 DefaultCharacterStyle = 10;
+
+quint16 le16(const uchar *data)
+{
+    return qFromLittleEndian<quint16>(data);
+}
+
+quint32 le32(const uchar *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+const uchar *bytes(const QByteArray &data)
+{
+    return reinterpret_cast<const uchar *>(data.constData());
+}
+
+// One property of a grpprl: the sprm code and its operand
+struct Sprm {
+    quint16 code = 0;
+    const uchar *operand = nullptr;
+    int size = 0;
+};
+
+// The top three bits of a sprm give its operand size; size 6 is variable
+// with a length byte in front
+bool nextSprm(const QByteArray &grpprl, qsizetype *position, Sprm *sprm)
+{
+    const uchar *data = bytes(grpprl);
+    qsizetype start = *position;
+    if (start + 2 > grpprl.size()) {
+        return false;
+    }
+    sprm->code = le16(data + start);
+    sprm->operand = data + start + 2;
+    static const int Sizes[8] = { 1, 1, 2, 4, 2, 2, -1, 3 };
+    sprm->size = Sizes[sprm->code >> 13];
+    if (sprm->size < 0) {
+        if (start + 3 > grpprl.size()) {
+            return false;
+        }
+        sprm->size = data[start + 2];
+        sprm->operand += 1;
+    }
+    *position = sprm->operand + sprm->size - data;
+    return *position <= grpprl.size();
+}
+
+// Toggles are set, cleared, or taken from the style as is or inverted
+bool toggle(uchar value, bool style)
+{
+    if (value == 0x80) {
+        return style;
+    }
+    if (value == 0x81) {
+        return !style;
+    }
+    return value != 0;
+}
+
+} // namespace
+
+DocDocument::DocDocument()
+{
+    m_defaultParagraph.size = 10;
+    m_defaultRun.size = 10;
+}
+
+bool DocDocument::load(const QString &fileName)
+{
+    CompoundFileReader file(fileName);
+    return read(file);
+}
+
+bool DocDocument::loadData(const QByteArray &data)
+{
+    CompoundFileReader file(data);
+    return read(file);
+}
+
+QString DocDocument::errorString() const
+{
+    return m_errorString;
+}
+
+bool DocDocument::read(const CompoundFileReader &file)
+{
+    m_paragraphs.clear();
+    m_pageSetup = DocxDocument::PageSetup();
+    m_defaultParagraph = DocxDocument::Paragraph();
+    m_defaultParagraph.size = 10;
+    m_defaultRun = DocxDocument::Run();
+    m_defaultRun.size = 10;
+    m_pieces.clear();
+    m_paragraphFormats.clear();
+    m_characterFormats.clear();
+
+    if (!file.isOpen()) {
+        return fail(file.errorString());
+    }
+    bool ok = false;
+    m_document = file.read("WordDocument", &ok);
+    if (!ok) {
+        return fail(file.errorString());
+    }
+
+    // The FIB: a fixed base, then counts and arrays of 16-bit values,
+    // 32-bit values and offset/size pairs, each led by its length
+    const uchar *fib = bytes(m_document);
+    if (m_document.size() < 34 || le16(fib) != WordIdentifier) {
+        return fail("Not a Word document");
+    }
+    if (le16(fib + 2) < Word97Version) {
+        return fail("Word 6 and 95 documents are not supported");
+    }
+    quint16 flags = le16(fib + 10);
+    if (flags & (EncryptedFlag | ObfuscatedFlag)) {
+        return fail("Encrypted document");
+    }
+
+    qsizetype position = 34 + 2 * qsizetype(le16(fib + 32));
+    if (position + 2 > m_document.size()) {
+        return fail("Damaged Word document header");
+    }
+    quint16 longCount = le16(fib + position);
+    const uchar *longs = fib + position + 2;
+    position += 2 + 4 * qsizetype(longCount);
+    if (position + 2 > m_document.size()) {
+        return fail("Damaged Word document header");
+    }
+    quint16 pairCount = le16(fib + position);
+    const uchar *pairs = fib + position + 2;
+    if (longCount <= HeaderTextboxText || pairCount <= FloatingShapes
+        || position + 2 + 8 * qsizetype(pairCount) > m_document.size()) {
+        return fail("Damaged Word document header");
+    }
+
+    if (le32(longs + 4 * FootnoteText) != 0 || le32(longs + 4 * EndnoteText) != 0) {
+        return fail("Footnotes or endnotes");
+    }
+    if (le32(longs + 4 * CommentText) != 0) {
+        return fail("Comments");
+    }
+    if (le32(longs + 4 * TextboxText) != 0 || le32(longs + 4 * HeaderTextboxText) != 0
+        || le32(pairs + 8 * FloatingShapes + 4) != 0) {
+        return fail("Text boxes or floating shapes");
+    }
+
+    m_table = file.read((flags & Table1Flag) ? "1Table" : "0Table", &ok);
+    if (!ok) {
+        return fail(file.errorString());
+    }
+    QByteArray parts[PieceTable + 1];
+    for (int part : { StyleSheet, SectionTable, CharacterBinTable, ParagraphBinTable, PieceTable }) {
+        quint32 offset = le32(pairs + 8 * part);
+        quint32 size = le32(pairs + 8 * part + 4);
+        if (qint64(offset) + size > m_table.size()) {
+            return fail("Damaged Word document header");
+        }
+        parts[part] = QByteArray::fromRawData(m_table.constData() + offset, size);
+    }
+
+    if (!readStyles(parts[StyleSheet]) || !readSection(parts[SectionTable]) || !readPieces(parts[PieceTable])
+        || !readFormats(parts[CharacterBinTable], false, &m_characterFormats)
+        || !readFormats(parts[ParagraphBinTable], true, &m_paragraphFormats)) {
+        return false;
+    }
+
+    // Word writes a header story of empty paragraphs even when there are
+    // no headers
+    quint32 length = le32(longs + 4 * MainText);
+    quint32 headerLength = le32(longs + 4 * HeaderText);
+    if (headerLength > 0) {
+        QString headers = text(length, length + headerLength);
+        if (headers.isNull() || headers.count(QChar('\r')) != headers.size()) {
+            return fail("Headers or footers");
+        }
+    }
+    return readText(length);
+}
+
+bool DocDocument::readPieces(const QByteArray &clx)
+{
+    // Property modifiers come first; pieces that used them would be
+    // rejected below, so they are skipped
+    const uchar *data = bytes(clx);
+    qsizetype position = 0;
+    while (position + 3 <= clx.size() && data[position] == 1) {
+        position += 3 + le16(data + position + 1);
+    }
+    if (position + 5 > clx.size() || data[position] != 2) {
+        return fail("Damaged piece table");
+    }
+    quint32 size = le32(data + position + 1);
+    const uchar *plc = data + position + 5;
+    if (position + 5 + qint64(size) > clx.size() || size < 4 || (size - 4) % 12 != 0) {
+        return fail("Damaged piece table");
+    }
+
+    // Character positions of n + 1 boundaries, then n 8-byte descriptors
+    quint32 count = (size - 4) / 12;
+    const uchar *descriptors = plc + 4 * (count + 1);
+    for (quint32 i = 0; i < count; ++i) {
+        Piece piece;
+        piece.cpStart = le32(plc + 4 * i);
+        piece.cpEnd = le32(plc + 4 * (i + 1));
+        quint32 offset = le32(descriptors + 8 * i + 2);
+        if (le16(descriptors + 8 * i + 6) != 0) {
+            return fail("Piece property modifiers");
+        }
+        piece.compressed = offset & CompressedFlag;
+        offset &= CompressedFlag - 1;
+        piece.offset = piece.compressed ? offset / 2 : offset;
+        qint64 end = piece.offset + qint64(piece.cpEnd - piece.cpStart) * (piece.compressed ? 1 : 2);
+        quint32 previousEnd = m_pieces.isEmpty() ? 0 : m_pieces.last().cpEnd;
+        if (piece.cpStart != previousEnd || piece.cpEnd < piece.cpStart || end > m_document.size()) {
+            return fail("Damaged piece table");
+        }
+        m_pieces << piece;
+    }
+    return true;
+}
+
+bool DocDocument::readFormats(const QByteArray &binTable, bool paragraphs, QList<Format> *formats)
+{
+    // The bin table lists the 512-byte FKP pages of the WordDocument
+    // stream; each page maps stream offsets to properties
+    if (binTable.isEmpty()) {
+        return true;
+    }
+    if (binTable.size() < 4 || (binTable.size() - 4) % 8 != 0) {
+        return fail("Damaged formatting table");
+    }
+    qsizetype count = (binTable.size() - 4) / 8;
+    const uchar *pages = bytes(binTable) + 4 * (count + 1);
+    for (qsizetype i = 0; i < count; ++i) {
+        qint64 page = qint64(le32(pages + 4 * i) & 0x3FFFFF) * FkpSize;
+        if (page + FkpSize > m_document.size()) {
+            return fail("Damaged formatting table");
+        }
+        const uchar *fkp = bytes(m_document) + page;
+        int runs = fkp[FkpSize - 1];
+        const uchar *offsets = fkp + 4 * (runs + 1);
+        if (4 * (runs + 1) + runs * (paragraphs ? 13 : 1) >= FkpSize) {
+            return fail("Damaged formatting table");
+        }
+
+        for (int k = 0; k < runs; ++k) {
+            Format format;
+            format.start = le32(fkp + 4 * k);
+            format.end = le32(fkp + 4 * (k + 1));
+            // Properties sit at twice the stored word offset; zero means none
+            int offset = 2 * (paragraphs ? offsets[13 * k] : offsets[k]);
+            if (offset > 0) {
+                int start = offset + 1;
+                int size = fkp[offset];
+                if (paragraphs) {
+                    // The style index leads; the length counts words
+                    if (size == 0) {
+                        start += 1;
+                        size = 2 * fkp[offset + 1];
+                    } else {
+                        size = 2 * size - 1;
+                    }
+                    if (size < 2) {
+                        return fail("Damaged paragraph properties");
+                    }
+                }
+                if (start + size > FkpSize - 1) {
+                    return fail("Damaged formatting table");
+                }
+                const char *properties = reinterpret_cast<const char *>(fkp + start);
+                if (paragraphs) {
+                    format.style = le16(fkp + start);
+                    format.properties = QByteArray(properties + 2, size - 2);
+                } else {
+                    format.properties = QByteArray(properties, size);
+                }
+            }
+            formats->append(format);
+        }
+    }
+    std::sort(formats->begin(), formats->end(), [](const Format &a, const Format &b) {
+        return a.start < b.start;
+    });
+    return true;
+}
+
+bool DocDocument::readStyles(const QByteArray &styles)
+{
+    // Only the Normal style matters: it is the first, and every paragraph
+    // naming another style is rejected
+    const uchar *data = bytes(styles);
+    if (styles.size() < 6) {
+        return true;
+    }
+    qsizetype position = 2 + le16(data);
+    quint16 baseSize = le16(data + 4);
+    if (position + 2 > styles.size()) {
+        return fail("Damaged style sheet");
+    }
+    qsizetype size = le16(data + position);
+    qsizetype start = position + 2;
+    qsizetype end = start + size;
+    if (size == 0) {
+        return true;
+    }
+    if (end > styles.size() || baseSize > size || (le16(data + start + 2) & 0xF) != 1) {
+        return fail("Damaged style sheet");
+    }
+
+    // The name, then paragraph properties behind the style's own index and
+    // character properties, each padded to an even length
+    position = start + baseSize;
+    if (position + 2 > end) {
+        return fail("Damaged style sheet");
+    }
+    position += 2 + 2 * (qsizetype(le16(data + position)) + 1);
+    QByteArray properties[2];
+    for (int i = 0; i < 2; ++i) {
+        if (position + 2 > end) {
+            return fail("Damaged style sheet");
+        }
+        qsizetype length = le16(data + position);
+        qsizetype skip = i == 0 ? 2 : 0;
+        if (position + 2 + length > end || length < skip) {
+            return fail("Damaged style sheet");
+        }
+        properties[i] = styles.mid(position + 2 + skip, length - skip);
+        position += 2 + length + (length & 1);
+    }
+
+    if (!applyParagraph(properties[0], &m_defaultParagraph) || !applyCharacter(properties[1], &m_defaultRun)) {
+        return false;
+    }
+    m_defaultParagraph.size = m_defaultRun.size;
+    return true;
+}
+
+bool DocDocument::readSection(const QByteArray &sections)
+{
+    double width = DefaultPageWidth;
+    double height = DefaultPageHeight;
+    double marginLeft = DefaultMarginLeftRight;
+    double marginRight = DefaultMarginLeftRight;
+    double marginTop = DefaultMarginTopBottom;
+    double marginBottom = DefaultMarginTopBottom;
+
+    // Boundaries, then a 12-byte descriptor per section pointing at its
+    // properties in the WordDocument stream
+    if (!sections.isEmpty()) {
+        if (sections.size() < 4 || (sections.size() - 4) % 16 != 0) {
+            return fail("Damaged section table");
+        }
+        if (sections.size() > 20) {
+            return fail("Several sections");
+        }
+        quint32 offset = le32(bytes(sections) + 10);
+        if (offset != 0xFFFFFFFF) {
+            if (qint64(offset) + 2 > m_document.size()
+                || qint64(offset) + 2 + le16(bytes(m_document) + offset) > m_document.size()) {
+                return fail("Damaged section properties");
+            }
+            QByteArray properties = m_document.mid(offset + 2, le16(bytes(m_document) + offset));
+            Sprm sprm;
+            qsizetype position = 0;
+            while (position < properties.size()) {
+                if (!nextSprm(properties, &position, &sprm)) {
+                    return fail("Damaged section properties");
+                }
+                qint16 value = qint16(sprm.size >= 2 ? le16(sprm.operand) : sprm.size > 0 ? sprm.operand[0] : 0);
+                switch (sprm.code) {
+                case 0xB01F:
+                    width = quint16(value);
+                    break;
+                case 0xB020:
+                    height = quint16(value);
+                    break;
+                case 0xB021:
+                    marginLeft = quint16(value);
+                    break;
+                case 0xB022:
+                    marginRight = quint16(value);
+                    break;
+                // A negative top or bottom margin means "fixed"; the size counts
+                case 0x9023:
+                    marginTop = qAbs(value);
+                    break;
+                case 0x9024:
+                    marginBottom = qAbs(value);
+                    break;
+                case 0x500B:
+                    // Number of columns minus one
+                    if (value != 0) {
+                        return fail("Columns");
+                    }
+                    break;
+                case 0x3005: case 0x3006: case 0x3009: case 0x300A: case 0x300E: case 0x3011:
+                case 0x301D: case 0x501C: case 0x5032: case 0x7030: case 0x7044: case 0x900C:
+                case 0x9031: case 0xB017: case 0xB018:
+                    // Break type, title page, page numbering, orientation,
+                    // grids, revision ids, column spacing, header distances
+                    break;
+                default:
+                    return unsupported(sprm.code);
+                }
+            }
+        }
+    }
+
+    m_pageSetup.width = width / 20.0;
+    m_pageSetup.height = height / 20.0;
+    m_pageSetup.marginLeft = marginLeft / 20.0;
+    m_pageSetup.marginRight = marginRight / 20.0;
+    m_pageSetup.marginTop = marginTop / 20.0;
+    m_pageSetup.marginBottom = marginBottom / 20.0;
+    // Leave room for at least a few words per line and a line per page
+    if (m_pageSetup.width - m_pageSetup.marginLeft - m_pageSetup.marginRight < 72
+        || m_pageSetup.height - m_pageSetup.marginTop - m_pageSetup.marginBottom < 72) {
+        return fail("Page too small for its margins");
+    }
+    return true;
+}
+
+QString DocDocument::text(quint32 start, quint32 end, QList<quint32> *offsets) const
+{
+    // Pieces are in text order; each is 8-bit Windows-1252 or UTF-16
+    if (m_pieces.isEmpty() || end < start || end > m_pieces.last().cpEnd) {
+        return QString();
+    }
+    QString result;
+    result.reserve(end - start);
+    if (offsets) {
+        offsets->reserve(end - start);
+    }
+    for (const Piece &piece : m_pieces) {
+        quint32 from = qMax(start, piece.cpStart);
+        quint32 to = qMin(end, piece.cpEnd);
+        for (quint32 cp = from; cp < to; ++cp) {
+            quint32 offset = piece.offset + (cp - piece.cpStart) * (piece.compressed ? 1 : 2);
+            const uchar *character = bytes(m_document) + offset;
+            result += piece.compressed ? PdfWriter::fromWinAnsi(char(*character)) : QChar(le16(character));
+            if (offsets) {
+                *offsets << offset;
+            }
+        }
+    }
+    if (quint32(result.size()) != end - start) {
+        return QString();
+    }
+    return result;
+}
+
+bool DocDocument::readText(quint32 length)
+{
+    QList<quint32> offsets;
+    QString characters = text(0, length, &offsets);
+    if (characters.isNull() && length > 0) {
+        return fail("Text outside the piece table");
+    }
+
+    // Runs change where the character properties do; a paragraph takes its
+    // properties and the height of empty lines from its mark
+    QList<DocxDocument::Run> runs;
+    DocxDocument::Run run;
+    const Format *format = nullptr;
+    DocxDocument::Run properties = m_defaultRun;
+    for (qsizetype i = 0; i < characters.size(); ++i) {
+        quint32 offset = offsets.at(i);
+        if (!format || offset < format->start || offset >= format->end) {
+            const Format *next = formatAt(m_characterFormats, offset);
+            if (next != format) {
+                format = next;
+                properties = m_defaultRun;
+                if (format && !applyCharacter(format->properties, &properties)) {
+                    return false;
+                }
+            }
+        }
+        if (properties.bold != run.bold || properties.italic != run.italic || properties.size != run.size) {
+            if (!run.text.isEmpty()) {
+                runs << run;
+            }
+            run = properties;
+            run.text.clear();
+        }
+
+        QChar ch = characters.at(i);
+        switch (ch.unicode()) {
+        case 0x0D: {
+            if (!run.text.isEmpty()) {
+                runs << run;
+            }
+            run.text.clear();
+
+            DocxDocument::Paragraph finished = m_defaultParagraph;
+            const Format *paragraphFormat = formatAt(m_paragraphFormats, offset);
+            if (paragraphFormat) {
+                if (paragraphFormat->style != 0) {
+                    return fail(QString("Paragraph style %1").arg(paragraphFormat->style));
+                }
+                if (!applyParagraph(paragraphFormat->properties, &finished)) {
+                    return false;
+                }
+            }
+            finished.runs = runs;
+            finished.size = properties.size;
+            m_paragraphs << finished;
+            runs.clear();
+            break;
+        }
+        case 0x09:
+        case 0x0B:
+        case 0x0C:
+            // Tab, line break, page break
+            run.text += ch == 0x09 ? QChar('\t') : ch == 0x0B ? QChar('\n') : QChar('\f');
+            break;
+        case 0x1E:
+            run.text += '-';
+            break;
+        case 0x1F:
+            // Optional hyphens are only drawn where a line breaks
+            break;
+        case 0x07:
+            return fail("Tables");
+        case 0x01:
+        case 0x08:
+            return fail("Pictures or drawings");
+        case 0x13:
+        case 0x14:
+        case 0x15:
+            return fail("Fields");
+        default:
+            if (ch.unicode() < 0x20) {
+                return fail(QString("Unsupported character 0x%1").arg(ch.unicode(), 2, 16, QChar('0')));
+            }
+            run.text += ch;
+        }
+    }
+
+    // Text after the last mark, which Word itself never leaves
+    if (!run.text.isEmpty()) {
+        runs << run;
+    }
+    if (!runs.isEmpty()) {
+        DocxDocument::Paragraph finished = m_defaultParagraph;
+        finished.runs = runs;
+        m_paragraphs << finished;
+    }
+    return true;
+}
+
+bool DocDocument::applyParagraph(const QByteArray &properties, DocxDocument::Paragraph *paragraph)
+{
+    Sprm sprm;
+    qsizetype position = 0;
+    while (position < properties.size()) {
+        if (!nextSprm(properties, &position, &sprm)) {
+            return fail("Damaged paragraph properties");
+        }
+        uchar byte = sprm.size > 0 ? sprm.operand[0] : 0;
+        qint16 value = qint16(sprm.size >= 2 ? le16(sprm.operand) : byte);
+        switch (sprm.code) {
+        case 0x2403:
+        case 0x2461:
+            if (byte == 1) {
+                paragraph->alignment = DocxDocument::Center;
+            } else if (byte == 2) {
+                paragraph->alignment = DocxDocument::Right;
+            } else if (byte == 0 || byte == 3) {
+                // Justified text is set ragged-right
+                paragraph->alignment = DocxDocument::Left;
+            } else {
+                return unsupported(sprm.code);
+            }
+            break;
+        case 0x840F:
+        case 0x845E:
+            paragraph->leftIndent = value / 20.0;
+            break;
+        case 0x840E:
+        case 0x845D:
+            paragraph->rightIndent = value / 20.0;
+            break;
+        case 0x8411:
+        case 0x8460:
+            paragraph->firstLineIndent = value / 20.0;
+            break;
+        case 0xA413:
+            paragraph->spaceBefore = quint16(value) / 20.0;
+            break;
+        case 0xA414:
+            paragraph->spaceAfter = quint16(value) / 20.0;
+            break;
+        case 0x6412: {
+            // In 240ths of a line when multiple, otherwise in twips: at
+            // least the height when positive, exactly it when negative
+            qint16 line = value;
+            if (le16(sprm.operand + 2) == 1) {
+                paragraph->lineSpacing = line / 240.0;
+                paragraph->lineHeight = 0;
+                paragraph->atLeast = false;
+            } else {
+                paragraph->lineSpacing = 1.0;
+                paragraph->lineHeight = qAbs(line) / 20.0;
+                paragraph->atLeast = line >= 0;
+            }
+            break;
+        }
+        case 0x2407:
+            paragraph->pageBreakBefore = byte != 0;
+            break;
+        case 0x2416: case 0x2417: case 0x6649: case 0x460B: case 0x4600: case 0x2441: case 0x245B: case 0x245C:
+            // Tables, lists, styles, right-to-left and automatic spacing
+            // are only accepted when explicitly off
+            if (value != 0) {
+                return unsupported(sprm.code);
+            }
+            break;
+        case 0x2405: case 0x2406: case 0x240C: case 0x242A: case 0x2431: case 0x2433: case 0x2434:
+        case 0x2435: case 0x2436: case 0x2437: case 0x2438: case 0x2448: case 0x245A: case 0x246D:
+        case 0x260A: case 0x2640: case 0x4439: case 0x6467:
+            // Keep with next, widow control, hyphenation, punctuation and
+            // wrapping of East Asian text, outline level, revision ids
+            break;
+        default:
+            return unsupported(sprm.code);
+        }
+    }
+    return true;
+}
+
+bool DocDocument::applyCharacter(const QByteArray &properties, DocxDocument::Run *run)
+{
+    Sprm sprm;
+    qsizetype position = 0;
+    while (position < properties.size()) {
+        if (!nextSprm(properties, &position, &sprm)) {
+            return fail("Damaged character properties");
+        }
+        uchar byte = sprm.size > 0 ? sprm.operand[0] : 0;
+        switch (sprm.code) {
+        case 0x0835:
+            run->bold = toggle(byte, m_defaultRun.bold);
+            break;
+        case 0x0836:
+            run->italic = toggle(byte, m_defaultRun.italic);
+            break;
+        case 0x4A43:
+            // Half-points
+            run->size = le16(sprm.operand) / 2.0;
+            if (run->size <= 0) {
+                return unsupported(sprm.code);
+            }
+            break;
+        case 0x4A30:
+            if (le16(sprm.operand) != DefaultCharacterStyle) {
+                return fail(QString("Character style %1").arg(le16(sprm.operand)));
+            }
+            break;
+        case 0x0800: case 0x0801: case 0x0802: case 0x0806: case 0x080A: case 0x0837: case 0x0838:
+        case 0x0839: case 0x083A: case 0x083B: case 0x083C: case 0x0854: case 0x0855: case 0x0856:
+        case 0x0858: case 0x2A0C: case 0x2A3E: case 0x2A48: case 0x2A53:
+            // Tracked changes, hidden text, embedded objects, special
+            // characters, strikethrough, caps, effects, highlighting,
+            // underlines and raised text are only accepted when off
+            if (toggle(byte, false)) {
+                return unsupported(sprm.code);
+            }
+            break;
+        case 0x0868: case 0x0875: case 0x0882: case 0x085C: case 0x085D: case 0x2A42: case 0x286F:
+        case 0x484B: case 0x485F: case 0x486D: case 0x486E: case 0x4873: case 0x4874: case 0x4A4F:
+        case 0x4A50: case 0x4A51: case 0x4A5E: case 0x4A61: case 0x6815: case 0x6816: case 0x6817:
+        case 0x6870:
+            // Fonts, languages, colors, kerning, proofing, complex script
+            // variants and revision ids
+            break;
+        default:
+            return unsupported(sprm.code);
+        }
+    }
+    return true;
+}
+
+const DocDocument::Format *DocDocument::formatAt(const QList<Format> &formats, quint32 offset)
+{
+    auto it = std::upper_bound(formats.constBegin(), formats.constEnd(), offset,
+                               [](quint32 value, const Format &format) { return value < format.start; });
+    if (it == formats.constBegin() || offset >= (it - 1)->end) {
+        return nullptr;
+    }
+    return &*(it - 1);
+}
+
+bool DocDocument::unsupported(quint16 sprm)
+{
+    return fail(QString("Unsupported property 0x%1").arg(sprm, 4, 16, QChar('0')));
+}
+
+bool DocDocument::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
@@ -0,0 +1,75 @@
+#ifndef DOCDOCUMENT_H
+#define DOCDOCUMENT_H
+
+#include "docxdocument.h"
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class CompoundFileReader;
+
+// Reads the main text of a Word 97-2003 binary document into the same
+// paragraphs as DocxDocument, so simple legacy files skip LibreOffice too.
+//
+// Text comes from the piece table of the WordDocument stream; paragraph
+// and character formatting from the FKP pages the bin tables point to,
+// over the Normal style. Only the properties DocxDocument reads are
+// accepted. Tables, pictures, fields, lists, named styles, footnotes,
+// headers and footers, text boxes, several sections, encryption, Word 6/95
+// files and every property not known to be harmless make load() fail with
+// the reason in errorString(), so callers send the file to LibreOffice.
+class DocDocument
+{
+public:
+    DocDocument();
+
+    bool load(const QString &fileName);
+    bool loadData(const QByteArray &data);
+    QString errorString() const;
+
+    const QList<DocxDocument::Paragraph> &paragraphs() const { return m_paragraphs; }
+    const DocxDocument::PageSetup &pageSetup() const { return m_pageSetup; }
+
+private:
+    // Stretch of the WordDocument stream with one set of properties
+    struct Format {
+        quint32 start = 0;
+        quint32 end = 0;
+        quint16 style = 0;
+        QByteArray properties;      // grpprl
+    };
+
+    struct Piece {
+        quint32 cpStart = 0;
+        quint32 cpEnd = 0;
+        quint32 offset = 0;         // in the WordDocument stream
+        bool compressed = false;    // 8-bit text, otherwise UTF-16
+    };
+
+    bool read(const CompoundFileReader &file);
+    bool readPieces(const QByteArray &clx);
+    bool readFormats(const QByteArray &binTable, bool paragraphs, QList<Format> *formats);
+    bool readStyles(const QByteArray &styles);
+    bool readSection(const QByteArray &sections);
+    QString text(quint32 start, quint32 end, QList<quint32> *offsets = nullptr) const;
+    bool readText(quint32 length);
+    bool applyParagraph(const QByteArray &properties, DocxDocument::Paragraph *paragraph);
+    bool applyCharacter(const QByteArray &properties, DocxDocument::Run *run);
+    static const Format *formatAt(const QList<Format> &formats, quint32 offset);
+    bool unsupported(quint16 sprm);
+    bool fail(const QString &message);
+
+    QByteArray m_document;          // WordDocument stream
+    QByteArray m_table;             // 0Table or 1Table stream
+    QList<Piece> m_pieces;
+    QList<Format> m_paragraphFormats;
+    QList<Format> m_characterFormats;
+
+    QList<DocxDocument::Paragraph> m_paragraphs;
+    DocxDocument::PageSetup m_pageSetup;
+    DocxDocument::Paragraph m_defaultParagraph;  // of the Normal style
+    DocxDocument::Run m_defaultRun;
+    QString m_errorString;
+};
+
+#endif // DOCDOCUMENT_H
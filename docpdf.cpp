@@ -1,231 +1,1337 @@
 #include "docpdf.h"
-#include <QProcess>
+#include "batchjournal.h"
+#include "bytescan.h"
+#include "conversioncache.h"
+#include "conversionmetrics.h"
+#include "conversionpool.h"
+#include "directorywatcher.h"
+#include "filescanner.h"
+#include "officeserverpool.h"
+#include "outputwriter.h"
+#include "popplertextextractor.h"
+#include "processscheduler.h"
+#include "progresschannel.h"
+#include "spoolleases.h"
+#include "systemresources.h"
+#include "docxpdfconverter.h"
+#include "docxwriter.h"
+#include "pdfdocument.h"
+#include "pdftextextractor.h"
+#include "pdfwriter.h"
 #include <QStandardPaths>
+#include <QBuffer>
 #include <QCoreApplication>
 #include <QDebug>
-#include <QTextStream>
 #include <QFile>
-#include <QRegularExpression>
 #include <QDateTime>
 #include <QDir>
-#include <QStringConverter>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+#include <QUrl>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// PDFs with at least this many pages are extracted on several threads
+const int ParallelPageThreshold = 64;
+
+// Pages per native extraction task; contiguous ranges keep each
+// extractor's font cache warm
+const int PagesPerRange = 16;
+
+// Smallest page range worth its own pdftotext process
+const int PagesPerProcess = 32;
+
+// Share of the available memory the running conversions may reserve
+const int MemoryBudgetPercent = 80;
+
+// How long a pause lets running converters finish before killing them
+const int DrainTimeoutMsecs = 10000;
+
+// Cost model for scheduling. Only the order of the estimates and their
+// memory relative to the budget matter, so these are deliberately rough.
+const qint64 BytesPerPdfPage = 64 * 1024;
+const qint64 PageCountProbeBytes = 4 * 1024 * 1024;
+const double PdfMsecsPerPage = 5;
+const double PdfMsecsPerMegabyte = 20;
+const qint64 PdfBaseMemory = 64 * 1024 * 1024;
+const qint64 OfficeBaseMemory = 300 * 1024 * 1024;
+const qint64 OfficeMemoryPerByte = 8;
+
+// Other hosts' writes to a network spool raise no local file events, so
+// it is rescanned this long after each round
+const int SpoolPollMsecs = 5000;
+
+// Numbers the engines of this process
+std::atomic<int> nextInstance(0);
+
+// Extra threads for the page ranges of one large PDF, borrowed from a
+// budget of cpuCount() - 1 that every conversion of the process shares.
+// The converting thread always works on a range itself; others are only
+// added while nobody else holds them, so full pools of workers don't each
+// start cpuCount() threads or pdftotext processes.
+class ExtractionThreads
+{
+public:
+    explicit ExtractionThreads(int wanted)
+        : m_borrowed(0)
+    {
+        while (m_borrowed < wanted - 1 && budget().tryAcquire()) {
+            m_borrowed++;
+        }
+    }
+    ~ExtractionThreads()
+    {
+        budget().release(m_borrowed);
+    }
+
+    int count() const { return m_borrowed + 1; }
+
+private:
+    static QSemaphore &budget()
+    {
+        static QSemaphore semaphore(SystemResources::cpuCount() - 1);
+        return semaphore;
+    }
+
+    int m_borrowed;
+};
+
+// Whether UTF-8 text is empty or all whitespace, without the copy that
+// trimmed() makes of the whole text
+bool isBlank(const QByteArray &text)
+{
+    return ByteScan::findNonSpace(text.constData(), text.size(), 0) == text.size();
+}
+
+} // namespace
 
 DocPdf::DocPdf(QObject *parent)
     : QObject(parent)
+    , m_jobCount(SystemResources::cpuCount())
+    , m_officeServerMode(false)
+    , m_maxJobsPerServer(200)
+    , m_processes(new ProcessScheduler)
+    , m_outputs(new OutputWriter)
+    , m_poppler(new PopplerTextExtractor)
+    , m_canceled(false)
+    , m_officeServers(nullptr)
+    , m_officeBatcher(new OfficeBatchConverter(m_processes, m_outputs))
+    , m_docxCompressionLevel(6)
+    , m_nativeDocx(true)
+    , m_cacheEnabled(true)
+    , m_resumeEnabled(true)
+    , m_cache(new ConversionCache)
+    , m_metrics(new ConversionMetrics)
+    , m_progress(new ProgressChannel)
+    , m_metricsDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation))
+    , m_watcher(nullptr)
+    , m_watchDirection(DocToPdf)
+    , m_spool(nullptr)
+    , m_spoolTimer(nullptr)
+    , m_spoolDirection(DocToPdf)
+    , m_recursive(false)
+    , m_pool(nullptr)
+    , m_paused(false)
+    , m_activeTasks(0)
+    , m_instance(nextInstance++)
+{
+}
+
+DocPdf::~DocPdf()
+{
+    delete m_spool;
+    delete m_officeServers;
+    delete m_officeBatcher;
+    delete m_processes;
+    delete m_outputs;
+    delete m_poppler;
+    delete m_cache;
+    delete m_metrics;
+    delete m_progress;
+    
+    // Remove the per-worker LibreOffice profiles created by this engine;
+    // other engines of the process may still be using theirs
+    QDir tempDir = QDir::temp();
+    QString pattern = QString("docpdf_lo_%1_%2_*").arg(QCoreApplication::applicationPid()).arg(m_instance);
+    for (const QString &profile : tempDir.entryList(QStringList() << pattern, QDir::Dirs)) {
+        QDir(tempDir.absoluteFilePath(profile)).removeRecursively();
+    }
+}
+
+void DocPdf::setJobCount(int jobCount)
+{
+    m_jobCount = qMax(1, jobCount);
+}
+
+int DocPdf::jobCount() const
+{
+    return m_jobCount;
+}
+
+void DocPdf::setOfficeServerMode(bool enabled)
+{
+    m_officeServerMode = enabled;
+    if (!enabled) {
+        delete m_officeServers;
+        m_officeServers = nullptr;
+    }
+}
+
+bool DocPdf::officeServerMode() const
+{
+    return m_officeServerMode;
+}
+
+void DocPdf::setDocxCompressionLevel(int level)
+{
+    m_docxCompressionLevel = qBound(0, level, 9);
+}
+
+void DocPdf::setNativeDocxEnabled(bool enabled)
+{
+    m_nativeDocx = enabled;
+}
+
+bool DocPdf::nativeDocxEnabled() const
+{
+    return m_nativeDocx;
+}
+
+void DocPdf::setCacheEnabled(bool enabled)
+{
+    m_cacheEnabled = enabled;
+}
+
+bool DocPdf::cacheEnabled() const
+{
+    return m_cacheEnabled;
+}
+
+void DocPdf::setCacheFile(const QString &fileName)
+{
+    m_cache->setIndexFile(fileName);
+}
+
+void DocPdf::setResumeEnabled(bool enabled)
+{
+    m_resumeEnabled = enabled;
+}
+
+bool DocPdf::resumeEnabled() const
+{
+    return m_resumeEnabled;
+}
+
+void DocPdf::setOutputDirectory(const QString &directory)
+{
+    m_outputDirectory = directory.isEmpty() ? QString() : QDir(directory).absolutePath();
+}
+
+QString DocPdf::outputDirectory() const
+{
+    return m_outputDirectory;
+}
+
+void DocPdf::setRecursive(bool recursive)
+{
+    m_recursive = recursive;
+}
+
+bool DocPdf::isRecursive() const
+{
+    return m_recursive;
+}
+
+void DocPdf::setIncludePatterns(const QStringList &patterns)
+{
+    m_includePatterns = patterns;
+}
+
+void DocPdf::setExcludePatterns(const QStringList &patterns)
+{
+    m_excludePatterns = patterns;
+}
+
+void DocPdf::setMetricsDirectory(const QString &directory)
+{
+    m_metricsDirectory = directory;
+}
+
+QString DocPdf::metricsDirectory() const
+{
+    return m_metricsDirectory;
+}
+
+void DocPdf::setMaxJobsPerServer(int maxJobs)
+{
+    m_maxJobsPerServer = maxJobs;
+    if (m_officeServers) {
+        m_officeServers->setMaxJobsPerServer(maxJobs);
+    }
+}
+
+void DocPdf::setOfficeBatchSize(int files)
 {
+    m_officeBatcher->setMaxBatchSize(files);
+}
+
+int DocPdf::officeBatchSize() const
+{
+    return m_officeBatcher->maxBatchSize();
 }
 
 void DocPdf::convertDocToPdf(const QString &directory)
 {
-    QStringList docFiles = findDocFiles(directory);
+    convertDirectory(directory, DocToPdf);
+}
+
+void DocPdf::convertPdfToDocx(const QString &directory)
+{
+    convertDirectory(directory, PdfToDocx);
+}
+
+void DocPdf::convertDirectory(const QString &directory, Direction direction)
+{
+    m_inputRoot = QDir(directory).absolutePath();
     
-    if (docFiles.isEmpty()) {
-        emit error("No DOC/DOCX files found in the directory.");
-        return;
+    // Discovery runs on the scanner's threads and feeds the pool as it
+    // goes, so conversion overlaps with walking the tree
+    FileScanner scanner;
+    scanner.setRecursive(m_recursive);
+    scanner.setFilter(inputFilter(direction));
+    
+    runBatch(direction, QStringList(), &scanner);
+}
+
+void DocPdf::runBatch(Direction direction, const QStringList &files, FileScanner *scanner)
+{
+    clearCancel();
+    
+    // Servers outlive the batch so the next one starts warm
+    if (direction == DocToPdf && m_officeServerMode
+        && (!m_officeServers || m_officeServers->serverCount() != m_jobCount)) {
+        delete m_officeServers;
+        m_officeServers = new OfficeServerPool(m_jobCount, m_processes);
+        m_officeServers->setMaxJobsPerServer(m_maxJobsPerServer);
     }
     
-    int converted = 0;
-    int total = docFiles.size();
+    if (m_cacheEnabled) {
+        m_cache->load();
+    }
+    m_cache->resetStatistics();
+    m_metrics->reset(direction == DocToPdf ? "doc-pdf" : "pdf-docx");
+    m_progress->begin();
+    QByteArray settings = cacheSettings(direction == DocToPdf ? "doc-pdf" : "pdf-docx");
+    QString suffix = direction == DocToPdf ? "pdf" : "docx";
+    
+    // Cold soffice runs take several documents at once. Every file still
+    // gets a task, but each task converts whatever batch is queued when it
+    // starts (possibly nothing), so batch sizes follow the latest estimates.
+    bool batched = direction == DocToPdf && !m_officeServerMode && m_officeBatcher->maxBatchSize() > 1;
+    OfficeBatchConverter::Queue batchQueue;
+    QList<std::shared_ptr<QList<OfficeBatchConverter::Job>>> batches;
+    
+    // Costly files start first, and the memory they are expected to need
+    // is admitted against what the host and the cgroup have left
+    ConversionPool pool(scanner ? m_jobCount : qMin(m_jobCount, files.size()));
+    pool.setMemoryBudget(SystemResources::availableMemory() / 100 * MemoryBudgetPercent);
+    {
+        QMutexLocker locker(&m_pauseMutex);
+        m_pool = &pool;
+    }
+    
+    // Directory batches are journaled, so one that is stopped half way
+    // continues from where it was on the next run
+    BatchJournal journal(m_outputs);
+    if (scanner && !m_spool && m_resumeEnabled) {
+        journal.open(QFileInfo(m_cache->indexFile()).absolutePath() + "/journals",
+                     settings + '\n' + m_inputRoot.toUtf8() + '\n' + m_outputDirectory.toUtf8());
+    }
+    // Files the journal lists are only reported; they go first, so
+    // progress catches up at once
+    ConversionPool::Cost resumedCost;
+    resumedCost.msecs = std::numeric_limits<qint64>::max();
+    
+    // Sequence numbers index this list; it grows while the scanner is
+    // still running
+    QMutex submittedMutex;
+    QStringList submitted;
+    QSet<int> resumed;
+    auto submit = [&](const QString &inputPath) {
+        // After a cancel the rest of the walk only drains
+        if (m_canceled) {
+            return;
+        }
+        // Files finished or leased elsewhere cost no estimate and no task
+        if (m_spool && !m_spool->isAvailable(inputPath)) {
+            return;
+        }
+        // Converted by an interrupted run of this batch, output still there
+        if (journal.isDone(inputPath) && QFileInfo::exists(outputPathFor(inputPath, suffix))) {
+            QMutexLocker locker(&submittedMutex);
+            resumed.insert(submitted.size());
+            submitted << inputPath;
+            if (batched) {
+                OfficeBatchConverter::Job job;
+                job.inputPath = inputPath;
+                job.ok = true;
+                auto batch = std::make_shared<QList<OfficeBatchConverter::Job>>();
+                *batch << job;
+                batches << batch;
+            }
+            pool.submit([](int) { return true; }, resumedCost);
+            return;
+        }
+        ConversionPool::Cost cost = estimateCost(inputPath);
+        QMutexLocker locker(&submittedMutex);
+        submitted << inputPath;
+        
+        if (batched) {
+            OfficeBatchConverter::Job job;
+            job.inputPath = inputPath;
+            job.outputPath = outputPathFor(inputPath, suffix);
+            job.size = QFileInfo(inputPath).size();
+            {
+                // Largest first, so batches follow the pool's order
+                QMutexLocker queueLocker(&batchQueue.mutex);
+                auto position = std::upper_bound(batchQueue.jobs.begin(), batchQueue.jobs.end(), job.size,
+                                                 [](qint64 size, const OfficeBatchConverter::Job &queued) {
+                                                     return size > queued.size;
+                                                 });
+                batchQueue.jobs.insert(position, job);
+            }
+            
+            auto batch = std::make_shared<QList<OfficeBatchConverter::Job>>();
+            batches << batch;
+            pool.submit([this, &batchQueue, batch, settings](int workerIndex) {
+                if (m_canceled) {
+                    return false;
+                }
+                beginTask();
+                bool ok = convertDocBatch(&batchQueue, batch.get(), settings, workerIndex);
+                endTask();
+                return ok;
+            }, cost);
+            return;
+        }
+        
+        pool.submit([this, direction, inputPath, suffix, settings](int workerIndex) {
+            if (m_canceled) {
+                return false;
+            }
+            // Claimed only when a worker is free, so busy hosts leave
+            // files to idle ones
+            if (m_spool && !m_spool->claim(inputPath)) {
+                return false;
+            }
+            beginTask();
+            ConversionMetrics::FileScope metrics(m_metrics, inputPath);
+            QString outputPath = outputPathFor(inputPath, suffix);
+            auto convert = [&]() {
+                ConversionMetrics::StageTimer timer(ConversionMetrics::Other);
+                return direction == DocToPdf ? convertSingleDocToPdf(inputPath, outputPath, workerIndex)
+                                             : convertSinglePdfToDocx(inputPath, outputPath);
+            };
+            bool ok = convertResumably([&]() {
+                if (!m_cacheEnabled) {
+                    return convert() != ConversionFailed;
+                }
+                ConversionMetrics::StageTimer timer(ConversionMetrics::Cache);
+                ConversionCache::Ticket ticket;
+                // A hit may clone another output into place
+                m_outputs->prepareDirectory(outputPath);
+                if (m_cache->lookup(inputPath, outputPath, settings, &ticket)) {
+                    return true;
+                }
+                ConversionResult result = convert();
+                if (result == Converted) {
+                    m_cache->store(inputPath, outputPath, settings, ticket);
+                }
+                return result != ConversionFailed;
+            });
+            metrics.setOk(ok);
+            endTask();
+            return ok;
+        }, cost);
+    };
+    
+    if (scanner) {
+        QElapsedTimer discoveryTimer;
+        discoveryTimer.start();
+        scanner->start(m_inputRoot, submit, [this, &pool, discoveryTimer]() {
+            m_metrics->record(ConversionMetrics::Discovery, discoveryTimer.nsecsElapsed());
+            pool.close();
+        });
+    } else {
+        for (const QString &file : files) {
+            submit(file);
+        }
+        pool.close();
+    }
     
-    for (int i = 0; i < docFiles.size(); ++i) {
-        const QString &docFile = docFiles[i];
-        QFileInfo fileInfo(docFile);
-        QString pdfFile = fileInfo.absolutePath() + "/" + fileInfo.baseName() + ".pdf";
+    // Results arrive in submission order. In spool mode files another process
+    // claimed first are not part of this batch, so the total only shrinks.
+    int converted = 0;
+    int reported = 0;
+    int skipped = 0;
+    int resumedCount = 0;
+    int sequence = 0;
+    bool ok = false;
+    while (pool.nextResult(&sequence, &ok)) {
+        QList<OfficeBatchConverter::Job> batch;
+        QString inputPath;
+        int total = 0;
+        bool wasResumed = false;
+        {
+            QMutexLocker locker(&submittedMutex);
+            if (batched) {
+                batch = *batches[sequence];
+            } else {
+                inputPath = submitted[sequence];
+            }
+            total = submitted.size();
+            wasResumed = resumed.contains(sequence);
+        }
+        if (wasResumed) {
+            resumedCount++;
+        }
+        
+        if (batched) {
+            // A batch reports each of its files; unclaimed ones never joined it
+            m_progress->setTotal(total - skipped);
+            for (const OfficeBatchConverter::Job &job : batch) {
+                if (m_spool) {
+                    m_canceled ? m_spool->release(job.inputPath) : m_spool->finish(job.inputPath, job.ok);
+                }
+                // Files a cancel skipped were not tried
+                if (!wasResumed && (job.ok || !m_canceled)) {
+                    journal.record(job.inputPath, job.ok);
+                }
+                QString fileName = QFileInfo(job.inputPath).fileName();
+                m_progress->fileDone(fileName, job.size, job.ok);
+                emit progress(++reported, total - skipped, fileName);
+                if (job.ok) {
+                    converted++;
+                }
+            }
+            continue;
+        }
         
-        emit progress(i + 1, total, fileInfo.fileName());
+        if (m_spool && !(m_canceled ? m_spool->release(inputPath) : m_spool->finish(inputPath, ok))) {
+            skipped++;
+            continue;
+        }
+        m_progress->setTotal(total - skipped);
+        if (!wasResumed && (ok || !m_canceled)) {
+            journal.record(inputPath, ok);
+        }
         
-        if (convertSingleDocToPdf(docFile, pdfFile)) {
+        QFileInfo inputInfo(inputPath);
+        m_progress->fileDone(inputInfo.fileName(), wasResumed ? 0 : inputInfo.size(), ok);
+        emit progress(++reported, total - skipped, inputInfo.fileName());
+        if (ok) {
             converted++;
         }
     }
     
-    emit finished(converted, total, "DOC/DOCX");
+    if (scanner) {
+        scanner->wait();
+    }
+    {
+        QMutexLocker locker(&m_pauseMutex);
+        m_pool = nullptr;
+        m_paused = false;
+    }
+    m_metrics->setDeferredCount(pool.deferredCount());
+    m_progress->end();
+    
+    // A cancel only applies to the batch it interrupted
+    bool wasCanceled = m_canceled.exchange(false);
+    m_processes->resume();
+    
+    // The journal of a canceled batch stays for the next run
+    if (wasCanceled) {
+        journal.close();
+    } else {
+        journal.remove();
+    }
+    
+    int total = m_spool ? reported : submitted.size();
+    if (total == 0 && !wasCanceled) {
+        // An empty round is the normal state of a spool
+        if (m_spool) {
+            return;
+        }
+        emit error(direction == DocToPdf ? "No DOC/DOCX files found in the directory."
+                                         : "No PDF files found in the directory.");
+        return;
+    }
+    
+    // Outputs are durable before the cache index refers to them
+    if (!m_outputs->flush()) {
+        qWarning() << "Some outputs could not be synced to disk";
+    }
+    if (m_cacheEnabled) {
+        m_cache->save();
+    }
+    
+    m_metrics->finish();
+    QJsonObject report = m_metrics->toJson();
+    if (!m_metricsDirectory.isEmpty() && !m_metrics->writeReports(m_metricsDirectory)) {
+        qWarning() << "Cannot write metrics to" << m_metricsDirectory;
+    }
+    emit metricsReady(report);
+    if (wasCanceled) {
+        emit canceled(converted, total);
+        return;
+    }
+    // Files finished by an earlier run count as up to date
+    emit finished(converted, total, direction == DocToPdf ? "DOC/DOCX" : "PDF", m_cache->hits() + resumedCount);
 }
 
-void DocPdf::convertPdfToDocx(const QString &directory)
+void DocPdf::startWatching(const QString &directory, Direction direction)
+{
+    stopWatching();
+    
+    m_watchDirection = direction;
+    m_inputRoot = QDir(directory).absolutePath();
+    m_watcher = new DirectoryWatcher(this);
+    connect(m_watcher, &DirectoryWatcher::filesReady, this, &DocPdf::convertWatchedFiles);
+    DirectoryWatcher *watcher = m_watcher;
+    connect(m_watcher, &DirectoryWatcher::directoryGone, this, [this, watcher]() {
+        if (m_watcher != watcher) {
+            return;
+        }
+        // Deleted once it has returned from emitting
+        m_watcher->deleteLater();
+        m_watcher = nullptr;
+        emit error(QString("Watched directory is gone: %1").arg(m_inputRoot));
+    });
+    
+    if (!m_watcher->start(directory, inputFilter(direction), m_recursive)) {
+        stopWatching();
+        emit error(QString("Cannot watch directory: %1").arg(directory));
+    }
+}
+
+void DocPdf::stopWatching()
+{
+    delete m_watcher;
+    m_watcher = nullptr;
+}
+
+bool DocPdf::isWatching() const
+{
+    return m_watcher != nullptr;
+}
+
+void DocPdf::startSpool(const QString &directory, Direction direction)
 {
-    QStringList pdfFiles = findPdfFiles(directory);
+    stopSpool();
     
-    if (pdfFiles.isEmpty()) {
-        emit error("No PDF files found in the directory.");
+    m_spoolDirection = direction;
+    m_spool = new SpoolLeases(directory);
+    m_spoolTimer = new QTimer(this);
+    m_spoolTimer->setSingleShot(true);
+    connect(m_spoolTimer, &QTimer::timeout, this, &DocPdf::runSpoolRound);
+    m_spoolTimer->start(0);
+}
+
+void DocPdf::stopSpool()
+{
+    // May run inside the timer's own timeout
+    if (m_spoolTimer) {
+        m_spoolTimer->deleteLater();
+    }
+    m_spoolTimer = nullptr;
+    delete m_spool;
+    m_spool = nullptr;
+}
+
+bool DocPdf::isSpooling() const
+{
+    return m_spool != nullptr;
+}
+
+ProgressChannel *DocPdf::progressChannel() const
+{
+    return m_progress;
+}
+
+void DocPdf::cancel()
+{
+    m_canceled = true;
+    m_processes->cancel();
+    
+    // Queued files of a paused batch are skipped like any others
+    QMutexLocker locker(&m_pauseMutex);
+    if (m_paused) {
+        m_paused = false;
+        m_pool->resume();
+    }
+    m_pauseChanged.wakeAll();
+}
+
+void DocPdf::pause()
+{
+    QMutexLocker locker(&m_pauseMutex);
+    if (m_paused || !m_pool || m_canceled) {
         return;
     }
+    m_paused = true;
+    m_pool->pause();
+    m_processes->cancelAfter(DrainTimeoutMsecs);
+    bool drained = m_activeTasks == 0;
+    locker.unlock();
     
-    int converted = 0;
-    int total = pdfFiles.size();
+    if (drained) {
+        emit paused();
+    }
+}
+
+void DocPdf::resume()
+{
+    QMutexLocker locker(&m_pauseMutex);
+    if (!m_paused) {
+        return;
+    }
+    m_paused = false;
+    // Disarms the drain timeout, or lifts the cancel it caused
+    m_processes->resume();
+    m_pool->resume();
+    m_pauseChanged.wakeAll();
+    locker.unlock();
     
-    for (int i = 0; i < pdfFiles.size(); ++i) {
-        const QString &pdfFile = pdfFiles[i];
-        QFileInfo fileInfo(pdfFile);
-        QString docxFile = fileInfo.absolutePath() + "/" + fileInfo.baseName() + ".docx";
-        
-        emit progress(i + 1, total, fileInfo.fileName());
-        
-        if (convertSinglePdfToDocx(pdfFile, docxFile)) {
-            converted++;
+    emit resumed();
+}
+
+bool DocPdf::isPaused() const
+{
+    QMutexLocker locker(&m_pauseMutex);
+    return m_paused;
+}
+
+bool DocPdf::waitForDrained(int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QMutexLocker locker(&m_pauseMutex);
+    while (m_activeTasks > 0) {
+        qint64 remaining = msecs - timer.elapsed();
+        if (remaining <= 0) {
+            return false;
         }
+        m_pauseChanged.wait(&m_pauseMutex, remaining);
     }
+    return true;
+}
+
+bool DocPdf::convertFile(const QString &inputPath, const QString &outputPath, int slot)
+{
+    clearCancel();
     
-    emit finished(converted, total, "PDF");
+    if (QFileInfo(inputPath).suffix().compare("pdf", Qt::CaseInsensitive) == 0) {
+        return convertSinglePdfToDocx(inputPath, outputPath) != ConversionFailed;
+    }
+    return convertSingleDocToPdf(inputPath, outputPath, slot) != ConversionFailed;
 }
 
-QStringList DocPdf::findDocFiles(const QString &directory)
+bool DocPdf::convertData(const QByteArray &input, const QString &suffix, QByteArray *output, int slot)
 {
-    QDir dir(directory);
-    QStringList nameFilters;
-    nameFilters << "*.doc" << "*.docx";
+    clearCancel();
+    
+    bool isPdf = suffix.compare("pdf", Qt::CaseInsensitive) == 0;
+    
+    // The native converters read and write the buffers themselves
+    output->clear();
+    QBuffer buffer(output);
+    buffer.open(QIODevice::WriteOnly);
+    if (isPdf) {
+        PdfDocument document;
+        bool loaded = false;
+        {
+            ConversionMetrics::StageTimer timer(ConversionMetrics::TextExtraction);
+            loaded = document.loadData(input) && !document.isEncrypted();
+        }
+        if (loaded) {
+            DocxWriter docx(&buffer);
+            if (writeDocxFromPdf(document, &docx)) {
+                return true;
+            }
+        }
+    } else if (m_nativeDocx && (suffix.compare("docx", Qt::CaseInsensitive) == 0
+                                || suffix.compare("doc", Qt::CaseInsensitive) == 0)) {
+        DocxPdfConverter converter;
+        if (converter.convert(input, &buffer)) {
+            return true;
+        }
+    }
+    buffer.close();
+    output->clear();
+    
+    // soffice, poppler and pdftotext need files; the directory goes away
+    // with everything in it
+    QTemporaryDir directory(QDir::temp().absoluteFilePath("docpdf_data_XXXXXX"));
+    if (!directory.isValid()) {
+        return false;
+    }
+    QString inputPath = directory.filePath("document." + suffix);
+    QString outputPath = directory.filePath(isPdf ? "document.docx" : "document.pdf");
+    QFile inputFile(inputPath);
+    if (!inputFile.open(QIODevice::WriteOnly) || inputFile.write(input) != input.size()) {
+        return false;
+    }
+    inputFile.close();
     
-    QStringList files = dir.entryList(nameFilters, QDir::Files);
-    QStringList absolutePaths;
+    QFile outputFile(outputPath);
+    bool ok = convertFile(inputPath, outputPath, slot) && outputFile.open(QIODevice::ReadOnly);
+    m_outputs->releaseStagingDirectories(directory.path());
+    if (!ok) {
+        return false;
+    }
+    *output = outputFile.readAll();
+    return true;
+}
+
+void DocPdf::beginTask()
+{
+    QMutexLocker locker(&m_pauseMutex);
+    m_activeTasks++;
+}
+
+void DocPdf::endTask()
+{
+    QMutexLocker locker(&m_pauseMutex);
+    bool drained = --m_activeTasks == 0 && m_paused;
+    m_pauseChanged.wakeAll();
+    locker.unlock();
     
-    for (const QString &file : files) {
-        // Skip temporary files
-        if (!file.startsWith("~$")) {
-            absolutePaths << dir.absoluteFilePath(file);
+    if (drained) {
+        emit paused();
+    }
+}
+
+bool DocPdf::convertResumably(const std::function<bool()> &convert)
+{
+    while (!m_canceled) {
+        int cancels = m_processes->cancelCount();
+        bool ok = convert();
+        if (ok || m_canceled || m_processes->cancelCount() == cancels) {
+            return ok;
+        }
+        
+        // A pause ran out of time and killed the converter; the file starts
+        // over once the batch is resumed
+        endTask();
+        {
+            QMutexLocker locker(&m_pauseMutex);
+            while (m_paused && !m_canceled) {
+                m_pauseChanged.wait(&m_pauseMutex);
+            }
         }
+        beginTask();
     }
+    return false;
+}
+
+void DocPdf::clearCancel()
+{
+    // A cancel only applies to the conversions it interrupted; one made
+    // between conversions must not fail the next
+    if (m_canceled.exchange(false)) {
+        m_processes->resume();
+    }
+}
+
+int DocPdf::spareThreads() const
+{
+    // Inside a batch only idle workers leave CPUs to spare; a per-document
+    // conversion may use them all
+    QMutexLocker locker(&m_pauseMutex);
+    return m_pool ? m_pool->idleWorkerCount() : SystemResources::cpuCount() - 1;
+}
+
+void DocPdf::convertWatchedFiles(const QStringList &files)
+{
+    // The cache drops files that were rewritten with identical content
+    runBatch(m_watchDirection, files, nullptr);
+}
+
+void DocPdf::runSpoolRound()
+{
+    convertDirectory(m_spool->spoolDirectory(), m_spoolDirection);
     
-    return absolutePaths;
+    // A finished() handler may have called stopSpool()
+    if (m_spoolTimer) {
+        m_spool->pruneDone();
+        m_spoolTimer->start(SpoolPollMsecs);
+    }
 }
 
-QStringList DocPdf::findPdfFiles(const QString &directory)
+QStringList DocPdf::nameFilters(Direction direction)
 {
-    QDir dir(directory);
     QStringList nameFilters;
-    nameFilters << "*.pdf";
+    if (direction == DocToPdf) {
+        nameFilters << "*.doc" << "*.docx";
+    } else {
+        nameFilters << "*.pdf";
+    }
+    return nameFilters;
+}
+
+PathFilter DocPdf::inputFilter(Direction direction) const
+{
+    PathFilter filter;
+    filter.setNameFilters(nameFilters(direction));
+    filter.setIncludePatterns(m_includePatterns);
+    // Skip temporary files
+    filter.setExcludePatterns(QStringList(m_excludePatterns) << "~$*");
+    return filter;
+}
+
+QString DocPdf::outputPathFor(const QString &inputPath, const QString &suffix) const
+{
+    QFileInfo fileInfo(inputPath);
+    QString directory = fileInfo.absolutePath();
+    
+    // Mirror the input tree below the output directory
+    if (!m_outputDirectory.isEmpty()) {
+        QString relative = QDir(m_inputRoot).relativeFilePath(directory);
+        directory = QDir(m_outputDirectory).absoluteFilePath(relative == "." ? QString() : relative);
+    }
     
-    QStringList files = dir.entryList(nameFilters, QDir::Files);
-    QStringList absolutePaths;
+    return QDir::cleanPath(directory + "/" + fileInfo.baseName() + "." + suffix);
+}
+
+ConversionPool::Cost DocPdf::estimateCost(const QString &inputPath) const
+{
+    QFileInfo fileInfo(inputPath);
+    qint64 size = fileInfo.size();
+    double megabytes = double(size) / (1024.0 * 1024.0);
+    ConversionPool::Cost cost;
     
-    for (const QString &file : files) {
-        absolutePaths << dir.absoluteFilePath(file);
+    if (fileInfo.suffix().compare("pdf", Qt::CaseInsensitive) == 0) {
+        // Page counts of large files are worth a look at their page tree
+        qint64 pages = qMax<qint64>(1, size / BytesPerPdfPage);
+        if (size >= PageCountProbeBytes) {
+            PdfDocument document;
+            if (document.load(inputPath)) {
+                pages = document.pageCount();
+            }
+        }
+        cost.msecs = qint64(pages * PdfMsecsPerPage + megabytes * PdfMsecsPerMegabyte);
+        // Pages are mapped, but the pdftotext fallback holds all the text
+        cost.memoryBytes = PdfBaseMemory + size / 2;
+        return cost;
     }
     
-    return absolutePaths;
+    // Whether a document can be laid out natively is only known once it
+    // is parsed, so every Word document is charged as a soffice run
+    cost.msecs = m_officeBatcher->predictedMsecs(size);
+    cost.memoryBytes = OfficeBaseMemory + size * OfficeMemoryPerByte;
+    return cost;
 }
 
-bool DocPdf::convertSingleDocToPdf(const QString &inputPath, const QString &outputPath)
+DocPdf::ConversionResult DocPdf::convertSingleDocToPdf(const QString &inputPath, const QString &outputPath,
+                                                      int workerIndex)
 {
+    if (convertNatively(inputPath, outputPath)) {
+        return Converted;
+    }
+    
     // For Windows, we'll use LibreOffice command line if available
     // This is a simplified implementation - in production you'd want to use
     // proper libraries like LibreOffice SDK or commercial solutions
     
-    QProcess process;
+    ConversionMetrics::StageTimer timer(ConversionMetrics::Process);
+    
+    // Office output goes to a private directory first and is committed
+    // over outputPath once complete
+    QString stagingDirectory = m_outputs->stagingDirectory(QFileInfo(outputPath).absolutePath(), workerIndex);
+    
+    // Warm server first; a cold soffice start is the fallback
+    QString staged = stagingDirectory + "/" + QFileInfo(outputPath).fileName();
+    if (m_officeServers && m_officeServers->convert(workerIndex, inputPath, staged)) {
+        return m_outputs->commit(staged, outputPath) ? Converted : ConversionFailed;
+    }
+    
     QStringList arguments;
     
     // Try LibreOffice headless conversion
     QString libreOfficePath = "soffice"; // Assumes LibreOffice is in PATH
+    // A private profile per worker lets concurrent instances run side by side
+    arguments << "-env:UserInstallation=" + libreOfficeProfileUrl(workerIndex);
     arguments << "--headless" << "--convert-to" << "pdf" << "--outdir" 
-              << QFileInfo(outputPath).absolutePath() << inputPath;
+              << stagingDirectory << inputPath;
+    
+    // soffice names its output after the input's complete base name
+    staged = stagingDirectory + "/" + QFileInfo(inputPath).completeBaseName() + ".pdf";
+    QFile::remove(staged);
     
-    process.start(libreOfficePath, arguments);
-    process.waitForFinished(30000); // 30 second timeout
+    // 30 second timeout
+    ProcessScheduler::Result result = m_processes->run(libreOfficePath, arguments, 30000);
+    if (result.timedOut) {
+        ConversionMetrics::reportTimeout("soffice", 30000);
+    }
     
-    if (process.exitCode() == 0) {
-        return QFile::exists(outputPath);
+    if (result.ok()) {
+        return QFile::exists(staged) && m_outputs->commit(staged, outputPath) ? Converted : ConversionFailed;
+    }
+    if (result.canceled) {
+        return ConversionFailed;
     }
     
     // Fallback: Try using Word via COM (Windows only)
     // This would require additional Windows-specific code
     // For now, we'll create a placeholder PDF
-    QFile file(outputPath);
-    if (file.open(QIODevice::WriteOnly)) {
-        QTextStream stream(&file);
-        stream << "%PDF-1.4\n";
-        stream << "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
-        stream << "2 0 obj\n<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n";
-        stream << "3 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] >>\nendobj\n";
-        stream << "xref\n0 4\n0000000000 65535 f \n0000000009 00000 n \n0000000058 00000 n \n0000000115 00000 n \n";
-        stream << "trailer\n<< /Size 4 /Root 1 0 R >>\nstartxref\n194\n%%EOF\n";
-        file.close();
-        return true;
+    return writePlaceholderPdf(outputPath) ? PlaceholderWritten : ConversionFailed;
+}
+
+bool DocPdf::convertDocBatch(OfficeBatchConverter::Queue *queue, QList<OfficeBatchConverter::Job> *batch,
+                             const QByteArray &settings, int workerIndex)
+{
+    m_officeBatcher->takeBatch(queue, batch);
+    
+    // In spool mode only the files this process wins are converted
+    if (m_spool) {
+        batch->erase(std::remove_if(batch->begin(), batch->end(),
+                                    [this](const OfficeBatchConverter::Job &job) {
+                                        return !m_spool->claim(job.inputPath);
+                                    }),
+                     batch->end());
     }
     
-    return false;
+    // Up-to-date outputs need no soffice run
+    QList<ConversionMetrics::FileRecord> records(batch->size());
+    QList<ConversionCache::Ticket> tickets(batch->size());
+    QList<OfficeBatchConverter::Job> misses;
+    QList<int> missIndexes;
+    QElapsedTimer timer;
+    for (int i = 0; i < batch->size(); ++i) {
+        OfficeBatchConverter::Job &job = (*batch)[i];
+        records[i].path = job.inputPath;
+        timer.start();
+        job.ok = m_cacheEnabled && m_outputs->prepareDirectory(job.outputPath)
+                 && m_cache->lookup(job.inputPath, job.outputPath, settings, &tickets[i]);
+        records[i].stageNanos[ConversionMetrics::Cache] = timer.nsecsElapsed();
+        if (job.ok) {
+            continue;
+        }
+        
+        // Text-only DOCX and DOC files never reach soffice
+        timer.start();
+        job.ok = convertNatively(job.inputPath, job.outputPath);
+        records[i].stageNanos[ConversionMetrics::Other] = timer.nsecsElapsed();
+        if (!job.ok) {
+            misses << job;
+            missIndexes << i;
+        } else if (m_cacheEnabled) {
+            timer.start();
+            m_cache->store(job.inputPath, job.outputPath, settings, tickets[i]);
+            records[i].stageNanos[ConversionMetrics::Cache] += timer.nsecsElapsed();
+        }
+    }
+    
+    // Files of a run a pause killed are converted again after resume();
+    // a run that finished before the kill keeps its outputs
+    QList<int> remaining;
+    for (int i = 0; i < misses.size(); ++i) {
+        remaining << i;
+    }
+    convertResumably([&]() {
+        QList<OfficeBatchConverter::Job> jobs;
+        for (int i : remaining) {
+            jobs << misses[i];
+        }
+        m_officeBatcher->convert(&jobs, libreOfficeProfileUrl(workerIndex), workerIndex);
+        QList<int> failed;
+        for (int k = 0; k < jobs.size(); ++k) {
+            misses[remaining[k]] = jobs[k];
+            if (!jobs[k].ok) {
+                failed << remaining[k];
+            }
+        }
+        remaining = failed;
+        return remaining.isEmpty();
+    });
+    
+    for (int i = 0; i < misses.size(); ++i) {
+        OfficeBatchConverter::Job &job = (*batch)[missIndexes[i]];
+        ConversionMetrics::FileRecord &record = records[missIndexes[i]];
+        job = misses[i];
+        record.stageNanos[ConversionMetrics::Process] = job.processNanos;
+        if (job.timeoutMsecs > 0) {
+            record.timeouts << "soffice";
+            m_metrics->addTimeout("soffice", job.inputPath, job.timeoutMsecs);
+        }
+        
+        timer.start();
+        if (!job.ok && !m_canceled) {
+            // Same fallback as a single conversion, and likewise not cached
+            job.ok = writePlaceholderPdf(job.outputPath);
+            record.stageNanos[ConversionMetrics::DiskWrite] = timer.nsecsElapsed();
+        } else if (job.ok && m_cacheEnabled) {
+            m_cache->store(job.inputPath, job.outputPath, settings, tickets[missIndexes[i]]);
+            record.stageNanos[ConversionMetrics::Cache] += timer.nsecsElapsed();
+        }
+    }
+    
+    // Batched run times are shared evenly between their files
+    bool allOk = true;
+    for (int i = 0; i < batch->size(); ++i) {
+        ConversionMetrics::FileRecord &record = records[i];
+        record.ok = batch->at(i).ok;
+        for (int stage = 0; stage < ConversionMetrics::StageCount; ++stage) {
+            if (record.stageNanos[stage] > 0) {
+                m_metrics->record(ConversionMetrics::Stage(stage), record.stageNanos[stage]);
+                record.totalNanos += record.stageNanos[stage];
+            }
+        }
+        m_metrics->addFile(record);
+        allOk = allOk && record.ok;
+    }
+    return allOk;
+}
+
+bool DocPdf::convertNatively(const QString &inputPath, const QString &outputPath)
+{
+    QString suffix = QFileInfo(inputPath).suffix();
+    if (!m_nativeDocx || (suffix.compare("docx", Qt::CaseInsensitive) != 0
+                          && suffix.compare("doc", Qt::CaseInsensitive) != 0)) {
+        return false;
+    }
+    
+    // Fails without touching the output when the document needs LibreOffice
+    DocxPdfConverter converter;
+    QString temporaryPath = m_outputs->temporaryPath(outputPath);
+    return converter.convert(inputPath, temporaryPath) && m_outputs->commit(temporaryPath, outputPath);
+}
+
+bool DocPdf::writePlaceholderPdf(const QString &outputPath)
+{
+    // One blank Letter page
+    QString temporaryPath = m_outputs->temporaryPath(outputPath);
+    PdfWriter writer(temporaryPath);
+    writer.beginPage(612, 792);
+    return writer.close() && m_outputs->commit(temporaryPath, outputPath);
+}
+
+QString DocPdf::libreOfficeProfileUrl(int workerIndex) const
+{
+    QString profileDir = QDir::temp().absoluteFilePath(
+        QString("docpdf_lo_%1_%2_%3").arg(QCoreApplication::applicationPid()).arg(m_instance).arg(workerIndex));
+    return QUrl::fromLocalFile(profileDir).toString();
+}
+
+QByteArray DocPdf::cacheSettings(const QByteArray &direction) const
+{
+    // Everything that changes the output bytes; bump the version when the
+    // converters change so old entries stop matching
+    QByteArray settings = direction + ";v1";
+    if (direction == "doc-pdf" && m_nativeDocx) {
+        // native=2: DOC files are laid out natively too
+        settings += ";native=2";
+    }
+    if (direction == "pdf-docx") {
+        // xml=2: control characters are dropped from document.xml
+        settings += ";xml=2;level=" + QByteArray::number(m_docxCompressionLevel);
+        if (PopplerTextExtractor::isAvailable()) {
+            settings += ";poppler=1";
+        }
+    }
+    return settings;
+}
+
+DocPdf::ConversionResult DocPdf::convertSinglePdfToDocx(const QString &inputPath, const QString &outputPath)
+{
+    // Native extraction streams page by page into the DOCX writer
+    int pageCount = 0;
+    if (streamPdfToDocx(inputPath, outputPath, &pageCount)) {
+        return Converted;
+    }
+    
+    // Extract text from PDF, as UTF-8 from the extractor to document.xml
+    bool placeholder = false;
+    QByteArray text = extractTextFromPdf(inputPath, pageCount, &placeholder);
+    
+    if (text.isEmpty() || !createDocxFromText(text, outputPath)) {
+        return ConversionFailed;
+    }
+    return placeholder ? PlaceholderWritten : Converted;
 }
 
-bool DocPdf::convertSinglePdfToDocx(const QString &inputPath, const QString &outputPath)
+bool DocPdf::streamPdfToDocx(const QString &pdfPath, const QString &outputPath, int *pageCount)
 {
-    // Extract text from PDF
-    QString text = extractTextFromPdf(inputPath);
+    // The PDF is memory-mapped and each page is decoded, extracted and
+    // written before the next one, so memory stays bounded by the largest
+    // page. Encrypted or unparsable files fall through to the other paths.
+    PdfDocument document;
+    {
+        ConversionMetrics::StageTimer timer(ConversionMetrics::TextExtraction);
+        if (!document.load(pdfPath)) {
+            return false;
+        }
+        *pageCount = document.pageCount();
+        if (document.isEncrypted()) {
+            return false;
+        }
+    }
     
-    if (text.isEmpty()) {
+    QString temporaryPath = m_outputs->temporaryPath(outputPath);
+    DocxWriter docx(temporaryPath);
+    return writeDocxFromPdf(document, &docx) && m_outputs->commit(temporaryPath, outputPath);
+}
+
+bool DocPdf::writeDocxFromPdf(const PdfDocument &document, DocxWriter *docx)
+{
+    if (!docx->isOpen()) {
         return false;
     }
+    docx->setCompressionLevel(m_docxCompressionLevel);
+    // Pool workers deflate on their own thread unless others are idle
+    docx->setThreadCount(1 + spareThreads());
+    
+    // Large documents are extracted a window of pages at a time, one
+    // contiguous range per thread, each with its own extractor. The window
+    // is written in page order before the next one starts, so memory stays
+    // bounded by the window instead of the document.
+    int pageCount = document.pageCount();
+    ExtractionThreads threads(pageCount >= ParallelPageThreshold ? 1 + spareThreads() : 1);
+    int rangeCount = threads.count();
+    int window = rangeCount > 1 ? rangeCount * PagesPerRange : 1;
+    std::vector<std::unique_ptr<PdfTextExtractor>> extractors;
+    for (int i = 0; i < rangeCount; ++i) {
+        extractors.push_back(std::make_unique<PdfTextExtractor>(document));
+    }
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(rangeCount);
+    QList<QByteArray> pages(window);
+    QByteArray *pageTexts = pages.data();
+    
+    bool hasText = false;
+    for (int first = 0; first < pageCount; first += window) {
+        int count = qMin(window, pageCount - first);
+        {
+            ConversionMetrics::StageTimer timer(ConversionMetrics::TextExtraction);
+            if (rangeCount == 1) {
+                pageTexts[0] = extractors[0]->pageText(first);
+            } else {
+                for (int range = 0; range * PagesPerRange < count; ++range) {
+                    PdfTextExtractor *extractor = extractors[range].get();
+                    threadPool.start([pageTexts, extractor, first, range, count]() {
+                        int end = qMin(count, (range + 1) * PagesPerRange);
+                        for (int i = range * PagesPerRange; i < end; ++i) {
+                            pageTexts[i] = extractor->pageText(first + i);
+                        }
+                    });
+                }
+                threadPool.waitForDone();
+            }
+        }
+        
+        for (int i = 0; i < count; ++i) {
+            hasText = hasText || !isBlank(pageTexts[i]);
+            if (!docx->addText(pageTexts[i])) {
+                docx->discard();
+                return false;
+            }
+        }
+        if (m_canceled) {
+            docx->discard();
+            return false;
+        }
+    }
     
-    // Create DOCX from text
-    return createDocxFromText(text, outputPath);
+    if (!hasText) {
+        docx->discard();
+        return false;
+    }
+    return docx->close();
 }
 
-QString DocPdf::extractTextFromPdf(const QString &pdfPath)
+QByteArray DocPdf::extractTextFromPdf(const QString &pdfPath, int pageCount, bool *placeholder)
 {
     // Always return some text so conversion doesn't fail
-    QString extractedText;
+    QByteArray extractedText;
     
-    // Try using pdftotext if available
-    QProcess process;
-    QStringList arguments;
-    arguments << "-layout" << pdfPath << "-"; // Output to stdout with layout
-    
-    process.start("pdftotext", arguments);
-    process.waitForFinished(10000);
+    // A page count of 0 means the native parser could not read the file
+    ExtractionThreads threads(pageCount == 0 || pageCount >= ParallelPageThreshold ? 1 + spareThreads() : 1);
     
-    if (process.exitCode() == 0) {
-        extractedText = QString::fromUtf8(process.readAllStandardOutput());
-        if (!extractedText.trimmed().isEmpty()) {
+    // poppler-cpp, in process, when it was built in
+    {
+        ConversionMetrics::StageTimer timer(ConversionMetrics::TextExtraction);
+        if (m_poppler->extract(pdfPath, threads.count(), &extractedText)
+            && !isBlank(extractedText)) {
             return extractedText;
         }
     }
     
-    // Fallback: Try reading PDF as binary and extract basic text
-    QFile file(pdfPath);
-    if (file.open(QIODevice::ReadOnly)) {
-        QByteArray data = file.readAll();
-        QString content = QString::fromLatin1(data);
-        
-        // Simple text extraction from PDF content streams
-        QStringList lines;
-        
-        // Look for text in parentheses (common PDF text format)
-        QRegularExpression textPattern(R"(\(([^)]+)\))");
-        QRegularExpressionMatchIterator matches = textPattern.globalMatch(content);
-        
-        while (matches.hasNext()) {
-            QRegularExpressionMatch match = matches.next();
-            QString text = match.captured(1);
-            if (!text.isEmpty() && text.length() > 1) {
-                lines << text;
-            }
+    // Fallback: pdftotext if available. Large documents are split into page
+    // ranges that run side by side; pdftotext ends every page with a form
+    // feed, so the outputs concatenate to what a single run would print.
+    QList<QStringList> argumentLists;
+    int rangeCount = pageCount >= ParallelPageThreshold
+                         ? qBound(1, pageCount / PagesPerProcess, threads.count())
+                         : 1;
+    for (int range = 0; range < rangeCount; ++range) {
+        QStringList arguments;
+        arguments << "-layout"; // Output to stdout with layout
+        if (rangeCount > 1) {
+            arguments << "-f" << QString::number(qint64(range) * pageCount / rangeCount + 1)
+                      << "-l" << QString::number(qint64(range + 1) * pageCount / rangeCount);
         }
-        
-        // Also look for text between 'BT' and 'ET' markers
-        QRegularExpression btPattern(R"(BT\s+.*?ET)", QRegularExpression::DotMatchesEverythingOption);
-        QRegularExpressionMatchIterator btMatches = btPattern.globalMatch(content);
-        
-        while (btMatches.hasNext()) {
-            QRegularExpressionMatch match = btMatches.next();
-            QString btContent = match.captured(0);
-            
-            // Extract text from within this block
-            QRegularExpression innerText(R"(\(([^)]+)\))");
-            QRegularExpressionMatchIterator innerMatches = innerText.globalMatch(btContent);
-            
-            while (innerMatches.hasNext()) {
-                QRegularExpressionMatch innerMatch = innerMatches.next();
-                QString text = innerMatch.captured(1);
-                if (!text.isEmpty() && text.length() > 1) {
-                    lines << text;
-                }
+        arguments << pdfPath << "-";
+        argumentLists << arguments;
+    }
+    
+    ConversionMetrics::StageTimer timer(ConversionMetrics::Process);
+    QList<ProcessScheduler::Result> results = m_processes->runAll("pdftotext", argumentLists, 10000);
+    bool ok = true;
+    bool timedOut = false;
+    qsizetype outputSize = 0;
+    for (const ProcessScheduler::Result &result : results) {
+        if (result.canceled) {
+            return QByteArray();
+        }
+        timedOut = timedOut || result.timedOut;
+        ok = ok && result.ok();
+        outputSize += result.standardOutput.size();
+    }
+    if (timedOut) {
+        ConversionMetrics::reportTimeout("pdftotext", 10000);
+    }
+    
+    if (ok) {
+        // A single run's output is shared, not copied; ranges are joined
+        // into one allocation
+        if (results.size() == 1) {
+            extractedText = results.first().standardOutput;
+        } else {
+            extractedText.clear();
+            extractedText.reserve(outputSize);
+            for (const ProcessScheduler::Result &result : results) {
+                extractedText += result.standardOutput;
             }
         }
-        
-        if (!lines.isEmpty()) {
-            extractedText = lines.join(" ");
+        if (!isBlank(extractedText)) {
+            return extractedText;
         }
     }
     
     // If we still have no text, create meaningful content
-    if (extractedText.trimmed().isEmpty()) {
+    if (isBlank(extractedText)) {
+        *placeholder = true;
         QFileInfo fileInfo(pdfPath);
         extractedText = QString("Document: %1\n\n"
                                "This document was converted from PDF to DOCX.\n"
@@ -237,102 +1343,23 @@ QString DocPdf::extractTextFromPdf(const QString &pdfPath)
                                .arg(fileInfo.baseName())
                                .arg(fileInfo.fileName())
                                .arg(fileInfo.size())
-                               .arg(QDateTime::currentDateTime().toString());
+                               .arg(QDateTime::currentDateTime().toString())
+                               .toUtf8();
     }
     
     return extractedText;
 }
 
-bool DocPdf::createDocxFromText(const QString &text, const QString &outputPath)
+bool DocPdf::createDocxFromText(const QByteArray &text, const QString &outputPath)
 {
-    // Create a proper DOCX file using Qt's built-in ZIP support
-    // First, create temporary directory structure
-    QDir tempDir = QDir::temp();
-    QString tempDirPath = tempDir.absoluteFilePath("docpdf_" + QString::number(QDateTime::currentMSecsSinceEpoch()));
-    
-    if (!tempDir.mkpath(tempDirPath)) {
+    QString temporaryPath = m_outputs->temporaryPath(outputPath);
+    DocxWriter docx(temporaryPath);
+    if (!docx.isOpen()) {
         return false;
     }
+    docx.setCompressionLevel(m_docxCompressionLevel);
+    docx.setThreadCount(1 + spareThreads());
     
-    QDir workDir(tempDirPath);
-    workDir.mkpath("word");
-    workDir.mkpath("_rels");
-    workDir.mkpath("word/_rels");
-    
-    // Create [Content_Types].xml
-    QFile contentTypes(workDir.absoluteFilePath("[Content_Types].xml"));
-    if (contentTypes.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream stream(&contentTypes);
-        stream.setEncoding(QStringConverter::Utf8);
-        stream << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n";
-        stream << "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n";
-        stream << "  <Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n";
-        stream << "  <Default Extension=\"xml\" ContentType=\"application/xml\"/>\n";
-        stream << "  <Override PartName=\"/word/document.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.document.main+xml\"/>\n";
-        stream << "</Types>\n";
-        contentTypes.close();
-    }
-    
-    // Create _rels/.rels
-    QFile rels(workDir.absoluteFilePath("_rels/.rels"));
-    if (rels.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream stream(&rels);
-        stream.setEncoding(QStringConverter::Utf8);
-        stream << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n";
-        stream << "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n";
-        stream << "  <Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"word/document.xml\"/>\n";
-        stream << "</Relationships>\n";
-        rels.close();
-    }
-    
-    // Create word/document.xml
-    QFile document(workDir.absoluteFilePath("word/document.xml"));
-    if (document.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream stream(&document);
-        stream.setEncoding(QStringConverter::Utf8);
-        stream << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n";
-        stream << "<w:document xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\">\n";
-        stream << "  <w:body>\n";
-        
-        // Split text into paragraphs and add to document
-        QStringList paragraphs = text.split('\n');
-        for (const QString &paragraph : paragraphs) {
-            QString cleanParagraph = paragraph.trimmed();
-            if (!cleanParagraph.isEmpty()) {
-                // Escape XML characters
-                cleanParagraph.replace("&", "&amp;");
-                cleanParagraph.replace("<", "&lt;");
-                cleanParagraph.replace(">", "&gt;");
-                cleanParagraph.replace("\"", "&quot;");
-                cleanParagraph.replace("'", "&apos;");
-                
-                stream << "    <w:p>\n";
-                stream << "      <w:r>\n";
-                stream << "        <w:t>" << cleanParagraph << "</w:t>\n";
-                stream << "      </w:r>\n";
-                stream << "    </w:p>\n";
-            }
-        }
-        
-        stream << "  </w:body>\n";
-        stream << "</w:document>\n";
-        document.close();
-    }
-    
-    // Now create the ZIP file manually using PowerShell (since we're on Windows)
-    QProcess zipProcess;
-    QString powershellScript = QString(
-        "Add-Type -AssemblyName System.IO.Compression.FileSystem; "
-        "[System.IO.Compression.ZipFile]::CreateFromDirectory('%1', '%2')"
-    ).arg(tempDirPath).arg(outputPath);
-    
-    zipProcess.start("powershell", QStringList() << "-Command" << powershellScript);
-    zipProcess.waitForFinished(10000);
-    
-    bool success = zipProcess.exitCode() == 0 && QFile::exists(outputPath);
-    
-    // Clean up temporary directory
-    QDir(tempDirPath).removeRecursively();
-    
-    return success;
-}
\ No newline at end of file
+    docx.addText(text);
+    return docx.close() && m_outputs->commit(temporaryPath, outputPath);
+}
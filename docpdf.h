@@ -1,35 +1,235 @@
 #ifndef DOCPDF_H
 #define DOCPDF_H
 
+#include "conversionpool.h"
+#include "officebatchconverter.h"
 #include <QObject>
 #include <QString>
 #include <QStringList>
 #include <QDir>
 #include <QFileInfo>
+#include <QJsonObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
+
+class ConversionCache;
+class ConversionMetrics;
+class DirectoryWatcher;
+class DocxWriter;
+class FileScanner;
+class OfficeServerPool;
+class OutputWriter;
+class PathFilter;
+class PdfDocument;
+class PopplerTextExtractor;
+class ProcessScheduler;
+class ProgressChannel;
+class SpoolLeases;
+class QTimer;
 
 class DocPdf : public QObject
 {
     Q_OBJECT
 
 public:
+    enum Direction {
+        DocToPdf,
+        PdfToDocx
+    };
+    Q_ENUM(Direction)
+
     explicit DocPdf(QObject *parent = nullptr);
+    ~DocPdf();
+
+    // Number of files converted concurrently (defaults to the core count)
+    void setJobCount(int jobCount);
+    int jobCount() const;
+
+    // Keep warm LibreOffice instances running and send conversions to them
+    void setOfficeServerMode(bool enabled);
+    bool officeServerMode() const;
+    void setMaxJobsPerServer(int maxJobs);
+
+    // Most documents passed to one cold soffice run (1 converts them one
+    // at a time); batches are sized from file sizes and past run times
+    void setOfficeBatchSize(int files);
+    int officeBatchSize() const;
+
+    // Deflate level for generated DOCX parts; 0 stores them uncompressed
+    void setDocxCompressionLevel(int level);
+
+    // Lay out text-only DOCX and DOC files in-process instead of starting
+    // LibreOffice (on by default); other documents still go to soffice
+    void setNativeDocxEnabled(bool enabled);
+    bool nativeDocxEnabled() const;
+
+    // Skip files whose output is up to date (on by default)
+    void setCacheEnabled(bool enabled);
+    bool cacheEnabled() const;
+    void setCacheFile(const QString &fileName);
+
+    // Continue a directory batch that an earlier run did not complete from
+    // its journal, next to the cache index (on by default)
+    void setResumeEnabled(bool enabled);
+    bool resumeEnabled() const;
+
+    // Write outputs below this directory (mirroring subdirectories) instead
+    // of next to their inputs; empty restores the default
+    void setOutputDirectory(const QString &directory);
+    QString outputDirectory() const;
+
+    // Include subdirectories when looking for input files
+    void setRecursive(bool recursive);
+    bool isRecursive() const;
+
+    // Glob filters for discovery, matched against the file name or the path
+    // relative to the input directory; excluded directories are skipped
+    void setIncludePatterns(const QStringList &patterns);
+    void setExcludePatterns(const QStringList &patterns);
+
+    // Where metrics.json and metrics.prom are written after each batch;
+    // defaults to the user cache directory, empty disables the files
+    void setMetricsDirectory(const QString &directory);
+    QString metricsDirectory() const;
+
+    bool isWatching() const;
+    bool isSpooling() const;
+
+    // Progress of the running batch for viewers that poll at their own
+    // rate instead of handling progress() for every file
+    ProgressChannel *progressChannel() const;
+
+    // Stops the running batch; safe to call from any thread. Converters in
+    // flight are killed, queued files are skipped and the batch ends with
+    // canceled() instead of finished().
+    void cancel();
+
+    // Holds the running batch; safe to call from any thread. Queued files
+    // wait and running conversions finish; converters still running after
+    // ten seconds are killed and their files start over after resume().
+    // paused() is emitted once nothing runs any more.
+    void pause();
+    void resume();
+    bool isPaused() const;
+
+    // Blocks until a pause has drained, at most msecs; false on timeout
+    bool waitForDrained(int msecs);
+
+    // Converts one document outside any batch and blocks until it is done;
+    // the direction follows the input's suffix, as in a batch. Safe to call
+    // from several threads at once, but not while a batch runs. Calls that
+    // run side by side need different slots, which pick the LibreOffice
+    // profile and staging directory. DocumentConverter is built on these.
+    bool convertFile(const QString &inputPath, const QString &outputPath, int slot = 0);
+
+    // The same for a document in memory: the native converters read and
+    // write the buffers directly, and only documents that need LibreOffice
+    // or poppler go through a private temporary directory
+    bool convertData(const QByteArray &input, const QString &suffix, QByteArray *output, int slot = 0);
 
 public slots:
     void convertDocToPdf(const QString &directory);
     void convertPdfToDocx(const QString &directory);
 
+    // Converts files as they are written into directory until stopped
+    void startWatching(const QString &directory, DocPdf::Direction direction);
+    void stopWatching();
+
+    // Converts files from a spool directory shared with other docpdf
+    // processes, possibly on other hosts, until stopped; each file is
+    // claimed through a lease, so it is converted by one process only
+    void startSpool(const QString &directory, DocPdf::Direction direction);
+    void stopSpool();
+
 signals:
     void progress(int current, int total, const QString &filename);
-    void finished(int converted, int total, const QString &type);
+    void finished(int converted, int total, const QString &type, int cached);
     void error(const QString &errorMessage);
+    void canceled(int converted, int total);
+    void paused();
+    void resumed();
+    // Per-stage and per-file timings of the batch that just finished
+    void metricsReady(const QJsonObject &report);
+
+private slots:
+    void convertWatchedFiles(const QStringList &files);
+    void runSpoolRound();
 
 private:
-    QStringList findDocFiles(const QString &directory);
-    QStringList findPdfFiles(const QString &directory);
-    bool convertSingleDocToPdf(const QString &inputPath, const QString &outputPath);
-    bool convertSinglePdfToDocx(const QString &inputPath, const QString &outputPath);
-    QString extractTextFromPdf(const QString &pdfPath);
-    bool createDocxFromText(const QString &text, const QString &outputPath);
+    // A placeholder stands in for a document no converter could read; it
+    // counts as done but is never cached, so the next run tries again
+    enum ConversionResult {
+        ConversionFailed,
+        Converted,
+        PlaceholderWritten
+    };
+
+    void convertDirectory(const QString &directory, Direction direction);
+    void runBatch(Direction direction, const QStringList &files, FileScanner *scanner);
+    static QStringList nameFilters(Direction direction);
+    // Name filters plus the include and exclude patterns, shared by the
+    // directory scan and watch mode
+    PathFilter inputFilter(Direction direction) const;
+    ConversionResult convertSingleDocToPdf(const QString &inputPath, const QString &outputPath, int workerIndex = 0);
+    bool convertDocBatch(OfficeBatchConverter::Queue *queue, QList<OfficeBatchConverter::Job> *batch,
+                         const QByteArray &settings, int workerIndex);
+    bool convertNatively(const QString &inputPath, const QString &outputPath);
+    bool writePlaceholderPdf(const QString &outputPath);
+    ConversionResult convertSinglePdfToDocx(const QString &inputPath, const QString &outputPath);
+    bool streamPdfToDocx(const QString &pdfPath, const QString &outputPath, int *pageCount);
+    bool writeDocxFromPdf(const PdfDocument &document, DocxWriter *docx);
+    QByteArray extractTextFromPdf(const QString &pdfPath, int pageCount, bool *placeholder);
+    bool createDocxFromText(const QByteArray &text, const QString &outputPath);
+    QString outputPathFor(const QString &inputPath, const QString &suffix) const;
+    ConversionPool::Cost estimateCost(const QString &inputPath) const;
+    QString libreOfficeProfileUrl(int workerIndex) const;
+    QByteArray cacheSettings(const QByteArray &direction) const;
+    void beginTask();
+    void endTask();
+    bool convertResumably(const std::function<bool()> &convert);
+    void clearCancel();
+    int spareThreads() const;
+
+    int m_jobCount;
+    bool m_officeServerMode;
+    int m_maxJobsPerServer;
+    ProcessScheduler *m_processes;
+    OutputWriter *m_outputs;
+    PopplerTextExtractor *m_poppler;
+    std::atomic<bool> m_canceled;
+    OfficeServerPool *m_officeServers;
+    OfficeBatchConverter *m_officeBatcher;
+    int m_docxCompressionLevel;
+    bool m_nativeDocx;
+    bool m_cacheEnabled;
+    bool m_resumeEnabled;
+    ConversionCache *m_cache;
+    ConversionMetrics *m_metrics;
+    ProgressChannel *m_progress;
+    QString m_metricsDirectory;
+    DirectoryWatcher *m_watcher;
+    Direction m_watchDirection;
+    SpoolLeases *m_spool;
+    QTimer *m_spoolTimer;
+    Direction m_spoolDirection;
+    QString m_inputRoot;
+    QString m_outputDirectory;
+    bool m_recursive;
+    QStringList m_includePatterns;
+    QStringList m_excludePatterns;
+
+    // Pause state of the running batch
+    mutable QMutex m_pauseMutex;
+    QWaitCondition m_pauseChanged;
+    ConversionPool *m_pool;
+    bool m_paused;
+    int m_activeTasks;      // in a conversion, not waiting for resume()
+
+    // Tells this engine's LibreOffice profiles from those of other engines
+    // in the same process
+    int m_instance;
 };
 
 #endif // DOCPDF_H
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "documentconverter.h"
+#include "docpdf.h"
+#include "processscheduler.h"
+#include "systemresources.h"
+#include <QMutexLocker>
+#include <QPromise>
+#include <QThreadPool>
+#include <memory>
+
+DocumentConverter::DocumentConverter(QThreadPool *threadPool)
+    : m_engine(new DocPdf)
+    , m_threadPool(threadPool)
+    , m_ownsThreadPool(threadPool == nullptr)
+    , m_nextId(0)
+    , m_slotCount(0)
+{
+    if (m_ownsThreadPool) {
+        m_threadPool = new QThreadPool;
+        m_threadPool->setMaxThreadCount(SystemResources::cpuCount());
+    }
+}
+
+DocumentConverter::~DocumentConverter()
+{
+    cancelAll();
+    {
+        QMutexLocker locker(&m_mutex);
+        while (!m_unfinished.isEmpty()) {
+            m_allDone.wait(&m_mutex);
+        }
+    }
+    if (m_ownsThreadPool) {
+        delete m_threadPool;
+    }
+    delete m_engine;
+}
+
+DocPdf *DocumentConverter::engine() const
+{
+    return m_engine;
+}
+
+QFuture<DocumentConverter::Result> DocumentConverter::convertFile(const QString &inputPath,
+                                                                  const QString &outputPath, int priority)
+{
+    DocPdf *engine = m_engine;
+    return submit(priority, [engine, inputPath, outputPath](int slot, QByteArray *output) {
+        Q_UNUSED(output);
+        return engine->convertFile(inputPath, outputPath, slot);
+    });
+}
+
+QFuture<DocumentConverter::Result> DocumentConverter::convertData(const QByteArray &input, const QString &suffix,
+                                                                  int priority)
+{
+    DocPdf *engine = m_engine;
+    return submit(priority, [engine, input, suffix](int slot, QByteArray *output) {
+        return engine->convertData(input, suffix, output, slot);
+    });
+}
+
+void DocumentConverter::cancelAll()
+{
+    QMutexLocker locker(&m_mutex);
+    for (QFuture<Result> &future : m_unfinished) {
+        future.cancel();
+    }
+}
+
+QFuture<DocumentConverter::Result> DocumentConverter::submit(int priority, const Conversion &conversion)
+{
+    // QThreadPool needs a copyable task, QPromise is move-only
+    auto promise = std::make_shared<QPromise<Result>>();
+    QFuture<Result> future = promise->future();
+    promise->start();
+
+    quint64 id = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        id = m_nextId++;
+        m_unfinished.insert(id, future);
+    }
+
+    m_threadPool->start([this, promise, conversion, id]() {
+        // A conversion canceled while queued never starts
+        if (!promise->isCanceled()) {
+            int slot = acquireSlot();
+            Result result;
+            {
+                // Canceling the future kills this conversion's children only
+                ProcessScheduler::KillScope scope([promise]() { return promise->isCanceled(); });
+                result.ok = conversion(slot, &result.data);
+            }
+            releaseSlot(slot);
+            if (!promise->isCanceled()) {
+                promise->addResult(result);
+            }
+        }
+        promise->finish();
+
+        QMutexLocker locker(&m_mutex);
+        m_unfinished.remove(id);
+        m_allDone.wakeAll();
+    }, priority);
+    return future;
+}
+
+int DocumentConverter::acquireSlot()
+{
+    // Each running conversion has a slot of its own; there are never more
+    // slots than conversions that ran side by side
+    QMutexLocker locker(&m_mutex);
+    if (m_freeSlots.isEmpty()) {
+        return m_slotCount++;
+    }
+    return m_freeSlots.takeLast();
+}
+
+void DocumentConverter::releaseSlot(int slot)
+{
+    QMutexLocker locker(&m_mutex);
+    m_freeSlots << slot;
+}
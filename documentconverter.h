@@ -0,0 +1,74 @@
+#ifndef DOCUMENTCONVERTER_H
+#define DOCUMENTCONVERTER_H
+
+#include <QByteArray>
+#include <QFuture>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+#include <functional>
+
+class DocPdf;
+class QThreadPool;
+
+// Asynchronous per-document API of libdocpdf, for programs that convert
+// single documents on their own schedule instead of directory batches.
+//
+// Every call queues one conversion on a thread pool and returns a QFuture
+// right away. Documents may be passed as paths or as byte buffers; buffers
+// of text-only DOC and DOCX files and of PDFs the native extractor reads
+// are converted without touching the filesystem. Conversions with a higher
+// priority start first. Canceling a future drops its conversion if it has
+// not started; one already running has its external converters (soffice,
+// unoconv, pdftotext) killed within a fraction of a second, and its future
+// reports the cancel instead of a result. Native conversions run to the
+// end, so a file conversion may still write its output.
+//
+// The engine behind it is a DocPdf of its own; settings such as native
+// DOCX or the DOCX compression level are made there.
+class DocumentConverter
+{
+public:
+    struct Result {
+        bool ok = false;
+        QByteArray data;    // the output, for conversions of buffers
+    };
+
+    // Conversions run on threadPool, which must outlive the converter;
+    // without one the converter has its own, sized to the core count
+    explicit DocumentConverter(QThreadPool *threadPool = nullptr);
+    // Cancels what has not started and waits for the rest
+    ~DocumentConverter();
+
+    DocPdf *engine() const;
+
+    // DOC and DOCX become PDF, PDF becomes DOCX, as the input's suffix says
+    QFuture<Result> convertFile(const QString &inputPath, const QString &outputPath, int priority = 0);
+    // suffix names the input's format, such as "docx" or "pdf"
+    QFuture<Result> convertData(const QByteArray &input, const QString &suffix, int priority = 0);
+
+    // Cancels every conversion not finished yet
+    void cancelAll();
+
+private:
+    using Conversion = std::function<bool(int slot, QByteArray *output)>;
+
+    QFuture<Result> submit(int priority, const Conversion &conversion);
+    int acquireSlot();
+    void releaseSlot(int slot);
+
+    DocPdf *m_engine;
+    QThreadPool *m_threadPool;
+    bool m_ownsThreadPool;
+
+    QMutex m_mutex;
+    QWaitCondition m_allDone;
+    QHash<quint64, QFuture<Result>> m_unfinished;   // by submission
+    quint64 m_nextId;
+    QList<int> m_freeSlots;
+    int m_slotCount;
+};
+
+#endif // DOCUMENTCONVERTER_H
@@ -0,0 +1,425 @@
+#include "docxdocument.h"
+#include "zipreader.h"
+#include <QXmlStreamReader>
+
+namespace {
+
+const char16_t WordNamespace[] = u"http://schemas.openxmlformats.org/wordprocessingml/2006/main";
+
+// Local name of a WordprocessingML element; empty for other namespaces,
+// which no branch below accepts
+QStringView wordName(const QXmlStreamReader &xml)
+{
+    return xml.namespaceUri() == WordNamespace ? xml.name() : QStringView();
+}
+
+QStringView attribute(const QXmlStreamReader &xml, const char16_t *name)
+{
+    return xml.attributes().value(QStringView(WordNamespace), QStringView(name));
+}
+
+// Lengths are stored in twentieths of a point
+double twips(const QXmlStreamReader &xml, const char16_t *name, double fallback)
+{
+    QStringView value = attribute(xml, name);
+    return value.isEmpty() ? fallback : value.toDouble() / 20.0;
+}
+
+// Toggle properties are on unless w:val turns them off
+bool isOn(const QXmlStreamReader &xml)
+{
+    QStringView value = attribute(xml, u"val");
+    return !(value == u"0" || value == u"false" || value == u"off" || value == u"none");
+}
+
+void readSpacing(const QXmlStreamReader &xml, DocxDocument::Paragraph *paragraph)
+{
+    paragraph->spaceBefore = twips(xml, u"before", paragraph->spaceBefore);
+    paragraph->spaceAfter = twips(xml, u"after", paragraph->spaceAfter);
+
+    QStringView line = attribute(xml, u"line");
+    if (line.isEmpty()) {
+        return;
+    }
+    // Auto spacing is in 240ths of a line, the others in twips
+    QStringView rule = attribute(xml, u"lineRule");
+    if (rule.isEmpty() || rule == u"auto") {
+        paragraph->lineSpacing = line.toDouble() / 240.0;
+        paragraph->lineHeight = 0;
+        paragraph->atLeast = false;
+    } else {
+        paragraph->lineSpacing = 1.0;
+        paragraph->lineHeight = line.toDouble() / 20.0;
+        paragraph->atLeast = rule == u"atLeast";
+    }
+}
+
+} // namespace
+
+DocxDocument::DocxDocument()
+{
+    // Word's built-in default when styles.xml sets none
+    m_defaultParagraph.size = 10;
+}
+
+bool DocxDocument::load(const QString &fileName)
+{
+    ZipReader zip(fileName);
+    return read(zip);
+}
+
+bool DocxDocument::loadData(const QByteArray &data)
+{
+    ZipReader zip(data);
+    return read(zip);
+}
+
+QString DocxDocument::errorString() const
+{
+    return m_errorString;
+}
+
+bool DocxDocument::read(const ZipReader &zip)
+{
+    m_paragraphs.clear();
+    m_pageSetup = PageSetup();
+    m_defaultParagraph = Paragraph();
+    m_defaultParagraph.size = 10;
+    m_paragraphStyle.clear();
+    m_characterStyle.clear();
+
+    if (!zip.isOpen()) {
+        return fail(zip.errorString());
+    }
+
+    bool ok = false;
+    if (zip.contains("word/styles.xml")) {
+        QByteArray styles = zip.read("word/styles.xml", &ok);
+        if (!ok) {
+            return fail(zip.errorString());
+        }
+        if (!readStyles(styles)) {
+            return false;
+        }
+    }
+
+    QByteArray document = zip.read("word/document.xml", &ok);
+    if (!ok) {
+        return fail(zip.errorString());
+    }
+    return readDocument(document);
+}
+
+bool DocxDocument::readStyles(const QByteArray &data)
+{
+    // Size and spacing come from the document defaults, then from the
+    // default paragraph style
+    QXmlStreamReader xml(data);
+    bool inDefaults = false;
+    bool inDefaultStyle = false;
+    while (!xml.atEnd()) {
+        xml.readNext();
+        QStringView name = wordName(xml);
+        if (xml.isEndElement()) {
+            if (name == u"docDefaults") {
+                inDefaults = false;
+            } else if (name == u"style") {
+                inDefaultStyle = false;
+            }
+            continue;
+        }
+        if (!xml.isStartElement()) {
+            continue;
+        }
+
+        if (name == u"docDefaults") {
+            inDefaults = true;
+        } else if (name == u"style") {
+            if (attribute(xml, u"default") == u"1" || attribute(xml, u"default") == u"true") {
+                QStringView type = attribute(xml, u"type");
+                if (type == u"paragraph") {
+                    m_paragraphStyle = attribute(xml, u"styleId").toString();
+                    inDefaultStyle = true;
+                } else if (type == u"character") {
+                    m_characterStyle = attribute(xml, u"styleId").toString();
+                }
+            }
+        } else if (inDefaults || inDefaultStyle) {
+            if (name == u"sz") {
+                m_defaultParagraph.size = attribute(xml, u"val").toDouble() / 2.0;
+            } else if (name == u"spacing") {
+                readSpacing(xml, &m_defaultParagraph);
+            }
+        }
+    }
+
+    if (xml.hasError()) {
+        return fail("styles.xml: " + xml.errorString());
+    }
+    if (m_defaultParagraph.size <= 0) {
+        m_defaultParagraph.size = 10;
+    }
+    return true;
+}
+
+bool DocxDocument::readDocument(const QByteArray &data)
+{
+    QXmlStreamReader xml(data);
+    if (!xml.readNextStartElement() || wordName(xml) != u"document") {
+        return fail("Not a WordprocessingML document");
+    }
+
+    while (xml.readNextStartElement()) {
+        if (wordName(xml) != u"body") {
+            return unsupported(xml);
+        }
+        if (!readBody(xml)) {
+            return false;
+        }
+    }
+
+    if (xml.hasError()) {
+        return fail("document.xml: " + xml.errorString());
+    }
+    return true;
+}
+
+bool DocxDocument::readBody(QXmlStreamReader &xml)
+{
+    while (xml.readNextStartElement()) {
+        QStringView name = wordName(xml);
+        if (name == u"p") {
+            if (!readParagraph(xml)) {
+                return false;
+            }
+        } else if (name == u"sectPr") {
+            if (!readSection(xml)) {
+                return false;
+            }
+        } else if (name == u"bookmarkStart" || name == u"bookmarkEnd" || name == u"proofErr") {
+            xml.skipCurrentElement();
+        } else {
+            return unsupported(xml);
+        }
+    }
+    return true;
+}
+
+bool DocxDocument::readParagraph(QXmlStreamReader &xml)
+{
+    Paragraph paragraph = m_defaultParagraph;
+
+    while (xml.readNextStartElement()) {
+        QStringView name = wordName(xml);
+        if (name == u"pPr") {
+            if (!readParagraphProperties(xml, &paragraph)) {
+                return false;
+            }
+        } else if (name == u"r") {
+            if (!readRun(xml, &paragraph)) {
+                return false;
+            }
+        } else if (name == u"hyperlink") {
+            // The link itself is dropped; its text is kept
+            while (xml.readNextStartElement()) {
+                if (wordName(xml) == u"r") {
+                    if (!readRun(xml, &paragraph)) {
+                        return false;
+                    }
+                } else if (wordName(xml) == u"proofErr") {
+                    xml.skipCurrentElement();
+                } else {
+                    return unsupported(xml);
+                }
+            }
+        } else if (name == u"bookmarkStart" || name == u"bookmarkEnd" || name == u"proofErr") {
+            xml.skipCurrentElement();
+        } else {
+            return unsupported(xml);
+        }
+    }
+
+    m_paragraphs << paragraph;
+    return true;
+}
+
+bool DocxDocument::readParagraphProperties(QXmlStreamReader &xml, Paragraph *paragraph)
+{
+    while (xml.readNextStartElement()) {
+        QStringView name = wordName(xml);
+        if (name == u"pStyle") {
+            if (attribute(xml, u"val") != m_paragraphStyle) {
+                return fail("Paragraph style " + attribute(xml, u"val").toString());
+            }
+            xml.skipCurrentElement();
+        } else if (name == u"jc") {
+            QStringView value = attribute(xml, u"val");
+            if (value == u"center") {
+                paragraph->alignment = Center;
+            } else if (value == u"right" || value == u"end") {
+                paragraph->alignment = Right;
+            } else if (value == u"left" || value == u"start" || value == u"both") {
+                // Justified text is set ragged-right
+                paragraph->alignment = Left;
+            } else {
+                return unsupported(xml);
+            }
+            xml.skipCurrentElement();
+        } else if (name == u"spacing") {
+            readSpacing(xml, paragraph);
+            xml.skipCurrentElement();
+        } else if (name == u"ind") {
+            paragraph->leftIndent = twips(xml, u"left", twips(xml, u"start", paragraph->leftIndent));
+            paragraph->rightIndent = twips(xml, u"right", twips(xml, u"end", paragraph->rightIndent));
+            paragraph->firstLineIndent = twips(xml, u"firstLine", paragraph->firstLineIndent);
+            paragraph->firstLineIndent = -twips(xml, u"hanging", -paragraph->firstLineIndent);
+            xml.skipCurrentElement();
+        } else if (name == u"pageBreakBefore") {
+            paragraph->pageBreakBefore = isOn(xml);
+            xml.skipCurrentElement();
+        } else if (name == u"rPr") {
+            // The paragraph mark sets the height of an empty paragraph
+            Run mark;
+            mark.size = paragraph->size;
+            if (!readRunProperties(xml, &mark)) {
+                return false;
+            }
+            paragraph->size = mark.size;
+        } else if (name == u"keepNext" || name == u"keepLines" || name == u"widowControl"
+                   || name == u"contextualSpacing" || name == u"snapToGrid" || name == u"suppressAutoHyphens"
+                   || name == u"autoSpaceDE" || name == u"autoSpaceDN" || name == u"adjustRightInd"
+                   || name == u"wordWrap" || name == u"overflowPunct" || name == u"textAlignment") {
+            xml.skipCurrentElement();
+        } else {
+            return unsupported(xml);
+        }
+    }
+    return true;
+}
+
+bool DocxDocument::readRun(QXmlStreamReader &xml, Paragraph *paragraph)
+{
+    Run run;
+    run.size = m_defaultParagraph.size;
+
+    while (xml.readNextStartElement()) {
+        QStringView name = wordName(xml);
+        if (name == u"rPr") {
+            if (!readRunProperties(xml, &run)) {
+                return false;
+            }
+        } else if (name == u"t") {
+            run.text += xml.readElementText();
+        } else if (name == u"tab") {
+            run.text += '\t';
+            xml.skipCurrentElement();
+        } else if (name == u"br") {
+            QStringView type = attribute(xml, u"type");
+            if (type == u"page") {
+                run.text += '\f';
+            } else if (type.isEmpty() || type == u"textWrapping") {
+                run.text += '\n';
+            } else {
+                return unsupported(xml);
+            }
+            xml.skipCurrentElement();
+        } else if (name == u"cr") {
+            run.text += '\n';
+            xml.skipCurrentElement();
+        } else if (name == u"noBreakHyphen") {
+            run.text += '-';
+            xml.skipCurrentElement();
+        } else if (name == u"softHyphen" || name == u"lastRenderedPageBreak") {
+            xml.skipCurrentElement();
+        } else {
+            return unsupported(xml);
+        }
+    }
+
+    if (!run.text.isEmpty()) {
+        paragraph->runs << run;
+    }
+    return true;
+}
+
+bool DocxDocument::readRunProperties(QXmlStreamReader &xml, Run *run)
+{
+    while (xml.readNextStartElement()) {
+        QStringView name = wordName(xml);
+        if (name == u"rStyle") {
+            if (attribute(xml, u"val") != m_characterStyle) {
+                return fail("Character style " + attribute(xml, u"val").toString());
+            }
+        } else if (name == u"b") {
+            run->bold = isOn(xml);
+        } else if (name == u"i") {
+            run->italic = isOn(xml);
+        } else if (name == u"sz") {
+            run->size = attribute(xml, u"val").toDouble() / 2.0;
+            if (run->size <= 0) {
+                return unsupported(xml);
+            }
+        } else if (name == u"u" || name == u"strike" || name == u"dstrike" || name == u"caps"
+                   || name == u"smallCaps" || name == u"vanish" || name == u"highlight"
+                   || name == u"outline" || name == u"shadow" || name == u"emboss" || name == u"imprint") {
+            // Only accepted when explicitly off
+            if (isOn(xml)) {
+                return unsupported(xml);
+            }
+        } else if (name == u"vertAlign") {
+            if (attribute(xml, u"val") != u"baseline") {
+                return unsupported(xml);
+            }
+        } else if (name != u"bCs" && name != u"iCs" && name != u"szCs" && name != u"rFonts"
+                   && name != u"lang" && name != u"noProof" && name != u"color" && name != u"kern"
+                   && name != u"webHidden") {
+            return unsupported(xml);
+        }
+        xml.skipCurrentElement();
+    }
+    return true;
+}
+
+bool DocxDocument::readSection(QXmlStreamReader &xml)
+{
+    while (xml.readNextStartElement()) {
+        QStringView name = wordName(xml);
+        if (name == u"pgSz") {
+            m_pageSetup.width = twips(xml, u"w", m_pageSetup.width);
+            m_pageSetup.height = twips(xml, u"h", m_pageSetup.height);
+        } else if (name == u"pgMar") {
+            // A negative top or bottom margin means "fixed"; the size counts
+            m_pageSetup.marginTop = qAbs(twips(xml, u"top", m_pageSetup.marginTop));
+            m_pageSetup.marginBottom = qAbs(twips(xml, u"bottom", m_pageSetup.marginBottom));
+            m_pageSetup.marginLeft = twips(xml, u"left", m_pageSetup.marginLeft);
+            m_pageSetup.marginRight = twips(xml, u"right", m_pageSetup.marginRight);
+        } else if (name == u"cols") {
+            if (attribute(xml, u"num").toInt() > 1) {
+                return unsupported(xml);
+            }
+        } else if (name != u"docGrid" && name != u"titlePg" && name != u"pgNumType"
+                   && name != u"type" && name != u"formProt") {
+            // headerReference and footerReference end up here
+            return unsupported(xml);
+        }
+        xml.skipCurrentElement();
+    }
+
+    // Leave room for at least a few words per line and a line per page
+    if (m_pageSetup.width - m_pageSetup.marginLeft - m_pageSetup.marginRight < 72
+        || m_pageSetup.height - m_pageSetup.marginTop - m_pageSetup.marginBottom < 72) {
+        return fail("Page too small for its margins");
+    }
+    return true;
+}
+
+bool DocxDocument::unsupported(QXmlStreamReader &xml)
+{
+    return fail("Unsupported element " + xml.qualifiedName().toString());
+}
+
+bool DocxDocument::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
@@ -0,0 +1,91 @@
+#ifndef DOCXDOCUMENT_H
+#define DOCXDOCUMENT_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class QXmlStreamReader;
+class ZipReader;
+
+// Reads the body of a WordprocessingML package into paragraphs of
+// formatted runs, for documents simple enough to lay out without an
+// office suite: paragraphs with alignment, indents and spacing, and runs
+// with bold, italic and size changes.
+//
+// Anything else that would change the rendering (tables, images, fields,
+// lists, headers and footers, named styles, columns, tracked changes...)
+// makes load() fail with the reason in errorString(), so callers can send
+// the file to LibreOffice instead of producing a lossy PDF.
+class DocxDocument
+{
+public:
+    enum Alignment {
+        Left,
+        Center,
+        Right
+    };
+
+    struct Run {
+        QString text;               // '\t' tab, '\n' line break, '\f' page break
+        bool bold = false;
+        bool italic = false;
+        double size = 0;            // points
+    };
+
+    // Lengths are in points
+    struct Paragraph {
+        QList<Run> runs;
+        Alignment alignment = Left;
+        double size = 0;            // of the paragraph mark, sizes empty lines
+        double spaceBefore = 0;
+        double spaceAfter = 0;
+        double lineSpacing = 1.0;   // multiple of single spacing...
+        double lineHeight = 0;      // ...unless this exact height is set
+        bool atLeast = false;       // lineHeight is a minimum
+        double leftIndent = 0;
+        double rightIndent = 0;
+        double firstLineIndent = 0; // negative for a hanging indent
+        bool pageBreakBefore = false;
+    };
+
+    struct PageSetup {
+        double width = 612;
+        double height = 792;
+        double marginTop = 72;
+        double marginBottom = 72;
+        double marginLeft = 72;
+        double marginRight = 72;
+    };
+
+    DocxDocument();
+
+    bool load(const QString &fileName);
+    bool loadData(const QByteArray &data);
+    QString errorString() const;
+
+    const QList<Paragraph> &paragraphs() const { return m_paragraphs; }
+    const PageSetup &pageSetup() const { return m_pageSetup; }
+
+private:
+    bool read(const ZipReader &zip);
+    bool readStyles(const QByteArray &xml);
+    bool readDocument(const QByteArray &xml);
+    bool readBody(QXmlStreamReader &xml);
+    bool readParagraph(QXmlStreamReader &xml);
+    bool readParagraphProperties(QXmlStreamReader &xml, Paragraph *paragraph);
+    bool readRun(QXmlStreamReader &xml, Paragraph *paragraph);
+    bool readRunProperties(QXmlStreamReader &xml, Run *run);
+    bool readSection(QXmlStreamReader &xml);
+    bool unsupported(QXmlStreamReader &xml);
+    bool fail(const QString &message);
+
+    QList<Paragraph> m_paragraphs;
+    PageSetup m_pageSetup;
+    Paragraph m_defaultParagraph;
+    QString m_paragraphStyle;       // ids of the default styles, which
+    QString m_characterStyle;       // paragraphs may name explicitly
+    QString m_errorString;
+};
+
+#endif // DOCXDOCUMENT_H
@@ -0,0 +1,315 @@
+#include "docxpdfconverter.h"
+#include "compoundfilereader.h"
+#include "conversionmetrics.h"
+#include "docdocument.h"
+#include <QFileInfo>
+#include <QtMath>
+
+namespace {
+
+// Word's default stops every half inch
+const double TabStop = 36;
+
+// Single spacing in ems, and how far the baseline sits above the bottom
+// of the line
+const double SingleLine = 1.15;
+const double Descent = 0.25;
+
+PdfWriter::Font fontFor(const DocxDocument::Run &run)
+{
+    if (run.bold) {
+        return run.italic ? PdfWriter::BoldItalic : PdfWriter::Bold;
+    }
+    return run.italic ? PdfWriter::Italic : PdfWriter::Regular;
+}
+
+} // namespace
+
+DocxPdfConverter::DocxPdfConverter()
+    : m_writer(nullptr)
+    , m_y(0)
+    , m_pageOpen(false)
+    , m_pageHasText(false)
+{
+}
+
+bool DocxPdfConverter::convert(const QString &inputPath, const QString &outputPath)
+{
+    // Both readers produce the same paragraphs
+    bool legacy = QFileInfo(inputPath).suffix().compare("doc", Qt::CaseInsensitive) == 0;
+    DocxDocument document;
+    DocDocument legacyDocument;
+    {
+        ConversionMetrics::StageTimer timer(ConversionMetrics::TextExtraction);
+        if (legacy && !legacyDocument.load(inputPath)) {
+            return fail(legacyDocument.errorString());
+        }
+        if (!legacy && !document.load(inputPath)) {
+            return fail(document.errorString());
+        }
+    }
+    const QList<DocxDocument::Paragraph> &paragraphs = legacy ? legacyDocument.paragraphs() : document.paragraphs();
+
+    // Encode everything first so an unsupported character never leaves a
+    // partial PDF behind
+    QList<QList<Item>> items;
+    if (!itemizeDocument(paragraphs, &items)) {
+        return false;
+    }
+    PdfWriter writer(outputPath);
+    return write(paragraphs, legacy ? legacyDocument.pageSetup() : document.pageSetup(), items, &writer);
+}
+
+bool DocxPdfConverter::convert(const QByteArray &input, QIODevice *output)
+{
+    // Buffers have no name; Word 97-2003 files are compound files
+    bool legacy = CompoundFileReader::isCompoundFile(input);
+    DocxDocument document;
+    DocDocument legacyDocument;
+    {
+        ConversionMetrics::StageTimer timer(ConversionMetrics::TextExtraction);
+        if (legacy && !legacyDocument.loadData(input)) {
+            return fail(legacyDocument.errorString());
+        }
+        if (!legacy && !document.loadData(input)) {
+            return fail(document.errorString());
+        }
+    }
+    const QList<DocxDocument::Paragraph> &paragraphs = legacy ? legacyDocument.paragraphs() : document.paragraphs();
+
+    QList<QList<Item>> items;
+    if (!itemizeDocument(paragraphs, &items)) {
+        return false;
+    }
+    PdfWriter writer(output);
+    return write(paragraphs, legacy ? legacyDocument.pageSetup() : document.pageSetup(), items, &writer);
+}
+
+QString DocxPdfConverter::errorString() const
+{
+    return m_errorString;
+}
+
+bool DocxPdfConverter::itemizeDocument(const QList<DocxDocument::Paragraph> &paragraphs, QList<QList<Item>> *items)
+{
+    items->resize(paragraphs.size());
+    for (int i = 0; i < paragraphs.size(); ++i) {
+        if (!itemize(paragraphs.at(i), &(*items)[i])) {
+            return fail("Text outside WinAnsiEncoding");
+        }
+    }
+    return true;
+}
+
+bool DocxPdfConverter::write(const QList<DocxDocument::Paragraph> &paragraphs, const DocxDocument::PageSetup &pageSetup,
+                             const QList<QList<Item>> &items, PdfWriter *writer)
+{
+    if (!writer->isOpen()) {
+        return fail(writer->errorString());
+    }
+    m_writer = writer;
+    m_page = pageSetup;
+    m_pageOpen = false;
+    m_pageHasText = false;
+
+    for (int i = 0; i < paragraphs.size(); ++i) {
+        layoutParagraph(paragraphs.at(i), items.at(i));
+    }
+    // An empty document still gets its blank page
+    if (!m_pageOpen) {
+        newPage();
+    }
+
+    m_writer = nullptr;
+    if (!writer->close()) {
+        return fail(writer->errorString());
+    }
+    return true;
+}
+
+bool DocxPdfConverter::itemize(const DocxDocument::Paragraph &paragraph, QList<Item> *items)
+{
+    for (const DocxDocument::Run &run : paragraph.runs) {
+        PdfWriter::Font font = fontFor(run);
+        qsizetype start = 0;
+        for (qsizetype i = 0; i <= run.text.size(); ++i) {
+            bool atEnd = i == run.text.size();
+            QChar ch = atEnd ? QChar() : run.text.at(i);
+            if (!atEnd && ch != ' ' && ch != '\t' && ch != '\n' && ch != '\f') {
+                continue;
+            }
+
+            if (i > start) {
+                Item word = { Word, font, run.size, QByteArray(), 0 };
+                if (!PdfWriter::toWinAnsi(run.text.mid(start, i - start), &word.text)) {
+                    return false;
+                }
+                word.width = PdfWriter::textWidth(font, run.size, word.text);
+                items->append(word);
+            }
+            start = i + 1;
+
+            if (ch == ' ') {
+                items->append({ Space, font, run.size, " ", PdfWriter::textWidth(font, run.size, " ") });
+            } else if (ch == '\t') {
+                items->append({ Tab, font, run.size, QByteArray(), 0 });
+            } else if (ch == '\n') {
+                items->append({ LineBreak, font, run.size, QByteArray(), 0 });
+            } else if (ch == '\f') {
+                items->append({ PageBreak, font, run.size, QByteArray(), 0 });
+            }
+        }
+    }
+    return true;
+}
+
+void DocxPdfConverter::layoutParagraph(const DocxDocument::Paragraph &paragraph, const QList<Item> &items)
+{
+    if (paragraph.pageBreakBefore && m_pageHasText) {
+        newPage();
+    }
+    // Spacing before is dropped at the top of a page
+    if (m_pageHasText) {
+        m_y -= paragraph.spaceBefore;
+    }
+
+    Line line;
+    bool firstLine = true;
+    for (int i = 0; i < items.size(); ++i) {
+        const Item &item = items.at(i);
+        switch (item.kind) {
+        case Space:
+            // Words wrap, spaces never do; they trail the previous line
+            append(&line, item, item.text, item.width);
+            break;
+        case Tab: {
+            double stop = (qFloor(line.end / TabStop) + 1) * TabStop;
+            if (stop > lineWidth(paragraph, firstLine) && line.end > 0) {
+                finishLine(paragraph, &line, firstLine);
+                firstLine = false;
+                stop = TabStop;
+            }
+            line.end = stop;
+            line.width = stop;
+            line.maxSize = qMax(line.maxSize, item.size);
+            line.afterTab = true;
+            break;
+        }
+        case LineBreak:
+        case PageBreak:
+            if (item.kind == LineBreak || line.end > 0) {
+                finishLine(paragraph, &line, firstLine);
+                firstLine = false;
+            }
+            if (item.kind == PageBreak) {
+                newPage();
+            }
+            break;
+        case Word: {
+            // Adjacent words with different formatting break as one
+            int end = i;
+            double width = 0;
+            while (end < items.size() && items.at(end).kind == Word) {
+                width += items.at(end++).width;
+            }
+            if (line.end > 0 && line.end + width > lineWidth(paragraph, firstLine)) {
+                finishLine(paragraph, &line, firstLine);
+                firstLine = false;
+            }
+
+            bool fits = width <= lineWidth(paragraph, firstLine);
+            for (int k = i; k < end; ++k) {
+                const Item &part = items.at(k);
+                if (fits) {
+                    append(&line, part, part.text, part.width);
+                    continue;
+                }
+                // Wider than a whole line: break between characters
+                for (char c : part.text) {
+                    QByteArray character(1, c);
+                    double characterWidth = PdfWriter::textWidth(part.font, part.size, character);
+                    if (line.end > 0 && line.end + characterWidth > lineWidth(paragraph, firstLine)) {
+                        finishLine(paragraph, &line, firstLine);
+                        firstLine = false;
+                    }
+                    append(&line, part, character, characterWidth);
+                }
+            }
+            i = end - 1;
+            break;
+        }
+        }
+    }
+
+    finishLine(paragraph, &line, firstLine);
+    m_y -= paragraph.spaceAfter;
+}
+
+double DocxPdfConverter::lineWidth(const DocxDocument::Paragraph &paragraph, bool firstLine) const
+{
+    return m_page.width - m_page.marginLeft - m_page.marginRight - paragraph.leftIndent
+           - paragraph.rightIndent - (firstLine ? paragraph.firstLineIndent : 0);
+}
+
+void DocxPdfConverter::append(Line *line, const Item &item, const QByteArray &text, double width)
+{
+    // Runs of one font are drawn with a single operator
+    if (!line->afterTab && !line->fragments.isEmpty() && line->fragments.last().font == item.font
+        && line->fragments.last().size == item.size) {
+        line->fragments.last().text += text;
+    } else {
+        line->fragments << Fragment{ item.font, item.size, line->end, text };
+    }
+    line->afterTab = false;
+    line->end += width;
+    if (item.kind != Space) {
+        line->width = line->end;
+    }
+    line->maxSize = qMax(line->maxSize, item.size);
+}
+
+void DocxPdfConverter::finishLine(const DocxDocument::Paragraph &paragraph, Line *line, bool firstLine)
+{
+    double size = line->maxSize > 0 ? line->maxSize : paragraph.size;
+    double height = size * SingleLine * paragraph.lineSpacing;
+    if (paragraph.lineHeight > 0) {
+        height = paragraph.atLeast ? qMax(height, paragraph.lineHeight) : paragraph.lineHeight;
+    }
+
+    if (m_pageOpen && m_pageHasText && m_y - height < m_page.marginBottom) {
+        newPage();
+    }
+    if (!m_pageOpen) {
+        newPage();
+    }
+
+    double x = m_page.marginLeft + paragraph.leftIndent + (firstLine ? paragraph.firstLineIndent : 0);
+    double slack = qMax(0.0, lineWidth(paragraph, firstLine) - line->width);
+    if (paragraph.alignment == DocxDocument::Center) {
+        x += slack / 2;
+    } else if (paragraph.alignment == DocxDocument::Right) {
+        x += slack;
+    }
+
+    double baseline = m_y - height + Descent * size;
+    for (const Fragment &fragment : line->fragments) {
+        m_writer->drawText(fragment.font, fragment.size, x + fragment.x, baseline, fragment.text);
+    }
+    m_y -= height;
+    m_pageHasText = true;
+    *line = Line();
+}
+
+void DocxPdfConverter::newPage()
+{
+    m_writer->beginPage(m_page.width, m_page.height);
+    m_pageOpen = true;
+    m_pageHasText = false;
+    m_y = m_page.height - m_page.marginTop;
+}
+
+bool DocxPdfConverter::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
@@ -0,0 +1,83 @@
+#ifndef DOCXPDFCONVERTER_H
+#define DOCXPDFCONVERTER_H
+
+#include "docxdocument.h"
+#include "pdfwriter.h"
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+// Converts text-only DOCX files, and Word 97-2003 DOC files DocDocument
+// reads, to PDF in-process, which is orders of magnitude cheaper than
+// starting LibreOffice for each of them.
+//
+// Paragraphs are laid out with greedy word wrapping in the standard-14
+// Helvetica faces. convert() fails before the output is created when the
+// document uses anything the readers do not accept or text outside
+// WinAnsiEncoding; callers then fall back to LibreOffice.
+class DocxPdfConverter
+{
+public:
+    DocxPdfConverter();
+
+    // A ".doc" suffix selects the Word 97-2003 reader
+    bool convert(const QString &inputPath, const QString &outputPath);
+    // The same for a document in memory, written to a device the caller
+    // opened; on failure the device may hold a partial PDF
+    bool convert(const QByteArray &input, QIODevice *output);
+    QString errorString() const;
+
+private:
+    enum ItemKind {
+        Word,
+        Space,
+        Tab,
+        LineBreak,
+        PageBreak
+    };
+
+    // A word, space or break of one paragraph, encoded and measured
+    struct Item {
+        ItemKind kind;
+        PdfWriter::Font font;
+        double size;
+        QByteArray text;
+        double width;
+    };
+
+    // Text drawn with one font, x relative to the start of its line
+    struct Fragment {
+        PdfWriter::Font font;
+        double size;
+        double x;
+        QByteArray text;
+    };
+
+    struct Line {
+        QList<Fragment> fragments;
+        double end = 0;         // pen position
+        double width = 0;       // up to the last non-space
+        double maxSize = 0;
+        bool afterTab = false;  // the next text starts a new fragment
+    };
+
+    bool itemizeDocument(const QList<DocxDocument::Paragraph> &paragraphs, QList<QList<Item>> *items);
+    bool write(const QList<DocxDocument::Paragraph> &paragraphs, const DocxDocument::PageSetup &pageSetup,
+               const QList<QList<Item>> &items, PdfWriter *writer);
+    static bool itemize(const DocxDocument::Paragraph &paragraph, QList<Item> *items);
+    void layoutParagraph(const DocxDocument::Paragraph &paragraph, const QList<Item> &items);
+    double lineWidth(const DocxDocument::Paragraph &paragraph, bool firstLine) const;
+    static void append(Line *line, const Item &item, const QByteArray &text, double width);
+    void finishLine(const DocxDocument::Paragraph &paragraph, Line *line, bool firstLine);
+    void newPage();
+    bool fail(const QString &message);
+
+    PdfWriter *m_writer;
+    DocxDocument::PageSetup m_page;
+    double m_y;                 // top of the next line
+    bool m_pageOpen;
+    bool m_pageHasText;
+    QString m_errorString;
+};
+
+#endif // DOCXPDFCONVERTER_H
@@ -0,0 +1,252 @@
+#include "docxwriter.h"
+#include "bytescan.h"
+#include "conversionmetrics.h"
+#include <QFile>
+
+namespace {
+
+const int FlushSize = 192 * 1024;
+
+const char ContentTypes[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
+    "  <Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
+    "  <Default Extension=\"xml\" ContentType=\"application/xml\"/>\n"
+    "  <Override PartName=\"/word/document.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.document.main+xml\"/>\n"
+    "</Types>\n";
+
+const char Relationships[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+    "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n"
+    "  <Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"word/document.xml\"/>\n"
+    "</Relationships>\n";
+
+const char ParagraphOpen[] =
+    "    <w:p>\n"
+    "      <w:r>\n"
+    "        <w:t>";
+const char ParagraphClose[] =
+    "</w:t>\n"
+    "      </w:r>\n"
+    "    </w:p>\n";
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Copies UTF-8 text, replacing every byte that does not start a
+// well-formed sequence of an XML character with U+FFFD: stray continuation
+// bytes, truncated or overlong sequences, surrogates, code points past
+// U+10FFFF and the noncharacters U+FFFE and U+FFFF. Extractors pass on
+// whatever bytes the PDF held, and Word rejects a package with any of them.
+void appendValidUtf8(QByteArray *buffer, const char *data, qint64 size)
+{
+    static const char Replacement[] = "\xEF\xBF\xBD";
+    qint64 i = 0;
+    while (i < size) {
+        qint64 ascii = ByteScan::findNonAscii(data, size, i);
+        buffer->append(data + i, ascii - i);
+        i = ascii;
+        if (i == size) {
+            break;
+        }
+
+        const uchar *bytes = reinterpret_cast<const uchar *>(data + i);
+        uchar lead = bytes[0];
+        int length = lead >= 0xF5 ? 0 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC2 ? 2 : 0;
+        char32_t code = lead & (0x7F >> length);
+        bool valid = length > 0 && i + length <= size;
+        for (int k = 1; valid && k < length; ++k) {
+            valid = (bytes[k] & 0xC0) == 0x80;
+            code = (code << 6) | (bytes[k] & 0x3F);
+        }
+        valid = valid && !(length == 3 && code < 0x800) && !(length == 4 && (code < 0x10000 || code > 0x10FFFF))
+                && !(code >= 0xD800 && code <= 0xDFFF) && code != 0xFFFE && code != 0xFFFF;
+        if (valid) {
+            buffer->append(data + i, length);
+            i += length;
+        } else {
+            buffer->append(Replacement, 3);
+            i++;
+        }
+    }
+}
+
+} // namespace
+
+DocxWriter::DocxWriter(const QString &fileName)
+    : m_zip(fileName)
+    , m_fileName(fileName)
+    , m_started(false)
+    , m_closed(false)
+    , m_success(m_zip.isOpen())
+{
+}
+
+DocxWriter::DocxWriter(QIODevice *device)
+    : m_zip(device)
+    , m_started(false)
+    , m_closed(false)
+    , m_success(m_zip.isOpen())
+{
+}
+
+DocxWriter::~DocxWriter()
+{
+    if (!m_closed) {
+        close();
+    }
+}
+
+bool DocxWriter::isOpen() const
+{
+    return m_success && !m_closed;
+}
+
+QString DocxWriter::errorString() const
+{
+    return m_zip.errorString();
+}
+
+void DocxWriter::setCompressionLevel(int level)
+{
+    if (level == 0) {
+        m_zip.setCompression(ZipWriter::Stored);
+    } else {
+        m_zip.setCompressionLevel(level);
+    }
+}
+
+void DocxWriter::setThreadCount(int threadCount)
+{
+    m_zip.setThreadCount(threadCount);
+}
+
+bool DocxWriter::addText(const char *data, qint64 size)
+{
+    ConversionMetrics::StageTimer timer(ConversionMetrics::XmlGeneration);
+    if (!m_started) {
+        m_success = m_success && start();
+    }
+
+    // One scan per line finds both the line end and the bytes to escape;
+    // runs between them are copied straight into the buffer. Trailing
+    // whitespace is trimmed from the output, where it is still raw.
+    qint64 position = 0;
+    while (m_success && position < size) {
+        while (position < size && isSpace(data[position])) {
+            position++;
+        }
+
+        const qsizetype paragraphStart = m_buffer.size();
+        m_buffer.append(ParagraphOpen, sizeof(ParagraphOpen) - 1);
+        const qsizetype textStart = m_buffer.size();
+
+        while (position < size) {
+            qint64 special = ByteScan::findXmlSpecial(data, size, position);
+            appendValidUtf8(&m_buffer, data + position, special - position);
+            position = special + 1;
+            if (special == size) {
+                break;
+            }
+
+            char c = data[special];
+            if (c == '\n') {
+                break;
+            }
+            switch (c) {
+            case '&': m_buffer.append("&amp;", 5); break;
+            case '<': m_buffer.append("&lt;", 4); break;
+            case '>': m_buffer.append("&gt;", 4); break;
+            case '"': m_buffer.append("&quot;", 6); break;
+            case '\'': m_buffer.append("&apos;", 6); break;
+            // Other control bytes are not allowed in XML 1.0
+            case '\t': case '\r': m_buffer.append(c); break;
+            default: break;
+            }
+        }
+
+        qsizetype end = m_buffer.size();
+        while (end > textStart && isSpace(m_buffer.at(end - 1))) {
+            end--;
+        }
+        if (end > textStart) {
+            m_buffer.resize(end);
+            m_buffer.append(ParagraphClose, sizeof(ParagraphClose) - 1);
+        } else {
+            m_buffer.resize(paragraphStart);
+        }
+
+        if (m_buffer.size() >= FlushSize) {
+            m_success = flush();
+        }
+    }
+    return m_success;
+}
+
+bool DocxWriter::addText(const QByteArray &text)
+{
+    return addText(text.constData(), text.size());
+}
+
+bool DocxWriter::close()
+{
+    if (m_closed) {
+        return m_success;
+    }
+
+    ConversionMetrics::StageTimer timer(ConversionMetrics::XmlGeneration);
+    if (!m_started) {
+        m_success = m_success && start();
+    }
+
+    m_buffer += "  </w:body>\n";
+    m_buffer += "</w:document>\n";
+
+    m_success = m_success && flush() && m_zip.endEntry();
+    m_success = m_zip.close() && m_success;
+    m_closed = true;
+
+    if (!m_success && !m_fileName.isEmpty()) {
+        QFile::remove(m_fileName);
+    }
+    return m_success;
+}
+
+void DocxWriter::discard()
+{
+    if (!m_closed) {
+        m_zip.close();
+        m_closed = true;
+    }
+    m_success = false;
+    if (!m_fileName.isEmpty()) {
+        QFile::remove(m_fileName);
+    }
+}
+
+bool DocxWriter::start()
+{
+    m_started = true;
+
+    // word/document.xml stays open while text is added
+    if (!m_zip.addEntry("[Content_Types].xml", QByteArray::fromRawData(ContentTypes, sizeof(ContentTypes) - 1))
+        || !m_zip.addEntry("_rels/.rels", QByteArray::fromRawData(Relationships, sizeof(Relationships) - 1))
+        || !m_zip.beginEntry("word/document.xml")) {
+        return false;
+    }
+
+    m_buffer.reserve(FlushSize + 64 * 1024);
+    m_buffer += "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n";
+    m_buffer += "<w:document xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\">\n";
+    m_buffer += "  <w:body>\n";
+    return true;
+}
+
+bool DocxWriter::flush()
+{
+    bool ok = m_zip.write(m_buffer);
+    m_buffer.resize(0); // keeps the capacity
+    return ok;
+}
@@ -0,0 +1,55 @@
+#ifndef DOCXWRITER_H
+#define DOCXWRITER_H
+
+#include "zipwriter.h"
+#include <QByteArray>
+#include <QString>
+
+// Writes a plain-text DOCX package, one paragraph per non-empty line.
+//
+// The document part is streamed through ZipWriter as text is added, so a
+// caller can feed it page by page and memory stays bounded by the largest
+// page rather than the whole document.
+class DocxWriter
+{
+public:
+    explicit DocxWriter(const QString &fileName);
+    // Writes to a seekable device the caller opened at position 0
+    explicit DocxWriter(QIODevice *device);
+    ~DocxWriter();
+
+    bool isOpen() const;
+    QString errorString() const;
+
+    // Deflate level for the package parts; 0 stores them uncompressed.
+    // Must be set before the first addText().
+    void setCompressionLevel(int level);
+    // Threads that deflate the document part, as ZipWriter::setThreadCount()
+    void setThreadCount(int threadCount);
+
+    // Appends UTF-8 text; a chunk that does not end in '\n' still ends its
+    // last paragraph. Malformed sequences and characters XML does not
+    // allow become U+FFFD, so a chunk must not split a character.
+    bool addText(const char *data, qint64 size);
+    bool addText(const QByteArray &text);
+
+    // Finishes the package; the output file (not a caller's device) is
+    // removed on failure
+    bool close();
+
+    // Abandons the package and removes the output file
+    void discard();
+
+private:
+    bool start();
+    bool flush();
+
+    ZipWriter m_zip;
+    QString m_fileName;     // empty when writing to a device
+    QByteArray m_buffer;
+    bool m_started;
+    bool m_closed;
+    bool m_success;
+};
+
+#endif // DOCXWRITER_H
@@ -0,0 +1,283 @@
+#include "filescanner.h"
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+namespace {
+
+#ifdef Q_OS_LINUX
+// Layout returned by getdents64
+struct LinuxDirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+const int ListingBufferSize = 256 * 1024;
+#endif
+
+} // namespace
+
+// PathFilter
+
+void PathFilter::setNameFilters(const QStringList &patterns)
+{
+    m_nameFilters = compile(patterns);
+}
+
+void PathFilter::setIncludePatterns(const QStringList &patterns)
+{
+    m_includePatterns = compile(patterns);
+}
+
+void PathFilter::setExcludePatterns(const QStringList &patterns)
+{
+    m_excludePatterns = compile(patterns);
+}
+
+bool PathFilter::acceptsFile(const QString &name, const QString &relativePath) const
+{
+    if (!m_nameFilters.isEmpty() && !matchesAny(m_nameFilters, name, QString())) {
+        return false;
+    }
+    if (!m_includePatterns.isEmpty() && !matchesAny(m_includePatterns, name, relativePath)) {
+        return false;
+    }
+    return !matchesAny(m_excludePatterns, name, relativePath);
+}
+
+bool PathFilter::acceptsDirectory(const QString &name, const QString &relativePath) const
+{
+    return !matchesAny(m_excludePatterns, name, relativePath);
+}
+
+QList<QRegularExpression> PathFilter::compile(const QStringList &patterns)
+{
+    QList<QRegularExpression> expressions;
+    for (const QString &pattern : patterns) {
+        expressions << QRegularExpression(QRegularExpression::wildcardToRegularExpression(pattern),
+                                          QRegularExpression::CaseInsensitiveOption);
+    }
+    return expressions;
+}
+
+bool PathFilter::matchesAny(const QList<QRegularExpression> &patterns, const QString &name,
+                            const QString &relativePath)
+{
+    for (const QRegularExpression &pattern : patterns) {
+        if (pattern.match(name).hasMatch() || (!relativePath.isEmpty() && pattern.match(relativePath).hasMatch())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// FileScanner
+
+FileScanner::FileScanner(int threadCount)
+    : m_threadCount(qMax(1, threadCount))
+    , m_recursive(true)
+    , m_runningThreads(0)
+    , m_fileCount(0)
+    , m_busy(0)
+{
+}
+
+FileScanner::~FileScanner()
+{
+    wait();
+}
+
+void FileScanner::setFilter(const PathFilter &filter)
+{
+    m_filter = filter;
+}
+
+void FileScanner::setRecursive(bool recursive)
+{
+    m_recursive = recursive;
+}
+
+void FileScanner::start(const QString &root, FileCallback onFile, FinishedCallback onFinished)
+{
+    wait();
+
+    m_root = QFileInfo(root).absoluteFilePath();
+    m_onFile = std::move(onFile);
+    m_onFinished = std::move(onFinished);
+    m_fileCount = 0;
+    m_busy = 0;
+    m_queue.clear();
+    m_queue.push_back(QString());
+
+    // Without recursion there is only one directory to list
+    int threadCount = m_recursive ? m_threadCount : 1;
+    m_runningThreads = threadCount;
+    for (int i = 0; i < threadCount; ++i) {
+        QThread *thread = QThread::create([this]() { workerLoop(); });
+        m_threads << thread;
+        thread->start();
+    }
+}
+
+void FileScanner::wait()
+{
+    for (QThread *thread : m_threads) {
+        thread->wait();
+        delete thread;
+    }
+    m_threads.clear();
+}
+
+QStringList FileScanner::scan(const QString &root)
+{
+    QMutex resultMutex;
+    QStringList result;
+    start(root, [&](const QString &path) {
+        QMutexLocker locker(&resultMutex);
+        result << path;
+    });
+    wait();
+
+    result.sort();
+    return result;
+}
+
+void FileScanner::workerLoop()
+{
+    QByteArray buffer;
+
+    while (true) {
+        QString directory;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_queue.empty() && m_busy > 0) {
+                m_wake.wait(&m_mutex);
+            }
+            if (m_queue.empty()) {
+                // Nothing queued and nobody listing: the walk is complete
+                m_wake.wakeAll();
+                break;
+            }
+            directory = m_queue.front();
+            m_queue.pop_front();
+            m_busy++;
+        }
+
+        listDirectory(directory, &buffer);
+
+        QMutexLocker locker(&m_mutex);
+        m_busy--;
+        if (m_busy == 0 && m_queue.empty()) {
+            m_wake.wakeAll();
+        }
+    }
+
+    if (--m_runningThreads == 0 && m_onFinished) {
+        m_onFinished();
+    }
+}
+
+void FileScanner::listDirectory(const QString &relativePath, QByteArray *buffer)
+{
+    QString absolutePath = relativePath.isEmpty() ? m_root : m_root + "/" + relativePath;
+    QStringList subdirectories;
+
+#ifdef Q_OS_LINUX
+    int fd = ::open(QFile::encodeName(absolutePath).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    buffer->resize(ListingBufferSize);
+    while (true) {
+        long length = syscall(SYS_getdents64, fd, buffer->data(), buffer->size());
+        if (length <= 0) {
+            break;
+        }
+
+        for (long offset = 0; offset < length;) {
+            const LinuxDirent64 *entry = reinterpret_cast<const LinuxDirent64 *>(buffer->constData() + offset);
+            offset += entry->d_reclen;
+
+            const char *name = entry->d_name;
+            if (name[0] == '.') {
+                continue; // ".", ".." and hidden entries
+            }
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                // Symlinks count as what they point to, except directories
+                struct stat info;
+                if (fstatat(fd, name, &info, type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                if (S_ISREG(info.st_mode)) {
+                    type = DT_REG;
+                } else if (S_ISDIR(info.st_mode) && entry->d_type == DT_UNKNOWN) {
+                    type = DT_DIR;
+                } else if (S_ISLNK(info.st_mode)) {
+                    type = fstatat(fd, name, &info, 0) == 0 && S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+                } else {
+                    continue;
+                }
+            }
+
+            if (type == DT_DIR || type == DT_REG) {
+                handleEntry(relativePath, QFile::decodeName(name), type == DT_DIR, &subdirectories);
+            }
+        }
+    }
+    ::close(fd);
+#else
+    Q_UNUSED(buffer);
+    QDirIterator it(absolutePath, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        if (info.isDir() && info.isSymLink()) {
+            continue;
+        }
+        handleEntry(relativePath, info.fileName(), info.isDir(), &subdirectories);
+    }
+#endif
+
+    if (!subdirectories.isEmpty()) {
+        QMutexLocker locker(&m_mutex);
+        for (const QString &subdirectory : subdirectories) {
+            m_queue.push_back(subdirectory);
+        }
+        m_wake.wakeAll();
+    }
+}
+
+void FileScanner::handleEntry(const QString &relativeDirectory, const QString &name, bool isDirectory,
+                              QStringList *subdirectories)
+{
+    QString relativePath = relativeDirectory.isEmpty() ? name : relativeDirectory + "/" + name;
+
+    if (isDirectory) {
+        if (m_recursive && m_filter.acceptsDirectory(name, relativePath)) {
+            *subdirectories << relativePath;
+        }
+        return;
+    }
+
+    if (!m_filter.acceptsFile(name, relativePath)) {
+        return;
+    }
+
+    m_fileCount++;
+    m_onFile(m_root + "/" + relativePath);
+}
@@ -0,0 +1,92 @@
+#ifndef FILESCANNER_H
+#define FILESCANNER_H
+
+#include <QList>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <functional>
+
+// Decides which files and directories of a tree are inputs. Patterns are
+// case-insensitive globs. Name filters match the file name. Include and
+// exclude patterns match either the name or the path relative to the root
+// ("*" does not cross '/'); excluded directories are pruned.
+class PathFilter
+{
+public:
+    void setNameFilters(const QStringList &patterns);
+    void setIncludePatterns(const QStringList &patterns);
+    void setExcludePatterns(const QStringList &patterns);
+
+    // relativePath uses '/' separators; name is its last component
+    bool acceptsFile(const QString &name, const QString &relativePath) const;
+    bool acceptsDirectory(const QString &name, const QString &relativePath) const;
+
+private:
+    static QList<QRegularExpression> compile(const QStringList &patterns);
+    static bool matchesAny(const QList<QRegularExpression> &patterns, const QString &name,
+                           const QString &relativePath);
+
+    QList<QRegularExpression> m_nameFilters;
+    QList<QRegularExpression> m_includePatterns;
+    QList<QRegularExpression> m_excludePatterns;
+};
+
+// Walks a directory tree on several threads and reports matching files as
+// soon as they are listed, so callers can start work before the walk ends.
+//
+// On Linux directories are read with getdents64 into a large buffer and
+// the entry type from the listing is used, so no file is stat()ed unless
+// the filesystem does not report types. Directory symlinks are not
+// followed; hidden entries are skipped.
+class FileScanner
+{
+public:
+    using FileCallback = std::function<void(const QString &path)>;
+    using FinishedCallback = std::function<void()>;
+
+    explicit FileScanner(int threadCount = 8);
+    ~FileScanner();
+
+    void setFilter(const PathFilter &filter);
+    void setRecursive(bool recursive);
+
+    // Starts the walk. onFile is called from the scanner threads (possibly
+    // concurrently); onFinished is called once, after the last onFile.
+    void start(const QString &root, FileCallback onFile, FinishedCallback onFinished = FinishedCallback());
+    void wait();
+
+    int fileCount() const { return m_fileCount; }
+
+    // Blocking convenience wrapper; the result is sorted
+    QStringList scan(const QString &root);
+
+private:
+    void workerLoop();
+    void listDirectory(const QString &relativePath, QByteArray *buffer);
+    void handleEntry(const QString &relativeDirectory, const QString &name, bool isDirectory,
+                     QStringList *subdirectories);
+
+    int m_threadCount;
+    bool m_recursive;
+    PathFilter m_filter;
+
+    QString m_root;
+    FileCallback m_onFile;
+    FinishedCallback m_onFinished;
+    QList<QThread *> m_threads;
+    std::atomic<int> m_runningThreads;
+    std::atomic<int> m_fileCount;
+
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    std::deque<QString> m_queue;    // directories relative to the root
+    int m_busy;
+};
+
+#endif // FILESCANNER_H
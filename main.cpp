@@ -1,8 +1,14 @@
 #include <QApplication>
 #include "mainwindow.h"
+#include "cli.h"
 
 int main(int argc, char *argv[])
 {
+    // Batch mode on a QCoreApplication: no display and no widget startup
+    if (Cli::isRequested(argc, argv)) {
+        return Cli::run(argc, argv);
+    }
+    
     QApplication app(argc, argv);
     
     app.setApplicationName("docpdf");
@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "progresschannel.h"
 #include <QApplication>
 #include <QDir>
 #include <QMessageBox>
@@ -6,11 +7,33 @@
 #include <QStyle>
 #include <QTime>
 
+namespace {
+
+// Status refreshes per second, and the most lines the log keeps
+const int ProgressIntervalMsecs = 100;
+const int MaximumLogLines = 1000;
+
+// Running conversions get this long to finish when the window closes
+const int CloseDrainMsecs = 5000;
+
+QString formatDuration(qint64 msecs)
+{
+    qint64 seconds = msecs / 1000;
+    if (seconds >= 3600) {
+        return QString("%1:%2:%3").arg(seconds / 3600).arg(seconds / 60 % 60, 2, 10, QChar('0'))
+                                  .arg(seconds % 60, 2, 10, QChar('0'));
+    }
+    return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+} // namespace
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_centralWidget(nullptr)
     , m_converter(nullptr)
     , m_converterThread(nullptr)
+    , m_progressTimer(nullptr)
 {
     m_currentDir = getCurrentDirectory();
     setupUI();
@@ -20,13 +43,21 @@ MainWindow::MainWindow(QWidget *parent)
     m_converter = new DocPdf();
     m_converter->moveToThread(m_converterThread);
     
-    // Connect signals
-    connect(m_converter, &DocPdf::progress, 
-            this, &MainWindow::onConversionProgress);
+    qRegisterMetaType<DocPdf::Direction>();
+    
+    // Connect signals; per-file progress is polled, see refreshProgress()
     connect(m_converter, &DocPdf::finished, 
             this, &MainWindow::onConversionFinished);
     connect(m_converter, &DocPdf::error, 
             this, &MainWindow::onConversionError);
+    connect(m_converter, &DocPdf::canceled,
+            this, &MainWindow::onConversionCanceled);
+    connect(m_converter, &DocPdf::paused,
+            this, &MainWindow::onConversionPaused);
+    
+    m_progressTimer = new QTimer(this);
+    m_progressTimer->setInterval(ProgressIntervalMsecs);
+    connect(m_progressTimer, &QTimer::timeout, this, &MainWindow::refreshProgress);
     
     m_converterThread->start();
 }
@@ -34,6 +65,13 @@ MainWindow::MainWindow(QWidget *parent)
 MainWindow::~MainWindow()
 {
     if (m_converterThread) {
+        // No new file starts, and the running ones get a few seconds before
+        // they are killed; the batch journal lets the next run resume
+        m_converter->pause();
+        m_converter->waitForDrained(CloseDrainMsecs);
+        m_converter->cancel();
+        // The watcher's notifiers belong to the converter thread
+        QMetaObject::invokeMethod(m_converter, "stopWatching", Qt::BlockingQueuedConnection);
         m_converterThread->quit();
         m_converterThread->wait();
     }
@@ -114,11 +152,28 @@ void MainWindow::setupUI()
     m_buttonLayout->addWidget(m_pdfToDocxButton);
     m_mainLayout->addLayout(m_buttonLayout);
     
+    // Watch mode
+    m_watchCheckBox = new QCheckBox("Keep converting new files dropped into the folder", this);
+    connect(m_watchCheckBox, &QCheckBox::toggled, this, &MainWindow::onWatchToggled);
+    m_mainLayout->addWidget(m_watchCheckBox);
+    
     // Progress bar
     m_progressBar = new QProgressBar(this);
     m_progressBar->setVisible(false);
     m_mainLayout->addWidget(m_progressBar);
     
+    // Pause and cancel take effect at once: they are called directly
+    // because the converter thread is busy with the batch
+    m_pauseButton = new QPushButton("Pause", this);
+    m_pauseButton->setVisible(false);
+    connect(m_pauseButton, &QPushButton::clicked, this, &MainWindow::togglePause);
+    m_mainLayout->addWidget(m_pauseButton);
+    
+    m_cancelButton = new QPushButton("Cancel", this);
+    m_cancelButton->setVisible(false);
+    connect(m_cancelButton, &QPushButton::clicked, this, &MainWindow::cancelConversion);
+    m_mainLayout->addWidget(m_cancelButton);
+    
     // Status label
     m_statusLabel = new QLabel("Ready", this);
     QFont statusFont("Arial", 9);
@@ -127,10 +182,11 @@ void MainWindow::setupUI()
     m_statusLabel->setStyleSheet("color: green;");
     m_mainLayout->addWidget(m_statusLabel);
     
-    // Log output
-    m_logOutput = new QTextEdit(this);
+    // Log output; old lines are dropped so long batches don't grow it
+    m_logOutput = new QPlainTextEdit(this);
     m_logOutput->setMaximumHeight(100);
     m_logOutput->setReadOnly(true);
+    m_logOutput->setMaximumBlockCount(MaximumLogLines);
     m_logOutput->setFont(QFont("Consolas", 8));
     m_mainLayout->addWidget(m_logOutput);
 }
@@ -144,14 +200,31 @@ void MainWindow::updateStatus(const QString &message, const QString &color)
 {
     m_statusLabel->setText(message);
     m_statusLabel->setStyleSheet(QString("color: %1;").arg(color));
-    m_logOutput->append(QString("[%1] %2").arg(QTime::currentTime().toString()).arg(message));
+    m_logOutput->appendPlainText(QString("[%1] %2").arg(QTime::currentTime().toString()).arg(message));
+}
+
+void MainWindow::setConverting(bool converting)
+{
+    m_docToPdfButton->setEnabled(!converting);
+    m_pdfToDocxButton->setEnabled(!converting);
+    m_progressBar->setVisible(converting);
+    m_pauseButton->setVisible(converting);
+    m_pauseButton->setEnabled(converting);
+    m_pauseButton->setText("Pause");
+    m_cancelButton->setVisible(converting);
+    m_cancelButton->setEnabled(converting);
+    
+    // Watch mode keeps polling for the batches it triggers
+    if (converting || m_watchCheckBox->isChecked()) {
+        m_progressTimer->start();
+    } else {
+        m_progressTimer->stop();
+    }
 }
 
 void MainWindow::convertDocToPdf()
 {
-    m_docToPdfButton->setEnabled(false);
-    m_pdfToDocxButton->setEnabled(false);
-    m_progressBar->setVisible(true);
+    setConverting(true);
     m_progressBar->setValue(0);
     
     updateStatus("Converting DOC/DOCX to PDF...", "blue");
@@ -159,13 +232,18 @@ void MainWindow::convertDocToPdf()
     QMetaObject::invokeMethod(m_converter, "convertDocToPdf", 
                              Qt::QueuedConnection,
                              Q_ARG(QString, m_currentDir));
+    
+    if (m_watchCheckBox->isChecked()) {
+        QMetaObject::invokeMethod(m_converter, "startWatching",
+                                 Qt::QueuedConnection,
+                                 Q_ARG(QString, m_currentDir),
+                                 Q_ARG(DocPdf::Direction, DocPdf::DocToPdf));
+    }
 }
 
 void MainWindow::convertPdfToDocx()
 {
-    m_docToPdfButton->setEnabled(false);
-    m_pdfToDocxButton->setEnabled(false);
-    m_progressBar->setVisible(true);
+    setConverting(true);
     m_progressBar->setValue(0);
     
     updateStatus("Converting PDF to DOCX...", "blue");
@@ -173,33 +251,118 @@ void MainWindow::convertPdfToDocx()
     QMetaObject::invokeMethod(m_converter, "convertPdfToDocx", 
                              Qt::QueuedConnection,
                              Q_ARG(QString, m_currentDir));
+    
+    if (m_watchCheckBox->isChecked()) {
+        QMetaObject::invokeMethod(m_converter, "startWatching",
+                                 Qt::QueuedConnection,
+                                 Q_ARG(QString, m_currentDir),
+                                 Q_ARG(DocPdf::Direction, DocPdf::PdfToDocx));
+    }
 }
 
-void MainWindow::onConversionProgress(int current, int total, const QString &filename)
+void MainWindow::refreshProgress()
 {
-    m_progressBar->setMaximum(total);
-    m_progressBar->setValue(current);
-    updateStatus(QString("Converting %1/%2: %3").arg(current).arg(total).arg(filename), "blue");
+    ProgressChannel::Snapshot progress = m_converter->progressChannel()->snapshot();
+    if (!progress.active) {
+        return;
+    }
+    
+    m_progressBar->setVisible(true);
+    m_progressBar->setMaximum(qMax(1, progress.total));
+    m_progressBar->setValue(progress.completed);
+    
+    // The pause message stays until the batch is resumed
+    if (m_converter->isPaused()) {
+        return;
+    }
+    
+    QString rates = QString("%1 files/s, %2 MB/s, ETA %3")
+                        .arg(progress.filesPerSecond, 0, 'f', 1)
+                        .arg(progress.bytesPerSecond / (1024.0 * 1024.0), 0, 'f', 1)
+                        .arg(progress.etaMsecs < 0 ? QString("--:--") : formatDuration(progress.etaMsecs));
+    m_statusLabel->setText(QString("Converting %1/%2 (%3)").arg(progress.completed).arg(progress.total).arg(rates));
+    
+    // The log gets a line per second rather than one per file
+    if (!m_lastProgressLog.isValid() || m_lastProgressLog.elapsed() >= 1000) {
+        m_lastProgressLog.start();
+        m_logOutput->appendPlainText(QString("[%1] %2/%3 converted, %4 failed, last: %5 (%6)")
+                                         .arg(QTime::currentTime().toString())
+                                         .arg(progress.completed).arg(progress.total)
+                                         .arg(progress.failed).arg(progress.currentFile, rates));
+    }
 }
 
-void MainWindow::onConversionFinished(int converted, int total, const QString &type)
+void MainWindow::onConversionFinished(int converted, int total, const QString &type, int cached)
 {
-    m_progressBar->setVisible(false);
-    m_docToPdfButton->setEnabled(true);
-    m_pdfToDocxButton->setEnabled(true);
+    setConverting(false);
     
     QString message = QString("Conversion complete! %1/%2 %3 files converted").arg(converted).arg(total).arg(type);
+    if (cached > 0) {
+        message += QString(" (%1 up to date, %2% cache hit rate)").arg(cached).arg(cached * 100 / total);
+    }
     updateStatus(message, "green");
     
-    QMessageBox::information(this, "Success", message);
+    // Batches from watch mode only go to the log
+    if (!m_watchCheckBox->isChecked()) {
+        QMessageBox::information(this, "Success", message);
+    }
 }
 
 void MainWindow::onConversionError(const QString &error)
 {
-    m_progressBar->setVisible(false);
-    m_docToPdfButton->setEnabled(true);
-    m_pdfToDocxButton->setEnabled(true);
+    setConverting(false);
     
     updateStatus("Conversion failed", "red");
     QMessageBox::critical(this, "Error", error);
-}
\ No newline at end of file
+}
+
+void MainWindow::togglePause()
+{
+    if (m_converter->isPaused()) {
+        m_converter->resume();
+        m_pauseButton->setText("Pause");
+        updateStatus("Resumed", "blue");
+        return;
+    }
+    // Only a running batch can be paused
+    m_converter->pause();
+    if (m_converter->isPaused()) {
+        m_pauseButton->setText("Resume");
+        updateStatus("Pausing: waiting for running conversions...", "orange");
+    }
+}
+
+void MainWindow::onConversionPaused()
+{
+    // Queued, so the batch may have been resumed since
+    if (!m_converter->isPaused()) {
+        return;
+    }
+    ProgressChannel::Snapshot progress = m_converter->progressChannel()->snapshot();
+    updateStatus(QString("Paused: %1/%2 files converted").arg(progress.completed).arg(progress.total), "orange");
+}
+
+void MainWindow::cancelConversion()
+{
+    m_cancelButton->setEnabled(false);
+    m_pauseButton->setEnabled(false);
+    m_converter->cancel();
+    updateStatus("Canceling...", "orange");
+}
+
+void MainWindow::onConversionCanceled(int converted, int total)
+{
+    setConverting(false);
+    updateStatus(QString("Conversion canceled: %1/%2 files converted").arg(converted).arg(total), "orange");
+}
+
+void MainWindow::onWatchToggled(bool checked)
+{
+    // Watching starts with the next conversion so the direction is known
+    if (checked) {
+        updateStatus("Watch mode: click a conversion to start watching the folder", "blue");
+    } else {
+        QMetaObject::invokeMethod(m_converter, "stopWatching", Qt::QueuedConnection);
+        updateStatus("Watch mode stopped");
+    }
+}
@@ -7,8 +7,11 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QProgressBar>
-#include <QTextEdit>
+#include <QCheckBox>
+#include <QPlainTextEdit>
 #include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
 #include "docpdf.h"
 
 class MainWindow : public QMainWindow
@@ -22,13 +25,19 @@ public:
 private slots:
     void convertDocToPdf();
     void convertPdfToDocx();
-    void onConversionProgress(int current, int total, const QString &filename);
-    void onConversionFinished(int converted, int total, const QString &type);
+    void refreshProgress();
+    void onConversionFinished(int converted, int total, const QString &type, int cached);
     void onConversionError(const QString &error);
+    void onConversionCanceled(int converted, int total);
+    void onConversionPaused();
+    void cancelConversion();
+    void togglePause();
+    void onWatchToggled(bool checked);
 
 private:
     void setupUI();
     void updateStatus(const QString &message, const QString &color = "black");
+    void setConverting(bool converting);
     QString getCurrentDirectory();
     
     // UI Components
@@ -39,9 +48,17 @@ private:
     QHBoxLayout *m_buttonLayout;
     QPushButton *m_docToPdfButton;
     QPushButton *m_pdfToDocxButton;
+    QCheckBox *m_watchCheckBox;
     QProgressBar *m_progressBar;
+    QPushButton *m_pauseButton;
+    QPushButton *m_cancelButton;
     QLabel *m_statusLabel;
-    QTextEdit *m_logOutput;
+    QPlainTextEdit *m_logOutput;
+    
+    // Progress is polled from the converter at a fixed rate, so the GUI
+    // cost does not grow with the conversion rate
+    QTimer *m_progressTimer;
+    QElapsedTimer m_lastProgressLog;
     
     // Converter
     DocPdf *m_converter;
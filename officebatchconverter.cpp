@@ -0,0 +1,182 @@
+#include "officebatchconverter.h"
+#include "outputwriter.h"
+#include "processscheduler.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSet>
+#include <QStringList>
+
+namespace {
+
+// Run time a batch is sized for, and the initial cost model
+const qint64 TargetBatchMsecs = 20000;
+const double InitialStartupMsecs = 3000;
+const double InitialMsecsPerMegabyte = 2000;
+
+// Small documents still cost something beyond the startup
+const qint64 MinimumFileBytes = 16 * 1024;
+
+qint64 effectiveBytes(qint64 size)
+{
+    return qMax(size, MinimumFileBytes);
+}
+
+// soffice names its output after the input's complete base name
+QString producedPath(const QString &outputDirectory, const QString &inputPath)
+{
+    return outputDirectory + "/" + QFileInfo(inputPath).completeBaseName() + ".pdf";
+}
+
+} // namespace
+
+OfficeBatchConverter::OfficeBatchConverter(ProcessScheduler *processes, OutputWriter *outputs)
+    : m_processes(processes)
+    , m_outputs(outputs)
+    , m_maxBatchSize(50)
+    , m_startupMsecs(InitialStartupMsecs)
+    , m_msecsPerMegabyte(InitialMsecsPerMegabyte)
+{
+}
+
+void OfficeBatchConverter::setMaxBatchSize(int files)
+{
+    m_maxBatchSize = qMax(1, files);
+}
+
+int OfficeBatchConverter::maxBatchSize() const
+{
+    return m_maxBatchSize;
+}
+
+void OfficeBatchConverter::takeBatch(Queue *queue, QList<Job> *batch) const
+{
+    batch->clear();
+
+    QMutexLocker locker(&queue->mutex);
+    if (queue->jobs.empty()) {
+        return;
+    }
+
+    QString outputDirectory = QFileInfo(queue->jobs.front().outputPath).absolutePath();
+    QSet<QString> names;
+    qint64 bytes = 0;
+
+    // Look a little past the batch size for files in the same directory,
+    // without scanning a huge backlog
+    QList<size_t> taken;
+    size_t lookahead = qMin(queue->jobs.size(), size_t(m_maxBatchSize) * 4);
+    for (size_t i = 0; i < lookahead && taken.size() < m_maxBatchSize; ++i) {
+        const Job &job = queue->jobs[i];
+        QString name = QFileInfo(job.inputPath).completeBaseName();
+        if (QFileInfo(job.outputPath).absolutePath() != outputDirectory || names.contains(name)) {
+            continue;
+        }
+        if (!taken.isEmpty() && predictedMsecs(bytes + effectiveBytes(job.size)) > TargetBatchMsecs) {
+            break;
+        }
+        names.insert(name);
+        bytes += effectiveBytes(job.size);
+        taken << i;
+    }
+
+    for (size_t i : taken) {
+        batch->append(queue->jobs[i]);
+    }
+    for (int i = taken.size() - 1; i >= 0; --i) {
+        queue->jobs.erase(queue->jobs.begin() + qsizetype(taken[i]));
+    }
+}
+
+void OfficeBatchConverter::convert(QList<Job> *jobs, const QString &profileUrl, int workerIndex)
+{
+    QList<int> indexes;
+    for (int i = 0; i < jobs->size(); ++i) {
+        indexes << i;
+    }
+    if (indexes.isEmpty()) {
+        return;
+    }
+
+    // soffice writes into a private directory and finished files are
+    // committed over their outputs, so a killed run leaves no partial PDF
+    QString outputDirectory = QFileInfo(jobs->first().outputPath).absolutePath();
+    run(jobs, indexes, profileUrl, m_outputs->stagingDirectory(outputDirectory, workerIndex));
+}
+
+void OfficeBatchConverter::run(QList<Job> *jobs, const QList<int> &indexes, const QString &profileUrl,
+                               const QString &stagingDirectory)
+{
+    QStringList arguments;
+    arguments << "-env:UserInstallation=" + profileUrl;
+    arguments << "--headless" << "--convert-to" << "pdf" << "--outdir" << stagingDirectory;
+
+    qint64 bytes = 0;
+    for (int index : indexes) {
+        const Job &job = (*jobs)[index];
+        bytes += effectiveBytes(job.size);
+        arguments << job.inputPath;
+        // Anything already there would pass for this run's output
+        QFile::remove(producedPath(stagingDirectory, job.inputPath));
+    }
+
+    int timeoutMsecs = int(qBound<qint64>(30000, 3 * predictedMsecs(bytes), 600000));
+
+    QElapsedTimer timer;
+    timer.start();
+    ProcessScheduler::Result result = m_processes->run("soffice", arguments, timeoutMsecs);
+    qint64 elapsedNanos = timer.nsecsElapsed();
+
+    QList<int> failed;
+    for (int index : indexes) {
+        Job &job = (*jobs)[index];
+        job.processNanos += elapsedNanos / indexes.size();
+
+        QString produced = producedPath(stagingDirectory, job.inputPath);
+        if (QFileInfo(produced).size() > 0) {
+            job.ok = m_outputs->commit(produced, job.outputPath);
+        }
+        if (!job.ok) {
+            if (result.timedOut) {
+                job.timeoutMsecs = timeoutMsecs;
+            }
+            failed << index;
+        }
+    }
+
+    if (failed.isEmpty() && !result.timedOut && !result.canceled) {
+        observe(elapsedNanos / 1000000, bytes);
+    }
+
+    // Retrying is pointless when soffice cannot be started at all
+    if (failed.isEmpty() || indexes.size() == 1 || !result.started || result.canceled) {
+        return;
+    }
+
+    if (failed.size() == 1) {
+        run(jobs, failed, profileUrl, stagingDirectory);
+        return;
+    }
+    int half = failed.size() / 2;
+    run(jobs, failed.mid(0, half), profileUrl, stagingDirectory);
+    run(jobs, failed.mid(half), profileUrl, stagingDirectory);
+}
+
+qint64 OfficeBatchConverter::predictedMsecs(qint64 bytes) const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_startupMsecs + m_msecsPerMegabyte * double(bytes) / (1024.0 * 1024.0));
+}
+
+void OfficeBatchConverter::observe(qint64 elapsedMsecs, qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Every run costs at least the startup, so the fastest run bounds it
+    m_startupMsecs = qMin(m_startupMsecs, double(elapsedMsecs));
+
+    double megabytes = double(bytes) / (1024.0 * 1024.0);
+    double sample = qMax(0.0, double(elapsedMsecs) - m_startupMsecs) / megabytes;
+    m_msecsPerMegabyte = 0.7 * m_msecsPerMegabyte + 0.3 * sample;
+}
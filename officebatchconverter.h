@@ -0,0 +1,68 @@
+#ifndef OFFICEBATCHCONVERTER_H
+#define OFFICEBATCHCONVERTER_H
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <deque>
+
+class OutputWriter;
+class ProcessScheduler;
+
+// Converts documents to PDF with several files per soffice invocation, so
+// LibreOffice's startup is paid once per batch instead of once per file.
+//
+// Batches are cut from a shared queue when a worker is ready for one, so
+// their size follows the latest estimate: a fixed startup cost plus a
+// per-byte cost learned from finished batches, kept under a target run
+// time. Files in a batch share an output directory (soffice has a single
+// --outdir). When a run fails or times out, the files without output are
+// split in half and retried, so one broken document costs a few extra
+// runs instead of failing its whole batch. Nothing is retried once the
+// scheduler is canceled.
+class OfficeBatchConverter
+{
+public:
+    struct Job {
+        QString inputPath;
+        QString outputPath;
+        qint64 size = 0;
+        bool ok = false;
+        int timeoutMsecs = 0;       // deadline of a run that expired, 0 if none
+        qint64 processNanos = 0;    // this file's share of the soffice runs
+    };
+
+    struct Queue {
+        QMutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    OfficeBatchConverter(ProcessScheduler *processes, OutputWriter *outputs);
+
+    // Upper bound on files per invocation
+    void setMaxBatchSize(int files);
+    int maxBatchSize() const;
+
+    // Removes the next batch from the queue; empty when the queue is
+    void takeBatch(Queue *queue, QList<Job> *batch) const;
+
+    // Converts the given jobs, setting ok, timeoutMsecs and processNanos
+    void convert(QList<Job> *jobs, const QString &profileUrl, int workerIndex);
+
+    // Expected run time of one soffice invocation over this many bytes
+    qint64 predictedMsecs(qint64 bytes) const;
+
+private:
+    void run(QList<Job> *jobs, const QList<int> &indexes, const QString &profileUrl,
+             const QString &stagingDirectory);
+    void observe(qint64 elapsedMsecs, qint64 bytes);
+
+    ProcessScheduler *m_processes;
+    OutputWriter *m_outputs;
+    int m_maxBatchSize;
+    mutable QMutex m_mutex;
+    double m_startupMsecs;
+    double m_msecsPerMegabyte;
+};
+
+#endif // OFFICEBATCHCONVERTER_H
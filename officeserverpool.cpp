@@ -0,0 +1,240 @@
+#include "officeserverpool.h"
+#include "conversionmetrics.h"
+#include "processscheduler.h"
+#include <QProcess>
+#include <QDebug>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QFile>
+#include <QDir>
+#include <QUrl>
+
+OfficeServerPool::OfficeServerPool(int serverCount, ProcessScheduler *processes)
+    : QObject(nullptr)
+    , m_processes(processes)
+    , m_thread(new QThread)
+    , m_ownerThread(QThread::currentThread())
+    , m_maxJobsPerServer(200)
+    , m_unavailable(false)
+    , m_instance(0)
+{
+    static std::atomic<int> nextInstance(0);
+    m_instance = nextInstance++;
+    for (int i = 0; i < qMax(1, serverCount); ++i) {
+        m_servers << new Server;
+    }
+
+    moveToThread(m_thread);
+    m_thread->start();
+}
+
+OfficeServerPool::~OfficeServerPool()
+{
+    QMetaObject::invokeMethod(this, [this]() { shutdown(); }, Qt::BlockingQueuedConnection);
+    m_thread->quit();
+    m_thread->wait();
+    delete m_thread;
+
+    for (int i = 0; i < m_servers.size(); ++i) {
+        QDir(QUrl(profileUrl(i)).toLocalFile()).removeRecursively();
+    }
+    qDeleteAll(m_servers);
+}
+
+void OfficeServerPool::setMaxJobsPerServer(int maxJobs)
+{
+    m_maxJobsPerServer = qMax(0, maxJobs);
+}
+
+bool OfficeServerPool::convert(int serverIndex, const QString &inputPath, const QString &outputPath)
+{
+    if (m_unavailable) {
+        return false;
+    }
+    Server *server = m_servers[serverIndex % m_servers.size()];
+    QMutexLocker locker(&server->mutex);
+
+    quint16 port = 0;
+    QMetaObject::invokeMethod(this, [this, serverIndex]() { return prepareServer(serverIndex); },
+                              Qt::BlockingQueuedConnection, &port);
+
+    // Health check: a fresh or hung instance does not accept connections
+    if (!waitUntilListening(server, port, 60000)) {
+        // A canceled wait says nothing about the instance, and one that
+        // could not start is not restarted
+        if (m_processes->isCanceled() || m_unavailable) {
+            return false;
+        }
+        if (server->healthy) {
+            ConversionMetrics::reportTimeout("soffice", 60000);
+        }
+        QMetaObject::invokeMethod(this, [this, serverIndex]() { reportJob(serverIndex, false); },
+                                  Qt::BlockingQueuedConnection);
+        return false;
+    }
+
+    QStringList arguments;
+    arguments << "--no-launch"
+              << "--connection" << QString("socket,host=127.0.0.1,port=%1;urp;StarOffice.ComponentContext").arg(port)
+              << "-f" << "pdf"
+              << "-o" << outputPath
+              << inputPath;
+
+    ProcessScheduler::Result result = m_processes->run("unoconv", arguments, 30000);
+    if (result.timedOut) {
+        ConversionMetrics::reportTimeout("unoconv", 30000);
+    }
+    // Without unoconv the instances are fine but useless
+    if (!result.started && !result.canceled) {
+        if (!m_unavailable.exchange(true)) {
+            qWarning() << "unoconv cannot be started; office server mode is off";
+        }
+        return false;
+    }
+
+    bool ok = result.ok() && QFile::exists(outputPath);
+
+    QMetaObject::invokeMethod(this, [this, serverIndex, ok]() { reportJob(serverIndex, ok); },
+                              Qt::BlockingQueuedConnection);
+    return ok;
+}
+
+quint16 OfficeServerPool::prepareServer(int serverIndex)
+{
+    int index = serverIndex % m_servers.size();
+    Server *server = m_servers[index];
+    int maxJobs = m_maxJobsPerServer;
+
+    if (server->process) {
+        bool exhausted = maxJobs > 0 && server->jobs >= maxJobs;
+        if (!server->healthy || server->process->state() != QProcess::Running || exhausted) {
+            stopServer(index);
+        }
+    }
+
+    if (!server->process) {
+        startServer(index);
+    }
+
+    return server->port;
+}
+
+void OfficeServerPool::reportJob(int serverIndex, bool ok)
+{
+    Server *server = m_servers[serverIndex % m_servers.size()];
+    server->jobs++;
+
+    // Any failure restarts the instance before its next job
+    if (!ok) {
+        server->healthy = false;
+    }
+}
+
+void OfficeServerPool::shutdown()
+{
+    for (int i = 0; i < m_servers.size(); ++i) {
+        stopServer(i);
+    }
+
+    // Hand the object back so it can be destroyed after this thread exits
+    moveToThread(m_ownerThread);
+}
+
+void OfficeServerPool::startServer(int serverIndex)
+{
+    Server *server = m_servers[serverIndex];
+    server->port = freePort();
+
+    QStringList arguments;
+    arguments << "-env:UserInstallation=" + profileUrl(serverIndex)
+              << "--headless" << "--invisible" << "--nologo" << "--norestore"
+              << "--nodefault" << "--nolockcheck"
+              << QString("--accept=socket,host=127.0.0.1,port=%1;urp;StarOffice.ComponentContext").arg(server->port);
+
+    server->process = new QProcess(this);
+    ProcessScheduler::startGroup(server->process);
+    server->jobs = 0;
+    server->healthy = true;
+
+    // A crashed instance is replaced on its next job
+    connect(server->process, &QProcess::finished, this, [server]() {
+        server->healthy = false;
+    });
+    // One that never started would fail the same way every time
+    connect(server->process, &QProcess::errorOccurred, this, [this, server](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+            server->healthy = false;
+            if (!m_unavailable.exchange(true)) {
+                qWarning() << "soffice cannot be started; office server mode is off";
+            }
+        }
+    });
+    if (server->port == 0) {
+        server->healthy = false;
+        return;
+    }
+
+    server->process->start("soffice", arguments);
+}
+
+void OfficeServerPool::stopServer(int serverIndex)
+{
+    Server *server = m_servers[serverIndex];
+    if (!server->process) {
+        return;
+    }
+
+    server->process->disconnect(this);
+    if (server->process->state() != QProcess::NotRunning) {
+        // The whole group, or soffice.bin outlives its wrapper
+        ProcessScheduler::terminateGroup(server->process);
+        if (!server->process->waitForFinished(5000)) {
+            ProcessScheduler::killGroup(server->process);
+            server->process->waitForFinished(1000);
+        }
+    }
+
+    delete server->process;
+    server->process = nullptr;
+    server->healthy = false;
+}
+
+bool OfficeServerPool::waitUntilListening(Server *server, quint16 port, int timeoutMs) const
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // An instance that exited or never started will not start listening
+    while (timer.elapsed() < timeoutMs && server->healthy && !m_processes->isCanceled()) {
+        QTcpSocket socket;
+        socket.connectToHost("127.0.0.1", port);
+        if (socket.waitForConnected(500)) {
+            socket.disconnectFromHost();
+            return true;
+        }
+        QThread::msleep(250);
+    }
+
+    return false;
+}
+
+QString OfficeServerPool::profileUrl(int serverIndex) const
+{
+    QString profileDir = QDir::temp().absoluteFilePath(
+        QString("docpdf_lo_server_%1_%2_%3").arg(QCoreApplication::applicationPid()).arg(m_instance).arg(serverIndex));
+    return QUrl::fromLocalFile(profileDir).toString();
+}
+
+quint16 OfficeServerPool::freePort()
+{
+    // The kernel picks a port nothing listens on; soffice binds it right
+    // after, so processes running side by side never share one
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost, 0)) {
+        return 0;
+    }
+    return server.serverPort();
+}
@@ -0,0 +1,70 @@
+#ifndef OFFICESERVERPOOL_H
+#define OFFICESERVERPOOL_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <atomic>
+
+class QProcess;
+class ProcessScheduler;
+
+// Pool of long-lived headless LibreOffice instances listening on UNO sockets.
+// Conversions are sent to a running instance with unoconv, so LibreOffice
+// startup is paid once per instance instead of once per document. Instances
+// are restarted when they crash, fail a health check, or reach the job limit.
+// Each instance listens on a port the kernel found free when it started. If
+// soffice or unoconv cannot be started at all, the pool stops trying and
+// convert() fails at once, leaving the documents to the cold soffice path.
+//
+// The QProcess objects live on the pool's own thread; convert() may be called
+// from any worker thread. unoconv clients run on the shared ProcessScheduler.
+class OfficeServerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    OfficeServerPool(int serverCount, ProcessScheduler *processes);
+    ~OfficeServerPool();
+
+    int serverCount() const { return m_servers.size(); }
+
+    // Restart an instance after this many conversions (0 = never)
+    void setMaxJobsPerServer(int maxJobs);
+
+    // Converts inputPath to PDF at outputPath on instance serverIndex.
+    // Returns false if the instance is unavailable or the conversion failed.
+    bool convert(int serverIndex, const QString &inputPath, const QString &outputPath);
+
+private:
+    struct Server {
+        QProcess *process = nullptr;
+        quint16 port = 0;
+        int jobs = 0;
+        std::atomic<bool> healthy{false};   // read by waiting workers
+        QMutex mutex; // serializes conversions on one instance
+    };
+
+    // Run on the pool thread
+    quint16 prepareServer(int serverIndex);
+    void reportJob(int serverIndex, bool ok);
+    void shutdown();
+
+    void startServer(int serverIndex);
+    void stopServer(int serverIndex);
+    bool waitUntilListening(Server *server, quint16 port, int timeoutMs) const;
+    QString profileUrl(int serverIndex) const;
+    static quint16 freePort();
+
+    ProcessScheduler *m_processes;
+    QThread *m_thread;
+    QThread *m_ownerThread;
+    QList<Server *> m_servers;
+    std::atomic<int> m_maxJobsPerServer;
+    std::atomic<bool> m_unavailable;    // soffice or unoconv is missing
+    int m_instance;                     // keeps profiles of pools apart
+};
+
+#endif // OFFICESERVERPOOL_H
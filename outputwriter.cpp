@@ -0,0 +1,441 @@
+#include "outputwriter.h"
+#include "conversionmetrics.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSysInfo>
+#include <QThreadPool>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef DOCPDF_HAVE_IO_URING
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+// Most files synced in one group; later commits wait for the next one
+const int MaxGroupSize = 256;
+
+// Concurrent fsync calls without io_uring
+const int SyncThreads = 16;
+
+// Temporary names must not collide with another docpdf process, which may
+// run on another host sharing the output directory
+QString processTag()
+{
+    static const QString tag = QString("%1-%2").arg(QSysInfo::machineHostName())
+                                               .arg(QCoreApplication::applicationPid());
+    return tag;
+}
+
+#ifdef DOCPDF_HAVE_IO_URING
+// Just enough of io_uring, through the raw syscalls, to submit a group of
+// fsync requests at once and reap their results
+class SyncRing
+{
+public:
+    explicit SyncRing(unsigned entries)
+        : m_fd(-1)
+        , m_sqRing(nullptr)
+        , m_cqRing(nullptr)
+        , m_sqes(nullptr)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        m_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) {
+            // Old kernel, or disabled by seccomp or sysctl
+            return;
+        }
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqRing = map(m_sqRingSize, IORING_OFF_SQ_RING);
+        m_cqRing = map(m_cqRingSize, IORING_OFF_CQ_RING);
+        m_sqes = static_cast<io_uring_sqe *>(map(m_sqesSize, IORING_OFF_SQES));
+        if (!m_sqRing || !m_cqRing || !m_sqes) {
+            release();
+            return;
+        }
+
+        char *sq = static_cast<char *>(m_sqRing);
+        m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        char *cq = static_cast<char *>(m_cqRing);
+        m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        m_entries = params.sq_entries;
+    }
+
+    ~SyncRing()
+    {
+        release();
+    }
+
+    bool isValid() const
+    {
+        return m_fd >= 0;
+    }
+
+    // Sets results to 0 or -errno per descriptor; false if the ring itself
+    // failed, after which it must not be used again
+    bool sync(const QList<int> &fds, bool dataOnly, QList<int> *results)
+    {
+        results->fill(0, fds.size());
+        for (qsizetype first = 0; first < fds.size(); first += m_entries) {
+            unsigned count = unsigned(qMin<qsizetype>(m_entries, fds.size() - first));
+            unsigned tail = *m_sqTail;
+            for (unsigned i = 0; i < count; ++i) {
+                unsigned index = (tail + i) & m_sqMask;
+                io_uring_sqe *sqe = &m_sqes[index];
+                memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = fds.at(first + i);
+                sqe->fsync_flags = dataOnly ? IORING_FSYNC_DATASYNC : 0;
+                sqe->user_data = quint64(first + i);
+                m_sqArray[index] = index;
+            }
+            __atomic_store_n(m_sqTail, tail + count, __ATOMIC_RELEASE);
+
+            unsigned unsubmitted = count;
+            unsigned completed = 0;
+            while (completed < count) {
+                int submitted = int(syscall(__NR_io_uring_enter, m_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS,
+                                            nullptr, 0));
+                if (submitted < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    release();
+                    return false;
+                }
+                unsubmitted -= qMin(unsubmitted, unsigned(submitted));
+
+                unsigned head = *m_cqHead;
+                unsigned available = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+                for (; head != available; ++head) {
+                    const io_uring_cqe &cqe = m_cqes[head & m_cqMask];
+                    (*results)[qsizetype(cqe.user_data)] = cqe.res;
+                    ++completed;
+                }
+                __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+            }
+        }
+        return true;
+    }
+
+private:
+    void *map(size_t size, off_t offset)
+    {
+        void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+        return address == MAP_FAILED ? nullptr : address;
+    }
+
+    void release()
+    {
+        if (m_sqes) {
+            munmap(m_sqes, m_sqesSize);
+        }
+        if (m_cqRing) {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        if (m_sqRing) {
+            munmap(m_sqRing, m_sqRingSize);
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+        m_fd = -1;
+        m_sqRing = m_cqRing = nullptr;
+        m_sqes = nullptr;
+    }
+
+    int m_fd;
+    void *m_sqRing;
+    void *m_cqRing;
+    io_uring_sqe *m_sqes;
+    size_t m_sqRingSize = 0;
+    size_t m_cqRingSize = 0;
+    size_t m_sqesSize = 0;
+    unsigned *m_sqTail = nullptr;
+    unsigned *m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned *m_cqHead = nullptr;
+    unsigned *m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe *m_cqes = nullptr;
+    unsigned m_entries = 0;
+};
+#else
+class SyncRing
+{
+public:
+    explicit SyncRing(unsigned) {}
+    bool isValid() const { return false; }
+    bool sync(const QList<int> &, bool, QList<int> *) { return false; }
+};
+#endif
+
+#ifdef Q_OS_UNIX
+int syncDescriptor(int fd, bool dataOnly)
+{
+#ifdef Q_OS_LINUX
+    int status = dataOnly ? ::fdatasync(fd) : ::fsync(fd);
+#else
+    Q_UNUSED(dataOnly);
+    int status = ::fsync(fd);
+#endif
+    return status == 0 ? 0 : -errno;
+}
+
+// Syncs and closes the descriptors; true if every sync succeeded
+bool syncDescriptors(const QList<int> &fds, bool dataOnly, SyncRing *ring, QThreadPool *threadPool)
+{
+    QList<int> results;
+    if (!ring->isValid() || !ring->sync(fds, dataOnly, &results)) {
+        results.fill(0, fds.size());
+        int *result = results.data();
+        for (int i = 0; i < fds.size(); ++i) {
+            int fd = fds.at(i);
+            threadPool->start([result, i, fd, dataOnly]() { result[i] = syncDescriptor(fd, dataOnly); });
+        }
+        threadPool->waitForDone();
+    }
+
+    bool ok = true;
+    for (int i = 0; i < fds.size(); ++i) {
+        // A kernel without IORING_OP_FSYNC rejects the opcode
+        if (results.at(i) == -EINVAL) {
+            results[i] = syncDescriptor(fds.at(i), dataOnly);
+        }
+        ok = ok && results.at(i) == 0;
+        ::close(fds.at(i));
+    }
+    return ok;
+}
+
+// Files first, then each of their directories once, so the renames are
+// durable as well
+bool syncFiles(const QStringList &files, SyncRing *ring, QThreadPool *threadPool)
+{
+    QList<int> fds;
+    QSet<QString> directories;
+    for (const QString &file : files) {
+        // Gone means replaced or removed since; nothing left to sync
+        int fd = ::open(QFile::encodeName(file).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            fds << fd;
+        }
+        directories.insert(QFileInfo(file).absolutePath());
+    }
+    bool ok = syncDescriptors(fds, true, ring, threadPool);
+
+    fds.clear();
+    for (const QString &directory : directories) {
+        int fd = ::open(QFile::encodeName(directory).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) {
+            fds << fd;
+        }
+    }
+    return syncDescriptors(fds, false, ring, threadPool) && ok;
+}
+#endif
+
+} // namespace
+
+OutputWriter::OutputWriter()
+    : m_thread(nullptr)
+    , m_syncing(false)
+    , m_stopping(false)
+    , m_failed(false)
+    , m_committed(0)
+    , m_synced(0)
+    , m_ioUring(false)
+    , m_instance(0)
+{
+    static std::atomic<int> nextInstance(0);
+    m_instance = nextInstance++;
+    m_thread = QThread::create([this]() { syncLoop(); });
+    m_thread->start();
+}
+
+OutputWriter::~OutputWriter()
+{
+    flush();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_pendingAvailable.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+}
+
+QString OutputWriter::temporaryPath(const QString &outputPath)
+{
+    static std::atomic<quint64> counter(0);
+    prepareDirectory(outputPath);
+    QFileInfo info(outputPath);
+    return info.absolutePath() + QString("/.%1.%2-%3.part")
+                                     .arg(info.fileName())
+                                     .arg(processTag())
+                                     .arg(++counter);
+}
+
+bool OutputWriter::prepareDirectory(const QString &outputPath)
+{
+    QString directory = QFileInfo(outputPath).absolutePath();
+    QMutexLocker locker(&m_mutex);
+    if (m_outputDirectories.contains(directory)) {
+        return true;
+    }
+    if (!QDir().mkpath(directory)) {
+        return false;
+    }
+    m_outputDirectories.insert(directory);
+    return true;
+}
+
+QString OutputWriter::stagingDirectory(const QString &outputDirectory, int workerIndex)
+{
+    QString directory = QDir(outputDirectory).absoluteFilePath(
+        QString(".docpdf-%1-%2-%3").arg(processTag()).arg(m_instance).arg(workerIndex));
+    QMutexLocker locker(&m_mutex);
+    if (!m_stagingDirectories.contains(directory)) {
+        QDir().mkpath(directory);
+        m_stagingDirectories.insert(directory);
+    }
+    return directory;
+}
+
+void OutputWriter::releaseStagingDirectories(const QString &outputDirectory)
+{
+    QString parent = QDir(outputDirectory).absolutePath();
+    QMutexLocker locker(&m_mutex);
+    m_outputDirectories.remove(parent);
+    for (auto it = m_stagingDirectories.begin(); it != m_stagingDirectories.end();) {
+        if (QFileInfo(*it).absolutePath() == parent) {
+            QDir(*it).removeRecursively();
+            it = m_stagingDirectories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool OutputWriter::commit(const QString &temporaryPath, const QString &outputPath)
+{
+    ConversionMetrics::StageTimer timer(ConversionMetrics::DiskWrite);
+#ifdef Q_OS_UNIX
+    bool renamed = ::rename(QFile::encodeName(temporaryPath).constData(),
+                            QFile::encodeName(outputPath).constData()) == 0;
+#else
+    // QFile::rename never replaces, so this is not atomic here
+    QFile::remove(outputPath);
+    bool renamed = QFile::rename(temporaryPath, outputPath);
+#endif
+    if (!renamed) {
+        QFile::remove(temporaryPath);
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    QMutexLocker locker(&m_mutex);
+    m_pending << outputPath;
+    m_committed++;
+    m_pendingAvailable.wakeOne();
+#endif
+    return true;
+}
+
+bool OutputWriter::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_pending.isEmpty() || m_syncing) {
+        m_idle.wait(&m_mutex);
+    }
+
+    // Only called between batches, so no converter is writing into these
+    for (const QString &directory : m_stagingDirectories) {
+        QDir(directory).removeRecursively();
+    }
+    m_stagingDirectories.clear();
+    // Output directories may be removed between batches
+    m_outputDirectories.clear();
+
+    bool ok = !m_failed;
+    m_failed = false;
+    return ok;
+}
+
+qint64 OutputWriter::commitCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_committed;
+}
+
+void OutputWriter::waitForSync(qint64 commits)
+{
+    // Groups are taken from the front of the queue, so the synced outputs
+    // are always the oldest commits
+    QMutexLocker locker(&m_mutex);
+    while (m_synced < commits) {
+        m_idle.wait(&m_mutex);
+    }
+}
+
+bool OutputWriter::usesIoUring() const
+{
+    return m_ioUring;
+}
+
+void OutputWriter::syncLoop()
+{
+    SyncRing ring(MaxGroupSize);
+    m_ioUring = ring.isValid();
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(SyncThreads);
+
+    // Commits that arrive while a group is syncing form the next group
+    QMutexLocker locker(&m_mutex);
+    while (true) {
+        while (m_pending.isEmpty() && !m_stopping) {
+            m_pendingAvailable.wait(&m_mutex);
+        }
+        if (m_pending.isEmpty()) {
+            break;
+        }
+
+        QStringList group = m_pending.mid(0, MaxGroupSize);
+        m_pending.remove(0, group.size());
+        m_syncing = true;
+        locker.unlock();
+
+        bool ok = true;
+#ifdef Q_OS_UNIX
+        ok = syncFiles(group, &ring, &threadPool);
+        m_ioUring = ring.isValid();
+#endif
+
+        locker.relock();
+        m_syncing = false;
+        m_failed = m_failed || !ok;
+        m_synced += group.size();
+        m_idle.wakeAll();
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+
+// Final stage for conversion outputs: every output is written to a
+// temporary file (or a staging directory, for converters that pick their
+// own file names) and then renamed over its final path, so a crash never
+// leaves a truncated file behind a real output name.
+//
+// The rename happens in commit(), so the cache and progress reporting see
+// the final file at once; making it durable does not hold up the worker.
+// Committed files are fsynced on a background thread in groups: all files
+// of a group, then their directories, as one io_uring submission each
+// where the kernel allows it, otherwise on a small thread pool. flush()
+// waits until everything committed so far is on stable storage.
+class OutputWriter
+{
+public:
+    OutputWriter();
+    ~OutputWriter();
+
+    // Where a writer puts an output before commit(); in the same
+    // directory, hidden, and not matching any input filter. The directory
+    // is created if need be.
+    QString temporaryPath(const QString &outputPath);
+
+    // Creates the directory outputPath goes into, once per directory until
+    // the next flush(); for outputs that are not staged, such as cache clones
+    bool prepareDirectory(const QString &outputPath);
+
+    // Private directory next to the outputs of one worker of this writer,
+    // created on first use and removed by flush()
+    QString stagingDirectory(const QString &outputDirectory, int workerIndex);
+    // Removes the staging directories next to outputDirectory now, for
+    // callers that write into a temporary directory and never flush(), and
+    // forgets that outputDirectory was created
+    void releaseStagingDirectories(const QString &outputDirectory);
+
+    // Atomically replaces outputPath with the finished temporary file and
+    // queues it for syncing; the temporary file is removed on failure
+    bool commit(const QString &temporaryPath, const QString &outputPath);
+
+    // Blocks until every committed output is synced; false if a sync failed
+    // since the last flush
+    bool flush();
+
+    // Outputs committed so far; waitForSync(count) returns once the first
+    // count of them are synced, while later commits keep arriving
+    qint64 commitCount() const;
+    void waitForSync(qint64 commits);
+
+    // Whether groups are synced through io_uring
+    bool usesIoUring() const;
+
+private:
+    void syncLoop();
+
+    QThread *m_thread;
+    mutable QMutex m_mutex;
+    QWaitCondition m_pendingAvailable;
+    QWaitCondition m_idle;
+    QStringList m_pending;
+    bool m_syncing;
+    bool m_stopping;
+    bool m_failed;
+    qint64 m_committed;
+    qint64 m_synced;
+    QSet<QString> m_stagingDirectories;
+    QSet<QString> m_outputDirectories;
+    std::atomic<bool> m_ioUring;
+    int m_instance;     // keeps staging directories of writers apart
+};
+
+#endif // OUTPUTWRITER_H
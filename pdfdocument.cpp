@@ -0,0 +1,1202 @@
+#include "pdfdocument.h"
+#include "bytescan.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <limits>
+
+#ifdef DOCPDF_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+const int MaxDepth = 64;
+
+// Inflated streams may grow to this multiple of the file size, but never
+// past the hard limit; a few-KB deflate bomb otherwise fills a worker's
+// memory. Small files still get room for well-compressed content.
+const qint64 InflateRatio = 100;
+const qint64 MinInflatedSize = qint64(16) << 20;
+const qint64 MaxInflatedSize = qint64(512) << 20;
+
+const PdfObject::ArrayData &emptyArray()
+{
+    static const PdfObject::ArrayData empty;
+    return empty;
+}
+
+const PdfObject::DictionaryData &emptyDictionary()
+{
+    static const PdfObject::DictionaryData empty;
+    return empty;
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+} // namespace
+
+// PdfObject
+
+PdfObject PdfObject::makeBoolean(bool value)
+{
+    PdfObject object;
+    object.m_type = Boolean;
+    object.m_boolean = value;
+    return object;
+}
+
+PdfObject PdfObject::makeNumber(double value)
+{
+    PdfObject object;
+    object.m_type = Number;
+    object.m_number = value;
+    return object;
+}
+
+PdfObject PdfObject::makeBytes(Type type, const QByteArray &bytes)
+{
+    PdfObject object;
+    object.m_type = type;
+    object.m_bytes = bytes;
+    return object;
+}
+
+PdfObject PdfObject::makeArray(ArrayData items)
+{
+    PdfObject object;
+    object.m_type = Array;
+    object.m_array = std::make_shared<const ArrayData>(std::move(items));
+    return object;
+}
+
+PdfObject PdfObject::makeDictionary(DictionaryData entries)
+{
+    PdfObject object;
+    object.m_type = Dictionary;
+    object.m_dictionary = std::make_shared<const DictionaryData>(std::move(entries));
+    return object;
+}
+
+PdfObject PdfObject::makeStream(const PdfObject &dictionary, qint64 dataOffset)
+{
+    PdfObject object = dictionary;
+    object.m_type = Stream;
+    object.m_streamOffset = dataOffset;
+    return object;
+}
+
+PdfObject PdfObject::makeReference(int objectNumber)
+{
+    PdfObject object;
+    object.m_type = Reference;
+    object.m_referenceNumber = objectNumber;
+    return object;
+}
+
+const PdfObject::ArrayData &PdfObject::array() const
+{
+    return m_array ? *m_array : emptyArray();
+}
+
+const PdfObject::DictionaryData &PdfObject::dictionary() const
+{
+    return m_dictionary ? *m_dictionary : emptyDictionary();
+}
+
+PdfObject PdfObject::value(const char *key) const
+{
+    for (const auto &entry : dictionary()) {
+        if (entry.first == key) {
+            return entry.second;
+        }
+    }
+    return PdfObject();
+}
+
+// PdfLexer
+
+PdfLexer::PdfLexer(const char *data, qint64 size, qint64 position)
+    : m_data(data)
+    , m_size(size)
+    , m_position(position)
+    , m_referencesAllowed(true)
+    , m_number(0)
+    , m_numberIsInteger(false)
+{
+}
+
+bool PdfLexer::isWhitespace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+}
+
+bool PdfLexer::isDelimiter(char c)
+{
+    return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']'
+           || c == '{' || c == '}' || c == '/' || c == '%';
+}
+
+void PdfLexer::skipWhitespace()
+{
+    while (m_position < m_size) {
+        char c = m_data[m_position];
+        if (isWhitespace(c)) {
+            m_position++;
+        } else if (c == '%') {
+            while (m_position < m_size && m_data[m_position] != '\n' && m_data[m_position] != '\r') {
+                m_position++;
+            }
+        } else {
+            break;
+        }
+    }
+}
+
+bool PdfLexer::atEnd()
+{
+    skipWhitespace();
+    return m_position >= m_size;
+}
+
+PdfLexer::TokenType PdfLexer::next()
+{
+    skipWhitespace();
+    if (m_position >= m_size) {
+        return EndOfData;
+    }
+
+    char c = m_data[m_position];
+    switch (c) {
+    case '(':
+        readLiteralString();
+        return StringToken;
+    case '<':
+        if (m_position + 1 < m_size && m_data[m_position + 1] == '<') {
+            m_position += 2;
+            return DictionaryBegin;
+        }
+        readHexString();
+        return StringToken;
+    case '>':
+        if (m_position + 1 < m_size && m_data[m_position + 1] == '>') {
+            m_position += 2;
+            return DictionaryEnd;
+        }
+        m_position++;
+        return InvalidToken;
+    case '[':
+        m_position++;
+        return ArrayBegin;
+    case ']':
+        m_position++;
+        return ArrayEnd;
+    case '/':
+        readName();
+        return NameToken;
+    case ')':
+    case '{':
+    case '}':
+        m_position++;
+        return InvalidToken;
+    default:
+        break;
+    }
+
+    if ((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.') {
+        readNumber();
+        return NumberToken;
+    }
+
+    qint64 start = m_position;
+    m_position = ByteScan::findTokenEnd(m_data, m_size, m_position);
+    m_token = QByteArray(m_data + start, m_position - start);
+    return KeywordToken;
+}
+
+void PdfLexer::readNumber()
+{
+    bool negative = false;
+    if (m_data[m_position] == '+' || m_data[m_position] == '-') {
+        negative = m_data[m_position] == '-';
+        m_position++;
+    }
+
+    double value = 0;
+    bool integer = true;
+    while (m_position < m_size && m_data[m_position] >= '0' && m_data[m_position] <= '9') {
+        value = value * 10 + (m_data[m_position] - '0');
+        m_position++;
+    }
+
+    if (m_position < m_size && m_data[m_position] == '.') {
+        integer = false;
+        m_position++;
+        double scale = 0.1;
+        while (m_position < m_size && m_data[m_position] >= '0' && m_data[m_position] <= '9') {
+            value += (m_data[m_position] - '0') * scale;
+            scale *= 0.1;
+            m_position++;
+        }
+    }
+
+    // Tolerate garbage such as "0.0.1" or "--5" by skipping to the delimiter
+    while (m_position < m_size && !isWhitespace(m_data[m_position]) && !isDelimiter(m_data[m_position])) {
+        m_position++;
+    }
+
+    m_number = negative ? -value : value;
+    m_numberIsInteger = integer;
+}
+
+void PdfLexer::readLiteralString()
+{
+    m_token.clear();
+    m_position++; // '('
+    int nesting = 1;
+
+    while (m_position < m_size) {
+        // Copy the run of ordinary bytes in one go
+        qint64 special = ByteScan::findStringSpecial(m_data, m_size, m_position);
+        m_token.append(m_data + m_position, special - m_position);
+        m_position = special;
+        if (m_position >= m_size) {
+            break;
+        }
+
+        char c = m_data[m_position++];
+        if (c == '(') {
+            nesting++;
+        } else if (c == ')') {
+            if (--nesting == 0) {
+                return;
+            }
+        } else if (c == '\\' && m_position < m_size) {
+            char e = m_data[m_position++];
+            switch (e) {
+            case 'n': m_token.append('\n'); continue;
+            case 'r': m_token.append('\r'); continue;
+            case 't': m_token.append('\t'); continue;
+            case 'b': m_token.append('\b'); continue;
+            case 'f': m_token.append('\f'); continue;
+            case '\r':
+                if (m_position < m_size && m_data[m_position] == '\n') {
+                    m_position++;
+                }
+                continue;
+            case '\n':
+                continue;
+            default:
+                break;
+            }
+            if (e >= '0' && e <= '7') {
+                int value = e - '0';
+                for (int i = 0; i < 2 && m_position < m_size; ++i) {
+                    char d = m_data[m_position];
+                    if (d < '0' || d > '7') {
+                        break;
+                    }
+                    value = value * 8 + (d - '0');
+                    m_position++;
+                }
+                m_token.append(char(value & 0xFF));
+            } else {
+                m_token.append(e);
+            }
+            continue;
+        }
+        m_token.append(c);
+    }
+}
+
+void PdfLexer::readHexString()
+{
+    m_token.clear();
+    m_position++; // '<'
+    int high = -1;
+
+    while (m_position < m_size) {
+        char c = m_data[m_position++];
+        if (c == '>') {
+            break;
+        }
+        int value = hexValue(c);
+        if (value < 0) {
+            continue;
+        }
+        if (high < 0) {
+            high = value;
+        } else {
+            m_token.append(char((high << 4) | value));
+            high = -1;
+        }
+    }
+
+    if (high >= 0) {
+        m_token.append(char(high << 4));
+    }
+}
+
+void PdfLexer::readName()
+{
+    m_token.clear();
+    m_position++; // '/'
+
+    while (m_position < m_size) {
+        char c = m_data[m_position];
+        if (isWhitespace(c) || isDelimiter(c)) {
+            break;
+        }
+        if (c == '#' && m_position + 2 < m_size) {
+            int high = hexValue(m_data[m_position + 1]);
+            int low = hexValue(m_data[m_position + 2]);
+            if (high >= 0 && low >= 0) {
+                m_token.append(char((high << 4) | low));
+                m_position += 3;
+                continue;
+            }
+        }
+        m_token.append(c);
+        m_position++;
+    }
+}
+
+PdfObject PdfLexer::parseObject(int depth)
+{
+    return objectFromToken(next(), depth);
+}
+
+PdfObject PdfLexer::objectFromToken(TokenType type, int depth)
+{
+    if (depth > MaxDepth) {
+        return PdfObject();
+    }
+
+    switch (type) {
+    case NumberToken: {
+        double value = m_number;
+        if (m_referencesAllowed && m_numberIsInteger && value >= 0 && value <= std::numeric_limits<int>::max()) {
+            // Look ahead for "n g R"
+            qint64 saved = m_position;
+            if (next() == NumberToken && m_numberIsInteger) {
+                if (next() == KeywordToken && m_token == "R") {
+                    return PdfObject::makeReference(int(value));
+                }
+            }
+            m_position = saved;
+        }
+        return PdfObject::makeNumber(value);
+    }
+    case StringToken:
+        return PdfObject::makeBytes(PdfObject::String, m_token);
+    case NameToken:
+        return PdfObject::makeBytes(PdfObject::Name, m_token);
+    case KeywordToken:
+        if (m_token == "true") {
+            return PdfObject::makeBoolean(true);
+        }
+        if (m_token == "false") {
+            return PdfObject::makeBoolean(false);
+        }
+        if (m_token == "null") {
+            return PdfObject();
+        }
+        return PdfObject::makeBytes(PdfObject::Keyword, m_token);
+    case ArrayBegin: {
+        PdfObject::ArrayData items;
+        while (true) {
+            TokenType itemType = next();
+            if (itemType == ArrayEnd || itemType == EndOfData) {
+                break;
+            }
+            items.push_back(objectFromToken(itemType, depth + 1));
+        }
+        return PdfObject::makeArray(std::move(items));
+    }
+    case DictionaryBegin: {
+        PdfObject::DictionaryData entries;
+        while (true) {
+            TokenType keyType = next();
+            if (keyType == DictionaryEnd || keyType == EndOfData) {
+                break;
+            }
+            if (keyType != NameToken) {
+                continue;
+            }
+            QByteArray key = m_token;
+            qint64 saved = m_position;
+            TokenType valueType = next();
+            if (valueType == DictionaryEnd) {
+                m_position = saved;
+                continue;
+            }
+            entries.emplace_back(key, objectFromToken(valueType, depth + 1));
+        }
+        return PdfObject::makeDictionary(std::move(entries));
+    }
+    default:
+        return PdfObject();
+    }
+}
+
+void PdfLexer::skipInlineImage()
+{
+    // Dictionary entries up to the ID keyword
+    while (true) {
+        TokenType type = next();
+        if (type == EndOfData) {
+            return;
+        }
+        if (type == KeywordToken && m_token == "ID") {
+            break;
+        }
+    }
+
+    // One whitespace byte separates ID from the image data
+    m_position++;
+
+    // The data ends at "EI" surrounded by whitespace
+    while ((m_position = ByteScan::find(m_data, m_size, m_position, "EI", 2)) >= 0) {
+        if (isWhitespace(m_data[m_position - 1])
+            && (m_position + 2 >= m_size || isWhitespace(m_data[m_position + 2])
+                || isDelimiter(m_data[m_position + 2]))) {
+            m_position += 2;
+            return;
+        }
+        m_position++;
+    }
+    m_position = m_size;
+}
+
+// PdfDocument
+
+PdfDocument::PdfDocument()
+{
+}
+
+bool PdfDocument::load(const QString &fileName)
+{
+    release();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+
+    // Map the file rather than reading it; only the parts that are parsed
+    // get paged in, so large scanned files cost little memory
+    qint64 size = m_file.size();
+    uchar *mapped = size > 0 ? m_file.map(0, size) : nullptr;
+    if (mapped) {
+        m_data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), qsizetype(size));
+    } else {
+        m_data = m_file.readAll();
+        m_file.close();
+    }
+    return initialize();
+}
+
+bool PdfDocument::loadData(const QByteArray &data)
+{
+    release();
+    m_data = data;
+    return initialize();
+}
+
+void PdfDocument::release()
+{
+    // Cached objects may refer to the mapping, drop them before unmapping
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        m_objectCache.clear();
+        m_objectStreams.clear();
+    }
+    m_pages.clear();
+    m_trailer = PdfObject();
+    m_data.clear();
+    m_file.close();
+}
+
+bool PdfDocument::isEncrypted() const
+{
+    return !m_trailer.value("Encrypt").isNull();
+}
+
+bool PdfDocument::initialize()
+{
+    m_xref.clear();
+    m_pages.clear();
+    m_objectCache.clear();
+    m_objectStreams.clear();
+    m_trailer = PdfObject();
+
+    if (!m_data.left(1024).contains("%PDF")) {
+        m_errorString = "Not a PDF file";
+        return false;
+    }
+
+    qint64 startxref = m_data.lastIndexOf("startxref");
+    bool ok = false;
+    if (startxref >= 0) {
+        PdfLexer lexer(m_data.constData(), m_data.size(), startxref + 9);
+        if (lexer.next() == PdfLexer::NumberToken) {
+            ok = readXref(qint64(lexer.number()), 0);
+        }
+    }
+
+    if (!ok || m_trailer.value("Root").isNull()) {
+        if (!rebuildXref()) {
+            m_errorString = "Cross-reference data is damaged";
+            return false;
+        }
+    }
+
+    PdfObject catalog = resolvedValue(m_trailer, "Root");
+    collectPages(resolvedValue(catalog, "Pages"), PdfObject(), 0);
+
+    if (m_pages.isEmpty()) {
+        m_errorString = "Document has no pages";
+        return false;
+    }
+    return true;
+}
+
+bool PdfDocument::readXref(qint64 offset, int depth)
+{
+    if (offset <= 0 || offset >= m_data.size() || depth > 32) {
+        return false;
+    }
+
+    PdfLexer lexer(m_data.constData(), m_data.size(), offset);
+    if (lexer.next() == PdfLexer::KeywordToken && lexer.token() == "xref") {
+        return readXrefTable(lexer, depth);
+    }
+    return readXrefStream(offset, depth);
+}
+
+bool PdfDocument::readXrefTable(PdfLexer &lexer, int depth)
+{
+    lexer.setReferencesAllowed(false);
+
+    while (true) {
+        PdfLexer::TokenType type = lexer.next();
+        if (type == PdfLexer::KeywordToken && lexer.token() == "trailer") {
+            break;
+        }
+        if (type != PdfLexer::NumberToken) {
+            return false;
+        }
+        int first = int(lexer.number());
+        if (lexer.next() != PdfLexer::NumberToken) {
+            return false;
+        }
+        int count = int(lexer.number());
+
+        for (int i = 0; i < count; ++i) {
+            if (lexer.next() != PdfLexer::NumberToken) {
+                return false;
+            }
+            qint64 entryOffset = qint64(lexer.number());
+            lexer.next(); // generation
+            if (lexer.next() != PdfLexer::KeywordToken) {
+                return false;
+            }
+
+            // Entries from newer sections were read first and take precedence
+            int number = first + i;
+            if (!m_xref.contains(number)) {
+                XrefEntry entry;
+                entry.type = lexer.token() == "n" ? 1 : 0;
+                entry.offset = entryOffset;
+                m_xref.insert(number, entry);
+            }
+        }
+    }
+
+    lexer.setReferencesAllowed(true);
+    PdfObject trailer = lexer.parseObject();
+    if (!trailer.isDictionary()) {
+        return false;
+    }
+    if (m_trailer.isNull()) {
+        m_trailer = trailer;
+    }
+
+    // Hybrid files keep compressed objects in an extra xref stream
+    PdfObject xrefStream = trailer.value("XRefStm");
+    if (xrefStream.isNumber()) {
+        readXrefStream(xrefStream.toInteger(), depth + 1);
+    }
+
+    PdfObject previous = trailer.value("Prev");
+    if (previous.isNumber()) {
+        readXref(previous.toInteger(), depth + 1);
+    }
+    return true;
+}
+
+bool PdfDocument::readXrefStream(qint64 offset, int depth)
+{
+    PdfObject stream = parseObjectAt(offset, -1);
+    if (!stream.isStream() || !stream.value("Type").isName("XRef")) {
+        return false;
+    }
+
+    if (m_trailer.isNull()) {
+        m_trailer = stream;
+    }
+
+    const PdfObject::ArrayData &widths = stream.value("W").array();
+    if (widths.size() != 3) {
+        return false;
+    }
+    int w[3];
+    for (int i = 0; i < 3; ++i) {
+        w[i] = int(widths[i].toInteger());
+        if (w[i] < 0 || w[i] > 8) {
+            return false;
+        }
+    }
+
+    QList<int> index;
+    const PdfObject::ArrayData &indexArray = stream.value("Index").array();
+    if (indexArray.empty()) {
+        index << 0 << int(stream.value("Size").toInteger());
+    } else {
+        for (const PdfObject &value : indexArray) {
+            index << int(value.toInteger());
+        }
+    }
+
+    QByteArray data = streamData(stream);
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    const int rowSize = w[0] + w[1] + w[2];
+    qint64 position = 0;
+
+    auto field = [&](int width, qint64 defaultValue) {
+        if (width == 0) {
+            return defaultValue;
+        }
+        qint64 value = 0;
+        for (int i = 0; i < width; ++i) {
+            value = (value << 8) | bytes[position++];
+        }
+        return value;
+    };
+
+    for (int section = 0; section + 1 < index.size(); section += 2) {
+        int first = index[section];
+        int count = index[section + 1];
+        for (int i = 0; i < count; ++i) {
+            if (position + rowSize > data.size()) {
+                break;
+            }
+            XrefEntry entry;
+            entry.type = int(field(w[0], 1));
+            entry.offset = field(w[1], 0);
+            entry.index = int(field(w[2], 0));
+
+            int number = first + i;
+            if (!m_xref.contains(number)) {
+                m_xref.insert(number, entry);
+            }
+        }
+    }
+
+    PdfObject previous = stream.value("Prev");
+    if (previous.isNumber()) {
+        readXref(previous.toInteger(), depth + 1);
+    }
+    return true;
+}
+
+bool PdfDocument::rebuildXref()
+{
+    // Scan the whole file for "n g obj" headers; later definitions win
+    m_xref.clear();
+    m_trailer = PdfObject();
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        m_objectCache.clear();
+        m_objectStreams.clear();
+    }
+
+    const char *data = m_data.constData();
+    qint64 position = 0;
+
+    while ((position = ByteScan::find(data, m_data.size(), position, "obj", 3)) >= 0) {
+        qint64 end = position;
+        position += 3;
+
+        qint64 p = end - 1;
+        while (p >= 0 && PdfLexer::isWhitespace(data[p])) {
+            p--;
+        }
+        qint64 generationEnd = p;
+        while (p >= 0 && data[p] >= '0' && data[p] <= '9') {
+            p--;
+        }
+        if (p == generationEnd || p < 0 || !PdfLexer::isWhitespace(data[p])) {
+            continue;
+        }
+        while (p >= 0 && PdfLexer::isWhitespace(data[p])) {
+            p--;
+        }
+        qint64 numberEnd = p;
+        while (p >= 0 && data[p] >= '0' && data[p] <= '9') {
+            p--;
+        }
+        if (p == numberEnd) {
+            continue;
+        }
+
+        int number = QByteArray(data + p + 1, numberEnd - p).toInt();
+        XrefEntry entry;
+        entry.type = 1;
+        entry.offset = p + 1;
+        m_xref.insert(number, entry);
+    }
+
+    // Prefer the last classic trailer, otherwise find the catalog directly
+    qint64 trailerPosition = m_data.lastIndexOf("trailer");
+    if (trailerPosition >= 0) {
+        PdfLexer lexer(data, m_data.size(), trailerPosition + 7);
+        PdfObject trailer = lexer.parseObject();
+        if (trailer.isDictionary() && !trailer.value("Root").isNull()) {
+            m_trailer = trailer;
+        }
+    }
+
+    if (m_trailer.isNull()) {
+        for (auto it = m_xref.constBegin(); it != m_xref.constEnd(); ++it) {
+            PdfObject candidate = object(it.key());
+            if (candidate.isDictionary() && candidate.value("Type").isName("Catalog")) {
+                PdfObject::DictionaryData entries;
+                entries.emplace_back("Root", PdfObject::makeReference(it.key()));
+                m_trailer = PdfObject::makeDictionary(std::move(entries));
+                break;
+            }
+        }
+    }
+
+    return !m_trailer.isNull();
+}
+
+void PdfDocument::collectPages(const PdfObject &node, PdfObject inheritedResources, int depth)
+{
+    if (!node.isDictionary() || depth > MaxDepth) {
+        return;
+    }
+
+    PdfObject resources = resolvedValue(node, "Resources");
+    if (resources.isNull()) {
+        resources = inheritedResources;
+    }
+
+    PdfObject kids = resolvedValue(node, "Kids");
+    if (kids.isArray()) {
+        for (const PdfObject &kid : kids.array()) {
+            collectPages(resolve(kid), resources, depth + 1);
+        }
+        return;
+    }
+
+    PageEntry entry;
+    entry.page = node;
+    entry.resources = resources;
+    m_pages << entry;
+}
+
+QByteArray PdfDocument::pageContents(int index) const
+{
+    PdfObject contents = resolvedValue(page(index), "Contents");
+    if (contents.isStream()) {
+        return streamData(contents);
+    }
+
+    QByteArray result;
+    for (const PdfObject &part : contents.array()) {
+        result += streamData(resolve(part));
+        result += '\n';
+    }
+    return result;
+}
+
+PdfObject PdfDocument::object(int objectNumber) const
+{
+    // Guards against reference cycles through object streams
+    static thread_local int nesting = 0;
+    if (nesting > 32) {
+        return PdfObject();
+    }
+
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        auto cached = m_objectCache.constFind(objectNumber);
+        if (cached != m_objectCache.constEnd()) {
+            return cached.value();
+        }
+    }
+
+    XrefEntry entry = m_xref.value(objectNumber);
+    PdfObject result;
+    nesting++;
+    if (entry.type == 1) {
+        result = parseObjectAt(entry.offset, objectNumber);
+    } else if (entry.type == 2 && int(entry.offset) != objectNumber) {
+        result = parseFromObjectStream(int(entry.offset), entry.index, objectNumber);
+    }
+    nesting--;
+
+    QMutexLocker locker(&m_cacheMutex);
+    m_objectCache.insert(objectNumber, result);
+    return result;
+}
+
+PdfObject PdfDocument::resolve(const PdfObject &object) const
+{
+    PdfObject current = object;
+    for (int i = 0; i < 16 && current.isReference(); ++i) {
+        current = this->object(current.referenceNumber());
+    }
+    return current.isReference() ? PdfObject() : current;
+}
+
+PdfObject PdfDocument::resolvedValue(const PdfObject &dictionary, const char *key) const
+{
+    return resolve(dictionary.value(key));
+}
+
+PdfObject PdfDocument::parseObjectAt(qint64 offset, int expectedNumber) const
+{
+    if (offset < 0 || offset >= m_data.size()) {
+        return PdfObject();
+    }
+
+    PdfLexer lexer(m_data.constData(), m_data.size(), offset);
+    lexer.setReferencesAllowed(false);
+    if (lexer.next() != PdfLexer::NumberToken) {
+        return PdfObject();
+    }
+    if (expectedNumber >= 0 && int(lexer.number()) != expectedNumber) {
+        return PdfObject();
+    }
+    if (lexer.next() != PdfLexer::NumberToken
+        || lexer.next() != PdfLexer::KeywordToken || lexer.token() != "obj") {
+        return PdfObject();
+    }
+    lexer.setReferencesAllowed(true);
+
+    PdfObject result = lexer.parseObject();
+    if (!result.isDictionary()) {
+        return result;
+    }
+
+    qint64 afterDictionary = lexer.position();
+    if (lexer.next() == PdfLexer::KeywordToken && lexer.token() == "stream") {
+        // The keyword is followed by CRLF or LF (a lone CR is tolerated)
+        qint64 dataOffset = lexer.position();
+        if (dataOffset < m_data.size() && m_data[dataOffset] == '\r') {
+            dataOffset++;
+        }
+        if (dataOffset < m_data.size() && m_data[dataOffset] == '\n') {
+            dataOffset++;
+        }
+        return PdfObject::makeStream(result, dataOffset);
+    }
+
+    lexer.setPosition(afterDictionary);
+    return result;
+}
+
+PdfObject PdfDocument::parseFromObjectStream(int streamNumber, int index, int objectNumber) const
+{
+    std::shared_ptr<const ObjectStream> objectStream;
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        objectStream = m_objectStreams.value(streamNumber);
+    }
+
+    if (!objectStream) {
+        PdfObject stream = object(streamNumber);
+        if (!stream.isStream()) {
+            return PdfObject();
+        }
+
+        auto loaded = std::make_shared<ObjectStream>();
+        loaded->data = streamData(stream);
+
+        int count = int(stream.value("N").toInteger());
+        qint64 first = stream.value("First").toInteger();
+        PdfLexer lexer(loaded->data.constData(), loaded->data.size());
+        lexer.setReferencesAllowed(false);
+        for (int i = 0; i < count; ++i) {
+            if (lexer.next() != PdfLexer::NumberToken) {
+                break;
+            }
+            int number = int(lexer.number());
+            if (lexer.next() != PdfLexer::NumberToken) {
+                break;
+            }
+            loaded->offsets << qMakePair(number, first + qint64(lexer.number()));
+        }
+
+        objectStream = loaded;
+        QMutexLocker locker(&m_cacheMutex);
+        m_objectStreams.insert(streamNumber, objectStream);
+    }
+
+    // The xref index is authoritative, but fall back to a search by number
+    int slot = index;
+    if (slot < 0 || slot >= objectStream->offsets.size() || objectStream->offsets[slot].first != objectNumber) {
+        slot = -1;
+        for (int i = 0; i < objectStream->offsets.size(); ++i) {
+            if (objectStream->offsets[i].first == objectNumber) {
+                slot = i;
+                break;
+            }
+        }
+    }
+    if (slot < 0) {
+        return PdfObject();
+    }
+
+    PdfLexer lexer(objectStream->data.constData(), objectStream->data.size(), objectStream->offsets[slot].second);
+    return lexer.parseObject();
+}
+
+QByteArray PdfDocument::rawStreamData(const PdfObject &stream) const
+{
+    qint64 offset = stream.streamOffset();
+    if (!stream.isStream() || offset < 0 || offset > m_data.size()) {
+        return QByteArray();
+    }
+
+    qint64 length = resolvedValue(stream, "Length").toInteger();
+    bool lengthValid = length >= 0 && offset + length <= m_data.size();
+    if (lengthValid) {
+        // The declared length must be followed by the endstream keyword
+        PdfLexer lexer(m_data.constData(), m_data.size(), offset + length);
+        lengthValid = lexer.next() == PdfLexer::KeywordToken && lexer.token() == "endstream";
+    }
+
+    if (!lengthValid) {
+        qint64 end = ByteScan::find(m_data.constData(), m_data.size(), offset, "endstream", 9);
+        if (end < 0) {
+            end = m_data.size();
+        }
+        length = end - offset;
+        // Strip the EOL that precedes endstream
+        if (length > 0 && m_data[offset + length - 1] == '\n') {
+            length--;
+        }
+        if (length > 0 && m_data[offset + length - 1] == '\r') {
+            length--;
+        }
+    }
+
+    // Refers to the document buffer; decoding makes its own copy
+    return QByteArray::fromRawData(m_data.constData() + offset, qsizetype(length));
+}
+
+QByteArray PdfDocument::streamData(const PdfObject &stream) const
+{
+    QByteArray data = rawStreamData(stream);
+
+    PdfObject filter = resolvedValue(stream, "Filter");
+    PdfObject parameters = resolvedValue(stream, "DecodeParms");
+
+    if (filter.isName()) {
+        return applyFilter(data, filter.bytes(), parameters);
+    }
+
+    const PdfObject::ArrayData &filters = filter.array();
+    for (size_t i = 0; i < filters.size(); ++i) {
+        PdfObject filterParameters;
+        if (parameters.isArray() && i < parameters.array().size()) {
+            filterParameters = resolve(parameters.array()[i]);
+        }
+        data = applyFilter(data, resolve(filters[i]).bytes(), filterParameters);
+    }
+    return data;
+}
+
+QByteArray PdfDocument::applyFilter(const QByteArray &data, const QByteArray &filter, const PdfObject &parameters) const
+{
+    if (filter == "FlateDecode" || filter == "Fl") {
+        qint64 maxSize = qBound(MinInflatedSize, qint64(m_data.size()) * InflateRatio, MaxInflatedSize);
+        QByteArray decoded = inflate(data, maxSize);
+
+        int predictor = int(parameters.value("Predictor").toInteger());
+        if (predictor < 10) {
+            return decoded;
+        }
+
+        // PNG predictors, one filter-type byte per row
+        int columns = qMax<int>(1, int(parameters.value("Columns").toInteger()));
+        int colors = parameters.value("Colors").isNull() ? 1 : qMax<int>(1, int(parameters.value("Colors").toInteger()));
+        int bits = parameters.value("BitsPerComponent").isNull() ? 8 : int(parameters.value("BitsPerComponent").toInteger());
+        int bytesPerPixel = qMax(1, (colors * bits + 7) / 8);
+        int rowLength = (columns * colors * bits + 7) / 8;
+
+        QByteArray output;
+        output.reserve(decoded.size());
+        QByteArray previous(rowLength, '\0');
+        QByteArray row(rowLength, '\0');
+        const uchar *in = reinterpret_cast<const uchar *>(decoded.constData());
+
+        for (qint64 position = 0; position + rowLength + 1 <= decoded.size(); position += rowLength + 1) {
+            int type = in[position];
+            const uchar *src = in + position + 1;
+            uchar *cur = reinterpret_cast<uchar *>(row.data());
+            const uchar *up = reinterpret_cast<const uchar *>(previous.constData());
+
+            for (int i = 0; i < rowLength; ++i) {
+                int left = i >= bytesPerPixel ? cur[i - bytesPerPixel] : 0;
+                int upLeft = i >= bytesPerPixel ? up[i - bytesPerPixel] : 0;
+                int value = src[i];
+                switch (type) {
+                case 1: value += left; break;
+                case 2: value += up[i]; break;
+                case 3: value += (left + up[i]) / 2; break;
+                case 4: {
+                    int p = left + up[i] - upLeft;
+                    int pa = qAbs(p - left);
+                    int pb = qAbs(p - up[i]);
+                    int pc = qAbs(p - upLeft);
+                    value += (pa <= pb && pa <= pc) ? left : (pb <= pc ? up[i] : upLeft);
+                    break;
+                }
+                default:
+                    break;
+                }
+                cur[i] = uchar(value);
+            }
+
+            output += row;
+            previous = row;
+        }
+        return output;
+    }
+
+    if (filter == "ASCIIHexDecode" || filter == "AHx") {
+        QByteArray hex = "<" + data;
+        if (!hex.contains('>')) {
+            hex += '>';
+        }
+        PdfLexer hexLexer(hex.constData(), hex.size());
+        hexLexer.next();
+        return hexLexer.token();
+    }
+
+    if (filter == "ASCII85Decode" || filter == "A85") {
+        QByteArray output;
+        quint32 tuple = 0;
+        int count = 0;
+        for (char c : data) {
+            if (c == '~') {
+                break;
+            }
+            if (PdfLexer::isWhitespace(c)) {
+                continue;
+            }
+            if (c == 'z' && count == 0) {
+                output.append(4, '\0');
+                continue;
+            }
+            if (c < '!' || c > 'u') {
+                continue;
+            }
+            tuple = tuple * 85 + quint32(c - '!');
+            if (++count == 5) {
+                char bytes[4];
+                qToBigEndian(tuple, bytes);
+                output.append(bytes, 4);
+                tuple = 0;
+                count = 0;
+            }
+        }
+        if (count > 1) {
+            for (int i = count; i < 5; ++i) {
+                tuple = tuple * 85 + 84;
+            }
+            char bytes[4];
+            qToBigEndian(tuple, bytes);
+            output.append(bytes, count - 1);
+        }
+        return output;
+    }
+
+    // Image and unknown filters carry no text
+    return filter.isEmpty() ? data : QByteArray();
+}
+
+QByteArray PdfDocument::inflate(const QByteArray &data, qint64 maxSize)
+{
+    if (data.isEmpty() || maxSize <= 0) {
+        return QByteArray();
+    }
+
+#ifdef DOCPDF_HAVE_ZLIB
+    QByteArray output;
+    output.resize(qsizetype(qMin<qint64>(qMax<qint64>(qint64(data.size()) * 4, 4096), maxSize)));
+
+    z_stream stream = {};
+    if (inflateInit(&stream) != Z_OK) {
+        return QByteArray();
+    }
+
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = uInt(data.size());
+
+    while (true) {
+        if (stream.total_out >= uLong(output.size())) {
+            if (output.size() >= maxSize) {
+                inflateEnd(&stream);
+                return QByteArray();
+            }
+            output.resize(qsizetype(qMin<qint64>(qint64(output.size()) * 2, maxSize)));
+        }
+        stream.next_out = reinterpret_cast<Bytef *>(output.data() + stream.total_out);
+        stream.avail_out = uInt(output.size() - qsizetype(stream.total_out));
+
+        int status = ::inflate(&stream, Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+            break;
+        }
+        // Keep whatever was decoded from truncated or damaged streams
+        if (status != Z_OK && status != Z_BUF_ERROR) {
+            break;
+        }
+        if (status == Z_BUF_ERROR && stream.avail_in == 0) {
+            break;
+        }
+    }
+
+    output.resize(qsizetype(stream.total_out));
+    inflateEnd(&stream);
+    return output;
+#else
+    // qUncompress expects a big-endian size hint in front of the zlib stream
+    QByteArray prefixed(4, '\0');
+    qToBigEndian(quint32(qMin<qint64>(qint64(data.size()) * 4, maxSize)), prefixed.data());
+    prefixed += data;
+    // qUncompress cannot be stopped early; the limit at least keeps the
+    // oversized result from reaching the caller
+    QByteArray output = qUncompress(prefixed);
+    return output.size() > maxSize ? QByteArray() : output;
+#endif
+}
@@ -0,0 +1,214 @@
+#ifndef PDFDOCUMENT_H
+#define PDFDOCUMENT_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// A parsed PDF object. Arrays and dictionaries are shared, so copies are cheap.
+class PdfObject
+{
+public:
+    enum Type {
+        Null,
+        Boolean,
+        Number,
+        String,
+        Name,
+        Array,
+        Dictionary,
+        Stream,
+        Reference,
+        Keyword
+    };
+
+    using ArrayData = std::vector<PdfObject>;
+    using DictionaryData = std::vector<std::pair<QByteArray, PdfObject>>;
+
+    PdfObject() = default;
+
+    static PdfObject makeBoolean(bool value);
+    static PdfObject makeNumber(double value);
+    static PdfObject makeBytes(Type type, const QByteArray &bytes);
+    static PdfObject makeArray(ArrayData items);
+    static PdfObject makeDictionary(DictionaryData entries);
+    static PdfObject makeStream(const PdfObject &dictionary, qint64 dataOffset);
+    static PdfObject makeReference(int objectNumber);
+
+    Type type() const { return m_type; }
+    bool isNull() const { return m_type == Null; }
+    bool isNumber() const { return m_type == Number; }
+    bool isName() const { return m_type == Name; }
+    bool isName(const char *name) const { return m_type == Name && m_bytes == name; }
+    bool isArray() const { return m_type == Array; }
+    bool isDictionary() const { return m_type == Dictionary || m_type == Stream; }
+    bool isStream() const { return m_type == Stream; }
+    bool isReference() const { return m_type == Reference; }
+    bool isKeyword(const char *keyword) const { return m_type == Keyword && m_bytes == keyword; }
+
+    bool toBool() const { return m_boolean; }
+    double toDouble() const { return m_number; }
+    qint64 toInteger() const { return qint64(m_number); }
+
+    // Payload of strings, names and keywords
+    const QByteArray &bytes() const { return m_bytes; }
+
+    const ArrayData &array() const;
+    const DictionaryData &dictionary() const;
+    PdfObject value(const char *key) const;
+
+    int referenceNumber() const { return m_referenceNumber; }
+    qint64 streamOffset() const { return m_streamOffset; }
+
+private:
+    Type m_type = Null;
+    bool m_boolean = false;
+    double m_number = 0;
+    int m_referenceNumber = 0;
+    qint64 m_streamOffset = -1;
+    QByteArray m_bytes;
+    std::shared_ptr<const ArrayData> m_array;
+    std::shared_ptr<const DictionaryData> m_dictionary;
+};
+
+// Tokenizer and object parser for PDF syntax (file bodies and content streams)
+class PdfLexer
+{
+public:
+    enum TokenType {
+        EndOfData,
+        NumberToken,
+        StringToken,
+        NameToken,
+        KeywordToken,
+        ArrayBegin,
+        ArrayEnd,
+        DictionaryBegin,
+        DictionaryEnd,
+        InvalidToken
+    };
+
+    PdfLexer(const char *data, qint64 size, qint64 position = 0);
+
+    // Content streams never contain "n g R" references
+    void setReferencesAllowed(bool allowed) { m_referencesAllowed = allowed; }
+
+    TokenType next();
+    const QByteArray &token() const { return m_token; }
+    double number() const { return m_number; }
+    bool numberIsInteger() const { return m_numberIsInteger; }
+
+    PdfObject parseObject(int depth = 0);
+
+    // Skips the data of an inline image; call after reading "BI"
+    void skipInlineImage();
+
+    qint64 position() const { return m_position; }
+    void setPosition(qint64 position) { m_position = position; }
+    bool atEnd();
+    void skipWhitespace();
+
+    static bool isWhitespace(char c);
+    static bool isDelimiter(char c);
+
+private:
+    PdfObject objectFromToken(TokenType type, int depth);
+    void readLiteralString();
+    void readHexString();
+    void readName();
+    void readNumber();
+
+    const char *m_data;
+    qint64 m_size;
+    qint64 m_position;
+    bool m_referencesAllowed;
+
+    QByteArray m_token;
+    double m_number;
+    bool m_numberIsInteger;
+};
+
+// Read-only access to the object graph of a PDF file: cross-reference tables
+// and streams (with a rebuild fallback for damaged files), object streams and
+// the page tree. Object lookups are thread-safe.
+class PdfDocument
+{
+public:
+    PdfDocument();
+
+    bool load(const QString &fileName);
+    bool loadData(const QByteArray &data);
+
+    QString errorString() const { return m_errorString; }
+    bool isEncrypted() const;
+
+    int pageCount() const { return m_pages.size(); }
+    PdfObject page(int index) const { return m_pages.value(index).page; }
+    PdfObject pageResources(int index) const { return m_pages.value(index).resources; }
+
+    // Decoded page content (all content streams concatenated)
+    QByteArray pageContents(int index) const;
+
+    PdfObject object(int objectNumber) const;
+    PdfObject resolve(const PdfObject &object) const;
+    PdfObject resolvedValue(const PdfObject &dictionary, const char *key) const;
+
+    // Raw and decoded stream data. Both may refer to the document buffer
+    // (the file mapping), so they must not outlive the document.
+    QByteArray rawStreamData(const PdfObject &stream) const;
+    QByteArray streamData(const PdfObject &stream) const;
+
+    const PdfObject &trailer() const { return m_trailer; }
+
+    // Returns an empty array when the output would exceed maxSize
+    static QByteArray inflate(const QByteArray &data, qint64 maxSize);
+
+private:
+    struct XrefEntry {
+        int type = 0;           // 0 free, 1 in file, 2 in object stream
+        qint64 offset = 0;      // file offset, or object stream number
+        int index = 0;          // index inside the object stream
+    };
+
+    struct PageEntry {
+        PdfObject page;
+        PdfObject resources;
+    };
+
+    struct ObjectStream {
+        QByteArray data;
+        QList<QPair<int, qint64>> offsets; // object number, offset in data
+    };
+
+    void release();
+    bool initialize();
+    bool readXref(qint64 offset, int depth);
+    bool readXrefTable(PdfLexer &lexer, int depth);
+    bool readXrefStream(qint64 offset, int depth);
+    bool rebuildXref();
+    void collectPages(const PdfObject &node, PdfObject inheritedResources, int depth);
+
+    PdfObject parseObjectAt(qint64 offset, int expectedNumber) const;
+    PdfObject parseFromObjectStream(int streamNumber, int index, int objectNumber) const;
+    QByteArray applyFilter(const QByteArray &data, const QByteArray &filter, const PdfObject &parameters) const;
+
+    QFile m_file;
+    QByteArray m_data;          // the mapped file, or a copy if mapping failed
+    QString m_errorString;
+    PdfObject m_trailer;
+    QHash<int, XrefEntry> m_xref;
+    QList<PageEntry> m_pages;
+
+    mutable QMutex m_cacheMutex;
+    mutable QHash<int, PdfObject> m_objectCache;
+    mutable QHash<int, std::shared_ptr<const ObjectStream>> m_objectStreams;
+};
+
+#endif // PDFDOCUMENT_H
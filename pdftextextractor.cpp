@@ -0,0 +1,677 @@
+#include "pdftextextractor.h"
+#include <QtMath>
+
+namespace {
+
+const int MaxFormDepth = 10;
+
+// WinAnsiEncoding: glyph names and code points for codes 0x20-0xFF
+struct GlyphEntry {
+    const char *name;
+    char32_t unicode;
+};
+
+const GlyphEntry WinAnsiGlyphs[224] = {
+    {"space", 0x20}, {"exclam", 0x21}, {"quotedbl", 0x22}, {"numbersign", 0x23},
+    {"dollar", 0x24}, {"percent", 0x25}, {"ampersand", 0x26}, {"quotesingle", 0x27},
+    {"parenleft", 0x28}, {"parenright", 0x29}, {"asterisk", 0x2A}, {"plus", 0x2B},
+    {"comma", 0x2C}, {"hyphen", 0x2D}, {"period", 0x2E}, {"slash", 0x2F},
+    {"zero", 0x30}, {"one", 0x31}, {"two", 0x32}, {"three", 0x33},
+    {"four", 0x34}, {"five", 0x35}, {"six", 0x36}, {"seven", 0x37},
+    {"eight", 0x38}, {"nine", 0x39}, {"colon", 0x3A}, {"semicolon", 0x3B},
+    {"less", 0x3C}, {"equal", 0x3D}, {"greater", 0x3E}, {"question", 0x3F},
+    {"at", 0x40}, {"A", 0x41}, {"B", 0x42}, {"C", 0x43},
+    {"D", 0x44}, {"E", 0x45}, {"F", 0x46}, {"G", 0x47},
+    {"H", 0x48}, {"I", 0x49}, {"J", 0x4A}, {"K", 0x4B},
+    {"L", 0x4C}, {"M", 0x4D}, {"N", 0x4E}, {"O", 0x4F},
+    {"P", 0x50}, {"Q", 0x51}, {"R", 0x52}, {"S", 0x53},
+    {"T", 0x54}, {"U", 0x55}, {"V", 0x56}, {"W", 0x57},
+    {"X", 0x58}, {"Y", 0x59}, {"Z", 0x5A}, {"bracketleft", 0x5B},
+    {"backslash", 0x5C}, {"bracketright", 0x5D}, {"asciicircum", 0x5E}, {"underscore", 0x5F},
+    {"grave", 0x60}, {"a", 0x61}, {"b", 0x62}, {"c", 0x63},
+    {"d", 0x64}, {"e", 0x65}, {"f", 0x66}, {"g", 0x67},
+    {"h", 0x68}, {"i", 0x69}, {"j", 0x6A}, {"k", 0x6B},
+    {"l", 0x6C}, {"m", 0x6D}, {"n", 0x6E}, {"o", 0x6F},
+    {"p", 0x70}, {"q", 0x71}, {"r", 0x72}, {"s", 0x73},
+    {"t", 0x74}, {"u", 0x75}, {"v", 0x76}, {"w", 0x77},
+    {"x", 0x78}, {"y", 0x79}, {"z", 0x7A}, {"braceleft", 0x7B},
+    {"bar", 0x7C}, {"braceright", 0x7D}, {"asciitilde", 0x7E}, {nullptr, 0},
+    {"Euro", 0x20AC}, {nullptr, 0}, {"quotesinglbase", 0x201A}, {"florin", 0x0192},
+    {"quotedblbase", 0x201E}, {"ellipsis", 0x2026}, {"dagger", 0x2020}, {"daggerdbl", 0x2021},
+    {"circumflex", 0x02C6}, {"perthousand", 0x2030}, {"Scaron", 0x0160}, {"guilsinglleft", 0x2039},
+    {"OE", 0x0152}, {nullptr, 0}, {"Zcaron", 0x017D}, {nullptr, 0},
+    {nullptr, 0}, {"quoteleft", 0x2018}, {"quoteright", 0x2019}, {"quotedblleft", 0x201C},
+    {"quotedblright", 0x201D}, {"bullet", 0x2022}, {"endash", 0x2013}, {"emdash", 0x2014},
+    {"tilde", 0x02DC}, {"trademark", 0x2122}, {"scaron", 0x0161}, {"guilsinglright", 0x203A},
+    {"oe", 0x0153}, {nullptr, 0}, {"zcaron", 0x017E}, {"Ydieresis", 0x0178},
+    {"nbspace", 0xA0}, {"exclamdown", 0xA1}, {"cent", 0xA2}, {"sterling", 0xA3},
+    {"currency", 0xA4}, {"yen", 0xA5}, {"brokenbar", 0xA6}, {"section", 0xA7},
+    {"dieresis", 0xA8}, {"copyright", 0xA9}, {"ordfeminine", 0xAA}, {"guillemotleft", 0xAB},
+    {"logicalnot", 0xAC}, {"sfthyphen", 0xAD}, {"registered", 0xAE}, {"macron", 0xAF},
+    {"degree", 0xB0}, {"plusminus", 0xB1}, {"twosuperior", 0xB2}, {"threesuperior", 0xB3},
+    {"acute", 0xB4}, {"mu", 0xB5}, {"paragraph", 0xB6}, {"periodcentered", 0xB7},
+    {"cedilla", 0xB8}, {"onesuperior", 0xB9}, {"ordmasculine", 0xBA}, {"guillemotright", 0xBB},
+    {"onequarter", 0xBC}, {"onehalf", 0xBD}, {"threequarters", 0xBE}, {"questiondown", 0xBF},
+    {"Agrave", 0xC0}, {"Aacute", 0xC1}, {"Acircumflex", 0xC2}, {"Atilde", 0xC3},
+    {"Adieresis", 0xC4}, {"Aring", 0xC5}, {"AE", 0xC6}, {"Ccedilla", 0xC7},
+    {"Egrave", 0xC8}, {"Eacute", 0xC9}, {"Ecircumflex", 0xCA}, {"Edieresis", 0xCB},
+    {"Igrave", 0xCC}, {"Iacute", 0xCD}, {"Icircumflex", 0xCE}, {"Idieresis", 0xCF},
+    {"Eth", 0xD0}, {"Ntilde", 0xD1}, {"Ograve", 0xD2}, {"Oacute", 0xD3},
+    {"Ocircumflex", 0xD4}, {"Otilde", 0xD5}, {"Odieresis", 0xD6}, {"multiply", 0xD7},
+    {"Oslash", 0xD8}, {"Ugrave", 0xD9}, {"Uacute", 0xDA}, {"Ucircumflex", 0xDB},
+    {"Udieresis", 0xDC}, {"Yacute", 0xDD}, {"Thorn", 0xDE}, {"germandbls", 0xDF},
+    {"agrave", 0xE0}, {"aacute", 0xE1}, {"acircumflex", 0xE2}, {"atilde", 0xE3},
+    {"adieresis", 0xE4}, {"aring", 0xE5}, {"ae", 0xE6}, {"ccedilla", 0xE7},
+    {"egrave", 0xE8}, {"eacute", 0xE9}, {"ecircumflex", 0xEA}, {"edieresis", 0xEB},
+    {"igrave", 0xEC}, {"iacute", 0xED}, {"icircumflex", 0xEE}, {"idieresis", 0xEF},
+    {"eth", 0xF0}, {"ntilde", 0xF1}, {"ograve", 0xF2}, {"oacute", 0xF3},
+    {"ocircumflex", 0xF4}, {"otilde", 0xF5}, {"odieresis", 0xF6}, {"divide", 0xF7},
+    {"oslash", 0xF8}, {"ugrave", 0xF9}, {"uacute", 0xFA}, {"ucircumflex", 0xFB},
+    {"udieresis", 0xFC}, {"yacute", 0xFD}, {"thorn", 0xFE}, {"ydieresis", 0xFF}
+};
+
+const GlyphEntry ExtraGlyphs[] = {
+    {"fi", 0xFB01}, {"fl", 0xFB02}, {"ff", 0xFB00}, {"ffi", 0xFB03}, {"ffl", 0xFB04},
+    {"minus", 0x2212}, {"dotlessi", 0x0131}, {"Lslash", 0x0141}, {"lslash", 0x0142},
+    {"fraction", 0x2044}, {"quotedblbase", 0x201E}, {"space", 0x20}
+};
+
+void appendUtf8(QByteArray &out, char32_t c)
+{
+    // Lone surrogates, the noncharacters XML forbids and values past
+    // Unicode come from broken ToUnicode maps and glyph names; the
+    // replacement character keeps the output valid UTF-8
+    if ((c >= 0xD800 && c <= 0xDFFF) || c == 0xFFFE || c == 0xFFFF || c >= 0x110000) {
+        c = 0xFFFD;
+    }
+    if (c < 0x80) {
+        out.append(char(c));
+    } else if (c < 0x800) {
+        out.append(char(0xC0 | (c >> 6)));
+        out.append(char(0x80 | (c & 0x3F)));
+    } else if (c < 0x10000) {
+        out.append(char(0xE0 | (c >> 12)));
+        out.append(char(0x80 | ((c >> 6) & 0x3F)));
+        out.append(char(0x80 | (c & 0x3F)));
+    } else {
+        out.append(char(0xF0 | (c >> 18)));
+        out.append(char(0x80 | ((c >> 12) & 0x3F)));
+        out.append(char(0x80 | ((c >> 6) & 0x3F)));
+        out.append(char(0x80 | (c & 0x3F)));
+    }
+}
+
+QByteArray utf16BeToUtf8(const QByteArray &bytes)
+{
+    QByteArray out;
+    const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+    for (int i = 0; i + 1 < bytes.size(); i += 2) {
+        char32_t unit = char32_t((data[i] << 8) | data[i + 1]);
+        if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < bytes.size()) {
+            char32_t low = char32_t((data[i + 2] << 8) | data[i + 3]);
+            if (low >= 0xDC00 && low < 0xE000) {
+                unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+        }
+        appendUtf8(out, unit);
+    }
+    // Odd-length destinations are single bytes in practice
+    if (bytes.size() == 1) {
+        appendUtf8(out, char32_t(data[0]));
+    }
+    return out;
+}
+
+quint32 codeFromBytes(const QByteArray &bytes)
+{
+    quint32 code = 0;
+    for (char c : bytes) {
+        code = (code << 8) | uchar(c);
+    }
+    return code;
+}
+
+const QHash<QByteArray, char32_t> &glyphNames()
+{
+    static const QHash<QByteArray, char32_t> names = [] {
+        QHash<QByteArray, char32_t> map;
+        for (const GlyphEntry &entry : WinAnsiGlyphs) {
+            if (entry.name) {
+                map.insert(entry.name, entry.unicode);
+            }
+        }
+        for (const GlyphEntry &entry : ExtraGlyphs) {
+            map.insert(entry.name, entry.unicode);
+        }
+        return map;
+    }();
+    return names;
+}
+
+// Maps a glyph name to UTF-8 following the Adobe Glyph List conventions
+QByteArray glyphNameToUtf8(QByteArray name)
+{
+    int dot = name.indexOf('.');
+    if (dot > 0) {
+        name.truncate(dot);
+    }
+
+    QByteArray out;
+    if (name.contains('_')) {
+        for (const QByteArray &part : name.split('_')) {
+            out += glyphNameToUtf8(part);
+        }
+        return out;
+    }
+
+    auto known = glyphNames().constFind(name);
+    if (known != glyphNames().constEnd()) {
+        appendUtf8(out, known.value());
+        return out;
+    }
+
+    bool ok = false;
+    if (name.startsWith("uni") && name.size() >= 7 && (name.size() - 3) % 4 == 0) {
+        for (int i = 3; i + 4 <= name.size(); i += 4) {
+            uint unit = name.mid(i, 4).toUInt(&ok, 16);
+            if (!ok) {
+                return QByteArray();
+            }
+            appendUtf8(out, char32_t(unit));
+        }
+        return out;
+    }
+    if (name.startsWith('u') && name.size() >= 5 && name.size() <= 7) {
+        uint unit = name.mid(1).toUInt(&ok, 16);
+        if (ok) {
+            appendUtf8(out, char32_t(unit));
+        }
+        return out;
+    }
+    return out;
+}
+
+void multiply(const double a[6], const double b[6], double result[6])
+{
+    double r[6];
+    r[0] = a[0] * b[0] + a[1] * b[2];
+    r[1] = a[0] * b[1] + a[1] * b[3];
+    r[2] = a[2] * b[0] + a[3] * b[2];
+    r[3] = a[2] * b[1] + a[3] * b[3];
+    r[4] = a[4] * b[0] + a[5] * b[2] + b[4];
+    r[5] = a[4] * b[1] + a[5] * b[3] + b[5];
+    for (int i = 0; i < 6; ++i) {
+        result[i] = r[i];
+    }
+}
+
+void setIdentity(double m[6])
+{
+    m[0] = 1; m[1] = 0; m[2] = 0; m[3] = 1; m[4] = 0; m[5] = 0;
+}
+
+} // namespace
+
+PdfTextExtractor::PdfTextExtractor(const PdfDocument &document)
+    : m_document(document)
+    , m_hasText(false)
+    , m_lastEndX(0)
+    , m_lastY(0)
+{
+    setIdentity(m_textMatrix);
+    setIdentity(m_lineMatrix);
+}
+
+QByteArray PdfTextExtractor::text()
+{
+    QByteArray result;
+    for (int i = 0; i < m_document.pageCount(); ++i) {
+        result += pageText(i);
+    }
+    return result;
+}
+
+QByteArray PdfTextExtractor::pageText(int pageIndex)
+{
+    m_output.clear();
+    m_parameters = TextParameters();
+    m_parameterStack.clear();
+    m_hasText = false;
+    setIdentity(m_textMatrix);
+    setIdentity(m_lineMatrix);
+
+    processContent(m_document.pageContents(pageIndex), m_document.pageResources(pageIndex), 0);
+
+    if (!m_output.isEmpty() && !m_output.endsWith('\n')) {
+        m_output.append('\n');
+    }
+    return m_output;
+}
+
+void PdfTextExtractor::processContent(const QByteArray &content, const PdfObject &resources, int depth)
+{
+    PdfLexer lexer(content.constData(), content.size());
+    lexer.setReferencesAllowed(false);
+    std::vector<PdfObject> operands;
+
+    while (true) {
+        PdfLexer::TokenType type = lexer.next();
+        if (type == PdfLexer::EndOfData) {
+            break;
+        }
+
+        if (type != PdfLexer::KeywordToken) {
+            if (type == PdfLexer::NumberToken) {
+                operands.push_back(PdfObject::makeNumber(lexer.number()));
+            } else if (type == PdfLexer::StringToken) {
+                operands.push_back(PdfObject::makeBytes(PdfObject::String, lexer.token()));
+            } else if (type == PdfLexer::NameToken) {
+                operands.push_back(PdfObject::makeBytes(PdfObject::Name, lexer.token()));
+            } else if (type == PdfLexer::ArrayBegin || type == PdfLexer::DictionaryBegin) {
+                // Let the parser consume the whole composite operand
+                lexer.setPosition(lexer.position() - (type == PdfLexer::ArrayBegin ? 1 : 2));
+                operands.push_back(lexer.parseObject());
+            }
+            continue;
+        }
+
+        const QByteArray op = lexer.token();
+        auto number = [&operands](size_t fromEnd) {
+            return fromEnd <= operands.size() ? operands[operands.size() - fromEnd].toDouble() : 0.0;
+        };
+
+        if (op == "BT") {
+            setIdentity(m_textMatrix);
+            setIdentity(m_lineMatrix);
+        } else if (op == "Tf" && operands.size() >= 2) {
+            m_parameters.font = loadFont(resources, operands[operands.size() - 2].bytes());
+            m_parameters.fontSize = number(1);
+        } else if (op == "Tc") {
+            m_parameters.charSpacing = number(1);
+        } else if (op == "Tw") {
+            m_parameters.wordSpacing = number(1);
+        } else if (op == "Tz") {
+            m_parameters.horizontalScaling = number(1) / 100.0;
+        } else if (op == "TL") {
+            m_parameters.leading = number(1);
+        } else if (op == "Td") {
+            moveText(number(2), number(1));
+        } else if (op == "TD") {
+            m_parameters.leading = -number(1);
+            moveText(number(2), number(1));
+        } else if (op == "Tm" && operands.size() >= 6) {
+            for (int i = 0; i < 6; ++i) {
+                m_lineMatrix[i] = operands[operands.size() - 6 + i].toDouble();
+                m_textMatrix[i] = m_lineMatrix[i];
+            }
+        } else if (op == "T*") {
+            nextLine();
+        } else if (op == "Tj" && !operands.empty()) {
+            showText(operands.back().bytes());
+        } else if (op == "'" && !operands.empty()) {
+            nextLine();
+            showText(operands.back().bytes());
+        } else if (op == "\"" && operands.size() >= 3) {
+            m_parameters.wordSpacing = number(3);
+            m_parameters.charSpacing = number(2);
+            nextLine();
+            showText(operands.back().bytes());
+        } else if (op == "TJ" && !operands.empty()) {
+            for (const PdfObject &item : operands.back().array()) {
+                if (item.type() == PdfObject::String) {
+                    showText(item.bytes());
+                } else if (item.isNumber()) {
+                    double tx = -item.toDouble() / 1000.0 * m_parameters.fontSize * m_parameters.horizontalScaling;
+                    m_textMatrix[4] += tx * m_textMatrix[0];
+                    m_textMatrix[5] += tx * m_textMatrix[1];
+                }
+            }
+        } else if (op == "q") {
+            m_parameterStack << m_parameters;
+        } else if (op == "Q") {
+            if (!m_parameterStack.isEmpty()) {
+                m_parameters = m_parameterStack.takeLast();
+            }
+        } else if (op == "Do" && !operands.empty() && depth < MaxFormDepth) {
+            PdfObject xobjects = m_document.resolvedValue(resources, "XObject");
+            PdfObject form = m_document.resolvedValue(xobjects, operands.back().bytes().constData());
+            if (form.isStream() && form.value("Subtype").isName("Form")) {
+                PdfObject formResources = m_document.resolvedValue(form, "Resources");
+                TextParameters saved = m_parameters;
+                processContent(m_document.streamData(form),
+                               formResources.isNull() ? resources : formResources, depth + 1);
+                m_parameters = saved;
+            }
+        } else if (op == "BI") {
+            lexer.skipInlineImage();
+        }
+
+        operands.clear();
+    }
+}
+
+void PdfTextExtractor::moveText(double tx, double ty)
+{
+    double translation[6] = {1, 0, 0, 1, tx, ty};
+    multiply(translation, m_lineMatrix, m_lineMatrix);
+    for (int i = 0; i < 6; ++i) {
+        m_textMatrix[i] = m_lineMatrix[i];
+    }
+}
+
+void PdfTextExtractor::nextLine()
+{
+    moveText(0, -m_parameters.leading);
+}
+
+void PdfTextExtractor::showText(const QByteArray &bytes)
+{
+    const Font *font = m_parameters.font.get();
+    if (!font || bytes.isEmpty()) {
+        return;
+    }
+
+    double x = m_textMatrix[4];
+    double y = m_textMatrix[5];
+    double height = qAbs(m_parameters.fontSize) * qSqrt(m_textMatrix[2] * m_textMatrix[2] + m_textMatrix[3] * m_textMatrix[3]);
+    if (height <= 0) {
+        height = 1;
+    }
+
+    // Break lines on vertical movement, words on horizontal gaps
+    if (m_hasText && !m_output.isEmpty()) {
+        bool atBreak = m_output.endsWith('\n') || m_output.endsWith(' ');
+        if (qAbs(y - m_lastY) > height * 0.5) {
+            if (!m_output.endsWith('\n')) {
+                m_output.append('\n');
+            }
+        } else if (!atBreak && (x - m_lastEndX > height * 0.15 || m_lastEndX - x > height)) {
+            m_output.append(' ');
+        }
+    }
+
+    const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+    const int size = bytes.size();
+    const double scaling = m_parameters.horizontalScaling;
+
+    for (int position = 0; position < size;) {
+        int length = codeLength(*font, data + position, size - position);
+        quint32 code = 0;
+        for (int i = 0; i < length; ++i) {
+            code = (code << 8) | data[position + i];
+        }
+        position += length;
+
+        auto mapped = font->toUnicode.constFind(code);
+        if (mapped != font->toUnicode.constEnd()) {
+            m_output += mapped.value();
+        } else if (!font->composite) {
+            m_output += font->simpleMap[code & 0xFF];
+        } else if (font->unicodeEncoding) {
+            appendUtf8(m_output, char32_t(code));
+        }
+
+        double width = font->composite ? font->cidWidths.value(code, font->defaultWidth)
+                                       : font->simpleWidths[code & 0xFF];
+        double tx = width / 1000.0 * m_parameters.fontSize + m_parameters.charSpacing;
+        if (length == 1 && code == 32) {
+            tx += m_parameters.wordSpacing;
+        }
+        tx *= scaling;
+        m_textMatrix[4] += tx * m_textMatrix[0];
+        m_textMatrix[5] += tx * m_textMatrix[1];
+    }
+
+    m_hasText = true;
+    m_lastEndX = m_textMatrix[4];
+    m_lastY = y;
+}
+
+int PdfTextExtractor::codeLength(const Font &font, const uchar *bytes, int available) const
+{
+    if (!font.composite) {
+        return 1;
+    }
+
+    if (!font.codespaces.isEmpty()) {
+        quint32 code = 0;
+        for (int length = 1; length <= 4 && length <= available; ++length) {
+            code = (code << 8) | bytes[length - 1];
+            for (const CodespaceRange &range : font.codespaces) {
+                if (range.length == length && code >= range.low && code <= range.high) {
+                    return length;
+                }
+            }
+        }
+    }
+
+    return qMin(2, available);
+}
+
+std::shared_ptr<const PdfTextExtractor::Font> PdfTextExtractor::loadFont(const PdfObject &resources, const QByteArray &name)
+{
+    PdfObject fonts = m_document.resolvedValue(resources, "Font");
+    PdfObject reference = fonts.value(name.constData());
+
+    if (reference.isReference()) {
+        auto cached = m_fontCache.constFind(reference.referenceNumber());
+        if (cached != m_fontCache.constEnd()) {
+            return cached.value();
+        }
+    }
+
+    PdfObject dictionary = m_document.resolve(reference);
+    auto font = std::make_shared<Font>();
+    for (double &width : font->simpleWidths) {
+        width = 500;
+    }
+
+    if (dictionary.isDictionary()) {
+        font->composite = dictionary.value("Subtype").isName("Type0");
+
+        if (font->composite) {
+            PdfObject encoding = m_document.resolvedValue(dictionary, "Encoding");
+            font->unicodeEncoding = encoding.isName()
+                && (encoding.bytes().contains("UCS2") || encoding.bytes().contains("UTF16"));
+        } else {
+            loadSimpleEncoding(dictionary, font.get());
+        }
+
+        PdfObject toUnicode = m_document.resolvedValue(dictionary, "ToUnicode");
+        if (toUnicode.isStream()) {
+            parseToUnicode(m_document.streamData(toUnicode), font.get());
+        }
+
+        loadWidths(dictionary, font.get());
+    } else {
+        // Unknown font resource: treat codes as Latin-1
+        for (int code = 0; code < 256; ++code) {
+            appendUtf8(font->simpleMap[code], char32_t(code));
+        }
+    }
+
+    if (reference.isReference()) {
+        m_fontCache.insert(reference.referenceNumber(), font);
+    }
+    return font;
+}
+
+void PdfTextExtractor::loadSimpleEncoding(const PdfObject &fontDictionary, Font *font) const
+{
+    // Start from WinAnsi, which agrees with Standard and MacRoman on ASCII
+    for (int code = 0; code < 256; ++code) {
+        font->simpleMap[code].clear();
+        if (code >= 0x20) {
+            const GlyphEntry &entry = WinAnsiGlyphs[code - 0x20];
+            if (entry.name) {
+                appendUtf8(font->simpleMap[code], entry.unicode);
+            }
+        } else if (code == '\t' || code == '\n' || code == '\r') {
+            font->simpleMap[code] = " ";
+        }
+    }
+
+    PdfObject encoding = m_document.resolvedValue(fontDictionary, "Encoding");
+    const PdfObject::ArrayData &differences = m_document.resolvedValue(encoding, "Differences").array();
+
+    int code = 0;
+    for (const PdfObject &item : differences) {
+        if (item.isNumber()) {
+            code = int(item.toInteger());
+        } else if (item.isName()) {
+            if (code >= 0 && code < 256) {
+                font->simpleMap[code] = glyphNameToUtf8(item.bytes());
+            }
+            code++;
+        }
+    }
+}
+
+void PdfTextExtractor::loadWidths(const PdfObject &fontDictionary, Font *font) const
+{
+    if (!font->composite) {
+        PdfObject descriptor = m_document.resolvedValue(fontDictionary, "FontDescriptor");
+        PdfObject missing = descriptor.value("MissingWidth");
+        double missingWidth = missing.isNumber() ? missing.toDouble() : 500;
+
+        const PdfObject::ArrayData &widths = m_document.resolvedValue(fontDictionary, "Widths").array();
+        if (widths.empty()) {
+            return;
+        }
+
+        int firstChar = int(fontDictionary.value("FirstChar").toInteger());
+        for (int code = 0; code < 256; ++code) {
+            int index = code - firstChar;
+            font->simpleWidths[code] = (index >= 0 && size_t(index) < widths.size())
+                ? m_document.resolve(widths[size_t(index)]).toDouble() : missingWidth;
+        }
+        return;
+    }
+
+    const PdfObject::ArrayData &descendants = m_document.resolvedValue(fontDictionary, "DescendantFonts").array();
+    if (descendants.empty()) {
+        return;
+    }
+
+    PdfObject cidFont = m_document.resolve(descendants.front());
+    PdfObject defaultWidth = cidFont.value("DW");
+    font->defaultWidth = defaultWidth.isNumber() ? defaultWidth.toDouble() : 1000;
+
+    // W: "c [w1 w2 ...]" or "cFirst cLast w"
+    const PdfObject::ArrayData &w = m_document.resolvedValue(cidFont, "W").array();
+    for (size_t i = 0; i < w.size();) {
+        quint32 first = quint32(m_document.resolve(w[i]).toInteger());
+        if (i + 1 >= w.size()) {
+            break;
+        }
+        PdfObject next = m_document.resolve(w[i + 1]);
+        if (next.isArray()) {
+            quint32 cid = first;
+            for (const PdfObject &width : next.array()) {
+                font->cidWidths.insert(cid++, m_document.resolve(width).toDouble());
+            }
+            i += 2;
+        } else {
+            if (i + 2 >= w.size()) {
+                break;
+            }
+            quint32 last = quint32(next.toInteger());
+            double width = m_document.resolve(w[i + 2]).toDouble();
+            for (quint32 cid = first; cid <= last && cid - first < 65536; ++cid) {
+                font->cidWidths.insert(cid, width);
+            }
+            i += 3;
+        }
+    }
+}
+
+void PdfTextExtractor::parseToUnicode(const QByteArray &cmap, Font *font) const
+{
+    PdfLexer lexer(cmap.constData(), cmap.size());
+    lexer.setReferencesAllowed(false);
+
+    enum Section { NoSection, Codespace, BfChar, BfRange } section = NoSection;
+    QList<PdfObject> operands;
+
+    while (true) {
+        PdfLexer::TokenType type = lexer.next();
+        if (type == PdfLexer::EndOfData) {
+            break;
+        }
+
+        if (type == PdfLexer::KeywordToken) {
+            const QByteArray &keyword = lexer.token();
+            if (keyword == "begincodespacerange") {
+                section = Codespace;
+            } else if (keyword == "beginbfchar") {
+                section = BfChar;
+            } else if (keyword == "beginbfrange") {
+                section = BfRange;
+            } else if (keyword.startsWith("end")) {
+                section = NoSection;
+            }
+            operands.clear();
+            continue;
+        }
+
+        if (section == NoSection) {
+            continue;
+        }
+
+        if (type == PdfLexer::ArrayBegin) {
+            lexer.setPosition(lexer.position() - 1);
+            operands << lexer.parseObject();
+        } else if (type == PdfLexer::StringToken) {
+            operands << PdfObject::makeBytes(PdfObject::String, lexer.token());
+        } else if (type == PdfLexer::NameToken) {
+            operands << PdfObject::makeBytes(PdfObject::Name, lexer.token());
+        } else {
+            continue;
+        }
+
+        if (section == Codespace && operands.size() == 2) {
+            CodespaceRange range;
+            range.length = qBound(1, int(operands[0].bytes().size()), 4);
+            range.low = codeFromBytes(operands[0].bytes());
+            range.high = codeFromBytes(operands[1].bytes());
+            font->codespaces << range;
+            operands.clear();
+        } else if (section == BfChar && operands.size() == 2) {
+            quint32 code = codeFromBytes(operands[0].bytes());
+            if (operands[1].isName()) {
+                font->toUnicode.insert(code, glyphNameToUtf8(operands[1].bytes()));
+            } else {
+                font->toUnicode.insert(code, utf16BeToUtf8(operands[1].bytes()));
+            }
+            operands.clear();
+        } else if (section == BfRange && operands.size() == 3) {
+            quint32 low = codeFromBytes(operands[0].bytes());
+            quint32 high = codeFromBytes(operands[1].bytes());
+            const PdfObject &destination = operands[2];
+
+            if (high >= low && high - low < 65536) {
+                if (destination.isArray()) {
+                    const PdfObject::ArrayData &items = destination.array();
+                    for (quint32 code = low; code <= high && size_t(code - low) < items.size(); ++code) {
+                        font->toUnicode.insert(code, utf16BeToUtf8(items[code - low].bytes()));
+                    }
+                } else {
+                    // Increment the last UTF-16 unit across the range
+                    QByteArray base = destination.bytes();
+                    for (quint32 code = low; code <= high; ++code) {
+                        QByteArray value = base;
+                        if (value.size() >= 2) {
+                            int last = value.size() - 2;
+                            quint32 unit = (uchar(value[last]) << 8 | uchar(value[last + 1])) + (code - low);
+                            value[last] = char((unit >> 8) & 0xFF);
+                            value[last + 1] = char(unit & 0xFF);
+                        }
+                        font->toUnicode.insert(code, utf16BeToUtf8(value));
+                    }
+                }
+            }
+            operands.clear();
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef PDFTEXTEXTRACTOR_H
+#define PDFTEXTEXTRACTOR_H
+
+#include "pdfdocument.h"
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <memory>
+
+// Interprets page content streams and returns their text as UTF-8.
+//
+// Handles the Tj, TJ, ' and " operators, maps character codes through
+// ToUnicode CMaps (falling back to the font encoding and Differences), and
+// uses glyph widths to decide where words and lines break. Form XObjects
+// are followed; inline images are skipped.
+class PdfTextExtractor
+{
+public:
+    explicit PdfTextExtractor(const PdfDocument &document);
+
+    // Text of one page; lines are separated by '\n'
+    QByteArray pageText(int pageIndex);
+
+    // Text of all pages
+    QByteArray text();
+
+private:
+    struct CodespaceRange {
+        int length;
+        quint32 low;
+        quint32 high;
+    };
+
+    struct Font {
+        bool composite = false;
+        bool unicodeEncoding = false;   // predefined UCS2/UTF16 CMap
+        QList<CodespaceRange> codespaces;
+        QHash<quint32, QByteArray> toUnicode;
+        QByteArray simpleMap[256];
+        double simpleWidths[256];
+        double defaultWidth = 500;
+        QHash<quint32, double> cidWidths;
+    };
+
+    struct TextParameters {
+        std::shared_ptr<const Font> font;
+        double fontSize = 0;
+        double charSpacing = 0;
+        double wordSpacing = 0;
+        double horizontalScaling = 1;
+        double leading = 0;
+    };
+
+    void processContent(const QByteArray &content, const PdfObject &resources, int depth);
+    void showText(const QByteArray &bytes);
+    void moveText(double tx, double ty);
+    void nextLine();
+
+    std::shared_ptr<const Font> loadFont(const PdfObject &resources, const QByteArray &name);
+    void parseToUnicode(const QByteArray &cmap, Font *font) const;
+    void loadSimpleEncoding(const PdfObject &fontDictionary, Font *font) const;
+    void loadWidths(const PdfObject &fontDictionary, Font *font) const;
+    int codeLength(const Font &font, const uchar *bytes, int available) const;
+
+    const PdfDocument &m_document;
+    QHash<int, std::shared_ptr<const Font>> m_fontCache;
+
+    // Per-page state
+    QByteArray m_output;
+    TextParameters m_parameters;
+    QList<TextParameters> m_parameterStack;
+    double m_textMatrix[6];
+    double m_lineMatrix[6];
+    bool m_hasText;
+    double m_lastEndX;
+    double m_lastY;
+};
+
+#endif // PDFTEXTEXTRACTOR_H
@@ -0,0 +1,342 @@
+#include "pdfwriter.h"
+#include "conversionmetrics.h"
+
+namespace {
+
+// Fixed object numbers; pages and their content follow the fonts
+const int CatalogObject = 1;
+const int PagesObject = 2;
+const int FirstFontObject = 3;
+
+const char *const FontNames[PdfWriter::FontCount] = {
+    "Helvetica",
+    "Helvetica-Bold",
+    "Helvetica-Oblique",
+    "Helvetica-BoldOblique"
+};
+
+// Advance widths (1/1000 em) of WinAnsi codes 0x20-0xFF from the Adobe
+// font metrics; the oblique faces share them. Undefined codes are 0.
+const short HelveticaWidths[224] = {
+    278, 278, 355, 556, 556, 889, 667, 191, 333, 333, 389, 584, 278, 333, 278, 278,
+    556, 556, 556, 556, 556, 556, 556, 556, 556, 556, 278, 278, 584, 584, 584, 556,
+    1015, 667, 667, 722, 722, 667, 611, 778, 722, 278, 500, 667, 556, 833, 722, 778,
+    667, 778, 722, 667, 611, 722, 667, 944, 667, 667, 611, 278, 278, 278, 469, 556,
+    333, 556, 556, 500, 556, 556, 278, 556, 556, 222, 222, 500, 222, 833, 556, 556,
+    556, 556, 333, 500, 278, 556, 500, 722, 500, 500, 500, 334, 260, 334, 584, 0,
+    556, 0, 222, 556, 333, 1000, 556, 556, 333, 1000, 667, 333, 1000, 0, 611, 0,
+    0, 222, 222, 333, 333, 350, 556, 1000, 333, 1000, 500, 333, 944, 0, 500, 667,
+    278, 333, 556, 556, 556, 556, 260, 556, 333, 737, 370, 556, 584, 333, 737, 333,
+    400, 584, 333, 333, 333, 556, 537, 278, 333, 333, 365, 556, 834, 834, 834, 611,
+    667, 667, 667, 667, 667, 667, 1000, 722, 667, 667, 667, 667, 278, 278, 278, 278,
+    722, 722, 778, 778, 778, 778, 778, 584, 778, 722, 722, 722, 722, 667, 667, 611,
+    556, 556, 556, 556, 556, 556, 889, 500, 556, 556, 556, 556, 278, 278, 278, 278,
+    556, 556, 556, 556, 556, 556, 556, 584, 611, 556, 556, 556, 556, 500, 556, 500
+};
+
+const short HelveticaBoldWidths[224] = {
+    278, 333, 474, 556, 556, 889, 722, 238, 333, 333, 389, 584, 278, 333, 278, 278,
+    556, 556, 556, 556, 556, 556, 556, 556, 556, 556, 333, 333, 584, 584, 584, 611,
+    975, 722, 722, 722, 722, 667, 611, 778, 722, 278, 556, 722, 611, 833, 722, 778,
+    667, 778, 722, 667, 611, 722, 667, 944, 667, 667, 611, 333, 278, 333, 584, 556,
+    333, 556, 611, 556, 611, 556, 333, 611, 611, 278, 278, 556, 278, 889, 611, 611,
+    611, 611, 389, 556, 333, 611, 556, 778, 556, 556, 500, 389, 280, 389, 584, 0,
+    556, 0, 278, 556, 500, 1000, 556, 556, 333, 1000, 667, 333, 1000, 0, 611, 0,
+    0, 278, 278, 500, 500, 350, 556, 1000, 333, 1000, 556, 333, 944, 0, 500, 667,
+    278, 333, 556, 556, 556, 556, 280, 556, 333, 737, 370, 556, 584, 333, 737, 333,
+    400, 584, 333, 333, 333, 611, 556, 278, 333, 333, 365, 556, 834, 834, 834, 611,
+    722, 722, 722, 722, 722, 722, 1000, 722, 667, 667, 667, 667, 278, 278, 278, 278,
+    722, 722, 778, 778, 778, 778, 778, 584, 778, 722, 722, 722, 722, 667, 667, 611,
+    556, 556, 556, 556, 556, 556, 889, 556, 556, 556, 556, 556, 278, 278, 278, 278,
+    611, 611, 611, 611, 611, 611, 611, 584, 611, 611, 611, 611, 611, 556, 611, 556
+};
+
+// Unicode code points of WinAnsi 0x80-0x9F; 0 where the code is unused
+const char16_t WinAnsiHigh[32] = {
+    0x20AC, 0, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017D, 0,
+    0, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0, 0x017E, 0x0178
+};
+
+QByteArray number(double value)
+{
+    if (value == qint64(value)) {
+        return QByteArray::number(qint64(value));
+    }
+    return QByteArray::number(value, 'f', 2);
+}
+
+void appendString(QByteArray &out, const QByteArray &text)
+{
+    out += '(';
+    for (char c : text) {
+        if (c == '(' || c == ')' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    out += ')';
+}
+
+} // namespace
+
+PdfWriter::PdfWriter(const QString &fileName)
+    : m_file(fileName)
+    , m_device(&m_file)
+    , m_offset(0)
+    , m_pageWidth(0)
+    , m_pageHeight(0)
+    , m_inPage(false)
+    , m_closed(false)
+    , m_failed(false)
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        fail(m_file.errorString());
+        return;
+    }
+    start();
+}
+
+PdfWriter::PdfWriter(QIODevice *device)
+    : m_device(device)
+    , m_offset(0)
+    , m_pageWidth(0)
+    , m_pageHeight(0)
+    , m_inPage(false)
+    , m_closed(false)
+    , m_failed(false)
+{
+    if (!m_device->isWritable()) {
+        fail("Device is not open for writing");
+        return;
+    }
+    start();
+}
+
+PdfWriter::~PdfWriter()
+{
+    if (!m_closed) {
+        close();
+    }
+}
+
+bool PdfWriter::isOpen() const
+{
+    return !m_closed && !m_failed;
+}
+
+QString PdfWriter::errorString() const
+{
+    return m_errorString;
+}
+
+void PdfWriter::beginPage(double width, double height)
+{
+    if (m_inPage) {
+        endPage();
+    }
+    m_content.clear();
+    m_pageWidth = width;
+    m_pageHeight = height;
+    m_inPage = true;
+}
+
+void PdfWriter::drawText(Font font, double size, double x, double y, const QByteArray &text)
+{
+    m_content += "BT /F" + QByteArray::number(font + 1) + ' ' + number(size) + " Tf "
+                 + number(x) + ' ' + number(y) + " Td ";
+    appendString(m_content, text);
+    m_content += " Tj ET\n";
+}
+
+bool PdfWriter::endPage()
+{
+    if (!m_inPage) {
+        return !m_failed;
+    }
+    m_inPage = false;
+
+    // Blank pages get an empty, unfiltered stream
+    QByteArray stream;
+    QByteArray filter;
+    if (!m_content.isEmpty()) {
+        ConversionMetrics::StageTimer timer(ConversionMetrics::Compression);
+        // qCompress puts a 4-byte length in front of the zlib stream
+        stream = qCompress(m_content).mid(4);
+        filter = " /Filter /FlateDecode";
+    }
+
+    ConversionMetrics::StageTimer timer(ConversionMetrics::DiskWrite);
+    int content = addObject();
+    beginObject(content);
+    write("<< /Length " + QByteArray::number(stream.size()) + filter + " >>\nstream\n");
+    write(stream);
+    write("\nendstream\nendobj\n");
+
+    QByteArray fonts;
+    for (int font = 0; font < FontCount; ++font) {
+        fonts += " /F" + QByteArray::number(font + 1) + ' ' + QByteArray::number(FirstFontObject + font) + " 0 R";
+    }
+    int page = addObject();
+    beginObject(page);
+    write("<< /Type /Page /Parent " + QByteArray::number(PagesObject) + " 0 R"
+          + " /MediaBox [0 0 " + number(m_pageWidth) + ' ' + number(m_pageHeight) + "]"
+          + " /Resources << /Font <<" + fonts + " >> >>"
+          + " /Contents " + QByteArray::number(content) + " 0 R >>\nendobj\n");
+    m_pages << page;
+    return !m_failed;
+}
+
+bool PdfWriter::close()
+{
+    if (m_closed) {
+        return !m_failed;
+    }
+    endPage();
+
+    ConversionMetrics::StageTimer timer(ConversionMetrics::DiskWrite);
+    QByteArray kids;
+    for (int page : m_pages) {
+        kids += QByteArray::number(page) + " 0 R ";
+    }
+    beginObject(PagesObject);
+    write("<< /Type /Pages /Kids [" + kids + "] /Count " + QByteArray::number(m_pages.size())
+          + " >>\nendobj\n");
+    beginObject(CatalogObject);
+    write("<< /Type /Catalog /Pages " + QByteArray::number(PagesObject) + " 0 R >>\nendobj\n");
+    int info = addObject();
+    beginObject(info);
+    write("<< /Producer (docpdf) >>\nendobj\n");
+
+    // Every xref entry is exactly 20 bytes
+    qint64 xrefOffset = m_offset;
+    QByteArray xref = "xref\n0 " + QByteArray::number(m_objectOffsets.size() + 1) + "\n0000000000 65535 f \n";
+    for (qint64 offset : m_objectOffsets) {
+        xref += QByteArray::number(offset).rightJustified(10, '0') + " 00000 n \n";
+    }
+    xref += "trailer\n<< /Size " + QByteArray::number(m_objectOffsets.size() + 1)
+            + " /Root " + QByteArray::number(CatalogObject) + " 0 R"
+            + " /Info " + QByteArray::number(info) + " 0 R >>\n"
+            + "startxref\n" + QByteArray::number(xrefOffset) + "\n%%EOF\n";
+    write(xref);
+
+    m_closed = true;
+    m_file.close();
+    if (m_failed || m_pages.isEmpty()) {
+        m_failed = true;
+        removeFile();
+    }
+    return !m_failed;
+}
+
+void PdfWriter::discard()
+{
+    m_closed = true;
+    m_failed = true;
+    m_file.close();
+    removeFile();
+}
+
+bool PdfWriter::toWinAnsi(const QString &text, QByteArray *encoded)
+{
+    encoded->clear();
+    encoded->reserve(text.size());
+    for (QChar ch : text) {
+        char16_t unicode = ch.unicode();
+        if ((unicode >= 0x20 && unicode < 0x7F) || (unicode >= 0xA0 && unicode <= 0xFF)) {
+            encoded->append(char(unicode));
+            continue;
+        }
+        int code = -1;
+        for (int i = 0; i < 32; ++i) {
+            if (WinAnsiHigh[i] == unicode && unicode != 0) {
+                code = 0x80 + i;
+                break;
+            }
+        }
+        if (code < 0) {
+            return false;
+        }
+        encoded->append(char(code));
+    }
+    return true;
+}
+
+QChar PdfWriter::fromWinAnsi(char code)
+{
+    uchar byte = uchar(code);
+    if (byte >= 0x80 && byte < 0xA0 && WinAnsiHigh[byte - 0x80] != 0) {
+        return QChar(WinAnsiHigh[byte - 0x80]);
+    }
+    return QChar(char16_t(byte));
+}
+
+double PdfWriter::textWidth(Font font, double size, const QByteArray &text)
+{
+    const short *widths = font == Bold || font == BoldItalic ? HelveticaBoldWidths : HelveticaWidths;
+    int units = 0;
+    for (char c : text) {
+        uchar code = uchar(c);
+        if (code >= 0x20) {
+            units += widths[code - 0x20];
+        }
+    }
+    return units * size / 1000.0;
+}
+
+void PdfWriter::start()
+{
+    // The comment marks the file as binary for transfer tools
+    write("%PDF-1.4\n%\xE2\xE3\xCF\xD3\n");
+
+    addObject();
+    addObject();
+    for (int font = 0; font < FontCount; ++font) {
+        int object = addObject();
+        beginObject(object);
+        write(QByteArray("<< /Type /Font /Subtype /Type1 /BaseFont /") + FontNames[font]
+              + " /Encoding /WinAnsiEncoding >>\nendobj\n");
+    }
+}
+
+void PdfWriter::removeFile()
+{
+    // A caller's device is the caller's to clean up
+    if (m_device == &m_file) {
+        m_file.remove();
+    }
+}
+
+int PdfWriter::addObject()
+{
+    m_objectOffsets << -1;
+    return m_objectOffsets.size();
+}
+
+bool PdfWriter::beginObject(int number)
+{
+    m_objectOffsets[number - 1] = m_offset;
+    return write(QByteArray::number(number) + " 0 obj\n");
+}
+
+bool PdfWriter::write(const QByteArray &data)
+{
+    if (m_failed) {
+        return false;
+    }
+    if (m_device->write(data) != data.size()) {
+        return fail(m_device->errorString());
+    }
+    m_offset += data.size();
+    return true;
+}
+
+bool PdfWriter::fail(const QString &message)
+{
+    if (!m_failed) {
+        m_errorString = message;
+    }
+    m_failed = true;
+    return false;
+}
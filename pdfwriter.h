@@ -0,0 +1,78 @@
+#ifndef PDFWRITER_H
+#define PDFWRITER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+
+// Writes text-only PDFs set in the standard-14 Helvetica family, which
+// every viewer provides, so no font program is embedded.
+//
+// Pages are written to the file as they are finished, each with a
+// Flate-compressed content stream; close() adds the page tree, the xref
+// table built from the recorded object offsets, and the trailer.
+class PdfWriter
+{
+public:
+    enum Font {
+        Regular,
+        Bold,
+        Italic,
+        BoldItalic,
+        FontCount
+    };
+
+    explicit PdfWriter(const QString &fileName);
+    // Writes to a device the caller opened and keeps open
+    explicit PdfWriter(QIODevice *device);
+    ~PdfWriter();
+
+    bool isOpen() const;
+    QString errorString() const;
+
+    // Page sizes are in points
+    void beginPage(double width, double height);
+    // Draws WinAnsi-encoded text with its baseline starting at (x, y),
+    // measured from the bottom-left corner of the page
+    void drawText(Font font, double size, double x, double y, const QByteArray &text);
+    bool endPage();
+
+    // Finishes the document; the output file (not a caller's device) is
+    // removed on failure
+    bool close();
+
+    // Abandons the document and removes the output file
+    void discard();
+
+    // Encodes text in WinAnsiEncoding; false if a character has no code
+    static bool toWinAnsi(const QString &text, QByteArray *encoded);
+    // The character of a WinAnsi code; unused codes map to C1 controls
+    static QChar fromWinAnsi(char code);
+
+    // Advance width of WinAnsi-encoded text in points
+    static double textWidth(Font font, double size, const QByteArray &text);
+
+private:
+    void start();
+    void removeFile();
+    int addObject();
+    bool beginObject(int number);
+    bool write(const QByteArray &data);
+    bool fail(const QString &message);
+
+    QFile m_file;
+    QIODevice *m_device;    // m_file unless the caller passed a device
+    qint64 m_offset;
+    QList<qint64> m_objectOffsets;  // by object number - 1
+    QList<int> m_pages;
+    QByteArray m_content;
+    double m_pageWidth;
+    double m_pageHeight;
+    bool m_inPage;
+    bool m_closed;
+    bool m_failed;
+    QString m_errorString;
+};
+
+#endif // PDFWRITER_H
@@ -0,0 +1,155 @@
+#include "popplertextextractor.h"
+#include <QByteArray>
+#include <QFile>
+#include <QThreadPool>
+#include <memory>
+#include <vector>
+
+#ifdef DOCPDF_HAVE_POPPLER
+#include <poppler-document.h>
+#include <poppler-global.h>
+#include <poppler-page.h>
+#endif
+
+namespace {
+
+#ifdef DOCPDF_HAVE_POPPLER
+// Files with at least this many pages are split into ranges, each range
+// at least this long
+const int ParallelPageThreshold = 64;
+const int PagesPerRange = 32;
+
+// One empty page; it only keeps poppler's global state alive
+const char AnchorPdf[] =
+    "%PDF-1.4\n"
+    "1 0 obj << /Type /Catalog /Pages 2 0 R >> endobj\n"
+    "2 0 obj << /Type /Pages /Kids [3 0 R] /Count 1 >> endobj\n"
+    "3 0 obj << /Type /Page /Parent 2 0 R /MediaBox [0 0 1 1] >> endobj\n"
+    "xref\n"
+    "0 4\n"
+    "0000000000 65535 f \n"
+    "0000000009 00000 n \n"
+    "0000000058 00000 n \n"
+    "0000000115 00000 n \n"
+    "trailer << /Size 4 /Root 1 0 R >>\n"
+    "startxref\n"
+    "182\n"
+    "%%EOF\n";
+
+// Damaged files are common in a batch and pdftotext is the fallback, so
+// poppler's complaints are not worth a line on stderr each
+void ignoreError(const std::string &, void *)
+{
+}
+
+std::unique_ptr<poppler::document> openDocument(const QString &fileName)
+{
+    std::unique_ptr<poppler::document> document(
+        poppler::document::load_from_file(QFile::encodeName(fileName).toStdString()));
+    if (!document || document->is_locked()) {
+        return nullptr;
+    }
+    return document;
+}
+
+// Pages [first, last), each followed by a form feed
+QByteArray pageRangeText(poppler::document *document, int first, int last)
+{
+    QByteArray text;
+    for (int i = first; i < last; ++i) {
+        std::unique_ptr<poppler::page> page(document->create_page(i));
+        if (page) {
+            poppler::byte_array utf8 = page->text(poppler::rectf(), poppler::page::physical_layout).to_utf8();
+            text.append(utf8.data(), qsizetype(utf8.size()));
+        }
+        text += '\f';
+    }
+    return text;
+}
+#endif
+
+} // namespace
+
+PopplerTextExtractor::PopplerTextExtractor()
+    : m_cacheAnchor(nullptr)
+{
+#ifdef DOCPDF_HAVE_POPPLER
+    poppler::set_debug_error_function(ignoreError, nullptr);
+    m_cacheAnchor = poppler::document::load_from_raw_data(AnchorPdf, int(sizeof(AnchorPdf) - 1));
+#endif
+}
+
+PopplerTextExtractor::~PopplerTextExtractor()
+{
+#ifdef DOCPDF_HAVE_POPPLER
+    delete m_cacheAnchor;
+#endif
+}
+
+bool PopplerTextExtractor::isAvailable()
+{
+#ifdef DOCPDF_HAVE_POPPLER
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool PopplerTextExtractor::extract(const QString &fileName, int threadCount, QByteArray *text) const
+{
+#ifdef DOCPDF_HAVE_POPPLER
+    std::unique_ptr<poppler::document> document = openDocument(fileName);
+    if (!document) {
+        return false;
+    }
+
+    int pageCount = document->pages();
+    int rangeCount = pageCount >= ParallelPageThreshold ? qBound(1, pageCount / PagesPerRange, threadCount) : 1;
+    if (rangeCount == 1) {
+        *text = pageRangeText(document.get(), 0, pageCount);
+        return true;
+    }
+
+    // A document object must not be shared between threads, so every
+    // other range opens the file again; this thread takes the first one
+    std::vector<QByteArray> ranges(rangeCount);
+    std::vector<char> opened(rangeCount, 1);
+    QByteArray *rangeTexts = ranges.data();
+    char *rangeOpened = opened.data();
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(rangeCount - 1);
+    for (int range = 1; range < rangeCount; ++range) {
+        int first = int(qint64(range) * pageCount / rangeCount);
+        int last = int(qint64(range + 1) * pageCount / rangeCount);
+        threadPool.start([fileName, first, last, range, rangeTexts, rangeOpened]() {
+            std::unique_ptr<poppler::document> rangeDocument = openDocument(fileName);
+            if (!rangeDocument) {
+                rangeOpened[range] = 0;
+                return;
+            }
+            rangeTexts[range] = pageRangeText(rangeDocument.get(), first, last);
+        });
+    }
+    ranges[0] = pageRangeText(document.get(), 0, pageCount / rangeCount);
+    threadPool.waitForDone();
+
+    qsizetype size = 0;
+    for (int range = 0; range < rangeCount; ++range) {
+        if (!opened[range]) {
+            return false;
+        }
+        size += ranges[range].size();
+    }
+    text->clear();
+    text->reserve(size);
+    for (const QByteArray &rangeText : ranges) {
+        *text += rangeText;
+    }
+    return true;
+#else
+    Q_UNUSED(fileName);
+    Q_UNUSED(threadCount);
+    Q_UNUSED(text);
+    return false;
+#endif
+}
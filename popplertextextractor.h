@@ -0,0 +1,40 @@
+#ifndef POPPLERTEXTEXTRACTOR_H
+#define POPPLERTEXTEXTRACTOR_H
+
+#include <QByteArray>
+#include <QString>
+
+namespace poppler {
+class document;
+}
+
+// In-process text extraction through poppler-cpp, for PDFs the native
+// extractor cannot read; it replaces a pdftotext process per file.
+//
+// Poppler keeps its font and CMap caches in global state that it tears
+// down when the last document closes. The extractor holds a tiny document
+// open for its whole lifetime, so the caches survive from one file to the
+// next. extract() may be called from several threads at once: every call
+// (and every page range of a large file) opens its own document object.
+//
+// Without DOCPDF_HAVE_POPPLER the class compiles to a stub that always
+// fails, and callers go straight to pdftotext.
+class PopplerTextExtractor
+{
+public:
+    PopplerTextExtractor();
+    ~PopplerTextExtractor();
+
+    static bool isAvailable();
+
+    // UTF-8 text of every page in -layout form, each page ended with a
+    // form feed as pdftotext prints it. Files with 64 pages or more are
+    // split into page ranges on up to threadCount threads. Fails when
+    // poppler cannot open the file or it needs a password.
+    bool extract(const QString &fileName, int threadCount, QByteArray *text) const;
+
+private:
+    poppler::document *m_cacheAnchor;
+};
+
+#endif // POPPLERTEXTEXTRACTOR_H
@@ -0,0 +1,310 @@
+#include "processscheduler.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QProcess>
+#include <QTimer>
+#include <QWaitCondition>
+#include <memory>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Time a child gets to exit after terminate() before it is killed
+const int KillGraceMsecs = 3000;
+
+// How often the kill checks of running children are asked
+const int KillPollMsecs = 100;
+
+thread_local ProcessScheduler::KillCheck currentKillCheck;
+
+#ifdef Q_OS_UNIX
+// False if there is no such group, as for a child that is still starting
+bool signalGroup(qint64 pid, int signalNumber)
+{
+    return pid > 0 && ::kill(-pid_t(pid), signalNumber) == 0;
+}
+#endif
+
+} // namespace
+
+ProcessScheduler::ProcessScheduler()
+    : QObject(nullptr)
+    , m_thread(new QThread)
+    , m_ownerThread(QThread::currentThread())
+    , m_killPoll(nullptr)
+    , m_canceled(false)
+    , m_cancelCount(0)
+    , m_resumeCount(0)
+{
+    moveToThread(m_thread);
+    m_thread->start();
+}
+
+ProcessScheduler::~ProcessScheduler()
+{
+    QMetaObject::invokeMethod(this, [this]() { shutdown(); }, Qt::BlockingQueuedConnection);
+    m_thread->quit();
+    m_thread->wait();
+    delete m_thread;
+}
+
+ProcessScheduler::KillScope::KillScope(KillCheck isKilled)
+    : m_previous(std::move(currentKillCheck))
+{
+    currentKillCheck = std::move(isKilled);
+}
+
+ProcessScheduler::KillScope::~KillScope()
+{
+    currentKillCheck = std::move(m_previous);
+}
+
+void ProcessScheduler::start(const QString &program, const QStringList &arguments, int timeoutMs,
+                             Callback callback)
+{
+    KillCheck isKilled = currentKillCheck;
+    if (m_canceled || (isKilled && isKilled())) {
+        Result result;
+        result.canceled = true;
+        callback(result);
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, [this, program, arguments, timeoutMs, isKilled, callback]() {
+        launch(program, arguments, timeoutMs, isKilled, callback);
+    }, Qt::QueuedConnection);
+}
+
+ProcessScheduler::Result ProcessScheduler::run(const QString &program, const QStringList &arguments,
+                                               int timeoutMs)
+{
+    return runAll(program, QList<QStringList>() << arguments, timeoutMs).first();
+}
+
+QList<ProcessScheduler::Result> ProcessScheduler::runAll(const QString &program,
+                                                         const QList<QStringList> &argumentLists, int timeoutMs)
+{
+    Q_ASSERT(QThread::currentThread() != m_thread);
+
+    struct Waiter {
+        QMutex mutex;
+        QWaitCondition done;
+        int remaining = 0;
+        QList<Result> results;
+    };
+    auto waiter = std::make_shared<Waiter>();
+    waiter->remaining = argumentLists.size();
+    waiter->results.resize(argumentLists.size());
+
+    for (int i = 0; i < argumentLists.size(); ++i) {
+        start(program, argumentLists.at(i), timeoutMs, [waiter, i](const Result &result) {
+            QMutexLocker locker(&waiter->mutex);
+            waiter->results[i] = result;
+            if (--waiter->remaining == 0) {
+                waiter->done.wakeAll();
+            }
+        });
+    }
+
+    QMutexLocker locker(&waiter->mutex);
+    while (waiter->remaining > 0) {
+        waiter->done.wait(&waiter->mutex);
+    }
+    return waiter->results;
+}
+
+void ProcessScheduler::cancel()
+{
+    // Set first so a start() racing with the kill fails in launch()
+    m_canceled = true;
+    m_cancelCount++;
+    QMetaObject::invokeMethod(this, [this]() { killAll(); }, Qt::QueuedConnection);
+}
+
+void ProcessScheduler::cancelAfter(int msecs)
+{
+    // A resume() before the timer fires disarms it
+    int resumes = m_resumeCount;
+    QMetaObject::invokeMethod(this, [this, msecs, resumes]() {
+        QTimer::singleShot(msecs, this, [this, resumes]() {
+            if (m_resumeCount == resumes) {
+                cancel();
+            }
+        });
+    }, Qt::QueuedConnection);
+}
+
+void ProcessScheduler::resume()
+{
+    m_resumeCount++;
+    m_canceled = false;
+}
+
+void ProcessScheduler::launch(const QString &program, const QStringList &arguments, int timeoutMs,
+                              KillCheck isKilled, Callback callback)
+{
+    Job *job = new Job;
+    job->isKilled = isKilled;
+    job->callback = callback;
+    if (m_canceled || (isKilled && isKilled())) {
+        job->result.canceled = true;
+        complete(job);
+        return;
+    }
+
+    job->process = new QProcess(this);
+    job->process->setStandardErrorFile(QProcess::nullDevice());
+    startGroup(job->process);
+    job->deadline = new QTimer(this);
+    job->deadline->setSingleShot(true);
+    m_jobs << job;
+
+    connect(job->process, &QProcess::started, this, [job]() {
+        job->result.started = true;
+    });
+    connect(job->process, &QProcess::finished, this, [this, job](int exitCode, QProcess::ExitStatus status) {
+#ifdef Q_OS_UNIX
+        // The leader may go first; whatever it started must not linger
+        if (job->result.timedOut || job->result.canceled) {
+            signalGroup(job->pid, SIGKILL);
+        }
+#endif
+        job->result.exitCode = status == QProcess::NormalExit ? exitCode : -1;
+        job->result.standardOutput = job->process->readAllStandardOutput();
+        complete(job);
+    });
+    // A child that never started gets no finished signal
+    connect(job->process, &QProcess::errorOccurred, this, [this, job](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+            complete(job);
+        }
+    });
+    connect(job->deadline, &QTimer::timeout, this, [this, job]() { expire(job); });
+
+    if (timeoutMs > 0) {
+        job->deadline->start(timeoutMs);
+    }
+    if (isKilled) {
+        if (!m_killPoll) {
+            m_killPoll = new QTimer(this);
+            m_killPoll->setInterval(KillPollMsecs);
+            connect(m_killPoll, &QTimer::timeout, this, &ProcessScheduler::pollKillChecks);
+        }
+        m_killPoll->start();
+    }
+    job->process->start(program, arguments);
+}
+
+void ProcessScheduler::expire(Job *job)
+{
+    // Ask politely first; the next expiry kills. finished() reaps either way.
+    job->pid = job->process->processId();
+    if (!job->result.timedOut) {
+        job->result.timedOut = true;
+        terminateGroup(job->process);
+        job->deadline->start(KillGraceMsecs);
+    } else {
+        killGroup(job->process);
+    }
+}
+
+void ProcessScheduler::complete(Job *job)
+{
+    if (job->process) {
+        job->deadline->stop();
+        job->process->disconnect(this);
+        job->deadline->disconnect(this);
+        job->process->deleteLater();
+        job->deadline->deleteLater();
+        m_jobs.removeOne(job);
+    }
+
+    job->callback(job->result);
+    delete job;
+}
+
+void ProcessScheduler::kill(Job *job)
+{
+    job->result.canceled = true;
+    job->pid = job->process->processId();
+    killGroup(job->process);
+}
+
+void ProcessScheduler::killAll()
+{
+    for (Job *job : m_jobs) {
+        kill(job);
+    }
+}
+
+void ProcessScheduler::pollKillChecks()
+{
+    bool checked = false;
+    for (Job *job : m_jobs) {
+        if (!job->isKilled || job->result.canceled) {
+            continue;
+        }
+        checked = true;
+        if (job->isKilled()) {
+            kill(job);
+        }
+    }
+
+    // Polling resumes with the next child that has a check
+    if (!checked) {
+        m_killPoll->stop();
+    }
+}
+
+void ProcessScheduler::shutdown()
+{
+    // Nothing may outlive the thread, so reap synchronously here
+    const QList<Job *> jobs = m_jobs;
+    for (Job *job : jobs) {
+        job->result.canceled = true;
+        job->process->disconnect(this);
+        killGroup(job->process);
+        job->process->waitForFinished(1000);
+        complete(job);
+    }
+
+    if (m_killPoll) {
+        m_killPoll->stop();
+    }
+
+    // Hand the object back so it can be destroyed after this thread exits
+    moveToThread(m_ownerThread);
+}
+
+void ProcessScheduler::startGroup(QProcess *process)
+{
+#ifdef Q_OS_UNIX
+    process->setChildProcessModifier([]() { ::setsid(); });
+#else
+    Q_UNUSED(process);
+#endif
+}
+
+void ProcessScheduler::terminateGroup(QProcess *process)
+{
+#ifdef Q_OS_UNIX
+    if (signalGroup(process->processId(), SIGTERM)) {
+        return;
+    }
+#endif
+    process->terminate();
+}
+
+void ProcessScheduler::killGroup(QProcess *process)
+{
+#ifdef Q_OS_UNIX
+    if (signalGroup(process->processId(), SIGKILL)) {
+        return;
+    }
+#endif
+    process->kill();
+}
@@ -0,0 +1,126 @@
+#ifndef PROCESSSCHEDULER_H
+#define PROCESSSCHEDULER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <atomic>
+#include <functional>
+
+class QProcess;
+class QTimer;
+
+// Runs the external converters (soffice, unoconv, pdftotext) as children
+// of one thread, driven by QProcess signals instead of waitForFinished.
+// Each child has its own deadline: when it expires the child is asked to
+// terminate, killed after a grace period and reaped. cancel() kills every
+// child at once and makes later starts fail until resume(); cancelAfter()
+// does the same once a grace period has passed, unless resume() comes
+// first.
+//
+// A KillScope gives the children one thread starts a kill handle of their
+// own: a check the scheduler polls, which kills just those children once it
+// returns true, so one piece of work can be canceled without the rest.
+//
+// Every child leads a process group of its own, and signals go to the whole
+// group: soffice is a wrapper whose soffice.bin would otherwise outlive a
+// kill and keep the worker's profile locked.
+//
+// The QProcess objects live on the scheduler's own thread; start() and
+// run() may be called from any other thread.
+class ProcessScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Result {
+        bool started = false;
+        bool timedOut = false;
+        bool canceled = false;
+        int exitCode = -1;          // -1 unless the child exited normally
+        QByteArray standardOutput;
+
+        // Exited with status 0 before its deadline
+        bool ok() const { return started && !timedOut && !canceled && exitCode == 0; }
+    };
+    using Callback = std::function<void(const Result &result)>;
+    using KillCheck = std::function<bool()>;
+
+    // While alive, children started on the creating thread are killed, group
+    // and all, as soon as isKilled returns true, and later starts fail as on
+    // a cancel. isKilled runs on the scheduler thread. Scopes nest.
+    class KillScope
+    {
+    public:
+        explicit KillScope(KillCheck isKilled);
+        ~KillScope();
+
+    private:
+        KillCheck m_previous;
+    };
+
+    ProcessScheduler();
+    ~ProcessScheduler();
+
+    // Starts program; callback runs on the scheduler thread once the child
+    // is reaped, or right away if the scheduler is canceled. A timeout of
+    // 0 means no deadline.
+    void start(const QString &program, const QStringList &arguments, int timeoutMs, Callback callback);
+
+    // Starts program and blocks the calling thread until its result is in.
+    // Must not be called from the scheduler thread.
+    Result run(const QString &program, const QStringList &arguments, int timeoutMs);
+
+    // Runs program once per argument list, all at the same time, and
+    // blocks until every child is reaped; results are in argument order
+    QList<Result> runAll(const QString &program, const QList<QStringList> &argumentLists, int timeoutMs);
+
+    void cancel();
+    void cancelAfter(int msecs);
+    void resume();
+    bool isCanceled() const { return m_canceled.load(); }
+
+    // Number of cancels so far; a caller whose child failed can compare it
+    // with the count before the start to tell a kill from a failure
+    int cancelCount() const { return m_cancelCount.load(); }
+
+    // Makes process, before it starts, the leader of a new process group
+    static void startGroup(QProcess *process);
+    // Sends SIGTERM or SIGKILL to the group process leads; elsewhere the
+    // same as QProcess::terminate() and kill()
+    static void terminateGroup(QProcess *process);
+    static void killGroup(QProcess *process);
+
+private:
+    struct Job {
+        QProcess *process = nullptr;
+        QTimer *deadline = nullptr;
+        qint64 pid = 0;             // the group to kill once it was signalled
+        KillCheck isKilled;         // from the starting thread's KillScope
+        Callback callback;
+        Result result;
+    };
+
+    // Run on the scheduler thread
+    void launch(const QString &program, const QStringList &arguments, int timeoutMs, KillCheck isKilled,
+                Callback callback);
+    void expire(Job *job);
+    void complete(Job *job);
+    void kill(Job *job);
+    void killAll();
+    void pollKillChecks();
+    void shutdown();
+
+    QThread *m_thread;
+    QThread *m_ownerThread;
+    QList<Job *> m_jobs;
+    QTimer *m_killPoll;
+    std::atomic<bool> m_canceled;
+    std::atomic<int> m_cancelCount;
+    std::atomic<int> m_resumeCount;
+};
+
+#endif // PROCESSSCHEDULER_H
@@ -0,0 +1,79 @@
+#include "progresschannel.h"
+#include <QMutexLocker>
+
+namespace {
+
+// Span of the rate window, and the shortest one worth dividing by
+const qint64 RateWindowMsecs = 5000;
+const qint64 MinimumWindowMsecs = 500;
+
+} // namespace
+
+void ProgressChannel::begin()
+{
+    QMutexLocker locker(&m_mutex);
+    m_state = Snapshot();
+    m_state.active = true;
+    m_samples.clear();
+    m_elapsed.start();
+}
+
+void ProgressChannel::setTotal(int total)
+{
+    QMutexLocker locker(&m_mutex);
+    m_state.total = total;
+}
+
+void ProgressChannel::fileDone(const QString &fileName, qint64 bytes, bool ok)
+{
+    QMutexLocker locker(&m_mutex);
+    m_state.completed++;
+    if (!ok) {
+        m_state.failed++;
+    }
+    m_state.bytes += bytes;
+    m_state.currentFile = fileName;
+}
+
+void ProgressChannel::end()
+{
+    QMutexLocker locker(&m_mutex);
+    m_state.active = false;
+    m_state.elapsedMsecs = m_elapsed.elapsed();
+    m_state.etaMsecs = 0;
+}
+
+ProgressChannel::Snapshot ProgressChannel::snapshot()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_state.active) {
+        return m_state;
+    }
+
+    qint64 now = m_elapsed.elapsed();
+    m_state.elapsedMsecs = now;
+    m_samples.push_back(Sample{now, m_state.completed, m_state.bytes});
+    while (m_samples.size() > 2 && now - m_samples.front().msecs > RateWindowMsecs) {
+        m_samples.pop_front();
+    }
+
+    // Early on the window is too short; the average since the start is
+    // the better estimate then
+    Sample first = m_samples.front();
+    if (now - first.msecs < MinimumWindowMsecs) {
+        first = Sample{0, 0, 0};
+    }
+    qint64 span = now - first.msecs;
+    if (span > 0) {
+        m_state.filesPerSecond = (m_state.completed - first.completed) * 1000.0 / span;
+        m_state.bytesPerSecond = (m_state.bytes - first.bytes) * 1000.0 / span;
+    }
+
+    int remaining = m_state.total - m_state.completed;
+    if (m_state.filesPerSecond > 0) {
+        m_state.etaMsecs = qint64(qMax(0, remaining) * 1000.0 / m_state.filesPerSecond);
+    } else {
+        m_state.etaMsecs = -1;
+    }
+    return m_state;
+}
@@ -0,0 +1,51 @@
+#ifndef PROGRESSCHANNEL_H
+#define PROGRESSCHANNEL_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <deque>
+
+// Progress of the running batch, shared between the converter thread and
+// a viewer. The converter records every file; the viewer polls snapshot()
+// at its own fixed rate, so its cost is the same at 10 or 10,000 files per
+// second. Rates cover the last few seconds of snapshots, which keeps the
+// ETA responsive when the mix of files changes during a batch.
+class ProgressChannel
+{
+public:
+    struct Snapshot {
+        bool active = false;
+        int completed = 0;
+        int failed = 0;
+        int total = 0;              // grows while discovery is running
+        qint64 bytes = 0;
+        QString currentFile;        // most recently completed
+        qint64 elapsedMsecs = 0;
+        double filesPerSecond = 0;
+        double bytesPerSecond = 0;
+        qint64 etaMsecs = -1;       // -1 until a rate is known
+    };
+
+    void begin();
+    void setTotal(int total);
+    void fileDone(const QString &fileName, qint64 bytes, bool ok);
+    void end();
+
+    // Takes a rate sample; call at a steady interval
+    Snapshot snapshot();
+
+private:
+    struct Sample {
+        qint64 msecs;
+        int completed;
+        qint64 bytes;
+    };
+
+    QMutex m_mutex;
+    QElapsedTimer m_elapsed;
+    Snapshot m_state;
+    std::deque<Sample> m_samples;
+};
+
+#endif // PROGRESSCHANNEL_H
@@ -0,0 +1,378 @@
+#include "spoolleases.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QSysInfo>
+
+#ifdef Q_OS_UNIX
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace {
+
+const int DefaultLeaseTimeout = 60000;
+
+// Heartbeats per lease timeout; a few missed ones are survivable
+const int HeartbeatsPerTimeout = 4;
+
+// Least time between two prunes of the done markers
+const qint64 PruneIntervalMsecs = 10 * 60 * 1000;
+
+QByteArray readFirstLine(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readLine().trimmed();
+}
+
+bool renameFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_UNIX
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#else
+    return QFile::rename(from, to);
+#endif
+}
+
+// Creates to as a second name of from; fails if to exists
+bool linkFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_UNIX
+    QByteArray source = QFile::encodeName(from);
+    ::link(source.constData(), QFile::encodeName(to).constData());
+    // NFS can report a failure for a link it made when the reply is lost,
+    // so the link count decides
+    struct stat info;
+    return ::stat(source.constData(), &info) == 0 && info.st_nlink == 2;
+#else
+    return QFile::copy(from, to);
+#endif
+}
+
+void touchFile(const QString &fileName)
+{
+#ifdef Q_OS_UNIX
+    // A null time lets NFS use the server's clock
+    ::utime(QFile::encodeName(fileName).constData(), nullptr);
+#else
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadWrite)) {
+        file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    }
+#endif
+}
+
+} // namespace
+
+SpoolLeases::SpoolLeases(const QString &spoolDirectory)
+    : m_spoolDirectory(QDir(spoolDirectory).absolutePath())
+    , m_stateDirectory(m_spoolDirectory + "/.docpdf-spool")
+    , m_leaseTimeout(DefaultLeaseTimeout)
+    , m_thread(nullptr)
+    , m_stopping(false)
+{
+    QDir().mkpath(m_stateDirectory + "/leases");
+    QDir().mkpath(m_stateDirectory + "/done");
+
+    // Identifies this process in its leases; the random part keeps a
+    // restarted process with a recycled pid from trusting old leases
+    m_token = QString("%1-%2-%3")
+                  .arg(QSysInfo::machineHostName())
+                  .arg(QCoreApplication::applicationPid())
+                  .arg(QRandomGenerator::global()->generate64(), 16, 16, QChar('0'))
+                  .toUtf8();
+
+    m_thread = QThread::create([this]() { heartbeatLoop(); });
+    m_thread->start();
+    m_sincePrune.start();
+}
+
+SpoolLeases::~SpoolLeases()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+
+    // Whatever is still held was never finished
+    for (const QString &lease : m_held) {
+        if (ownsLease(lease)) {
+            QFile::remove(lease);
+        }
+    }
+}
+
+QString SpoolLeases::spoolDirectory() const
+{
+    return m_spoolDirectory;
+}
+
+void SpoolLeases::setLeaseTimeout(int msecs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_leaseTimeout = qMax(HeartbeatsPerTimeout, msecs);
+    m_wake.wakeAll();
+}
+
+bool SpoolLeases::isAvailable(const QString &inputPath) const
+{
+    QString key = keyFor(inputPath);
+    if (isDone(inputPath, key)) {
+        return false;
+    }
+    QString lease = leasePath(key);
+    return !QFile::exists(lease) || isExpired(lease);
+}
+
+bool SpoolLeases::claim(const QString &inputPath)
+{
+    QString key = keyFor(inputPath);
+    if (isDone(inputPath, key)) {
+        return false;
+    }
+
+    QString lease = leasePath(key);
+    if (!createLease(lease, inputPath)) {
+        if (!isExpired(lease) || !takeOverLease(lease) || !createLease(lease, inputPath)) {
+            return false;
+        }
+    }
+
+    // The previous holder may have finished between the check and the claim
+    if (isDone(inputPath, key)) {
+        QFile::remove(lease);
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_held.insert(inputPath, lease);
+    return true;
+}
+
+bool SpoolLeases::finish(const QString &inputPath, bool ok)
+{
+    QString lease;
+    {
+        QMutexLocker locker(&m_mutex);
+        lease = m_held.take(inputPath);
+    }
+    if (lease.isEmpty()) {
+        return false;
+    }
+
+    // After a stall long enough for another process to take the file over,
+    // the result is theirs to record
+    if (!ownsLease(lease)) {
+        return true;
+    }
+
+    // The relative path on the second line lets pruneDone() find the input
+    QFileInfo inputInfo(inputPath);
+    QString key = keyFor(inputPath);
+    Done done;
+    done.inputPath = inputPath;
+    done.size = inputInfo.size();
+    done.mtime = inputInfo.lastModified().toMSecsSinceEpoch();
+    QSaveFile marker(donePath(key));
+    if (marker.open(QIODevice::WriteOnly)) {
+        marker.write(QByteArray::number(done.size) + ' ' + QByteArray::number(done.mtime) + ' '
+                     + (ok ? "ok" : "failed") + '\n'
+                     + QDir(m_spoolDirectory).relativeFilePath(inputPath).toUtf8() + '\n');
+        if (marker.commit()) {
+            QMutexLocker locker(&m_mutex);
+            m_done.insert(key, done);
+        } else {
+            qWarning() << "Cannot record spool result for" << inputPath;
+        }
+    }
+    QFile::remove(lease);
+    return true;
+}
+
+bool SpoolLeases::release(const QString &inputPath)
+{
+    QString lease;
+    {
+        QMutexLocker locker(&m_mutex);
+        lease = m_held.take(inputPath);
+    }
+    if (lease.isEmpty()) {
+        return false;
+    }
+    if (ownsLease(lease)) {
+        QFile::remove(lease);
+    }
+    return true;
+}
+
+void SpoolLeases::pruneDone()
+{
+    if (m_sincePrune.elapsed() < PruneIntervalMsecs) {
+        return;
+    }
+    m_sincePrune.restart();
+
+    // Remembered markers name their input already; others are read
+    QHash<QString, Done> known;
+    {
+        QMutexLocker locker(&m_mutex);
+        known = m_done;
+    }
+    QDir doneDirectory(m_stateDirectory + "/done");
+    const QStringList keys = doneDirectory.entryList(QDir::Files);
+    for (const QString &key : keys) {
+        QString inputPath = known.value(key).inputPath;
+        if (inputPath.isEmpty()) {
+            QFile file(doneDirectory.filePath(key));
+            if (!file.open(QIODevice::ReadOnly)) {
+                continue;
+            }
+            file.readLine();
+            QString relativePath = QString::fromUtf8(file.readLine().trimmed());
+            if (relativePath.isEmpty()) {
+                continue;
+            }
+            inputPath = QDir(m_spoolDirectory).absoluteFilePath(relativePath);
+        }
+        if (!QFileInfo::exists(inputPath)) {
+            QFile::remove(doneDirectory.filePath(key));
+            QMutexLocker locker(&m_mutex);
+            m_done.remove(key);
+        }
+    }
+}
+
+QString SpoolLeases::keyFor(const QString &inputPath) const
+{
+    // Relative, so hosts that mount the spool at different paths agree
+    QString relativePath = QDir(m_spoolDirectory).relativeFilePath(inputPath);
+    return QString::fromLatin1(QCryptographicHash::hash(relativePath.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+QString SpoolLeases::leasePath(const QString &key) const
+{
+    return m_stateDirectory + "/leases/" + key;
+}
+
+QString SpoolLeases::donePath(const QString &key) const
+{
+    return m_stateDirectory + "/done/" + key;
+}
+
+bool SpoolLeases::isDone(const QString &inputPath, const QString &key) const
+{
+    QFileInfo inputInfo(inputPath);
+    Done done;
+    done.inputPath = inputPath;
+    done.size = inputInfo.size();
+    done.mtime = inputInfo.lastModified().toMSecsSinceEpoch();
+    {
+        // Known to be done in exactly this state; no marker read
+        QMutexLocker locker(&m_mutex);
+        auto it = m_done.constFind(key);
+        if (it != m_done.constEnd() && it->size == done.size && it->mtime == done.mtime) {
+            return true;
+        }
+    }
+
+    // "size mtime result"; failed files are not retried until they change
+    QList<QByteArray> fields = readFirstLine(donePath(key)).split(' ');
+    if (fields.size() != 3 || fields[0].toLongLong() != done.size || fields[1].toLongLong() != done.mtime) {
+        return false;
+    }
+    QMutexLocker locker(&m_mutex);
+    m_done.insert(key, done);
+    return true;
+}
+
+bool SpoolLeases::isExpired(const QString &leasePath) const
+{
+    QFileInfo leaseInfo(leasePath);
+    if (!leaseInfo.exists()) {
+        return false;
+    }
+    int timeout;
+    {
+        QMutexLocker locker(&m_mutex);
+        timeout = m_leaseTimeout;
+    }
+    return leaseInfo.lastModified().msecsTo(QDateTime::currentDateTime()) > timeout;
+}
+
+bool SpoolLeases::ownsLease(const QString &leasePath) const
+{
+    return readFirstLine(leasePath) == m_token;
+}
+
+bool SpoolLeases::createLease(const QString &leasePath, const QString &inputPath)
+{
+    // Written in full under a private name, then linked into place
+    QString temporaryPath = leasePath + "." + QString::fromUtf8(m_token);
+    QFile file(temporaryPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    file.write(m_token + '\n' + QDir(m_spoolDirectory).relativeFilePath(inputPath).toUtf8() + '\n');
+    file.close();
+
+    bool linked = linkFile(temporaryPath, leasePath);
+    QFile::remove(temporaryPath);
+    return linked;
+}
+
+bool SpoolLeases::takeOverLease(const QString &leasePath)
+{
+    // Only one of the processes that saw the lease expire can move it aside
+    QString asidePath = leasePath + ".stale-" + QString::fromUtf8(m_token);
+    if (!renameFile(leasePath, asidePath)) {
+        return false;
+    }
+
+    // The holder may have renewed it, or a new lease may have replaced it,
+    // since the expiry check; then it goes back unless yet another exists
+    if (!isExpired(asidePath)) {
+        linkFile(asidePath, leasePath);
+        QFile::remove(asidePath);
+        return false;
+    }
+    QFile::remove(asidePath);
+    return true;
+}
+
+void SpoolLeases::heartbeatLoop()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stopping) {
+        m_wake.wait(&m_mutex, m_leaseTimeout / HeartbeatsPerTimeout);
+        if (m_stopping) {
+            break;
+        }
+
+        QHash<QString, QString> held = m_held;
+        locker.unlock();
+        for (auto it = held.constBegin(); it != held.constEnd(); ++it) {
+            // A lost lease stays listed; finish() then leaves the result alone
+            if (ownsLease(it.value())) {
+                touchFile(it.value());
+            } else {
+                qWarning() << "Lost the spool lease on" << it.key();
+            }
+        }
+        locker.relock();
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef SPOOLLEASES_H
+#define SPOOLLEASES_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+// Lets any number of docpdf processes, on any number of hosts, share one
+// spool directory (typically on NFS) without a coordinator.
+//
+// A process claims a file right before converting it by creating a lease
+// in <spool>/.docpdf-spool/leases. The lease is written under a unique
+// name and hard-linked into place, which is atomic on NFS as well; its
+// mtime is refreshed by a heartbeat while the conversion runs. A lease
+// that has not been refreshed within the timeout belongs to a dead or
+// hung process and is taken over by renaming it aside first, so only one
+// claimant wins. Finished files get a marker in .docpdf-spool/done that
+// records the input's size and mtime, so a rewritten input is converted
+// again and nothing else is. Markers this process has read or written are
+// remembered, so later rounds over a large spool only stat the inputs, and
+// markers whose input was removed are pruned now and then.
+//
+// Expiry compares lease mtimes with the local clock, so hosts need
+// synchronised clocks (NTP); the timeout leaves room for small skews.
+class SpoolLeases
+{
+public:
+    explicit SpoolLeases(const QString &spoolDirectory);
+    ~SpoolLeases();
+
+    QString spoolDirectory() const;
+
+    // Age after which a lease is considered abandoned (default 60 s)
+    void setLeaseTimeout(int msecs);
+
+    // Not finished for its current contents and not leased by a live
+    // process; a cheap check before any work is spent on the file
+    bool isAvailable(const QString &inputPath) const;
+
+    // Takes the lease on inputPath; false if the file is finished or
+    // another process holds a live lease on it
+    bool claim(const QString &inputPath);
+
+    // Records the result and drops the lease; false if this process did
+    // not hold it (the file was claimed elsewhere)
+    bool finish(const QString &inputPath, bool ok);
+
+    // Drops the lease without a result, so the file is claimed again
+    bool release(const QString &inputPath);
+
+    // Removes the done markers of inputs that no longer exist; does the
+    // work at most every few minutes, so it may be called every round
+    void pruneDone();
+
+private:
+    // Input state a done marker was written for
+    struct Done {
+        QString inputPath;
+        qint64 size = -1;
+        qint64 mtime = -1;
+    };
+
+    QString keyFor(const QString &inputPath) const;
+    QString leasePath(const QString &key) const;
+    QString donePath(const QString &key) const;
+    bool isDone(const QString &inputPath, const QString &key) const;
+    bool isExpired(const QString &leasePath) const;
+    bool ownsLease(const QString &leasePath) const;
+    bool createLease(const QString &leasePath, const QString &inputPath);
+    bool takeOverLease(const QString &leasePath);
+    void heartbeatLoop();
+
+    QString m_spoolDirectory;
+    QString m_stateDirectory;
+    QByteArray m_token;
+    int m_leaseTimeout;
+
+    QThread *m_thread;
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    bool m_stopping;
+    QHash<QString, QString> m_held;     // input path -> lease path
+    mutable QHash<QString, Done> m_done;    // by key
+    QElapsedTimer m_sincePrune;
+};
+
+#endif // SPOOLLEASES_H
@@ -0,0 +1,202 @@
+#include "systemresources.h"
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QThread>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_MACOS)
+#include <mach/mach.h>
+#endif
+
+namespace {
+
+#ifdef Q_OS_LINUX
+const char CgroupRoot[] = "/sys/fs/cgroup";
+
+QByteArray readFile(const QString &fileName)
+{
+    // Pseudo files report no size, so read until the end
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll().trimmed();
+}
+
+// Directory of this process's cgroup for a v1 controller, or for the v2
+// hierarchy when controller is empty; empty if there is none
+QString cgroupDirectory(const QByteArray &controller)
+{
+    const QList<QByteArray> lines = readFile("/proc/self/cgroup").split('\n');
+    for (const QByteArray &line : lines) {
+        // hierarchy-ID:controller-list:path
+        QList<QByteArray> fields = line.split(':');
+        if (fields.size() < 3) {
+            continue;
+        }
+        QByteArray path = line.mid(fields[0].size() + fields[1].size() + 2);
+        if (controller.isEmpty() ? fields[0] == "0" && fields[1].isEmpty()
+                                 : fields[1].split(',').contains(controller)) {
+            QString root = controller.isEmpty() ? QString(CgroupRoot)
+                                                : QString(CgroupRoot) + "/" + QString::fromLatin1(controller);
+            return root + QString::fromUtf8(path == "/" ? QByteArray() : path);
+        }
+    }
+    return QString();
+}
+
+// Visits the cgroup directory and its ancestors up to the mount point; a
+// limit set anywhere on the way applies to the process
+template <typename Visit>
+void forEachAncestor(const QString &directory, const QString &root, Visit visit)
+{
+    QString current = directory;
+    while (current.size() >= root.size()) {
+        visit(current);
+        int slash = current.lastIndexOf('/');
+        if (slash <= 0 || current == root) {
+            break;
+        }
+        current.truncate(slash);
+    }
+}
+
+// Lowest "quota period" pair of cpu.max; "max" means no quota
+double cgroupCpuLimit()
+{
+    double limit = 0;
+    QString v2 = cgroupDirectory(QByteArray());
+    if (!v2.isEmpty()) {
+        forEachAncestor(v2, CgroupRoot, [&](const QString &directory) {
+            QList<QByteArray> fields = readFile(directory + "/cpu.max").split(' ');
+            if (fields.size() == 2 && fields[0] != "max" && fields[1].toDouble() > 0) {
+                double cpus = fields[0].toDouble() / fields[1].toDouble();
+                limit = limit > 0 ? qMin(limit, cpus) : cpus;
+            }
+        });
+    }
+
+    // Hybrid hierarchies keep the controllers on v1
+    QString v1 = cgroupDirectory("cpu");
+    if (!v1.isEmpty()) {
+        forEachAncestor(v1, QString(CgroupRoot) + "/cpu", [&](const QString &directory) {
+            qint64 quota = readFile(directory + "/cpu.cfs_quota_us").toLongLong();
+            qint64 period = readFile(directory + "/cpu.cfs_period_us").toLongLong();
+            if (quota > 0 && period > 0) {
+                double cpus = double(quota) / double(period);
+                limit = limit > 0 ? qMin(limit, cpus) : cpus;
+            }
+        });
+    }
+    return limit;
+}
+
+// Value of a "name value" line of memory.stat, 0 if it is missing
+qint64 memoryStat(const QString &directory, const QByteArray &name)
+{
+    const QList<QByteArray> lines = readFile(directory + "/memory.stat").split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith(name + ' ')) {
+            return line.mid(name.size() + 1).toLongLong();
+        }
+    }
+    return 0;
+}
+
+// Room left below the tightest memory limit on the way to the root; -1
+// when no limit is set. Usage leaves out inactive page cache, which the
+// kernel reclaims before it hits the limit.
+qint64 cgroupAvailableMemory()
+{
+    qint64 available = -1;
+    auto consider = [&](qint64 limit, qint64 usage) {
+        // v1 reports "no limit" as a huge page-aligned number
+        if (limit <= 0 || limit >= (qint64(1) << 60)) {
+            return;
+        }
+        qint64 room = qMax<qint64>(0, limit - qMax<qint64>(0, usage));
+        available = available < 0 ? room : qMin(available, room);
+    };
+
+    QString v2 = cgroupDirectory(QByteArray());
+    if (!v2.isEmpty()) {
+        forEachAncestor(v2, CgroupRoot, [&](const QString &directory) {
+            QByteArray limit = readFile(directory + "/memory.max");
+            if (!limit.isEmpty() && limit != "max") {
+                consider(limit.toLongLong(), readFile(directory + "/memory.current").toLongLong()
+                                                 - memoryStat(directory, "inactive_file"));
+            }
+        });
+    }
+
+    QString v1 = cgroupDirectory("memory");
+    if (!v1.isEmpty()) {
+        forEachAncestor(v1, QString(CgroupRoot) + "/memory", [&](const QString &directory) {
+            consider(readFile(directory + "/memory.limit_in_bytes").toLongLong(),
+                     readFile(directory + "/memory.usage_in_bytes").toLongLong()
+                         - memoryStat(directory, "total_inactive_file"));
+        });
+    }
+    return available;
+}
+
+// MemAvailable of /proc/meminfo, in bytes
+qint64 hostAvailableMemory()
+{
+    const QList<QByteArray> lines = readFile("/proc/meminfo").split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith("MemAvailable:")) {
+            // "MemAvailable:   12345678 kB"
+            return line.mid(13).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+    return 0;
+}
+#endif
+
+} // namespace
+
+int SystemResources::cpuCount()
+{
+    // Read once; the pool and every extractor ask for it
+    static const int count = []() {
+        int cpus = QThread::idealThreadCount();
+#ifdef Q_OS_LINUX
+        double limit = cgroupCpuLimit();
+        if (limit > 0) {
+            cpus = qMin(cpus, qMax(1, int(limit + 0.999)));
+        }
+#endif
+        return qMax(1, cpus);
+    }();
+    return count;
+}
+
+qint64 SystemResources::availableMemory()
+{
+#ifdef Q_OS_LINUX
+    qint64 available = hostAvailableMemory();
+    qint64 cgroup = cgroupAvailableMemory();
+    if (cgroup >= 0) {
+        available = available > 0 ? qMin(available, cgroup) : cgroup;
+    }
+    return available;
+#elif defined(Q_OS_WIN)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx(&status) ? qint64(status.ullAvailPhys) : 0;
+#elif defined(Q_OS_MACOS)
+    // Free pages plus the clean ones the kernel hands out on demand
+    vm_statistics64_data_t stats;
+    mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+    if (host_statistics64(mach_host_self(), HOST_VM_INFO64, host_info64_t(&stats), &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return qint64(stats.free_count + stats.inactive_count + stats.purgeable_count) * qint64(vm_page_size);
+#else
+    return 0;
+#endif
+}
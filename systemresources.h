@@ -0,0 +1,23 @@
+#ifndef SYSTEMRESOURCES_H
+#define SYSTEMRESOURCES_H
+
+#include <QtGlobal>
+
+// CPU and memory this process may use. On Linux the cgroup limits of the
+// process (v2, or the v1 cpu and memory controllers) are honoured, so a
+// container with two CPUs and 4 GiB is not sized like the host it runs on.
+class SystemResources
+{
+public:
+    // CPUs available to the process: the scheduler affinity, capped by the
+    // cgroup CPU quota (rounded up); read on the first call
+    static int cpuCount();
+
+    // Memory that can still be allocated before the host or the cgroup
+    // runs out, in bytes. Windows and macOS report the host's available
+    // physical memory; elsewhere it is 0, which leaves the pool without a
+    // memory budget.
+    static qint64 availableMemory();
+};
+
+#endif // SYSTEMRESOURCES_H
@@ -0,0 +1,219 @@
+#include "zipreader.h"
+#include "zipwriter.h"
+#include <QtEndian>
+
+#ifdef DOCPDF_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+const quint32 EndOfDirectorySignature = 0x06054b50;
+const quint32 DirectoryEntrySignature = 0x02014b50;
+const quint32 LocalHeaderSignature = 0x04034b50;
+
+const qint64 EndOfDirectorySize = 22;
+const qint64 DirectoryEntrySize = 46;
+const qint64 LocalHeaderSize = 30;
+
+// Uncompressed size a part may declare in the central directory. Parts are
+// inflated into memory, and deflate packs repeated bytes a thousand to one,
+// so a small archive could otherwise claim gigabytes; document.xml of even
+// a very long DOCX is a few tens of megabytes.
+const quint32 MaximumEntrySize = 512 * 1024 * 1024;
+
+quint16 le16(const uchar *data)
+{
+    return qFromLittleEndian<quint16>(data);
+}
+
+quint32 le32(const uchar *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+} // namespace
+
+ZipReader::ZipReader(const QString &fileName)
+    : m_file(fileName)
+    , m_data(nullptr)
+    , m_size(0)
+    , m_open(false)
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        fail(m_file.errorString());
+        return;
+    }
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        fail("Cannot map " + fileName);
+        return;
+    }
+    m_open = readDirectory();
+}
+
+ZipReader::ZipReader(const QByteArray &data)
+    : m_buffer(data)
+    , m_data(reinterpret_cast<const uchar *>(m_buffer.constData()))
+    , m_size(m_buffer.size())
+    , m_open(false)
+{
+    m_open = readDirectory();
+}
+
+ZipReader::~ZipReader()
+{
+    if (m_data && m_file.isOpen()) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+}
+
+bool ZipReader::isOpen() const
+{
+    return m_open;
+}
+
+QString ZipReader::errorString() const
+{
+    return m_errorString;
+}
+
+bool ZipReader::contains(const QString &name) const
+{
+    return m_entries.contains(name);
+}
+
+QByteArray ZipReader::read(const QString &name, bool *ok) const
+{
+    if (ok) {
+        *ok = false;
+    }
+
+    auto it = m_entries.constFind(name);
+    if (!m_open || it == m_entries.constEnd()) {
+        m_errorString = "No ZIP entry " + name;
+        return QByteArray();
+    }
+    const Entry &entry = it.value();
+    if (entry.flags & 0x0001) {
+        m_errorString = "Encrypted ZIP entry " + name;
+        return QByteArray();
+    }
+
+    qint64 header = entry.localHeaderOffset;
+    if (header + LocalHeaderSize > m_size || le32(m_data + header) != LocalHeaderSignature) {
+        m_errorString = "Damaged ZIP entry " + name;
+        return QByteArray();
+    }
+    qint64 dataOffset = header + LocalHeaderSize + le16(m_data + header + 26) + le16(m_data + header + 28);
+    if (dataOffset + entry.compressedSize > m_size) {
+        m_errorString = "Truncated ZIP entry " + name;
+        return QByteArray();
+    }
+    const char *compressed = reinterpret_cast<const char *>(m_data + dataOffset);
+
+    QByteArray data;
+    if (entry.method == ZipWriter::Stored) {
+        data = QByteArray(compressed, entry.compressedSize);
+    } else if (entry.method == ZipWriter::Deflated) {
+#ifdef DOCPDF_HAVE_ZLIB
+        data.resize(entry.uncompressedSize);
+        z_stream stream = {};
+        // Negative window bits: raw deflate without a zlib header
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+            m_errorString = "Cannot initialize zlib";
+            return QByteArray();
+        }
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed));
+        stream.avail_in = uInt(entry.compressedSize);
+        stream.next_out = reinterpret_cast<Bytef *>(data.data());
+        stream.avail_out = uInt(data.size());
+        int status = inflate(&stream, Z_FINISH);
+        bool complete = status == Z_STREAM_END && stream.total_out == entry.uncompressedSize;
+        inflateEnd(&stream);
+        if (!complete) {
+            m_errorString = "Cannot inflate ZIP entry " + name;
+            return QByteArray();
+        }
+#else
+        m_errorString = "Deflated ZIP entries need zlib";
+        return QByteArray();
+#endif
+    } else {
+        m_errorString = QString("Unsupported compression method %1").arg(entry.method);
+        return QByteArray();
+    }
+
+    if (quint32(data.size()) != entry.uncompressedSize
+        || ZipWriter::crc32(0, data.constData(), data.size()) != entry.crc) {
+        m_errorString = "CRC mismatch in ZIP entry " + name;
+        return QByteArray();
+    }
+
+    if (ok) {
+        *ok = true;
+    }
+    return data;
+}
+
+bool ZipReader::readDirectory()
+{
+    // The end record sits behind an optional comment of up to 64 KiB
+    qint64 end = -1;
+    qint64 lowest = qMax<qint64>(0, m_size - EndOfDirectorySize - 0xFFFF);
+    for (qint64 i = m_size - EndOfDirectorySize; i >= lowest; --i) {
+        if (le32(m_data + i) == EndOfDirectorySignature) {
+            end = i;
+            break;
+        }
+    }
+    if (end < 0) {
+        return fail("Not a ZIP file");
+    }
+
+    quint16 count = le16(m_data + end + 10);
+    quint32 directorySize = le32(m_data + end + 12);
+    quint32 directoryOffset = le32(m_data + end + 16);
+    if (le16(m_data + end + 4) != 0 || count == 0xFFFF || directoryOffset == 0xFFFFFFFF) {
+        return fail("Multi-disk and ZIP64 archives are not supported");
+    }
+    if (qint64(directoryOffset) + directorySize > end) {
+        return fail("Damaged ZIP central directory");
+    }
+
+    qint64 position = directoryOffset;
+    for (int i = 0; i < count; ++i) {
+        if (position + DirectoryEntrySize > end || le32(m_data + position) != DirectoryEntrySignature) {
+            return fail("Damaged ZIP central directory");
+        }
+        const uchar *record = m_data + position;
+        quint16 nameLength = le16(record + 28);
+        qint64 next = position + DirectoryEntrySize + nameLength + le16(record + 30) + le16(record + 32);
+        if (next > end) {
+            return fail("Damaged ZIP central directory");
+        }
+
+        Entry entry;
+        entry.flags = le16(record + 8);
+        entry.method = le16(record + 10);
+        entry.crc = le32(record + 16);
+        entry.compressedSize = le32(record + 20);
+        entry.uncompressedSize = le32(record + 24);
+        entry.localHeaderOffset = le32(record + 42);
+        if (entry.uncompressedSize > MaximumEntrySize) {
+            return fail("ZIP entry too large");
+        }
+
+        QString name = QString::fromUtf8(reinterpret_cast<const char *>(record + DirectoryEntrySize), nameLength);
+        m_entries.insert(name, entry);
+        position = next;
+    }
+    return true;
+}
+
+bool ZipReader::fail(const QString &message)
+{
+    m_errorString = message;
+    return false;
+}
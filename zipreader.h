@@ -0,0 +1,54 @@
+#ifndef ZIPREADER_H
+#define ZIPREADER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+// Minimal ZIP reader for OPC packages such as DOCX.
+//
+// The file is memory-mapped and the central directory is indexed on open;
+// entries are read whole. Stored entries are always supported, deflated
+// ones only with zlib. ZIP64, encryption and multi-disk archives are
+// rejected, which for DOCX only happens with unusual producers.
+class ZipReader
+{
+public:
+    explicit ZipReader(const QString &fileName);
+    // Reads an archive already in memory, without copying it
+    explicit ZipReader(const QByteArray &data);
+    ~ZipReader();
+
+    bool isOpen() const;
+    QString errorString() const;
+
+    bool contains(const QString &name) const;
+
+    // Returns the uncompressed entry; sets *ok to false (and returns an
+    // empty array) if it is missing, unsupported or fails its CRC check
+    QByteArray read(const QString &name, bool *ok = nullptr) const;
+
+private:
+    struct Entry {
+        quint16 method = 0;
+        quint16 flags = 0;
+        quint32 crc = 0;
+        quint32 compressedSize = 0;
+        quint32 uncompressedSize = 0;
+        quint32 localHeaderOffset = 0;
+    };
+
+    bool readDirectory();
+    bool fail(const QString &message);
+
+    QFile m_file;
+    QByteArray m_buffer;        // keeps in-memory data alive
+    const uchar *m_data;
+    qint64 m_size;
+    QHash<QString, Entry> m_entries;
+    bool m_open;
+    mutable QString m_errorString;
+};
+
+#endif // ZIPREADER_H
@@ -0,0 +1,428 @@
+#include "zipwriter.h"
+#include "conversionmetrics.h"
+#include <QDateTime>
+#include <QThread>
+#include <QThreadPool>
+#include <QtEndian>
+
+#ifdef DOCPDF_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+const int DictionarySize = 32768;
+
+void appendLe16(QByteArray &out, quint16 value)
+{
+    char bytes[2];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 2);
+}
+
+void appendLe32(QByteArray &out, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 4);
+}
+
+#ifndef DOCPDF_HAVE_ZLIB
+const quint32 *crcTable()
+{
+    static quint32 table[256];
+    static bool initialized = [] {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    Q_UNUSED(initialized);
+    return table;
+}
+#endif
+
+} // namespace
+
+ZipWriter::ZipWriter(const QString &fileName)
+    : m_file(fileName)
+    , m_device(&m_file)
+    , m_inEntry(false)
+    , m_closed(false)
+    , m_failed(false)
+    , m_method(Deflated)
+    , m_level(6)
+    , m_threadCount(QThread::idealThreadCount())
+    , m_chunkSize(128 * 1024)
+{
+#ifndef DOCPDF_HAVE_ZLIB
+    m_method = Stored;
+#endif
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        fail(m_file.errorString());
+    }
+}
+
+ZipWriter::ZipWriter(QIODevice *device)
+    : m_device(device)
+    , m_inEntry(false)
+    , m_closed(false)
+    , m_failed(false)
+    , m_method(Deflated)
+    , m_level(6)
+    , m_threadCount(QThread::idealThreadCount())
+    , m_chunkSize(128 * 1024)
+{
+#ifndef DOCPDF_HAVE_ZLIB
+    m_method = Stored;
+#endif
+    if (!m_device->isWritable()) {
+        fail("Device is not open for writing");
+    }
+}
+
+ZipWriter::~ZipWriter()
+{
+    if (!m_closed) {
+        close();
+    }
+}
+
+bool ZipWriter::isOpen() const
+{
+    return !m_closed && !m_failed;
+}
+
+QString ZipWriter::errorString() const
+{
+    return m_errorString;
+}
+
+void ZipWriter::setCompression(CompressionMethod method)
+{
+#ifdef DOCPDF_HAVE_ZLIB
+    m_method = method;
+#else
+    Q_UNUSED(method);
+#endif
+}
+
+void ZipWriter::setCompressionLevel(int level)
+{
+    m_level = qBound(0, level, 9);
+}
+
+void ZipWriter::setThreadCount(int threadCount)
+{
+    m_threadCount = qMax(1, threadCount);
+}
+
+bool ZipWriter::beginEntry(const QString &name)
+{
+    if (m_failed || m_inEntry) {
+        return fail("Cannot begin a ZIP entry while another one is open");
+    }
+
+    QDateTime now = QDateTime::currentDateTime();
+    QDate date = now.date();
+    QTime time = now.time();
+
+    m_current = Entry();
+    m_current.name = name.toUtf8();
+    m_current.method = m_method;
+    m_current.dosTime = quint16((time.hour() << 11) | (time.minute() << 5) | (time.second() / 2));
+    m_current.dosDate = quint16(((qMax(date.year(), 1980) - 1980) << 9) | (date.month() << 5) | date.day());
+    m_current.offset = quint64(m_device->pos());
+    m_pending.clear();
+    m_dictionary.clear();
+
+    // Sizes and CRC are patched in endEntry(), the file is seekable
+    QByteArray header;
+    appendLe32(header, 0x04034b50);
+    appendLe16(header, 20);         // version needed
+    appendLe16(header, 0x0800);     // UTF-8 names
+    appendLe16(header, m_current.method);
+    appendLe16(header, m_current.dosTime);
+    appendLe16(header, m_current.dosDate);
+    appendLe32(header, 0);          // crc
+    appendLe32(header, 0);          // compressed size
+    appendLe32(header, 0);          // uncompressed size
+    appendLe16(header, quint16(m_current.name.size()));
+    appendLe16(header, 0);          // extra length
+    header.append(m_current.name);
+
+    m_inEntry = true;
+    return writeRaw(header);
+}
+
+bool ZipWriter::write(const char *data, qint64 size)
+{
+    if (m_failed || !m_inEntry) {
+        return fail("No ZIP entry is open");
+    }
+
+    ConversionMetrics::StageTimer timer(ConversionMetrics::Compression);
+
+    m_current.crc = crc32(m_current.crc, data, size);
+    m_current.uncompressedSize += quint64(size);
+
+    if (m_current.method == Stored) {
+        m_current.compressedSize += quint64(size);
+        return writeRaw(QByteArray::fromRawData(data, qsizetype(size)));
+    }
+
+    m_pending.append(data, size);
+    if (m_pending.size() >= qint64(m_chunkSize) * m_threadCount) {
+        return deflatePending(false);
+    }
+    return true;
+}
+
+bool ZipWriter::write(const QByteArray &data)
+{
+    return write(data.constData(), data.size());
+}
+
+bool ZipWriter::endEntry()
+{
+    if (m_failed || !m_inEntry) {
+        return fail("No ZIP entry is open");
+    }
+
+    if (m_current.method == Deflated) {
+        ConversionMetrics::StageTimer timer(ConversionMetrics::Compression);
+        if (!deflatePending(true)) {
+            return false;
+        }
+    }
+    m_inEntry = false;
+
+    if (m_current.compressedSize > 0xFFFFFFFFull || m_current.uncompressedSize > 0xFFFFFFFFull
+        || m_current.offset > 0xFFFFFFFFull) {
+        return fail("ZIP entry exceeds 4 GiB (ZIP64 is not supported)");
+    }
+
+    QByteArray sizes;
+    appendLe32(sizes, m_current.crc);
+    appendLe32(sizes, quint32(m_current.compressedSize));
+    appendLe32(sizes, quint32(m_current.uncompressedSize));
+
+    qint64 end = m_device->pos();
+    if (!m_device->seek(qint64(m_current.offset) + 14) || !writeRaw(sizes) || !m_device->seek(end)) {
+        return fail(m_device->errorString());
+    }
+
+    m_entries << m_current;
+    return true;
+}
+
+bool ZipWriter::addEntry(const QString &name, const QByteArray &data)
+{
+    return beginEntry(name) && write(data) && endEntry();
+}
+
+bool ZipWriter::close()
+{
+    if (m_closed) {
+        return !m_failed;
+    }
+    m_closed = true;
+
+    if (m_inEntry) {
+        endEntry();
+    }
+
+    if (!m_failed) {
+        quint64 directoryOffset = quint64(m_device->pos());
+        QByteArray directory;
+
+        for (const Entry &entry : m_entries) {
+            appendLe32(directory, 0x02014b50);
+            appendLe16(directory, 20);      // version made by
+            appendLe16(directory, 20);      // version needed
+            appendLe16(directory, 0x0800);
+            appendLe16(directory, entry.method);
+            appendLe16(directory, entry.dosTime);
+            appendLe16(directory, entry.dosDate);
+            appendLe32(directory, entry.crc);
+            appendLe32(directory, quint32(entry.compressedSize));
+            appendLe32(directory, quint32(entry.uncompressedSize));
+            appendLe16(directory, quint16(entry.name.size()));
+            appendLe16(directory, 0);       // extra length
+            appendLe16(directory, 0);       // comment length
+            appendLe16(directory, 0);       // disk number
+            appendLe16(directory, 0);       // internal attributes
+            appendLe32(directory, 0);       // external attributes
+            appendLe32(directory, quint32(entry.offset));
+            directory.append(entry.name);
+        }
+
+        quint32 directorySize = quint32(directory.size());
+        appendLe32(directory, 0x06054b50);
+        appendLe16(directory, 0);
+        appendLe16(directory, 0);
+        appendLe16(directory, quint16(m_entries.size()));
+        appendLe16(directory, quint16(m_entries.size()));
+        appendLe32(directory, directorySize);
+        appendLe32(directory, quint32(directoryOffset));
+        appendLe16(directory, 0);           // comment length
+
+        writeRaw(directory);
+    }
+
+    // Flushes QFile's buffer; a caller's device stays open
+    if (m_device == &m_file) {
+        ConversionMetrics::StageTimer timer(ConversionMetrics::DiskWrite);
+        m_file.close();
+    }
+    return !m_failed;
+}
+
+quint32 ZipWriter::crc32(quint32 crc, const char *data, qint64 size)
+{
+#ifdef DOCPDF_HAVE_ZLIB
+    const Bytef *bytes = reinterpret_cast<const Bytef *>(data);
+    while (size > 0) {
+        uInt block = uInt(qMin<qint64>(size, 1 << 30));
+        crc = quint32(::crc32(crc, bytes, block));
+        bytes += block;
+        size -= block;
+    }
+    return crc;
+#else
+    const quint32 *table = crcTable();
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    crc = ~crc;
+    for (qint64 i = 0; i < size; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+#endif
+}
+
+bool ZipWriter::deflatePending(bool finish)
+{
+#ifdef DOCPDF_HAVE_ZLIB
+    const qint64 pendingSize = m_pending.size();
+    int pieceCount = 0;
+    qint64 consumed = 0;
+
+    if (finish) {
+        pieceCount = qMax<qint64>(1, (pendingSize + m_chunkSize - 1) / m_chunkSize);
+        consumed = pendingSize;
+    } else {
+        pieceCount = int(pendingSize / m_chunkSize);
+        consumed = qint64(pieceCount) * m_chunkSize;
+    }
+
+    if (pieceCount == 0) {
+        return true;
+    }
+
+    QList<QByteArray> outputs(pieceCount);
+    QList<bool> results(pieceCount, false);
+    QByteArray *outputData = outputs.data();
+    bool *resultData = results.data();
+    const char *input = m_pending.constData();
+
+    // Each piece is an independent raw deflate stream ending on a byte
+    // boundary (sync flush), so the pieces concatenate into one stream
+    auto compressPiece = [&](int index) {
+        qint64 start = qint64(index) * m_chunkSize;
+        qint64 length = qMin<qint64>(m_chunkSize, consumed - start);
+        bool last = finish && index == pieceCount - 1;
+
+        z_stream stream = {};
+        if (deflateInit2(&stream, m_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return;
+        }
+
+        if (index == 0) {
+            if (!m_dictionary.isEmpty()) {
+                deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(m_dictionary.constData()),
+                                     uInt(m_dictionary.size()));
+            }
+        } else {
+            qint64 dictionaryStart = qMax<qint64>(0, start - DictionarySize);
+            deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(input + dictionaryStart),
+                                 uInt(start - dictionaryStart));
+        }
+
+        QByteArray &output = outputData[index];
+        output.resize(qsizetype(deflateBound(&stream, uLong(length)) + 16));
+
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input + start));
+        stream.avail_in = uInt(length);
+        stream.next_out = reinterpret_cast<Bytef *>(output.data());
+        stream.avail_out = uInt(output.size());
+
+        int status = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        bool ok = (last ? status == Z_STREAM_END : status == Z_OK) && stream.avail_in == 0;
+
+        output.resize(qsizetype(stream.total_out));
+        deflateEnd(&stream);
+        resultData[index] = ok;
+    };
+
+    if (pieceCount > 1 && m_threadCount > 1) {
+        QThreadPool threadPool;
+        threadPool.setMaxThreadCount(qMin(pieceCount, m_threadCount));
+        for (int i = 0; i < pieceCount; ++i) {
+            threadPool.start([&compressPiece, i]() { compressPiece(i); });
+        }
+        threadPool.waitForDone();
+    } else {
+        for (int i = 0; i < pieceCount; ++i) {
+            compressPiece(i);
+        }
+    }
+
+    for (int i = 0; i < pieceCount; ++i) {
+        if (!results[i]) {
+            return fail("Deflate failed");
+        }
+        m_current.compressedSize += quint64(outputs[i].size());
+        if (!writeRaw(outputs[i])) {
+            return false;
+        }
+    }
+
+    // Keep the last 32 KiB of input to prime the next piece
+    qint64 keep = qMin<qint64>(consumed, DictionarySize);
+    m_dictionary.append(m_pending.constData() + consumed - keep, keep);
+    if (m_dictionary.size() > DictionarySize) {
+        m_dictionary.remove(0, m_dictionary.size() - DictionarySize);
+    }
+    m_pending.remove(0, consumed);
+    return true;
+#else
+    Q_UNUSED(finish);
+    return fail("Deflate is not available in this build");
+#endif
+}
+
+bool ZipWriter::writeRaw(const QByteArray &data)
+{
+    if (m_failed) {
+        return false;
+    }
+
+    ConversionMetrics::StageTimer timer(ConversionMetrics::DiskWrite);
+    if (m_device->write(data) != data.size()) {
+        return fail(m_device->errorString());
+    }
+    return true;
+}
+
+bool ZipWriter::fail(const QString &message)
+{
+    if (!m_failed) {
+        m_failed = true;
+        m_errorString = message;
+    }
+    return false;
+}
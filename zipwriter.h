@@ -0,0 +1,85 @@
+#ifndef ZIPWRITER_H
+#define ZIPWRITER_H
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+
+// Minimal streaming ZIP writer for OPC packages such as DOCX.
+//
+// Entries are written straight to the output file, or to a caller's device
+// such as a QBuffer. Deflated entries are compressed in independent chunks
+// (each primed with the previous 32 KiB as dictionary), so large parts are
+// deflated on all cores while memory stays bounded by chunkSize *
+// threadCount. Without zlib every entry is stored uncompressed.
+class ZipWriter
+{
+public:
+    enum CompressionMethod {
+        Stored = 0,
+        Deflated = 8
+    };
+
+    explicit ZipWriter(const QString &fileName);
+    // Writes to a seekable device the caller opened at position 0; close()
+    // leaves it open
+    explicit ZipWriter(QIODevice *device);
+    ~ZipWriter();
+
+    bool isOpen() const;
+    QString errorString() const;
+
+    void setCompression(CompressionMethod method);
+    void setCompressionLevel(int level);
+    // Threads deflating chunks of one entry; defaults to the core count,
+    // callers already running on a busy pool pass 1
+    void setThreadCount(int threadCount);
+
+    bool beginEntry(const QString &name);
+    bool write(const char *data, qint64 size);
+    bool write(const QByteArray &data);
+    bool endEntry();
+
+    bool addEntry(const QString &name, const QByteArray &data);
+
+    // Writes the central directory and closes the file
+    bool close();
+
+    static quint32 crc32(quint32 crc, const char *data, qint64 size);
+
+private:
+    struct Entry {
+        QByteArray name;
+        quint16 method = Stored;
+        quint16 dosTime = 0;
+        quint16 dosDate = 0;
+        quint32 crc = 0;
+        quint64 compressedSize = 0;
+        quint64 uncompressedSize = 0;
+        quint64 offset = 0;
+    };
+
+    bool deflatePending(bool finish);
+    bool writeRaw(const QByteArray &data);
+    bool fail(const QString &message);
+
+    QFile m_file;
+    QIODevice *m_device;    // m_file unless the caller passed a device
+    QList<Entry> m_entries;
+    Entry m_current;
+    bool m_inEntry;
+    bool m_closed;
+    bool m_failed;
+    QString m_errorString;
+
+    CompressionMethod m_method;
+    int m_level;
+    int m_threadCount;
+    int m_chunkSize;
+
+    QByteArray m_pending;
+    QByteArray m_dictionary;
+};
+
+#endif // ZIPWRITER_H